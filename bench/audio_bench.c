@@ -0,0 +1,605 @@
+/**
+ * @file audio_bench.c
+ * @brief Offline audio renderer and benchmark, renders the synth faster than realtime on the host
+ *
+ * Plays sustained synth voices, a midi file and scripted sample triggers for a number of seconds,
+ * then reports the realtime factor, peak voices, the time spent in each stage of the audio
+ * callback and a hash of the output. The output can be written to a wav file to listen to it.
+ *
+ * usage: audio_bench [-s seconds] [-v voices] [-f] [-r] [-p] [-l] [-m file.mid] [-d] [-e script] [-o file.wav] [-x hash] [-t]
+ *   -s  seconds to render, 10 by default
+ *   -v  sustained wavetable voices, spread over as many oscillators as needed
+ *   -f  adds a swept lowpass to every voice oscillator and a high shelf to the music bus
+ *   -r  adds a room reverb to the music bus and an echo to the sample triggers on the sfx bus
+ *   -p  voices play a two operator FM patch instead of the saw wavetable, midi programs pick
+ *       patches from the general midi FM bank
+ *   -l  limiter check, plays a decaying bass chord far over full scale and exits with 1 if a
+ *       sample gets through the limiter over full scale
+ *   -m  midi file to play on the music bus, every drum note plays the trigger sample
+ *   -d  drum notes play the synthesized general midi kit instead of the trigger sample
+ *   -e  sample trigger script, one "<seconds> <amplitude 0 to 1> <speed>" per line, # comments
+ *   -o  wav file to write the output to
+ *   -x  expected output hash, exits with 1 if the output differs
+ *   -t  also times each filter type on its own for as many samples as are rendered, in ns per
+ *       sample of a mono block and ns per frame of a stereo bus block in stereo builds
+ *
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "audio.h"
+#include "audio_delay.h"
+#include "audio_filter.h"
+#include "audio_fm.h"
+#include "pal.h"
+#include "wavetable.h"
+
+#ifndef AUDIO_ENABLE_PROFILING
+#error "The audio benchmark needs AUDIO_ENABLE_PROFILING!"
+#endif
+
+// frames rendered per audio_render_offline call, like the buffer of an audio callback
+#define RENDER_CHUNK_SIZE (256)
+#define MAX_VOICE_OSCILLATORS (16)
+#define MAX_VOICES (MAX_VOICE_OSCILLATORS * OSC_MAX_VOICES)
+#define MAX_TRIGGERS (4096)
+#define TRIGGER_SAMPLE_LENGTH (PAL_AUDIO_SAMPLE_RATE / 5)
+// lowpass of the -f option sweeps between these frequencies
+#define SWEEP_MIN_FREQUENCY (300.0)
+#define SWEEP_MAX_FREQUENCY (4000.0)
+#define SWEEP_RATE (0.25)
+// the -l option plays this many full scale voices in phase
+#define OVERLOAD_VOICES (4)
+// filters of the -t option are designed with these parameters
+#define TIMING_FREQUENCY (1000.0)
+#define TIMING_Q (0.707)
+#define TIMING_GAIN_DB (6.0)
+
+struct trigger {
+    uint64_t sample_num;
+    pal_float_t time;       // game time, offline it's the time rendered
+    uint16_t amplitude;
+    pal_float_t speed;
+};
+
+// sustained voices of the -p option, a bright stack with some feedback
+static const struct fm_patch voice_fm_patch = {
+    FM_ALGORITHM_STACK, 2, {
+        { FM_RATIO(2), 5, 300, 50, 160, 90, 3 },
+        { FM_RATIO(1), 5, 300, 50, 180, 255, 0 }
+    }
+};
+
+static const char *stage_names[AUDIO_PROFILE_NUM_STAGES] = {
+    [AUDIO_PROFILE_EVENTS] = "events",
+    [AUDIO_PROFILE_SAMPLERS] = "samplers",
+    [AUDIO_PROFILE_OSCILLATORS] = "oscillators",
+    [AUDIO_PROFILE_MIX] = "mix",
+    [AUDIO_PROFILE_OUTPUT] = "output",
+};
+
+static const char *filter_type_names[] = {
+    [AUDIO_FILTER_LOWPASS] = "lowpass",
+    [AUDIO_FILTER_HIGHPASS] = "highpass",
+    [AUDIO_FILTER_BANDPASS] = "bandpass",
+    [AUDIO_FILTER_NOTCH] = "notch",
+    [AUDIO_FILTER_LOW_SHELF] = "low shelf",
+    [AUDIO_FILTER_HIGH_SHELF] = "high shelf",
+    [AUDIO_FILTER_ONE_POLE] = "one pole",
+    [AUDIO_FILTER_DC_BLOCKER] = "dc blocker",
+};
+
+static struct oscillator voice_oscillators[MAX_VOICE_OSCILLATORS];
+static struct audio_filter voice_filters[MAX_VOICE_OSCILLATORS];
+static struct audio_filter music_shelf;
+static struct audio_filter timing_filter;
+static int32_t timing_blocks[PAL_AUDIO_CHANNELS][RENDER_CHUNK_SIZE];
+static struct oscillator overload_oscillator;
+static struct audio_reverb music_reverb;
+static struct audio_delay sfx_echo;
+static struct midi_player player;
+static int16_t trigger_sample_data[TRIGGER_SAMPLE_LENGTH];
+static struct trigger triggers[MAX_TRIGGERS];
+static int num_triggers = 0;
+
+static uint64_t time_ns() {
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return (uint64_t) time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+// used if the wavetable pool is full
+static int32_t saw_wave(uint32_t t) {
+    return (int32_t) ((int64_t) t * 2 * OSC_AMPLITUDE / OSC_PERIOD) - OSC_AMPLITUDE;
+}
+
+/**
+ * @brief Fills the trigger sample with a decaying noise burst, the same on every run
+ *
+ */
+static void make_trigger_sample() {
+    uint32_t noise = 12345;
+
+    for (int i = 0; i < TRIGGER_SAMPLE_LENGTH; i++) {
+        noise = noise * 1664525 + 1013904223;
+        // quadratic decay to silence over the sample
+        int32_t envelope = (int32_t) (((int64_t) (TRIGGER_SAMPLE_LENGTH - i) * (TRIGGER_SAMPLE_LENGTH - i) * INT16_MAX)
+            / ((int64_t) TRIGGER_SAMPLE_LENGTH * TRIGGER_SAMPLE_LENGTH));
+
+        trigger_sample_data[i] = (int16_t) (((int32_t) (noise >> 16) - 32768) * envelope / 32768);
+    }
+}
+
+/**
+ * @brief Reads the sample triggers of script, sorted by time
+ *
+ * @param path
+ * @return true if the script was read
+ * @return false if it couldn't be opened or has an invalid line
+ */
+static bool load_trigger_script(const char *path) {
+    FILE *file = fopen(path, "r");
+    char line[256];
+    int line_num = 0;
+
+    if (file == NULL) {
+        fprintf(stderr, "Can't open trigger script %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        double seconds, amplitude, speed;
+        char first;
+
+        line_num++;
+
+        if (sscanf(line, " %c", &first) != 1 || first == '#')
+            continue;
+
+        if (sscanf(line, "%lf %lf %lf", &seconds, &amplitude, &speed) != 3 || seconds < 0 || amplitude < 0 || amplitude > 1 || speed <= 0) {
+            fprintf(stderr, "%s:%d: expected \"<seconds> <amplitude 0 to 1> <speed>\"\n", path, line_num);
+            fclose(file);
+            return false;
+        }
+
+        if (num_triggers == MAX_TRIGGERS) {
+            fprintf(stderr, "%s: more than %d triggers\n", path, MAX_TRIGGERS);
+            fclose(file);
+            return false;
+        }
+
+        // insertion sort, scripts are short and mostly in order
+        int i = num_triggers++;
+
+        for (; i > 0 && triggers[i - 1].sample_num > (uint64_t) llround(seconds * PAL_AUDIO_SAMPLE_RATE); i--)
+            triggers[i] = triggers[i - 1];
+
+        triggers[i] = (struct trigger) {
+            .sample_num = llround(seconds * PAL_AUDIO_SAMPLE_RATE),
+            .time = PAL_FLOAT(seconds),
+            .amplitude = (uint16_t) lround(amplitude * OSC_AMPLITUDE),
+            .speed = PAL_FLOAT(speed)
+        };
+    }
+
+    fclose(file);
+
+    return true;
+}
+
+/**
+ * @brief Reads whole midi file, the player reads it while playing so it's never freed
+ *
+ * @param path
+ * @return uint8_t* NULL if it couldn't be read
+ */
+static uint8_t *load_midi_file(const char *path) {
+    FILE *file = fopen(path, "rb");
+    uint8_t *data = NULL;
+    long length;
+
+    if (file == NULL) {
+        fprintf(stderr, "Can't open midi file %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+
+    if (fseek(file, 0, SEEK_END) == 0 && (length = ftell(file)) > 0 && fseek(file, 0, SEEK_SET) == 0) {
+        data = malloc(length);
+
+        if (data != NULL && fread(data, 1, length, file) != (size_t) length) {
+            free(data);
+            data = NULL;
+        }
+    }
+
+    if (data == NULL)
+        fprintf(stderr, "Can't read midi file %s\n", path);
+
+    fclose(file);
+
+    return data;
+}
+
+static void write_u32(FILE *file, uint32_t value) {
+    uint8_t bytes[4] = { value, value >> 8, value >> 16, value >> 24 };
+
+    fwrite(bytes, 1, sizeof(bytes), file);
+}
+
+static void write_u16(FILE *file, uint16_t value) {
+    uint8_t bytes[2] = { value, value >> 8 };
+
+    fwrite(bytes, 1, sizeof(bytes), file);
+}
+
+/**
+ * @brief Writes the header of a 16 bit wav file with PAL_AUDIO_CHANNELS channels
+ *
+ * @param file
+ * @param num_frames
+ */
+static void write_wav_header(FILE *file, uint32_t num_frames) {
+    const uint32_t frame_bytes = 2 * PAL_AUDIO_CHANNELS;
+
+    fwrite("RIFF", 1, 4, file);
+    write_u32(file, 36 + num_frames * frame_bytes);
+    fwrite("WAVEfmt ", 1, 8, file);
+    write_u32(file, 16);                                    // fmt chunk size
+    write_u16(file, 1);                                     // pcm
+    write_u16(file, PAL_AUDIO_CHANNELS);
+    write_u32(file, PAL_AUDIO_SAMPLE_RATE);
+    write_u32(file, PAL_AUDIO_SAMPLE_RATE * frame_bytes);   // bytes per second
+    write_u16(file, frame_bytes);
+    write_u16(file, 16);                                    // bits per sample
+    fwrite("data", 1, 4, file);
+    write_u32(file, num_frames * frame_bytes);
+}
+
+/**
+ * @brief Converts output sample to signed 16 bit for the wav file
+ *
+ * @param sample
+ * @return int16_t
+ */
+static int16_t sample_to_s16(audio_sample_t sample) {
+#if defined PAL_AUDIO_FORMAT_F32
+    return lrintf(sample * INT16_MAX);
+#else
+    return sample - AUDIO_SAMPLE_SILENCE;
+#endif
+}
+
+/**
+ * @brief Starts num_voices sustained voices, a chord spread over the wavetable oscillators
+ *
+ * @param num_voices
+ * @param filters
+ */
+static void start_voices(int num_voices, bool filters, bool fm) {
+    const struct wavetable *saw = wavetable_get_builtin(WAVETABLE_SAW);
+
+    for (int i = 0; i < num_voices; i++) {
+        struct oscillator *osc = &voice_oscillators[i / OSC_MAX_VOICES];
+
+        if (i % OSC_MAX_VOICES == 0) {
+            oscillator_init(osc, 5, 50, OSC_AMPLITUDE * 0.7, 50, &saw_wave);
+            oscillator_set_wavetable(osc, saw);
+            oscillator_set_bus(osc, AUDIO_BUS_MUSIC);
+
+            if (fm)
+                oscillator_set_fm_patch(osc, &voice_fm_patch);
+
+            if (filters) {
+                audio_filter_init(&voice_filters[i / OSC_MAX_VOICES], AUDIO_FILTER_LOWPASS, PAL_FLOAT(SWEEP_MAX_FREQUENCY), PAL_FLOAT(2.0), 0);
+                oscillator_add_filter(osc, &voice_filters[i / OSC_MAX_VOICES].node);
+            }
+        }
+
+        // fifths and octaves from A1 up, wrapping every 4 octaves
+        double frequency = 55.0 * pow(2.0, ((i * 7) % 48) / 12.0);
+
+        oscillator_play_voice(osc, OSC_AMPLITUDE / 8, PAL_FLOAT(frequency));
+    }
+
+    if (filters) {
+        audio_filter_init(&music_shelf, AUDIO_FILTER_HIGH_SHELF, PAL_FLOAT(6000.0), PAL_FLOAT(0.707), PAL_FLOAT(-6.0));
+        audio_bus_add_filter(AUDIO_BUS_MUSIC, &music_shelf.node);
+    }
+}
+
+/**
+ * @brief Starts OVERLOAD_VOICES full scale sine voices in phase on a low note, decaying slowly so
+ * the limiter has to keep raising its gain over many samples
+ *
+ */
+static void start_overload() {
+    oscillator_init(&overload_oscillator, 5, 2000, 0, 50, &saw_wave);
+    oscillator_set_wavetable(&overload_oscillator, wavetable_get_builtin(WAVETABLE_SINE));
+
+    for (int i = 0; i < OVERLOAD_VOICES; i++)
+        oscillator_play_voice(&overload_oscillator, OSC_AMPLITUDE, PAL_FLOAT(41.2));
+}
+
+/**
+ * @brief Moves the voice lowpass filters along their sweep, called once per render chunk
+ *
+ * @param num_voices
+ * @param sample_num
+ */
+static void sweep_filters(int num_voices, uint64_t sample_num) {
+    double phase = 2 * M_PI * SWEEP_RATE * sample_num / PAL_AUDIO_SAMPLE_RATE;
+    double frequency = SWEEP_MIN_FREQUENCY + (SWEEP_MAX_FREQUENCY - SWEEP_MIN_FREQUENCY) * (0.5 - 0.5 * cos(phase));
+
+    for (int i = 0; i < (num_voices + OSC_MAX_VOICES - 1) / OSC_MAX_VOICES; i++)
+        audio_filter_set(&voice_filters[i], PAL_FLOAT(frequency), PAL_FLOAT(2.0), 0);
+}
+
+/**
+ * @brief Posts the sample triggers that start before end_sample_num, timed to their exact sample
+ * by their game time
+ *
+ * @param sample
+ * @param next_trigger index of the first trigger that hasn't been posted
+ * @param end_sample_num
+ * @return int index of the first trigger left
+ */
+static int post_triggers(wave_sample_t sample, int next_trigger, uint64_t end_sample_num) {
+    for (; next_trigger < num_triggers && triggers[next_trigger].sample_num < end_sample_num; next_trigger++)
+        wave_sample_play_at(sample, triggers[next_trigger].amplitude, triggers[next_trigger].speed, triggers[next_trigger].time);
+
+    return next_trigger;
+}
+
+/**
+ * @brief Runs blocks of noise through timing_filter until num_samples samples are filtered, a
+ * stereo bus block at a time when stereo is set
+ *
+ * @param num_samples
+ * @param stereo
+ * @return double ns per sample, or per frame of a stereo block
+ */
+static double time_filter(uint32_t num_samples, bool stereo) {
+    struct filter_node *node = &timing_filter.node;
+    uint32_t noise = 12345;
+    uint64_t start_ns, elapsed_ns = 0;
+
+#if PAL_AUDIO_CHANNELS == 1
+    // mono builds have no stereo bus blocks
+    (void) stereo;
+#endif
+
+    for (uint32_t sample_num = 0; sample_num < num_samples; sample_num += RENDER_CHUNK_SIZE) {
+        int block_size = num_samples - sample_num < RENDER_CHUNK_SIZE ? num_samples - sample_num : RENDER_CHUNK_SIZE;
+
+        // fresh input every block, in the range of mixed voices
+        for (int channel = 0; channel < PAL_AUDIO_CHANNELS; channel++) {
+            for (int i = 0; i < block_size; i++) {
+                noise = noise * 1664525 + 1013904223;
+                timing_blocks[channel][i] = (int32_t) (noise >> 16) - 32768;
+            }
+        }
+
+        start_ns = time_ns();
+
+#if PAL_AUDIO_CHANNELS == 2
+        if (stereo)
+            node->process_stereo_block(node, timing_blocks[0], timing_blocks[1], block_size);
+        else
+#endif
+            node->process_block(node, timing_blocks[0], block_size);
+
+        elapsed_ns += time_ns() - start_ns;
+    }
+
+    return (double) elapsed_ns / num_samples;
+}
+
+/**
+ * @brief Prints the time each filter type takes on its own
+ *
+ * @param num_samples
+ */
+static void print_filter_times(uint32_t num_samples) {
+    printf("filters, %u samples each\n", num_samples);
+
+    for (int type = AUDIO_FILTER_LOWPASS; type <= AUDIO_FILTER_DC_BLOCKER; type++) {
+        audio_filter_init(&timing_filter, type, PAL_FLOAT(TIMING_FREQUENCY), PAL_FLOAT(TIMING_Q), PAL_FLOAT(TIMING_GAIN_DB));
+        printf("  %-12s %8.2f ns/sample", filter_type_names[type], time_filter(num_samples, false));
+
+#if PAL_AUDIO_CHANNELS == 2
+        audio_filter_init(&timing_filter, type, PAL_FLOAT(TIMING_FREQUENCY), PAL_FLOAT(TIMING_Q), PAL_FLOAT(TIMING_GAIN_DB));
+        printf(" %8.2f ns/stereo frame", time_filter(num_samples, true));
+#endif
+
+        printf("\n");
+    }
+}
+
+/**
+ * @brief 64 bit FNV-1a hash of the bytes of the output, continued from hash
+ *
+ * @param hash
+ * @param samples
+ * @param num_samples
+ * @return uint64_t
+ */
+static uint64_t hash_samples(uint64_t hash, const audio_sample_t *samples, int num_samples) {
+    const uint8_t *bytes = (const uint8_t *) samples;
+
+    for (size_t i = 0; i < num_samples * sizeof(audio_sample_t); i++)
+        hash = (hash ^ bytes[i]) * 0x100000001B3;
+
+    return hash;
+}
+
+int main(int argc, char **argv) {
+    double seconds = 10;
+    int num_voices = 0;
+    bool filters = false;
+    bool effects = false;
+    bool limiter_check = false;
+    bool fm = false;
+    bool synth_drums = false;
+    const char *midi_path = NULL;
+    const char *script_path = NULL;
+    const char *wav_path = NULL;
+    const char *expected_hash = NULL;
+    bool filter_timing = false;
+    int option;
+
+    while ((option = getopt(argc, argv, "s:v:frplm:de:o:x:t")) != -1) {
+        switch (option) {
+            case 's': seconds = atof(optarg); break;
+            case 'v': num_voices = atoi(optarg); break;
+            case 'f': filters = true; break;
+            case 'r': effects = true; break;
+            case 'p': fm = true; break;
+            case 'l': limiter_check = true; break;
+            case 'm': midi_path = optarg; break;
+            case 'd': synth_drums = true; break;
+            case 'e': script_path = optarg; break;
+            case 'o': wav_path = optarg; break;
+            case 'x': expected_hash = optarg; break;
+            case 't': filter_timing = true; break;
+            default:
+                fprintf(stderr, "usage: %s [-s seconds] [-v voices] [-f] [-r] [-p] [-l] [-m file.mid] [-d] [-e script] [-o file.wav] [-x hash] [-t]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    if (seconds <= 0 || num_voices < 0 || num_voices > MAX_VOICES) {
+        fprintf(stderr, "Render 0 to %d voices for more than 0 seconds\n", MAX_VOICES);
+        return 2;
+    }
+
+    if (script_path != NULL && !load_trigger_script(script_path))
+        return 2;
+
+    uint8_t *midi_data = NULL;
+
+    if (midi_path != NULL && (midi_data = load_midi_file(midi_path)) == NULL)
+        return 2;
+
+    // calls before audio_start_offline are applied right away
+    midi_player_init(&player);
+
+    make_trigger_sample();
+
+    struct wave_data trigger_wave = { .data = trigger_sample_data, .length = TRIGGER_SAMPLE_LENGTH };
+    wave_sample_t trigger_sample = wave_sample_register(&trigger_wave);
+
+    // a note's sample takes priority over the kit
+    if (!synth_drums) {
+        for (int note = 0; note < NUM_DRUM_NOTES; note++)
+            midi_player_assign_drum_sample_to_note(&player, trigger_sample, note);
+    }
+
+    if (fm)
+        midi_player_set_fm_bank(&player, &fm_bank_gm);
+
+    if (midi_data != NULL)
+        midi_player_load_midi(&player, midi_data);
+
+    start_voices(num_voices, filters, fm);
+
+    if (limiter_check)
+        start_overload();
+
+    if (effects) {
+        if (!audio_reverb_init(&music_reverb, PAL_FLOAT(0.8), PAL_FLOAT(0.5), PAL_FLOAT(0.5), PAL_FLOAT(0.3))
+            || !audio_delay_init(&sfx_echo, 250, PAL_FLOAT(0.4), PAL_FLOAT(0.3))) {
+            fprintf(stderr, "Effects don't fit in the delay pool\n");
+            return 2;
+        }
+
+        audio_bus_add_filter(AUDIO_BUS_MUSIC, &music_reverb.node);
+        audio_bus_add_filter(AUDIO_BUS_SFX, &sfx_echo.node);
+    }
+
+    FILE *wav_file = NULL;
+    uint32_t num_samples = (uint32_t) llround(seconds * PAL_AUDIO_SAMPLE_RATE);
+
+    if (wav_path != NULL) {
+        if ((wav_file = fopen(wav_path, "wb")) == NULL) {
+            fprintf(stderr, "Can't open %s: %s\n", wav_path, strerror(errno));
+            return 2;
+        }
+
+        write_wav_header(wav_file, num_samples);
+    }
+
+    audio_start_offline();
+    audio_reset_profile();
+
+    audio_sample_t samples[RENDER_CHUNK_SIZE * PAL_AUDIO_CHANNELS];
+    uint64_t hash = 0xCBF29CE484222325;
+    uint64_t render_ns = 0;
+    int next_trigger = 0;
+
+    for (uint32_t sample_num = 0; sample_num < num_samples; sample_num += RENDER_CHUNK_SIZE) {
+        int chunk_size = num_samples - sample_num < RENDER_CHUNK_SIZE ? num_samples - sample_num : RENDER_CHUNK_SIZE;
+
+        // game side work is part of the benchmark, it runs in the game loop on the device too
+        uint64_t start_ns = time_ns();
+
+        next_trigger = post_triggers(trigger_sample, next_trigger, sample_num + chunk_size);
+
+        if (filters)
+            sweep_filters(num_voices, sample_num);
+
+        audio_render_offline(samples, chunk_size);
+        render_ns += time_ns() - start_ns;
+
+        hash = hash_samples(hash, samples, chunk_size * PAL_AUDIO_CHANNELS);
+
+        if (wav_file != NULL) {
+            for (int i = 0; i < chunk_size * PAL_AUDIO_CHANNELS; i++)
+                write_u16(wav_file, (uint16_t) sample_to_s16(samples[i]));
+        }
+    }
+
+    if (wav_file != NULL)
+        fclose(wav_file);
+
+    struct audio_profile profile;
+
+    audio_get_profile(&profile);
+
+    printf("%d voices, filters %s, %.1f s of audio rendered in %.3f s, realtime x%.1f, peak voices %d\n",
+           num_voices, filters ? "on" : "off", seconds, render_ns / 1e9, seconds / (render_ns / 1e9), profile.peak_voices);
+
+    for (int stage = 0; stage < AUDIO_PROFILE_NUM_STAGES; stage++) {
+        printf("  %-12s %8.2f ns/sample %5.1f%%\n", stage_names[stage], (double) profile.stage_ns[stage] / profile.num_samples,
+               100.0 * profile.stage_ns[stage] / render_ns);
+    }
+
+    printf("output hash %016" PRIx64 "\n", hash);
+
+    if (filter_timing)
+        print_filter_times(num_samples);
+
+    if (limiter_check) {
+        printf("samples over full scale %" PRIu64 "\n", profile.clipped_samples);
+
+        if (profile.clipped_samples > 0) {
+            fprintf(stderr, "The limiter let samples through!\n");
+            return 1;
+        }
+    }
+
+    if (expected_hash != NULL && strtoull(expected_hash, NULL, 16) != hash) {
+        fprintf(stderr, "Output hash differs from expected %s!\n", expected_hash);
+        return 1;
+    }
+
+    return 0;
+}
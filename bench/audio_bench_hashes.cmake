@@ -0,0 +1,31 @@
+# Expected audio_bench output hashes of the audio_benchmark runs, per numeric mode, for the
+# reference output format: 44100 Hz, 1 channel, U16 samples and Q16.16 fixed point.
+# Only update them for a change that is meant to change the output, from the "output hash" lines
+# the runs print.
+
+set(AUDIO_BENCH_HASH_double_v1 dbffbfcad68f376a)
+set(AUDIO_BENCH_HASH_double_v1_f 6d0e6b0683da6b66)
+set(AUDIO_BENCH_HASH_double_v8 4531cbc0c5cb43a0)
+set(AUDIO_BENCH_HASH_double_v8_f 67129c64df3c725e)
+set(AUDIO_BENCH_HASH_double_v32 d34f910867fbf41a)
+set(AUDIO_BENCH_HASH_double_v32_f e4b6f3a4c320c9d3)
+set(AUDIO_BENCH_HASH_double_v64 8b6c2257e4df7984)
+set(AUDIO_BENCH_HASH_double_v64_f 8ac2d5d412b619a6)
+
+set(AUDIO_BENCH_HASH_float32_v1 4b68f36add5b2ad8)
+set(AUDIO_BENCH_HASH_float32_v1_f b4a1d11acef83271)
+set(AUDIO_BENCH_HASH_float32_v8 2df62bfd8f570f1c)
+set(AUDIO_BENCH_HASH_float32_v8_f cab18eca47808f20)
+set(AUDIO_BENCH_HASH_float32_v32 78e04b0ba70ca041)
+set(AUDIO_BENCH_HASH_float32_v32_f 5ebdca44a46a5e12)
+set(AUDIO_BENCH_HASH_float32_v64 0bd95594f8b130bd)
+set(AUDIO_BENCH_HASH_float32_v64_f 4c82bb0f48de1f68)
+
+set(AUDIO_BENCH_HASH_fixed_v1 21657fe5af72c008)
+set(AUDIO_BENCH_HASH_fixed_v1_f 8ea5df6029824a4c)
+set(AUDIO_BENCH_HASH_fixed_v8 f19cc0a869178b96)
+set(AUDIO_BENCH_HASH_fixed_v8_f 1aa6adae5295c19e)
+set(AUDIO_BENCH_HASH_fixed_v32 46043f5eea623dae)
+set(AUDIO_BENCH_HASH_fixed_v32_f 4c6b1fae202c60f6)
+set(AUDIO_BENCH_HASH_fixed_v64 a2f948e4d17431ff)
+set(AUDIO_BENCH_HASH_fixed_v64_f 6b8bc5567a57ccd2)
@@ -0,0 +1,235 @@
+/**
+ * @file fastmath_bench.c
+ * @brief Accuracy and throughput of the fast math functions against the C library
+ *
+ * Sweeps each function over the inputs the engine gives it and reports the worst error in units in
+ * the last place (ulp) of pal_float_t and as an absolute (trig) or relative (rsqrt) error, then the
+ * time per call of the fast function and of the C library function it replaces. Build it once per
+ * floating point mode and FAST_MATH_ACCURACY tier to compare them, fixed point doesn't use the tiers.
+ * The ulp of sin, cos and atan2 blow up near their zero crossings where the ulp is tiny, the
+ * absolute error is the one to compare for them.
+ *
+ * usage: fastmath_bench [-n calls]
+ *   -n  calls per function for the throughput, 10000000 by default
+ *
+ */
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fastmath.h"
+#include "mathutils.h"
+#include "pal.h"
+
+#if defined PAL_USE_FIXED
+#error "The fast math benchmark needs a floating point mode!"
+#endif
+
+// inputs per accuracy sweep, and per batch of the throughput loops
+#define NUM_SWEEP_INPUTS (1000000)
+#define BATCH_SIZE (4096)
+// angles of the sin/cos sweep, a few turns either way like accumulated rotations
+#define ANGLE_RANGE (8 * M_PI)
+
+#if defined PAL_USE_FLOAT32
+#define NUMERIC_MODE "float32"
+#define LIBM_SIN sinf
+#define LIBM_COS cosf
+#define LIBM_ATAN2 atan2f
+#define LIBM_SQRT sqrtf
+#else
+#define NUMERIC_MODE "double"
+#define LIBM_SIN sin
+#define LIBM_COS cos
+#define LIBM_ATAN2 atan2
+#define LIBM_SQRT sqrt
+#endif
+
+#if FAST_MATH_ACCURACY == FAST_MATH_ACCURACY_LOW
+#define ACCURACY_TIER "low"
+#elif FAST_MATH_ACCURACY == FAST_MATH_ACCURACY_HIGH
+#define ACCURACY_TIER "high"
+#else
+#define ACCURACY_TIER "exact"
+#endif
+
+struct error_stats {
+    double max_ulp;
+    double max_error;
+    double worst_input;
+};
+
+static pal_float_t inputs_x[BATCH_SIZE];
+static pal_float_t inputs_y[BATCH_SIZE];
+// results are summed into this so the loops can't be optimized out
+static volatile pal_float_t sink;
+
+static uint64_t time_ns() {
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return (uint64_t) time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+/**
+ * @brief Gets the size of one unit in the last place of pal_float_t at value
+ *
+ * @param value
+ * @return double
+ */
+static double ulp(double value) {
+    pal_float_t magnitude = (pal_float_t) fabs(value);
+
+    // below the normal range the spacing doesn't shrink any further
+    if (magnitude < (sizeof(pal_float_t) == sizeof(float) ? FLT_MIN : DBL_MIN))
+        magnitude = sizeof(pal_float_t) == sizeof(float) ? FLT_MIN : DBL_MIN;
+
+    return sizeof(pal_float_t) == sizeof(float) ? nextafterf((float) magnitude, INFINITY) - (float) magnitude
+                                                : nextafter((double) magnitude, INFINITY) - (double) magnitude;
+}
+
+/**
+ * @brief Adds the error of result to stats, relative to the reference or absolute
+ *
+ * @param stats
+ * @param input
+ * @param result
+ * @param reference computed in long double
+ * @param relative
+ */
+static void add_error(struct error_stats *stats, double input, pal_float_t result, long double reference, bool relative) {
+    double difference = fabs((double) ((long double) result - reference));
+    double ulps = difference / ulp((double) reference);
+    double error = relative ? difference / fabs((double) reference) : difference;
+
+    if (ulps > stats->max_ulp)
+        stats->max_ulp = ulps;
+
+    if (error > stats->max_error) {
+        stats->max_error = error;
+        stats->worst_input = input;
+    }
+}
+
+static void print_errors(const char *name, const struct error_stats *stats, bool relative) {
+    printf("  %-8s %12.1f ulp %10.3g %s at %g\n", name, stats->max_ulp, stats->max_error, relative ? "relative" : "absolute", stats->worst_input);
+}
+
+static void measure_accuracy() {
+    struct error_stats sin_stats = { 0 }, cos_stats = { 0 }, sincos_stats = { 0 }, atan2_stats = { 0 }, rsqrt_stats = { 0 };
+
+    printf("accuracy\n");
+
+    for (int i = 0; i < NUM_SWEEP_INPUTS; i++) {
+        pal_float_t a = (pal_float_t) (-ANGLE_RANGE + 2 * ANGLE_RANGE * i / (NUM_SWEEP_INPUTS - 1));
+        pal_float_t s, c;
+
+        add_error(&sin_stats, a, fast_sin(a), sinl(a), false);
+        add_error(&cos_stats, a, fast_cos(a), cosl(a), false);
+        fast_sincos(a, &s, &c);
+        add_error(&sincos_stats, a, s, sinl(a), false);
+        add_error(&sincos_stats, a, c, cosl(a), false);
+    }
+
+    // every direction on circles from 1/1000 to 1000 units
+    for (int i = 0; i < NUM_SWEEP_INPUTS; i++) {
+        double angle = 2 * M_PI * (i % 1000) / 1000;
+        double radius = pow(10, -3 + 6.0 * (i / 1000) / (NUM_SWEEP_INPUTS / 1000 - 1));
+        pal_float_t x = (pal_float_t) (radius * cos(angle));
+        pal_float_t y = (pal_float_t) (radius * sin(angle));
+
+        add_error(&atan2_stats, angle, fast_atan2(y, x), atan2l(y, x), false);
+    }
+
+    // squared magnitudes from 1e-6 to 1e6, log spaced
+    for (int i = 0; i < NUM_SWEEP_INPUTS; i++) {
+        pal_float_t a = (pal_float_t) pow(10, -6 + 12.0 * i / (NUM_SWEEP_INPUTS - 1));
+
+        add_error(&rsqrt_stats, a, fast_rsqrt(a), 1 / sqrtl(a), true);
+    }
+
+    print_errors("sin", &sin_stats, false);
+    print_errors("cos", &cos_stats, false);
+    print_errors("sincos", &sincos_stats, false);
+    print_errors("atan2", &atan2_stats, false);
+    print_errors("rsqrt", &rsqrt_stats, true);
+}
+
+/**
+ * @brief Runs expression over the input batch until num_calls calls are made
+ *
+ * @return double ns per call
+ */
+#define TIME_CALLS(num_calls, expression) ({                            \
+    pal_float_t sum = 0;                                                \
+    uint64_t start = time_ns();                                         \
+    for (long done = 0; done < (num_calls); done += BATCH_SIZE) {       \
+        for (int i = 0; i < BATCH_SIZE; i++) {                          \
+            pal_float_t x = inputs_x[i], y = inputs_y[i];               \
+            (void) y;                                                   \
+            sum += (expression);                                        \
+        }                                                               \
+    }                                                                   \
+    sink = sum;                                                         \
+    (double) (time_ns() - start) / (num_calls);                         \
+})
+
+static void print_throughput(const char *name, double fast_ns, double libm_ns) {
+    printf("  %-8s %8.2f ns fast %8.2f ns libm %6.2fx\n", name, fast_ns, libm_ns, libm_ns / fast_ns);
+}
+
+static void measure_throughput(long num_calls) {
+    pal_float_t s, c;
+
+    srand(1);
+
+    for (int i = 0; i < BATCH_SIZE; i++) {
+        inputs_x[i] = (pal_float_t) ((double) rand() / RAND_MAX * 2 * ANGLE_RANGE - ANGLE_RANGE);
+        inputs_y[i] = (pal_float_t) ((double) rand() / RAND_MAX * 2 * ANGLE_RANGE - ANGLE_RANGE);
+    }
+
+    printf("throughput, %ld calls each\n", num_calls);
+
+    print_throughput("sin", TIME_CALLS(num_calls, fast_sin(x)), TIME_CALLS(num_calls, LIBM_SIN(x)));
+    print_throughput("cos", TIME_CALLS(num_calls, fast_cos(x)), TIME_CALLS(num_calls, LIBM_COS(x)));
+    print_throughput("sincos", TIME_CALLS(num_calls, (fast_sincos(x, &s, &c), s + c)), TIME_CALLS(num_calls, LIBM_SIN(x) + LIBM_COS(x)));
+    print_throughput("atan2", TIME_CALLS(num_calls, fast_atan2(y, x)), TIME_CALLS(num_calls, LIBM_ATAN2(y, x)));
+
+    // rsqrt takes squared magnitudes, always positive
+    for (int i = 0; i < BATCH_SIZE; i++)
+        inputs_x[i] = inputs_x[i] * inputs_x[i] + (pal_float_t) 1e-3;
+
+    print_throughput("rsqrt", TIME_CALLS(num_calls, fast_rsqrt(x)), TIME_CALLS(num_calls, 1 / LIBM_SQRT(x)));
+}
+
+int main(int argc, char **argv) {
+    long num_calls = 10000000;
+    int option;
+
+    while ((option = getopt(argc, argv, "n:")) != -1) {
+        switch (option) {
+            case 'n': num_calls = atol(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-n calls]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    if (num_calls <= 0) {
+        fprintf(stderr, "Make more than 0 calls\n");
+        return 2;
+    }
+
+    printf("%s, %s accuracy\n", NUMERIC_MODE, ACCURACY_TIER);
+
+    measure_accuracy();
+    measure_throughput(num_calls);
+
+    return 0;
+}
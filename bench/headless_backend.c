@@ -0,0 +1,94 @@
+/**
+ * @file headless_backend.c
+ * @brief PAL backend without a screen, input or audio device, for running the engine offline
+ * on the host. Audio is pulled with audio_render_offline instead of a callback
+ *
+ */
+#include "pal.h"
+
+#include <time.h>
+#ifndef PAL_USE_FIXED
+#include <math.h>
+#endif
+
+const screen_dim_t PAL_SCREEN_WIDTH = 240;
+const screen_dim_t PAL_SCREEN_HEIGHT = 240;
+const uint32_t PAL_RAND_MAX = 0x7FFFFFFF;
+
+// fixed seed so renders that use random numbers are repeatable
+static uint32_t rand_state = 1;
+// pal_get_time is the time since this
+static uint64_t start_time_ns;
+static bool start_time_set = false;
+
+bool pal_init() {
+    return true;
+}
+
+void pal_screen_clear(struct color c) {
+    (void) c;
+}
+
+void pal_screen_render() {}
+
+void pal_screen_draw_pixel(int x, int y, struct color c) {
+    (void) x;
+    (void) y;
+    (void) c;
+}
+
+bool pal_poll_event(struct pal_event *event) {
+    (void) event;
+
+    return false;
+}
+
+uint64_t pal_get_time_ns() {
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return (uint64_t) time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+pal_float_t pal_get_time() {
+    // counted from the first call, the host's uptime would overflow fixed point after 9 hours
+    if (!start_time_set) {
+        start_time_ns = pal_get_time_ns();
+        start_time_set = true;
+    }
+
+    return PAL_FLOAT((pal_get_time_ns() - start_time_ns) / 1e9);
+}
+
+void pal_set_audio_callback(pal_audio_callback_t audio_callback) {
+    (void) audio_callback;
+}
+
+#ifndef PAL_USE_FIXED
+pal_float_t pal_sin(pal_float_t a) {
+    return sin(a);
+}
+
+pal_float_t pal_cos(pal_float_t a) {
+    return cos(a);
+}
+
+pal_float_t pal_atan2(pal_float_t y, pal_float_t x) {
+    return atan2(y, x);
+}
+
+pal_float_t pal_hypot(pal_float_t x, pal_float_t y) {
+    return hypot(x, y);
+}
+
+pal_float_t pal_sqrt(pal_float_t x) {
+    return sqrt(x);
+}
+#endif
+
+uint32_t pal_rand() {
+    rand_state = rand_state * 1103515245 + 12345;
+
+    return rand_state >> 1;
+}
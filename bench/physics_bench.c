@@ -0,0 +1,240 @@
+/**
+ * @file physics_bench.c
+ * @brief Physics frame time benchmark, steps a crowded scene like the game loop does and reports
+ * the time spent in each stage of a frame
+ *
+ * Build it once per numeric mode (double, PAL_USE_FLOAT32 and PAL_USE_FIXED) to compare them, the
+ * scene is the same in every mode. Bodies are pulled towards the middle of the scene so they keep
+ * colliding, the mean distance from the middle at the end should be about the same in every mode.
+ *
+ * usage: physics_bench [-n frames] [-b bodies]
+ *   -n  frames to step, 600 (10 seconds of game time) by default
+ *   -b  circles and boxes in the scene, 128 by default
+ *
+ */
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mathutils.h"
+#include "pal.h"
+#include "physics.h"
+
+#define FRAME_DT (1.0 / 60)
+#define MAX_COLLISIONS (4 * PHYS_MAX_BODIES)
+// bodies start on a grid this far apart and are pulled to the middle with this acceleration per unit of distance
+#define GRID_SPACING (12)
+#define PULL (4)
+
+#if defined PAL_USE_FIXED
+#define NUMERIC_MODE "fixed"
+#elif defined PAL_USE_FLOAT32
+#define NUMERIC_MODE "float32"
+#else
+#define NUMERIC_MODE "double"
+#endif
+
+enum frame_stage {
+    STAGE_FORCES,
+    STAGE_INTEGRATE,
+    STAGE_BOUNDS,
+    STAGE_BROADPHASE,
+    STAGE_NARROWPHASE,
+    STAGE_RESOLVE,
+    NUM_STAGES
+};
+
+static const char *stage_names[NUM_STAGES] = {
+    [STAGE_FORCES] = "forces",
+    [STAGE_INTEGRATE] = "integrate",
+    [STAGE_BOUNDS] = "bounds",
+    [STAGE_BROADPHASE] = "broadphase",
+    [STAGE_NARROWPHASE] = "narrowphase",
+    [STAGE_RESOLVE] = "resolve",
+};
+
+static struct phys_data bodies[PHYS_MAX_BODIES];
+static struct phys_data *candidates[PHYS_MAX_BODIES];
+static struct collision_descriptor collisions[MAX_COLLISIONS];
+
+static uint64_t time_ns() {
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return (uint64_t) time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+/**
+ * @brief Puts num_bodies circles and boxes on a grid around the middle of the scene, with
+ * velocities from the backend's seeded random numbers so every run starts the same
+ *
+ * @param num_bodies
+ * @return true if every body got a slot in the body store
+ */
+static bool make_scene(int num_bodies) {
+    int columns = (int) ceil(sqrt(num_bodies));
+
+    for (int i = 0; i < num_bodies; i++) {
+        struct phys_data *phys = &bodies[i];
+        int size = 4 + (int) (pal_rand() % 4);
+
+        if (!physics_init(phys, PAL_FROM_INT(size)))
+            return false;
+
+        phys->elasticity = PAL_FLOAT(0.5);
+
+        if (i % 2 == 0)
+            physics_set_bounds_circle(phys, PAL_FROM_INT(size));
+        else
+            physics_set_bounds_rect(phys, PAL_FROM_INT(2 * size), PAL_FROM_INT(size + 2));
+
+        struct vec2 position = {
+            PAL_FROM_INT((i % columns - columns / 2) * GRID_SPACING),
+            PAL_FROM_INT((i / columns - columns / 2) * GRID_SPACING)
+        };
+        struct vec2 velocity = {
+            PAL_FROM_INT((int) (pal_rand() % 61) - 30),
+            PAL_FROM_INT((int) (pal_rand() % 61) - 30)
+        };
+
+        physics_set_position(phys, &position);
+        physics_set_velocity(phys, &velocity);
+        physics_set_awake(phys, true);
+        physics_compute_translated_bounds(phys);
+    }
+
+    return true;
+}
+
+int main(int argc, char **argv) {
+    int num_frames = 600;
+    int num_bodies = 128;
+    int option;
+
+    while ((option = getopt(argc, argv, "n:b:")) != -1) {
+        switch (option) {
+            case 'n': num_frames = atoi(optarg); break;
+            case 'b': num_bodies = atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-n frames] [-b bodies]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    if (num_frames <= 0 || num_bodies <= 1 || num_bodies > PHYS_MAX_BODIES) {
+        fprintf(stderr, "Step more than 0 frames of 2 to %d bodies\n", PHYS_MAX_BODIES);
+        return 2;
+    }
+
+    if (!make_scene(num_bodies)) {
+        fprintf(stderr, "Body store is full\n");
+        return 2;
+    }
+
+    uint64_t stage_ns[NUM_STAGES] = { 0 };
+    uint64_t total_ns = 0;
+    uint64_t worst_frame_ns = 0;
+    uint64_t total_collisions = 0;
+
+    for (int frame = 0; frame < num_frames; frame++) {
+        uint64_t stage_start[NUM_STAGES + 1];
+        size_t num_collisions = 0;
+
+        stage_start[STAGE_FORCES] = time_ns();
+
+        for (int i = 0; i < num_bodies; i++) {
+            struct vec2 position, force;
+
+            physics_get_position(&bodies[i], &position);
+            vec2_scale(&position, -pal_mul(bodies[i].mass, PAL_FROM_INT(PULL)), &force);
+            physics_set_force(&bodies[i], &force);
+        }
+
+        stage_start[STAGE_INTEGRATE] = time_ns();
+        physics_integrate_all(PAL_FLOAT(FRAME_DT));
+
+        stage_start[STAGE_BOUNDS] = time_ns();
+
+        for (int i = 0; i < num_bodies; i++)
+            physics_compute_translated_bounds(&bodies[i]);
+
+        // broadphase and narrowphase are timed apart, so the candidate pairs are gathered first
+        stage_start[STAGE_BROADPHASE] = time_ns();
+
+        for (int i = 0; i < num_bodies && num_collisions < MAX_COLLISIONS; i++) {
+            struct vec2 position;
+            pal_float_t reach = bodies[i].bounds.furthest_vertex_distance;
+
+            physics_get_position(&bodies[i], &position);
+
+            struct aabb region = {
+                { position.x - reach, position.y - reach },
+                { position.x + reach, position.y + reach }
+            };
+            size_t num_candidates = physics_query_aabb(&region, candidates, PHYS_MAX_BODIES);
+
+            // each pair once, from its lower body
+            for (size_t j = 0; j < num_candidates && num_collisions < MAX_COLLISIONS; j++) {
+                if (candidates[j] > &bodies[i]) {
+                    collisions[num_collisions].phys1 = &bodies[i];
+                    collisions[num_collisions].phys2 = candidates[j];
+                    num_collisions++;
+                }
+            }
+        }
+
+        stage_start[STAGE_NARROWPHASE] = time_ns();
+
+        for (size_t i = 0; i < num_collisions; i++) {
+            struct collision_descriptor *collision = &collisions[i];
+
+            if (!physics_detect_collision(collision->phys1, collision->phys2, collision))
+                collision->should_resolve = false;
+        }
+
+        stage_start[STAGE_RESOLVE] = time_ns();
+
+        for (size_t i = 0; i < num_collisions; i++) {
+            physics_resolve_collision(&collisions[i]);
+            total_collisions += collisions[i].should_resolve;
+        }
+
+        stage_start[NUM_STAGES] = time_ns();
+
+        for (int stage = 0; stage < NUM_STAGES; stage++)
+            stage_ns[stage] += stage_start[stage + 1] - stage_start[stage];
+
+        uint64_t frame_ns = stage_start[NUM_STAGES] - stage_start[STAGE_FORCES];
+
+        total_ns += frame_ns;
+
+        if (frame_ns > worst_frame_ns)
+            worst_frame_ns = frame_ns;
+    }
+
+    double mean_distance = 0;
+
+    for (int i = 0; i < num_bodies; i++) {
+        struct vec2 position;
+
+        physics_get_position(&bodies[i], &position);
+        mean_distance += hypot(PAL_TO_DOUBLE(position.x), PAL_TO_DOUBLE(position.y)) / num_bodies;
+    }
+
+    printf("%s, %d bodies, %d frames\n", NUMERIC_MODE, num_bodies, num_frames);
+    printf("frame time       %8.2f us mean, %8.2f us worst\n", total_ns / 1e3 / num_frames, worst_frame_ns / 1e3);
+    printf("collisions       %8.2f per frame\n", (double) total_collisions / num_frames);
+    printf("mean distance    %8.2f from the middle\n", mean_distance);
+
+    for (int stage = 0; stage < NUM_STAGES; stage++) {
+        printf("  %-14s %8.2f us %5.1f%%\n", stage_names[stage], stage_ns[stage] / 1e3 / num_frames,
+            total_ns > 0 ? 100.0 * stage_ns[stage] / total_ns : 0.0);
+    }
+
+    return 0;
+}
@@ -18,7 +18,7 @@ function(generate_midi MIDI_FILES OUTPUT_SRC_DIR OUTPUT_INC_DIR OUTPUT_SOURCE_FI
         # Add a custom command to run the Python script for each MIDI file
         add_custom_command(
             OUTPUT ${MIDI_C_FILE} ${MIDI_H_FILE}
-            COMMAND ${UTIL_PYTHON} ${MIDI_TO_C} ${MIDI_FILE} ${OUTPUT_SRC_DIR} ${OUTPUT_INC_DIR} "assets/midi"
+            COMMAND ${UTIL_PYTHON} ${MIDI_TO_C} ${MIDI_FILE} ${PAL_AUDIO_SAMPLE_RATE} ${OUTPUT_SRC_DIR} ${OUTPUT_INC_DIR} "assets/midi"
             DEPENDS ${MIDI_FILE}
             COMMENT "Generating midi .c and .h files for ${MIDI_FILE}"
         )
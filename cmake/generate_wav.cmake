@@ -15,10 +15,15 @@ function(generate_wav WAV_FILES OUTPUT_SRC_DIR OUTPUT_INC_DIR OUTPUT_SOURCE_FILE
         # Construct the output filenames for the generated C and H files
         set(WAV_C_FILE ${OUTPUT_SRC_DIR}/${WAV_STEM}.c)
         set(WAV_H_FILE ${OUTPUT_INC_DIR}/${WAV_STEM}.h)
+        # Files also listed in ADPCM_WAV_FILES are stored as 4 bit IMA-ADPCM
+        set(WAV_FORMAT_FLAGS "")
+        if(WAV_FILE IN_LIST ADPCM_WAV_FILES)
+            set(WAV_FORMAT_FLAGS --adpcm)
+        endif()
         # Add a custom command to run the Python script for each wave file
         add_custom_command(
             OUTPUT ${WAV_C_FILE} ${WAV_H_FILE}
-            COMMAND ${UTIL_PYTHON} ${WAV_TO_C} ${WAV_FILE} ${PAL_AUDIO_SAMPLE_RATE} ${OUTPUT_SRC_DIR} ${OUTPUT_INC_DIR} "assets/samples"
+            COMMAND ${UTIL_PYTHON} ${WAV_TO_C} ${WAV_FILE} ${PAL_AUDIO_SAMPLE_RATE} ${OUTPUT_SRC_DIR} ${OUTPUT_INC_DIR} "assets/samples" ${WAV_FORMAT_FLAGS}
             DEPENDS ${WAV_FILE}
             COMMENT "Generating wave sample .c and .h files for ${WAV_FILE}"
         )
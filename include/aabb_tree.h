@@ -0,0 +1,145 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "mathutils.h"
+
+// maximum number of leaves in a tree, can be overridden in the CMakeLists.txt
+#ifndef AABB_TREE_MAX_LEAVES
+#define AABB_TREE_MAX_LEAVES 256
+#endif
+// a binary tree with n leaves has n - 1 internal nodes
+#define AABB_TREE_MAX_NODES (2 * AABB_TREE_MAX_LEAVES)
+
+typedef uint16_t aabb_tree_proxy_t;
+#define AABB_TREE_NULL_NODE ((aabb_tree_proxy_t) UINT16_MAX)
+
+_Static_assert(AABB_TREE_MAX_NODES < UINT16_MAX, "Too many AABB tree nodes! Increase the size of aabb_tree_proxy_t or decrease AABB_TREE_MAX_LEAVES!");
+
+/**
+ * @brief Axis aligned bounding box
+ *
+ */
+struct aabb {
+    struct vec2 min;
+    struct vec2 max;
+};
+
+/**
+ * @brief Callback called for every leaf found by a tree query
+ *
+ * void * leaf data
+ * void * query context
+ * returns true to continue the query, false to stop it
+ */
+typedef bool (*aabb_tree_query_callback_t)(void *, void *);
+
+struct aabb_tree_node {
+    struct aabb aabb;           // fat AABB for leaves, union of children for internal nodes
+    void *data;                 // leaf data
+    aabb_tree_proxy_t parent;   // next free node when node is in the free list
+    aabb_tree_proxy_t child1;
+    aabb_tree_proxy_t child2;
+    int16_t height;             // leaf = 0, free node = -1
+};
+
+/**
+ * @brief Dynamic bounding volume tree. Leaves store fat AABBs so objects can move a little
+ * without the tree being restructured.
+ *
+ */
+struct aabb_tree {
+    struct aabb_tree_node nodes[AABB_TREE_MAX_NODES];
+    aabb_tree_proxy_t root;
+    aabb_tree_proxy_t free_list;
+    pal_float_t margin;
+};
+
+/**
+ * @brief Checks if two AABBs overlap
+ *
+ * @param a
+ * @param b
+ * @return true
+ * @return false
+ */
+bool aabb_overlap(const struct aabb *a, const struct aabb *b);
+
+/**
+ * @brief Checks if AABB a fully contains AABB b
+ *
+ * @param a
+ * @param b
+ * @return true
+ * @return false
+ */
+bool aabb_contains(const struct aabb *a, const struct aabb *b);
+
+/**
+ * @brief Initializes empty tree
+ *
+ * @param tree
+ * @param margin distance leaf AABBs are fattened by on every side
+ */
+void aabb_tree_init(struct aabb_tree *tree, pal_float_t margin);
+
+/**
+ * @brief Inserts leaf into tree
+ *
+ * @param tree
+ * @param aabb tight AABB of object
+ * @param data leaf data passed to query callbacks
+ * @return aabb_tree_proxy_t proxy of leaf, AABB_TREE_NULL_NODE if tree is full
+ */
+aabb_tree_proxy_t aabb_tree_insert(struct aabb_tree *tree, const struct aabb *aabb, void *data);
+
+/**
+ * @brief Removes leaf from tree
+ *
+ * @param tree
+ * @param proxy
+ */
+void aabb_tree_remove(struct aabb_tree *tree, aabb_tree_proxy_t proxy);
+
+/**
+ * @brief Moves leaf, only restructuring the tree if the new AABB has left the leaf's fat AABB
+ *
+ * @param tree
+ * @param proxy
+ * @param aabb new tight AABB of object
+ * @return true if leaf was reinserted
+ * @return false if the fat AABB still contains the object
+ */
+bool aabb_tree_move(struct aabb_tree *tree, aabb_tree_proxy_t proxy, const struct aabb *aabb);
+
+/**
+ * @brief Gets fat AABB of leaf
+ *
+ * @param tree
+ * @param proxy
+ * @return const struct aabb*
+ */
+const struct aabb *aabb_tree_get_fat_aabb(const struct aabb_tree *tree, aabb_tree_proxy_t proxy);
+
+/**
+ * @brief Calls callback for every leaf whose fat AABB overlaps given AABB
+ *
+ * @param tree
+ * @param aabb
+ * @param callback
+ * @param context passed to callback
+ */
+void aabb_tree_query(const struct aabb_tree *tree, const struct aabb *aabb, aabb_tree_query_callback_t callback, void *context);
+
+/**
+ * @brief Calls callback for every leaf whose fat AABB (grown by radius) is hit by a ray
+ *
+ * @param tree
+ * @param origin
+ * @param direction normalized ray direction
+ * @param max_distance
+ * @param radius radius of swept circle, 0 for plain rays
+ * @param callback
+ * @param context passed to callback
+ */
+void aabb_tree_raycast(const struct aabb_tree *tree, const struct vec2 *origin, const struct vec2 *direction, pal_float_t max_distance, pal_float_t radius, aabb_tree_query_callback_t callback, void *context);
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <limits.h>
 
@@ -7,16 +9,97 @@
 #include "midi_parse.h"
 
 // oscillator period is power of 2 so wrapping isn't an issue
-#define OSC_PERIOD (1 << 18)
+#define OSC_PERIOD_BITS 18
+#define OSC_PERIOD (1 << OSC_PERIOD_BITS)
 #define OSC_PERIOD_MASK (OSC_PERIOD - 1)
 #define OSC_AMPLITUDE INT16_MAX
 #define MAX_POLYPHONIC_WAVE_SAMPLERS (64)
 #define MAX_CONCURRENT_SAMPLE_VOICES (4)
 #define NUM_DRUM_NOTES (128)
+// IMA-ADPCM samples are stored in blocks of a 4 byte header (predictor and step index of the
+// decoder before the first sample) and a nibble per sample, low nibble first. Fixed, must match
+// util/wav_to_c.py
+#define WAVE_ADPCM_BLOCK_SAMPLES (256)
+#define WAVE_ADPCM_BLOCK_HEADER_BYTES (4)
+#define WAVE_ADPCM_BLOCK_BYTES (WAVE_ADPCM_BLOCK_HEADER_BYTES + WAVE_ADPCM_BLOCK_SAMPLES / 2)
+// maximum number of samples rendered at once, can be overridden in the CMakeLists.txt
+#ifndef AUDIO_BLOCK_SIZE
+#define AUDIO_BLOCK_SIZE (64)
+#endif
+// synthesized drum voices that can play at once, can be overridden in the CMakeLists.txt
+#ifndef AUDIO_MAX_DRUM_VOICES
+#define AUDIO_MAX_DRUM_VOICES (8)
+#endif
+// operators of FM voices, every oscillator voice keeps the state of this many, 2 to 4, can be
+// overridden in the CMakeLists.txt
+#ifndef FM_MAX_OPERATORS
+#define FM_MAX_OPERATORS (2)
+#endif
+// samples between control points of envelopes and effects, the gain is ramped linearly in
+// between, can be overridden in the CMakeLists.txt
+#ifndef AUDIO_CONTROL_PERIOD
+#define AUDIO_CONTROL_PERIOD (32)
+#endif
+// number of game side audio calls that can be waiting for the audio thread, power of 2,
+// can be overridden in the CMakeLists.txt
+#ifndef AUDIO_COMMAND_QUEUE_SIZE
+#define AUDIO_COMMAND_QUEUE_SIZE (256)
+#endif
+// number of timestamped audio calls that can wait for their sample, later calls wait in the command
+// queue until one is due. Can be overridden in the CMakeLists.txt
+#ifndef AUDIO_MAX_SCHEDULED_COMMANDS
+#define AUDIO_MAX_SCHEDULED_COMMANDS (32)
+#endif
+// time after the output latency given to calls timed with a game time, a frame at 60 fps and some
+// margin since calls come in while the frame runs, can be overridden in the CMakeLists.txt
+#ifndef AUDIO_SCHEDULE_SLACK_MS
+#define AUDIO_SCHEDULE_SLACK_MS (20)
+#endif
+// command time of audio calls that are applied at the start of the next block
+#define AUDIO_TIME_NOW (0)
+// number of mixer buses including the default ones, can be overridden in the CMakeLists.txt
+#ifndef AUDIO_MAX_BUSES
+#define AUDIO_MAX_BUSES (8)
+#endif
+// samples the master limiter looks ahead to turn the gain down before a peak, the output is
+// delayed by as many samples, can be overridden in the CMakeLists.txt
+#ifndef AUDIO_LIMITER_LOOKAHEAD
+#define AUDIO_LIMITER_LOOKAHEAD (64)
+#endif
+// time for the master limiter to go from silence back to unity gain, can be overridden in the CMakeLists.txt
+#ifndef AUDIO_LIMITER_RELEASE_MS
+#define AUDIO_LIMITER_RELEASE_MS (50)
+#endif
+// 0 to synthesize in the backend's audio callback instead of an engine owned render thread, for
+// platforms without POSIX threads, set with PAL_AUDIO_RENDER_THREAD in the CMakeLists.txt
+#ifndef AUDIO_RENDER_THREAD
+#define AUDIO_RENDER_THREAD (1)
+#endif
+// frames the render thread can get ahead of the audio callback, power of 2, can be overridden in the CMakeLists.txt
+#ifndef AUDIO_RENDER_BUFFER_SIZE
+#define AUDIO_RENDER_BUFFER_SIZE (2048)
+#endif
+// blocks the render thread keeps ready for the audio callback until audio_set_latency is
+// called, can be overridden in the CMakeLists.txt
+#ifndef AUDIO_RENDER_AHEAD_BLOCKS
+#define AUDIO_RENDER_AHEAD_BLOCKS (16)
+#endif
+// define AUDIO_ENABLE_STATS in the CMakeLists.txt to measure the audio load, voice counts and
+// glitches for audio_get_stats
+// time the load percentage is averaged over, can be overridden in the CMakeLists.txt
+#ifndef AUDIO_STATS_WINDOW_MS
+#define AUDIO_STATS_WINDOW_MS (250)
+#endif
+// define AUDIO_ENABLE_PROFILING in the CMakeLists.txt to time each stage of the audio callback
+// with the POSIX monotonic clock, for host builds like the audio benchmark
 
 struct effect_node;
 struct filter_node;
 struct oscillator;
+struct drum_kit;
+struct fm_bank;
+struct fm_patch;
+struct wavetable;
 
 /**
  * @brief Function to get sample from oscillator based on time t in the oscillator's period
@@ -27,7 +110,7 @@ struct oscillator;
 typedef int32_t (*oscillator_waveform_func_t)(uint32_t t);
 
 /**
- * @brief Effect node update function, called every sample period
+ * @brief Effect node update function, called every control period (AUDIO_CONTROL_PERIOD samples)
  * Used to perform operation on oscillator, things like changing frequency based on lfo
  *
  */
@@ -39,10 +122,78 @@ typedef void (*effect_node_update_func_t)(struct oscillator *, struct effect_nod
  */
 typedef int32_t (*filter_process_func_t)(struct filter_node *, int32_t input_sample);
 
+/**
+ * @brief Block version of oscillator_waveform_func_t, fills samples with num_samples waveform
+ * values starting at time t and stepping by t_increment
+ * NOTE: t must wrap at OSC_PERIOD (mask with OSC_PERIOD_MASK)
+ * NOTE: the written values must be between -OSC_AMPLITUDE and +OSC_AMPLITUDE
+ *
+ */
+typedef void (*oscillator_waveform_block_func_t)(int32_t *samples, uint32_t t, uint32_t t_increment, int num_samples);
+
+/**
+ * @brief Version of effect_node_update_func_t that also gets the number of samples until the next
+ * control period, called every control period
+ *
+ */
+typedef void (*effect_node_update_block_func_t)(struct oscillator *, struct effect_node *, int num_samples);
+
+/**
+ * @brief Block version of filter_process_func_t, filters num_samples samples in place
+ *
+ */
+typedef void (*filter_process_block_func_t)(struct filter_node *, int32_t *samples, int num_samples);
+
+/**
+ * @brief Stereo version of filter_process_block_func_t for bus filters, filters num_samples
+ * samples of both channels in place with separate state for each
+ *
+ */
+typedef void (*filter_process_stereo_block_func_t)(struct filter_node *, int32_t *left, int32_t *right, int num_samples);
+
 typedef int8_t wave_sample_t;
 #define WAVE_SAMPLE_INVALID ((wave_sample_t) -1)
 
+typedef int8_t audio_bus_t;
+#define AUDIO_BUS_INVALID ((audio_bus_t) -1)
+// default buses, music and sfx and ui are mixed into master
+#define AUDIO_BUS_MASTER ((audio_bus_t) 0)
+#define AUDIO_BUS_MUSIC ((audio_bus_t) 1)
+#define AUDIO_BUS_SFX ((audio_bus_t) 2)
+#define AUDIO_BUS_UI ((audio_bus_t) 3)
+#define AUDIO_NUM_DEFAULT_BUSES (4)
+
 _Static_assert(MAX_POLYPHONIC_WAVE_SAMPLERS <= ((1 << ((sizeof(wave_sample_t) << 3) - 1)) - 1), "MAX_POLYPHONIC_WAVE_SAMPLERS must fit into wave_sample_t");
+_Static_assert(MAX_CONCURRENT_SAMPLE_VOICES <= INT8_MAX, "Too many sample voices! Decrease MAX_CONCURRENT_SAMPLE_VOICES!");
+_Static_assert(AUDIO_MAX_DRUM_VOICES > 0, "AUDIO_MAX_DRUM_VOICES must be positive!");
+_Static_assert(FM_MAX_OPERATORS >= 2 && FM_MAX_OPERATORS <= 4, "FM_MAX_OPERATORS must be between 2 and 4!");
+_Static_assert((AUDIO_COMMAND_QUEUE_SIZE & (AUDIO_COMMAND_QUEUE_SIZE - 1)) == 0, "AUDIO_COMMAND_QUEUE_SIZE must be a power of 2!");
+_Static_assert(AUDIO_CONTROL_PERIOD > 0 && AUDIO_CONTROL_PERIOD <= UINT16_MAX, "AUDIO_CONTROL_PERIOD must be between 1 and UINT16_MAX!");
+_Static_assert(AUDIO_MAX_BUSES >= AUDIO_NUM_DEFAULT_BUSES && AUDIO_MAX_BUSES <= INT8_MAX, "AUDIO_MAX_BUSES must be between AUDIO_NUM_DEFAULT_BUSES and INT8_MAX!");
+_Static_assert(AUDIO_LIMITER_LOOKAHEAD > 0 && AUDIO_LIMITER_LOOKAHEAD <= INT16_MAX, "AUDIO_LIMITER_LOOKAHEAD must be between 1 and INT16_MAX!");
+_Static_assert(AUDIO_LIMITER_RELEASE_MS > 0, "AUDIO_LIMITER_RELEASE_MS must be positive!");
+_Static_assert(PAL_AUDIO_CHANNELS == 1 || PAL_AUDIO_CHANNELS == 2, "PAL_AUDIO_CHANNELS must be 1 or 2!");
+_Static_assert((AUDIO_RENDER_BUFFER_SIZE & (AUDIO_RENDER_BUFFER_SIZE - 1)) == 0, "AUDIO_RENDER_BUFFER_SIZE must be a power of 2!");
+_Static_assert(AUDIO_RENDER_AHEAD_BLOCKS >= 1 && AUDIO_RENDER_AHEAD_BLOCKS * AUDIO_BLOCK_SIZE <= AUDIO_RENDER_BUFFER_SIZE, "AUDIO_RENDER_AHEAD_BLOCKS must fit in AUDIO_RENDER_BUFFER_SIZE!");
+
+/**
+ * @brief Handle to a playing wave sample voice, returned by wave_sample_play
+ *
+ */
+struct wave_sample_voice {
+    wave_sample_t sample;
+    uint32_t id;        // 0 if the sample wasn't played, detects the channel being reused by another play
+};
+
+/**
+ * @brief What wave_sample_play does when every voice of a sample is busy
+ *
+ */
+enum wave_sample_steal_mode {
+    WAVE_SAMPLE_STEAL_NONE,     // don't play the new sound
+    WAVE_SAMPLE_STEAL_OLDEST,   // replace the voice that started first
+    WAVE_SAMPLE_STEAL_QUIETEST  // replace the voice with the lowest amplitude, oldest if tied
+};
 
 enum oscillator_voice_num {
     OSC_VOICE_NONE = -1,
@@ -56,6 +207,8 @@ enum oscillator_voice_num {
     OSC_MAX_VOICES
 };
 
+_Static_assert(OSC_MAX_VOICES <= 32, "Too many oscillator voices! Decrease OSC_MAX_VOICES!");
+
 enum adsr_state {
     ADSR_STATE_ATTACK,
     ADSR_STATE_DECAY,
@@ -64,30 +217,90 @@ enum adsr_state {
     ADSR_STATE_OFF
 };
 
+/**
+ * @brief Linear ADSR envelope, advanced once per control period
+ * Levels are OSC_AMPLITUDE full scale with ENVELOPE_FRAC_BITS extra fractional bits
+ *
+ */
 struct adsr_envelope {
-    int32_t envelope_value;
-    int16_t sustain;
-    uint32_t attack_step;
+    int32_t envelope_value; // level at the next control point
+    int32_t sustain;
+    uint32_t attack_step;   // level change per sample of each stage
     uint32_t decay_step;
     uint32_t release_step;
     enum adsr_state state;
 };
 
+/**
+ * @brief Operator of an FM voice, a sine with its own envelope
+ *
+ */
+struct fm_operator_state {
+    uint32_t phase;         // a cycle is 2^32
+    int32_t envelope;       // level with 30 fractional bits
+    int32_t stage_rate;     // envelope change per control period in attack, decay factor after it
+    // output level, ramped every sample from the last control point to the next like the voice gain
+    int32_t gain;
+    int32_t gain_step;
+    int16_t feedback[2];    // last two outputs
+    uint8_t stage;          // enum adsr_state
+};
+
+/**
+ * @brief FM state of an oscillator voice, patch is NULL if the voice plays the oscillator's waveform
+ *
+ */
+struct fm_voice {
+    const struct fm_patch *patch;
+    struct fm_operator_state operators[FM_MAX_OPERATORS];
+};
+
 struct oscillator_voice {
     int16_t amplitude;
     int32_t t;
     int32_t t_increment;
     struct adsr_envelope adsr;
+    // envelope and amplitude of the voice, ramped every sample from the last control point to
+    // gain_target at the next one. GAIN_RAMP_FRAC_BITS more fractional bits than the 15 of the
+    // amplitude so slow ramps don't go in steps
+    int32_t gain;
+    int32_t gain_step;
+    int32_t gain_target;
+    struct fm_voice fm;     // operator envelopes take the place of adsr for FM voices
 };
 
+/*
+ * Filters and waveforms can implement either the per sample or the block callback. The block
+ * callback is used when it's set, otherwise the per sample callback is called for every sample in
+ * the block. An oscillator's FM patch takes priority over its wavetable, and the wavetable over
+ * both waveform callbacks. Effects run at
+ * control rate, either callback is called once every control period. audio_filter.h has builtin
+ * block filters.
+ */
 struct effect_node {
     effect_node_update_func_t update;
     struct effect_node *next;
+    effect_node_update_block_func_t update_block;
 };
 
 struct filter_node {
     filter_process_func_t process;
     struct filter_node *next;
+    filter_process_block_func_t process_block;
+    // used for bus filters in stereo builds when set. Without it each channel is run through the
+    // mono callback in turn, which is only right for filters without state
+    filter_process_stereo_block_func_t process_stereo_block;
+};
+
+/**
+ * @brief Constant power pan of a mono sound into the stereo buses, left and right gains with 15
+ * fractional bits. The gains ramp to the targets over a block so pan changes don't click.
+ * Unused in mono builds
+ *
+ */
+struct audio_pan {
+    int32_t gains[2];
+    int32_t targets[2];
 };
 
 struct oscillator {
@@ -96,11 +309,38 @@ struct oscillator {
     struct effect_node *effect_list_head;
     struct filter_node *filter_list_head;
     oscillator_waveform_func_t waveform;
+    oscillator_waveform_block_func_t waveform_block;
+    const struct wavetable *wavetable;
+    const struct fm_patch *fm_patch;    // played by voices started while it's set
+
+    // voices that aren't ADSR_STATE_OFF, only these are rendered
+    int8_t active_voices[OSC_MAX_VOICES];
+    int8_t num_active_voices;
+    uint16_t control_samples_left;  // samples until the next control point
+    audio_bus_t bus;                // bus the oscillator is mixed into
+    struct audio_pan pan;           // of all voices, the oscillator filters run on the mono mix
+    // bit per voice that can be played, claimed by the thread playing the voice and given back
+    // by the audio thread when the voice finishes
+    atomic_uint free_voices;
+};
+
+enum wave_data_format {
+    WAVE_DATA_PCM16,        // data holds length 16 bit samples
+    // adpcm_data holds 4 bit IMA-ADPCM samples in blocks of WAVE_ADPCM_BLOCK_SAMPLES, from
+    // util/wav_to_c.py --adpcm. Each block starts with the decoder state, so a voice can start
+    // decoding at any block
+    WAVE_DATA_IMA_ADPCM
 };
 
 struct wave_data {
+    enum wave_data_format format;   // WAVE_DATA_PCM16 if not set
     const int16_t *data;
+    const uint8_t *adpcm_data;
     uint32_t length;
+    // optional sustain loop [loop_start, loop_end), looped until the voice is released.
+    // loop_end of 0 means no loop
+    uint32_t loop_start;
+    uint32_t loop_end;
 };
 
 enum midi_channel_type {
@@ -113,25 +353,75 @@ struct midi_player {
     struct oscillator oscillators[MIDI_NUM_CHANNELS - 1];
     int8_t channel_voice_to_note_mapping[MIDI_NUM_CHANNELS - 1][OSC_MAX_VOICES];
     wave_sample_t drum_samples[NUM_DRUM_NOTES];
+    const struct drum_kit *drum_kit;    // synthesizes drum notes without a sample, optional
+    const struct fm_bank *fm_bank;      // FM patches of the midi programs, optional
     int8_t channel_transpose[MIDI_NUM_CHANNELS - 1];
+    audio_bus_t bus;    // bus of the drum samples, the channel oscillators keep their own
+    int32_t drum_pan;   // pan of the drum samples from the drum channel's pan controller
 
     struct midi_parser parser;
+    const struct midi_index *index; // checkpoints of the parser's midi file for seeking, optional
+    // played instead of the parser when set, the parser's loop settings and playback rate still apply
+    const struct midi_stream *stream;
+    uint32_t stream_position;       // index of the next stream event
+    uint64_t stream_event_position; // song position of the next stream event
+    // song position with MIDI_PLAYBACK_RATE_FRAC_BITS fractional bits, advanced by the playback rate
+    uint64_t stream_time;
 };
 
+/*
+ * The audio callback runs on the backend's audio thread. Once audio_start is called, game side
+ * calls that change what is playing don't touch the audio state, they post a command to a
+ * wait-free queue that the audio thread drains at the start of every block. Commands are applied
+ * in order, at the sample set with audio_set_command_time. All of these calls must come from the
+ * same game thread. Before audio_start they are applied immediately.
+ */
+
 /**
  * @brief Initializes oscillator with given ADSR parameters and waveform function
  *
  * @param osc
  * @param attack_ms
  * @param decay_ms
- * @param sustain_value
+ * @param sustain_value envelope level held after decay, 0 to OSC_AMPLITUDE
  * @param release_ms
  * @param waveform
  */
 void oscillator_init(struct oscillator *osc, uint32_t attack_ms, uint32_t decay_ms, int16_t sustain_value, uint32_t release_ms, oscillator_waveform_func_t waveform);
 
+/**
+ * @brief Sets block waveform function of oscillator, used instead of the per sample waveform
+ * function given to oscillator_init from the command time on
+ *
+ * @param osc
+ * @param waveform_block
+ */
+void oscillator_set_waveform_block(struct oscillator *osc, oscillator_waveform_block_func_t waveform_block);
+
+/**
+ * @brief Sets wavetable of oscillator, used instead of the waveform functions from the command
+ * time on
+ *
+ * @param osc
+ * @param wavetable wavetable from wavetable.h, NULL to go back to the waveform functions
+ */
+void oscillator_set_wavetable(struct oscillator *osc, const struct wavetable *wavetable);
+
+/**
+ * @brief Sets FM patch of oscillator, used instead of the wavetable and waveform functions by the
+ * voices played after it. Its operator envelopes replace the oscillator's ADSR envelope
+ * NOTE: call this from the game side, the first FM patch or bank generates the sine table
+ *
+ * @param osc
+ * @param patch FM patch from audio_fm.h, NULL to go back to the wavetable and waveform functions
+ * @return true if patch was set
+ * @return false if the wavetable pool is full
+ */
+bool oscillator_set_fm_patch(struct oscillator *osc, const struct fm_patch *patch);
+
 /**
  * @brief Deletes oscillator from active oscillators
+ * NOTE: the audio thread stops using the oscillator at the next block, it must stay valid until then
  *
  * @param osc
  */
@@ -139,11 +429,12 @@ void oscillator_delete(struct oscillator *osc);
 
 /**
  * @brief Plays tone on oscillator, returning the voice the tone is played on
+ * The voice is reserved right away, the tone starts when the audio thread runs the command
  *
  * @param osc
  * @param amplitude
  * @param frequency
- * @return enum oscillator_voice_num
+ * @return enum oscillator_voice_num OSC_VOICE_NONE if all voices are busy or the command queue is full
  */
 enum oscillator_voice_num oscillator_play_voice(struct oscillator *osc, uint16_t amplitude, pal_float_t frequency);
 
@@ -155,8 +446,30 @@ enum oscillator_voice_num oscillator_play_voice(struct oscillator *osc, uint16_t
  */
 void oscillator_stop_voice(struct oscillator *osc, enum oscillator_voice_num voice);
 
+/**
+ * @brief oscillator_play_voice at game time, the tone starts on the sample of game_time from
+ * audio_time_to_sample_num
+ *
+ * @param osc
+ * @param amplitude
+ * @param frequency
+ * @param game_time time from pal_get_time, like game_get_frame_time, see audio_time_to_sample_num for its range
+ * @return enum oscillator_voice_num OSC_VOICE_NONE if all voices are busy or the command queue is full
+ */
+enum oscillator_voice_num oscillator_play_voice_at(struct oscillator *osc, uint16_t amplitude, pal_float_t frequency, pal_float_t game_time);
+
+/**
+ * @brief oscillator_stop_voice at game time
+ *
+ * @param osc
+ * @param voice
+ * @param game_time time from pal_get_time, like game_get_frame_time, see audio_time_to_sample_num for its range
+ */
+void oscillator_stop_voice_at(struct oscillator *osc, enum oscillator_voice_num voice, pal_float_t game_time);
+
 /**
  * @brief Changes frequency of oscillator voice to given frequency
+ * NOTE: this is applied directly, it's meant for effect nodes running on the audio thread
  *
  * @param osc
  * @param voice
@@ -180,10 +493,60 @@ void oscillator_add_filter(struct oscillator *osc, struct filter_node *filter);
  */
 void oscillator_add_effect(struct oscillator *osc, struct effect_node *effect);
 
+/**
+ * @brief Sets bus oscillator is mixed into, AUDIO_BUS_SFX by default
+ *
+ * @param osc
+ * @param bus
+ */
+void oscillator_set_bus(struct oscillator *osc, audio_bus_t bus);
+
+/**
+ * @brief Pans oscillator in stereo builds, its voices are filtered together and panned as one.
+ * Centered by default. Does nothing in mono builds
+ *
+ * @param osc
+ * @param pan -1 (left) to 1 (right), constant power so the loudness stays the same
+ */
+void oscillator_set_pan(struct oscillator *osc, pal_float_t pan);
+
+/*
+ * Every source is mixed into a bus. Each bus runs its filter chain and gain on its mix and adds
+ * the result to its output bus, down to the master bus. The master bus ends in a look-ahead
+ * limiter instead of clipping. The bus graph is compiled into a flat mixing order by audio_start,
+ * so buses can only be added before it.
+ */
+
+/**
+ * @brief Adds submix bus
+ * NOTE: call before audio_start
+ *
+ * @param output bus the new bus is mixed into
+ * @return audio_bus_t AUDIO_BUS_INVALID if there are already AUDIO_MAX_BUSES buses, output
+ * doesn't exist or audio has started
+ */
+audio_bus_t audio_bus_add(audio_bus_t output);
+
+/**
+ * @brief Sets gain of bus, ramped over one block so changes don't click
+ *
+ * @param bus
+ * @param gain 0 to 16
+ */
+void audio_bus_set_gain(audio_bus_t bus, pal_float_t gain);
+
+/**
+ * @brief Adds filter to filter chain of bus, run on the mix of the bus before its gain
+ *
+ * @param bus
+ * @param filter
+ */
+void audio_bus_add_filter(audio_bus_t bus, struct filter_node *filter);
+
 /**
  * @brief Adds filter to master audio filter chain
  *
- * This filter is run on the final output of audio synthesis
+ * This filter is run on the final output of audio synthesis, before the limiter
  *
  * @param filter
  */
@@ -204,8 +567,60 @@ wave_sample_t wave_sample_register(const struct wave_data *wave_data);
  * @param sample
  * @param amplitude Amplitude of wave sample
  * @param speed Speed multiplier of sample playback
+ * @return struct wave_sample_voice handle of the voice playing the sample, id is 0 if the command
+ * queue is full
+ */
+struct wave_sample_voice wave_sample_play(wave_sample_t sample, uint16_t amplitude, pal_float_t speed);
+
+/**
+ * @brief wave_sample_play at game time, the sample starts on the sample of game_time from
+ * audio_time_to_sample_num. Sounds from event handlers keep the timing of their frames instead of
+ * starting whenever the audio thread next runs
+ *
+ * @param sample
+ * @param amplitude Amplitude of wave sample
+ * @param speed Speed multiplier of sample playback
+ * @param game_time time from pal_get_time, like game_get_frame_time, see audio_time_to_sample_num for its range
+ * @return struct wave_sample_voice handle of the voice playing the sample, id is 0 if the command
+ * queue is full
  */
-void wave_sample_play(wave_sample_t sample, uint16_t amplitude, pal_float_t speed);
+struct wave_sample_voice wave_sample_play_at(wave_sample_t sample, uint16_t amplitude, pal_float_t speed, pal_float_t game_time);
+
+/**
+ * @brief Releases wave sample voice, it leaves its sustain loop and plays to the end of the sample
+ * Does nothing if the voice has already finished, was stolen or never got a channel
+ *
+ * @param voice
+ */
+void wave_sample_release(struct wave_sample_voice voice);
+
+/**
+ * @brief Sets what happens when the sample is played while all its voices are busy
+ * Defaults to WAVE_SAMPLE_STEAL_OLDEST
+ *
+ * @param sample
+ * @param mode
+ */
+void wave_sample_set_steal_mode(wave_sample_t sample, enum wave_sample_steal_mode mode);
+
+/**
+ * @brief Sets bus wave sample is played on, AUDIO_BUS_SFX by default
+ * Voices that are already playing stay on their bus
+ *
+ * @param sample
+ * @param bus
+ */
+void wave_sample_set_bus(wave_sample_t sample, audio_bus_t bus);
+
+/**
+ * @brief Pans wave sample voice in stereo builds, voices start centered. Called right after
+ * wave_sample_play the voice starts at the pan, later calls glide to it over a block
+ * Does nothing in mono builds or if the voice has finished
+ *
+ * @param voice
+ * @param pan -1 (left) to 1 (right), constant power so the loudness stays the same
+ */
+void wave_sample_set_pan(struct wave_sample_voice voice, pal_float_t pan);
 
 /**
  * @brief Initializes midi player
@@ -222,6 +637,78 @@ void midi_player_init(struct midi_player *player);
  */
 void midi_player_load_midi(struct midi_player *player, uint8_t *midi_data_source);
 
+/**
+ * @brief Loads midi player with merged event stream, from util/midi_to_c.py or midi_stream_init
+ * Streams are played without any parsing. The loop points are set to the loop markers of the stream
+ *
+ * @param player
+ * @param stream
+ */
+void midi_player_load_stream(struct midi_player *player, const struct midi_stream *stream);
+
+/**
+ * @brief Sets checkpoint index of the midi file loaded in midi player, for seeking without parsing
+ * from the start. The loop points are set to the loop markers of the index
+ * Call after midi_player_load_midi, loading clears it
+ *
+ * @param player
+ * @param index built with midi_index_init from the same midi data
+ */
+void midi_player_set_index(struct midi_player *player, const struct midi_index *index);
+
+/**
+ * @brief Moves midi player playback to time in the song, notes that are on there start again
+ * An index makes seeking midi loaded with midi_player_load_midi fast, streams are scanned from
+ * the start without parsing
+ *
+ * @param player
+ * @param seconds song time at playback rate 1
+ */
+void midi_player_seek(struct midi_player *player, pal_float_t seconds);
+
+/**
+ * @brief Moves midi player playback to beat. Midi loaded with midi_player_load_midi needs an index
+ * set with midi_player_set_index and streams need beat positions, otherwise nothing happens
+ *
+ * @param player
+ * @param beat quarter notes from the start of the song, frames for SMPTE timed files
+ */
+void midi_player_seek_beat(struct midi_player *player, uint32_t beat);
+
+/**
+ * @brief Turns looping of midi player on or off, loading midi turns it off
+ * Playback jumps back to the loop start when the loop end or the end of the song is reached
+ *
+ * @param player
+ * @param loop
+ */
+void midi_player_set_loop(struct midi_player *player, bool loop);
+
+/**
+ * @brief Sets loop points of midi player, overriding the loop markers of the index or stream
+ *
+ * @param player
+ * @param loop_start song time in seconds
+ * @param loop_end song time in seconds, not included in the loop
+ */
+void midi_player_set_loop_points(struct midi_player *player, pal_float_t loop_start, pal_float_t loop_end);
+
+/**
+ * @brief Sets playback rate of midi player without re-parsing, loading midi resets it to 1
+ *
+ * @param player
+ * @param rate tempo multiplier, up to 16
+ */
+void midi_player_set_playback_rate(struct midi_player *player, pal_float_t rate);
+
+/**
+ * @brief Sets bus of midi player's channel oscillators and drum samples, AUDIO_BUS_MUSIC by default
+ *
+ * @param player
+ * @param bus
+ */
+void midi_player_set_bus(struct midi_player *player, audio_bus_t bus);
+
 /**
  * @brief Assigns drum wave sample data to drum note number in midi player
  *
@@ -231,6 +718,28 @@ void midi_player_load_midi(struct midi_player *player, uint8_t *midi_data_source
  */
 void midi_player_assign_drum_sample_to_note(struct midi_player *player, wave_sample_t sample, int note_number);
 
+/**
+ * @brief Sets drum kit that synthesizes the drum notes without a drum sample, drum_kit_gm from
+ * audio_drum.h by default
+ *
+ * @param player
+ * @param kit NULL to only play drum samples
+ */
+void midi_player_set_drum_kit(struct midi_player *player, const struct drum_kit *kit);
+
+/**
+ * @brief Sets FM bank that program changes pick the patches of the channel oscillators from,
+ * fm_bank_gm from audio_fm.h has a patch for most general midi instruments. Without a bank,
+ * program changes are ignored
+ * NOTE: call this from the game side, the first FM patch or bank generates the sine table
+ *
+ * @param player
+ * @param bank NULL to ignore program changes, channels keep the patch they have
+ * @return true if bank was set
+ * @return false if the wavetable pool is full
+ */
+bool midi_player_set_fm_bank(struct midi_player *player, const struct fm_bank *bank);
+
 /**
  * @brief Sets transpose (in note number/half steps) of given midi channel
  *
@@ -252,20 +761,163 @@ void midi_player_set_channel_transpose(struct midi_player *player, int channel,
 struct oscillator *midi_player_get_channel_oscillator(struct midi_player *player, uint8_t channel);
 
 /**
- * @brief Requests audio subsystem to stop outputing sound
+ * @brief Requests audio subsystem to stop outputing sound, returns once every oscillator voice
+ * has been released. Blocks on a fence the audio thread signals, without spinning
+ * NOTE: returns right away after audio_start_offline, render until the voices are released
  *
  */
 void audio_request_stop();
 
 /**
- * @brief Starts audio subsystem
+ * @brief Starts audio subsystem, synthesis runs on an engine render thread that works ahead of
+ * the audio callback, which only copies the rendered samples out
  *
  */
 void audio_start();
 
 /**
- * @brief Sets master volume
+ * @brief Sets how many blocks the render thread keeps ready for the audio callback. More blocks
+ * ride out longer synthesis spikes without an underrun, but delay every sound by as much
+ * NOTE: the latency has to cover the sample count the backend asks for in one callback
+ *
+ * @param num_blocks 1 to AUDIO_RENDER_BUFFER_SIZE / AUDIO_BLOCK_SIZE, clamped
+ */
+void audio_set_latency(int num_blocks);
+
+/**
+ * @brief Gets the number of audio callbacks that found fewer samples ready than they needed
+ * and played silence for the rest, safe to call from any thread. Always 0 when synthesizing in
+ * the audio callback
+ *
+ * @return uint32_t
+ */
+uint32_t audio_get_underrun_count();
+
+/**
+ * @brief Starts audio subsystem without an audio callback, samples are rendered with
+ * audio_render_offline on the calling thread, for rendering to a file or benchmarking
+ *
+ */
+void audio_start_offline();
+
+/**
+ * @brief Renders the next num_frames frames in the output format, same as the audio callback
+ * NOTE: only call after audio_start_offline, from the thread making the other audio calls
+ *
+ * @param samples num_frames * PAL_AUDIO_CHANNELS samples
+ * @param num_frames
+ */
+void audio_render_offline(audio_sample_t *samples, int num_frames);
+
+/**
+ * @brief Sets master volume, the gain of AUDIO_BUS_MASTER
  *
  * @param gain
  */
-void audio_set_master_volume(pal_float_t gain);
\ No newline at end of file
+void audio_set_master_volume(pal_float_t gain);
+
+/**
+ * @brief Sets the sample number that the following game side audio calls are applied at, for
+ * sample accurate scheduling. Calls with a time that already passed are applied at the next block,
+ * so AUDIO_TIME_NOW calls run ahead of earlier calls that are still waiting for a later sample.
+ * While AUDIO_MAX_SCHEDULED_COMMANDS calls are waiting, the following calls wait in the queue
+ * behind them, even AUDIO_TIME_NOW ones
+ *
+ * @param sample_num sample number from audio_get_sample_num, AUDIO_TIME_NOW to apply calls at
+ * the start of the next block
+ */
+void audio_set_command_time(uint64_t sample_num);
+
+/**
+ * @brief Gets the number of samples the audio thread has rendered, safe to call from any thread
+ * With the render thread it's ahead of the samples played by up to the latency
+ *
+ * @return uint64_t
+ */
+uint64_t audio_get_sample_num();
+
+/**
+ * @brief Gets the sample number of game time for audio_set_command_time. Every game time is
+ * delayed by the same output latency plus AUDIO_SCHEDULE_SLACK_MS, so sounds keep the spacing of
+ * the times they're given. The audio callback keeps the clock in step with pal_get_time.
+ * With audio_start_offline, game time is the time rendered. Fixed point times have steps of
+ * 1 / PAL_FIXED_ONE seconds, so calls can land a sample off.
+ * NOTE: fixed point game times only reach INT32_MAX / PAL_FIXED_ONE seconds, about 9.1 hours in
+ * Q16.16. Later times wrap negative and are applied at the next block, so the backend's
+ * pal_get_time has to count from startup and games running longer need floating point
+ *
+ * @param game_time time from pal_get_time
+ * @return uint64_t AUDIO_TIME_NOW before the first audio callback
+ */
+uint64_t audio_time_to_sample_num(pal_float_t game_time);
+
+#ifdef AUDIO_ENABLE_STATS
+/**
+ * @brief Audio load and glitch counters, for budgeting polyphony on the device.
+ * Load is synthesis time over the real time of the samples synthesized in per mille, above 1000
+ * the audio can't keep up. Peaks are since audio_reset_stats, counters since audio_start
+ *
+ */
+struct audio_stats {
+    uint32_t load_permille;         // averaged over AUDIO_STATS_WINDOW_MS
+    uint32_t peak_load_permille;    // highest load of a single render
+    uint32_t render_us;             // time the last render took
+    uint32_t budget_us;             // real time of the samples the last render produced
+    uint32_t active_voices;         // oscillator, sample and drum voices
+    uint32_t peak_voices;
+    uint32_t active_filters;        // filters of playing oscillators and buses
+    uint32_t active_effects;        // effects of playing oscillators
+    // renders that took longer than their budget. Glitches when synthesizing in the audio
+    // callback, the render thread rides them out while it's ahead
+    uint32_t overruns;
+    uint32_t underruns;             // same as audio_get_underrun_count
+    // audio callbacks that came over two buffers after the previous one, the device or the
+    // scheduler stalled
+    uint32_t late_callbacks;
+};
+
+/**
+ * @brief Gets the latest audio stats, safe to call from any thread
+ *
+ * @param stats
+ */
+void audio_get_stats(struct audio_stats *stats);
+
+/**
+ * @brief Clears the peak load and peak voices, at the next render
+ *
+ */
+void audio_reset_stats();
+#endif
+
+#ifdef AUDIO_ENABLE_PROFILING
+enum audio_profile_stage {
+    AUDIO_PROFILE_EVENTS,       // audio commands and midi events
+    AUDIO_PROFILE_SAMPLERS,     // wave sample and drum voices
+    AUDIO_PROFILE_OSCILLATORS,  // voices, effects and oscillator filters
+    AUDIO_PROFILE_MIX,          // bus gains and bus filters
+    AUDIO_PROFILE_OUTPUT,       // master limiter and conversion to output samples
+    AUDIO_PROFILE_NUM_STAGES
+};
+
+struct audio_profile {
+    uint64_t stage_ns[AUDIO_PROFILE_NUM_STAGES];
+    uint64_t num_samples;
+    int peak_voices;            // most oscillator, sample and drum voices playing in one block
+    uint64_t clipped_samples;   // samples the limiter left over full scale, cut by the output clamp
+};
+
+/**
+ * @brief Gets the time spent in each stage since audio_reset_profile
+ * NOTE: not synchronized with the audio thread, call it between audio_render_offline calls
+ *
+ * @param profile
+ */
+void audio_get_profile(struct audio_profile *profile);
+
+/**
+ * @brief Clears the stage times and peak voices
+ *
+ */
+void audio_reset_profile();
+#endif
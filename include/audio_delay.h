@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "audio.h"
+#include "pal.h"
+
+// samples of delay memory shared by every delay and reverb, 2 bytes each, can be overridden in the CMakeLists.txt
+#ifndef AUDIO_DELAY_POOL_SAMPLES
+#define AUDIO_DELAY_POOL_SAMPLES (32768)
+#endif
+#define AUDIO_REVERB_NUM_COMBS 4
+#define AUDIO_REVERB_NUM_ALLPASSES 2
+
+/**
+ * @brief Circular buffer of 16 bit samples from the delay pool, a sample read at position is
+ * replaced by the one delayed next, length samples later
+ *
+ */
+struct audio_delay_line {
+    int16_t *buffer;
+    uint32_t length;
+    uint32_t position;
+};
+
+/**
+ * @brief Echo that repeats its input every delay time, fading by the feedback each time. Add it to
+ * a chain through node with oscillator_add_filter, audio_bus_add_filter or audio_add_filter
+ *
+ */
+struct audio_delay {
+    struct filter_node node;    // first so the node can be cast back to the delay
+    // one line per channel, only the first is used outside stereo bus chains
+    struct audio_delay_line lines[PAL_AUDIO_CHANNELS];
+    // gains with 15 fractional bits, set by the game side and read by the audio thread every block
+    atomic_int feedback;
+    atomic_int mix;
+};
+
+/**
+ * @brief Freeverb style room reverb, parallel combs with damped feedback into series allpasses.
+ * Add it to a chain through node like the delay
+ *
+ */
+struct audio_reverb {
+    struct filter_node node;    // first so the node can be cast back to the reverb
+    // only the first channel is used outside stereo bus chains, the right one is a few samples
+    // longer so the channels don't sound the same
+    struct audio_reverb_channel {
+        struct audio_delay_line combs[AUDIO_REVERB_NUM_COMBS];
+        int32_t comb_lowpass[AUDIO_REVERB_NUM_COMBS];  // damping filter state of each comb
+        struct audio_delay_line allpasses[AUDIO_REVERB_NUM_ALLPASSES];
+    } channels[PAL_AUDIO_CHANNELS];
+    // gains with 15 fractional bits, set by the game side and read by the audio thread every block
+    atomic_int feedback;
+    atomic_int damping;
+    atomic_int mix;
+};
+
+/**
+ * @brief Initializes delay, taking time_ms of every channel from the delay pool. Call before
+ * adding it to a filter chain
+ * NOTE: call this from the game side, pool memory is never given back
+ *
+ * @param delay
+ * @param time_ms time between the echoes, fixed for the delay
+ * @param feedback 0 to 0.95, level of each echo relative to the last one
+ * @param mix 0 (dry) to 1 (only echoes)
+ * @return true if delay was initialized
+ * @return false if the delay pool is too small
+ */
+bool audio_delay_init(struct audio_delay *delay, uint32_t time_ms, pal_float_t feedback, pal_float_t mix);
+
+/**
+ * @brief Changes feedback and mix of delay, picked up at the next block
+ *
+ * @param delay
+ * @param feedback
+ * @param mix
+ */
+void audio_delay_set(struct audio_delay *delay, pal_float_t feedback, pal_float_t mix);
+
+/**
+ * @brief Initializes reverb, taking its lines from the delay pool. Call before adding it to a
+ * filter chain. A full size reverb takes about 6300 samples per channel at 44.1 kHz
+ * NOTE: call this from the game side, pool memory is never given back
+ *
+ * @param reverb
+ * @param size 0.1 to 1, scales the line lengths and memory, small rooms sound more metallic
+ * @param decay 0 to 1, length of the tail
+ * @param damping 0 to 1, how much faster the highs fade than the lows
+ * @param mix 0 (dry) to 1 (only reverb)
+ * @return true if reverb was initialized
+ * @return false if the delay pool is too small
+ */
+bool audio_reverb_init(struct audio_reverb *reverb, pal_float_t size, pal_float_t decay, pal_float_t damping, pal_float_t mix);
+
+/**
+ * @brief Changes decay, damping and mix of reverb, picked up at the next block
+ *
+ * @param reverb
+ * @param decay
+ * @param damping
+ * @param mix
+ */
+void audio_reverb_set(struct audio_reverb *reverb, pal_float_t decay, pal_float_t damping, pal_float_t mix);
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "audio.h"
+
+/**
+ * @brief Synthesized percussion sound, a pitched sine body and filtered noise with exponential
+ * decays. A few bytes instead of a PCM sample, play it on the midi drum channel with a drum kit
+ * Levels of the body and the noise should add up to 255 at most so a hit doesn't clip
+ *
+ */
+struct drum_patch {
+    uint16_t tone_start_hz;     // pitch of the body when hit
+    uint16_t tone_end_hz;       // pitch the body drops to
+    uint16_t tone_sweep_ms;     // time constant of the pitch drop
+    uint16_t tone_decay_ms;     // time for the body to fade by 60 dB
+    uint16_t noise_decay_ms;    // time for the noise to fade by 60 dB
+    uint8_t tone_level;         // 0 to 255
+    uint8_t noise_level;        // 0 to 255
+    // one pole filters on the white noise, coefficient / 256. A lowpass of 255 leaves the noise
+    // white, a highpass of 0 is off and higher values cut more of the low end
+    uint8_t noise_lowpass;
+    uint8_t noise_highpass;
+    uint8_t choke_group;        // a hit fades the playing voices in the same group, 0 for none
+};
+
+/**
+ * @brief Drum patches of the midi drum notes
+ *
+ */
+struct drum_kit {
+    const struct drum_patch *patches;
+    uint8_t note_patches[NUM_DRUM_NOTES];   // index + 1 into patches, 0 if the note has no patch
+};
+
+/**
+ * @brief Drum voice playing a patch, owned by the audio thread
+ *
+ */
+struct drum_voice {
+    const struct drum_patch *patch;
+    uint32_t phase;                 // of the body, a cycle is 2^32
+    uint32_t end_increment;
+    int32_t sweep_increment;        // added to end_increment at the start of the pitch drop
+    uint32_t noise;                 // LFSR state
+    int32_t noise_lowpass;
+    int32_t noise_highpass;
+    // envelopes and their factor per sample, 30 fractional bits
+    int32_t tone_env, tone_decay;
+    int32_t noise_env, noise_decay;
+    int32_t sweep_env, sweep_decay;
+    int32_t amplitude;
+    audio_bus_t bus;
+    struct audio_pan pan;
+};
+
+/**
+ * @brief General MIDI percussion kit, the default kit of midi players
+ *
+ */
+extern const struct drum_kit drum_kit_gm;
+
+/**
+ * @brief Starts voice on patch
+ *
+ * @param voice
+ * @param patch
+ * @param amplitude 0 to OSC_AMPLITUDE
+ */
+void drum_voice_start(struct drum_voice *voice, const struct drum_patch *patch, uint16_t amplitude);
+
+/**
+ * @brief Fades voice out over a few milliseconds, for choke groups and stolen voices
+ *
+ * @param voice
+ */
+void drum_voice_choke(struct drum_voice *voice);
+
+/**
+ * @brief Level of voice for picking one to steal, the louder of its envelopes
+ *
+ * @param voice
+ * @return int32_t
+ */
+int32_t drum_voice_level(const struct drum_voice *voice);
+
+/**
+ * @brief Renders block of voice and adds it to samples
+ *
+ * @param voice
+ * @param samples
+ * @param num_samples
+ * @return true if voice is still playing
+ * @return false if it has faded out
+ */
+bool drum_voice_render(struct drum_voice *voice, int32_t *samples, int num_samples);
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "audio.h"
+#include "pal.h"
+
+// fractional bits of the filter coefficients, coefficients are between -16 and 16
+#define AUDIO_FILTER_COEF_FRAC_BITS 27
+
+enum audio_filter_type {
+    AUDIO_FILTER_LOWPASS,
+    AUDIO_FILTER_HIGHPASS,
+    AUDIO_FILTER_BANDPASS,      // 0 dB at the center frequency
+    AUDIO_FILTER_NOTCH,
+    AUDIO_FILTER_LOW_SHELF,
+    AUDIO_FILTER_HIGH_SHELF,
+    AUDIO_FILTER_ONE_POLE,      // one pole lowpass, smooths control signals or darkens a bus cheaply
+    AUDIO_FILTER_DC_BLOCKER     // one pole highpass, removes offset with a low cutoff
+};
+
+enum audio_filter_coef {
+    AUDIO_FILTER_B0,
+    AUDIO_FILTER_B1,
+    AUDIO_FILTER_B2,
+    AUDIO_FILTER_A1,
+    AUDIO_FILTER_A2,
+    AUDIO_FILTER_NUM_COEFS
+};
+
+/**
+ * @brief Fixed point filter processed a block at a time, add it to a chain through node with
+ * oscillator_add_filter, audio_bus_add_filter or audio_add_filter
+ * Biquads are direct form 1 with error feedback, so low cutoffs don't drift or go silent
+ *
+ */
+struct audio_filter {
+    struct filter_node node;    // first so the node can be cast back to the filter
+    enum audio_filter_type type;
+    int32_t coefs[AUDIO_FILTER_NUM_COEFS];
+    // coefficients glide to target_coefs by coef_steps every sample for ramp_samples_left samples
+    int32_t target_coefs[AUDIO_FILTER_NUM_COEFS];
+    int32_t coef_steps[AUDIO_FILTER_NUM_COEFS];
+    uint16_t ramp_samples_left;
+    // history of each channel, only the first is used outside stereo bus chains
+    struct audio_filter_state {
+        int32_t x1, x2, y1, y2;
+        int32_t error;          // fraction dropped from the last output, added to the next one
+    } state[PAL_AUDIO_CHANNELS];
+    // coefficients set with audio_filter_set, picked up by the audio thread at the next block.
+    // The sequence is odd while they are written, like the published sample number
+    atomic_int pending_coefs[AUDIO_FILTER_NUM_COEFS];
+    atomic_uint pending_sequence;
+    unsigned int applied_sequence;
+};
+
+/**
+ * @brief Initializes filter, call before adding it to a filter chain
+ *
+ * @param filter
+ * @param type
+ * @param frequency cutoff, center or shelf frequency in Hz
+ * @param q resonance of the biquads, 0.1 to 64, 0.707 is flat. Unused by the one pole filters
+ * @param gain_db gain of the shelf filters, -18 to 18. Unused by the other filters
+ */
+void audio_filter_init(struct audio_filter *filter, enum audio_filter_type type, pal_float_t frequency, pal_float_t q, pal_float_t gain_db);
+
+/**
+ * @brief Changes parameters of filter, the coefficients glide to the new ones over
+ * AUDIO_CONTROL_PERIOD samples so sweeps don't click
+ * NOTE: call from one thread only, either the game side or effect nodes on the audio thread
+ *
+ * @param filter
+ * @param frequency
+ * @param q
+ * @param gain_db
+ */
+void audio_filter_set(struct audio_filter *filter, pal_float_t frequency, pal_float_t q, pal_float_t gain_db);
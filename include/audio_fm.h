@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "audio.h"
+
+// operator frequency ratios have 8 fractional bits
+#define FM_RATIO(r) ((uint16_t) ((r) * 256))
+#define FM_NUM_PROGRAMS (128)
+
+/**
+ * @brief How the operators of a patch modulate each other, operator 0 is the first
+ *
+ */
+enum fm_algorithm {
+    FM_ALGORITHM_STACK,     // each operator modulates the next one, the last one is heard
+    FM_ALGORITHM_PAIRS,     // even operators modulate the odd one after them, the odd ones are heard
+    FM_ALGORITHM_BRANCH,    // every other operator modulates the last one, which is heard
+    FM_ALGORITHM_PARALLEL   // no modulation, every operator is heard, an additive organ
+};
+
+/**
+ * @brief Sine operator of an FM patch, carriers are heard and modulators bend the phase of the
+ * operator they modulate. Envelope times are the time to change by 60 dB, the attack is linear
+ *
+ */
+struct fm_operator {
+    uint16_t ratio;         // frequency as a multiple of the note, FM_RATIO(1) plays the note
+    uint16_t attack_ms;     // time to rise to full level
+    uint16_t decay_ms;      // time constant of the fall to sustain
+    uint16_t release_ms;    // time constant of the fall to silence after the note is released
+    uint8_t sustain;        // 0 to 255, 0 ends the operator after its decay
+    // 0 to 255, the output level of carriers. For modulators 255 bends the phase of the modulated
+    // operator by up to two cycles
+    uint8_t level;
+    uint8_t feedback;       // self modulation, 0 for none to 7 for up to half a cycle
+};
+
+/**
+ * @brief Instrument of 2 to FM_MAX_OPERATORS sine operators. Levels of the carriers should add up
+ * to 255 at most so a voice doesn't clip
+ *
+ */
+struct fm_patch {
+    uint8_t algorithm;      // enum fm_algorithm
+    uint8_t num_operators;
+    struct fm_operator operators[FM_MAX_OPERATORS];
+};
+
+/**
+ * @brief FM patches of the midi programs
+ *
+ */
+struct fm_bank {
+    const struct fm_patch *patches;
+    uint8_t program_patches[FM_NUM_PROGRAMS];   // index + 1 into patches, 0 if the program has no patch
+};
+
+/**
+ * @brief Two operator patches of the general midi instrument families, sound effects are left
+ * to the channel's wavetable
+ *
+ */
+extern const struct fm_bank fm_bank_gm;
+
+/**
+ * @brief Gets the sine table of the operators, generating it on first use
+ * NOTE: call this from the game side, oscillator_set_fm_patch and midi_player_set_fm_bank call it
+ *
+ * @return true if the table is ready
+ * @return false if the wavetable pool is full
+ */
+bool fm_init();
+
+/**
+ * @brief Starts voice on patch, every operator from its attack at phase 0
+ *
+ * @param voice
+ * @param patch
+ */
+void fm_voice_start(struct fm_voice *voice, const struct fm_patch *patch);
+
+/**
+ * @brief Runs control point of voice, advances the operator envelopes and sets up their gain
+ * ramps to the next control point
+ *
+ * @param voice
+ * @param released whether the note has been released, the operators go to their release
+ * @param num_samples samples until the next control point
+ * @return true if a carrier is still playing
+ * @return false if every carrier has faded out
+ */
+bool fm_voice_control_tick(struct fm_voice *voice, bool released, int num_samples);
+
+/**
+ * @brief Renders block of voice into samples, overwriting them
+ *
+ * @param voice
+ * @param samples
+ * @param t_increment oscillator time step of the note, scaled by the operator ratios
+ * @param num_samples no more than the samples until the next control point
+ */
+void fm_voice_render(struct fm_voice *voice, int32_t *samples, uint32_t t_increment, int num_samples);
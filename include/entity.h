@@ -50,12 +50,18 @@ enum entity_state {
     ENTITY_STATE_CLICKED,
     ENTITY_STATE_SPRITE_LOOP_ENDED,
     ENTITY_STATE_SHOULD_BE_REMOVED,
+    ENTITY_STATE_CULLED,
+    ENTITY_STATE_ADDED,     // in the game's entity list, only then is the body awake
 
     NUM_ENTITY_STATES
 };
 
 typedef uint8_t entity_event_id_t;
 
+// gets entity from pointer to its phys_data, e.g. from scene query results. NULL if the body
+// doesn't belong to an entity added to the game
+#define entity_from_phys(phys_ptr) ((struct entity *) (phys_ptr)->user_data)
+
 _Static_assert(NUM_ENTITY_EVENTS < 256, "Too many entity events! Increase the size of entity_event_id_t or decrease number of events!");
 _Static_assert(NUM_ENTITY_STATES < 32, "Too many entity states! Increase the size of _state_flags or decrease number of states!");
 
@@ -86,12 +92,16 @@ struct entity {
 };
 
 /**
- * @brief Initializes entity with given mass. This function adds the entity to the list and
+ * @brief Initializes entity with given mass and a physics body, which is integrated once the
+ * entity is added with game_entity_add. Initializing an entity again replaces its body instead of
+ * taking another one
  *
  * @param entity pointer to entity
  * @param mass mass
+ * @return true if the entity got a physics body
+ * @return false if the body store is full, the entity then doesn't do physics
  */
-void entity_init(struct entity *entity, pal_float_t mass);
+bool entity_init(struct entity *entity, pal_float_t mass);
 
 /**
  * @brief Scales entity's bounds by given factor
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "pal.h"
+
+/*
+ * Accuracy tiers, pick one by defining FAST_MATH_ACCURACY in the CMakeLists.txt
+ *  LOW:   cheapest polynomials, sin/cos ~3e-4, atan2 ~1.5e-3 rad, rsqrt ~2e-3 relative error
+ *  HIGH:  minimax polynomials at about single precision (~1e-7)
+ *  EXACT: calls the pal_ math functions
+ * The tiers only apply to the floating point modes, in fixed point mode every tier uses the
+ * engine's fixed point implementations.
+ */
+#define FAST_MATH_ACCURACY_LOW   0
+#define FAST_MATH_ACCURACY_HIGH  1
+#define FAST_MATH_ACCURACY_EXACT 2
+
+#ifndef FAST_MATH_ACCURACY
+#define FAST_MATH_ACCURACY FAST_MATH_ACCURACY_HIGH
+#endif
+
+/**
+ * @brief Approximate sine
+ *
+ * @param a angle in radians
+ * @return pal_float_t
+ */
+pal_float_t fast_sin(pal_float_t a);
+
+/**
+ * @brief Approximate cosine
+ *
+ * @param a angle in radians
+ * @return pal_float_t
+ */
+pal_float_t fast_cos(pal_float_t a);
+
+/**
+ * @brief Approximate sine and cosine of the same angle, sharing the range reduction
+ *
+ * @param a angle in radians
+ * @param sin_out
+ * @param cos_out
+ */
+void fast_sincos(pal_float_t a, pal_float_t *sin_out, pal_float_t *cos_out);
+
+/**
+ * @brief Approximate arc tangent of y/x using the signs of both to get the quadrant
+ *
+ * @param y
+ * @param x
+ * @return pal_float_t angle in range [-pi, pi], 0 if both are 0
+ */
+pal_float_t fast_atan2(pal_float_t y, pal_float_t x);
+
+/**
+ * @brief Approximate reciprocal square root, 1 / sqrt(a)
+ *
+ * @param a must be positive
+ * @return pal_float_t
+ */
+pal_float_t fast_rsqrt(pal_float_t a);
@@ -27,6 +27,14 @@ void game_loop_run();
  */
 void game_loop_stop();
 
+/**
+ * @brief Gets the time the current frame started, from pal_get_time. Event handlers of the frame
+ * can play sounds at it with wave_sample_play_at, so they keep in step with the frames
+ *
+ * @return pal_float_t
+ */
+pal_float_t game_get_frame_time();
+
 /**
  * @brief Adds entity to game
  *
@@ -1,7 +1,72 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 #include "pal.h"
+#include "fastmath.h"
+
+#define PAL_PI PAL_FLOAT(3.14159265358979323846)
+
+/*
+ * Multiplication and division of two pal_float_t values. Addition, subtraction, comparison and
+ * multiplication/division by an integer can use the normal operators in every numeric mode,
+ * pal_add_sat is for sums that can reach PAL_FLOAT_MAX, like sums of inverse masses.
+ */
+#if defined PAL_USE_FIXED
+#define pal_mul(a, b) pal_fixed_mul(a, b)
+#define pal_div(a, b) pal_fixed_div(a, b)
+#define pal_add_sat(a, b) pal_fixed_add_sat(a, b)
+
+/**
+ * @brief Fixed point addition, saturates on overflow
+ *
+ * @param a
+ * @param b
+ * @return pal_float_t
+ */
+static inline pal_float_t pal_fixed_add_sat(pal_float_t a, pal_float_t b) {
+    int64_t sum = (int64_t) a + b;
+
+    if (sum > INT32_MAX)
+        return INT32_MAX;
+    if (sum < INT32_MIN)
+        return INT32_MIN;
+
+    return (pal_float_t) sum;
+}
+
+/**
+ * @brief Fixed point multiplication, saturates on overflow
+ *
+ * @param a
+ * @param b
+ * @return pal_float_t
+ */
+static inline pal_float_t pal_fixed_mul(pal_float_t a, pal_float_t b) {
+    // round to nearest
+    int64_t product = ((int64_t) a * b + ((int64_t) 1 << (PAL_FIXED_FRAC_BITS - 1))) >> PAL_FIXED_FRAC_BITS;
+
+    if (product > INT32_MAX)
+        return INT32_MAX;
+    if (product < INT32_MIN)
+        return INT32_MIN;
+
+    return (pal_float_t) product;
+}
+
+/**
+ * @brief Fixed point division, saturates on overflow and division by zero
+ *
+ * @param a
+ * @param b
+ * @return pal_float_t
+ */
+pal_float_t pal_fixed_div(pal_float_t a, pal_float_t b);
+#else
+#define pal_mul(a, b) ((a) * (b))
+#define pal_div(a, b) ((a) / (b))
+#define pal_add_sat(a, b) ((a) + (b))
+#endif
 
 /**
  * @brief Absolute value function for integers
@@ -9,7 +74,9 @@
  * @param num
  * @return int
  */
-int pal_abs(int num);
+static inline int pal_abs(int num) {
+    return num > 0 ? num : -num;
+}
 
 /**
  * @brief Absolute value function for floats
@@ -50,7 +117,9 @@ pal_float_t pal_round(pal_float_t num);
  * @param b
  * @return pal_float_t
  */
-pal_float_t pal_fmin(pal_float_t a, pal_float_t b);
+static inline pal_float_t pal_fmin(pal_float_t a, pal_float_t b) {
+    return a < b ? a : b;
+}
 
 /**
  * @brief Maximum of two floats
@@ -59,7 +128,9 @@ pal_float_t pal_fmin(pal_float_t a, pal_float_t b);
  * @param b
  * @return pal_float_t
  */
-pal_float_t pal_fmax(pal_float_t a, pal_float_t b);
+static inline pal_float_t pal_fmax(pal_float_t a, pal_float_t b) {
+    return a > b ? a : b;
+}
 
 /**
  * @brief Minimum of two ints
@@ -68,7 +139,9 @@ pal_float_t pal_fmax(pal_float_t a, pal_float_t b);
  * @param b
  * @return int
  */
-int pal_min(int a, int b);
+static inline int pal_min(int a, int b) {
+    return a < b ? a : b;
+}
 
 /**
  * @brief Maximum of two ints
@@ -77,7 +150,9 @@ int pal_min(int a, int b);
  * @param b
  * @return int
  */
-int pal_max(int a, int b);
+static inline int pal_max(int a, int b) {
+    return a > b ? a : b;
+}
 
 /**
  * @brief Separate a pal_float_t into integral and fractional parts
@@ -96,7 +171,9 @@ pal_float_t pal_modf(pal_float_t num, pal_float_t *integral);
  * @param t
  * @return pal_float_t
  */
-pal_float_t lerp(pal_float_t x1, pal_float_t x2, pal_float_t t);
+static inline pal_float_t lerp(pal_float_t x1, pal_float_t x2, pal_float_t t) {
+    return pal_mul(x1, PAL_FROM_INT(1) - t) + pal_mul(x2, t);
+}
 
 /**
  * @brief Magnitude of vector
@@ -112,7 +189,9 @@ pal_float_t vec2_mag(const struct vec2 *v);
  * @param v
  * @return pal_float_t
  */
-pal_float_t vec2_squared_mag(const struct vec2 *v);
+static inline pal_float_t vec2_squared_mag(const struct vec2 *v) {
+    return pal_mul(v->x, v->x) + pal_mul(v->y, v->y);
+}
 
 /**
  * @brief Direction of vector
@@ -147,7 +226,10 @@ void vec2_set_dir(const struct vec2 *v, pal_float_t dir, struct vec2 *v_out);
  * @param v2
  * @param sum
  */
-void vec2_add(const struct vec2 *v1, const struct vec2 *v2, struct vec2 *sum);
+static inline void vec2_add(const struct vec2 *v1, const struct vec2 *v2, struct vec2 *sum) {
+    sum->x = v1->x + v2->x;
+    sum->y = v1->y + v2->y;
+}
 
 /**
  * @brief Subtracts two vectors
@@ -156,7 +238,10 @@ void vec2_add(const struct vec2 *v1, const struct vec2 *v2, struct vec2 *sum);
  * @param v2
  * @param diff difference of vectors
  */
-void vec2_sub(const struct vec2 *v1, const struct vec2 *v2, struct vec2 *diff);
+static inline void vec2_sub(const struct vec2 *v1, const struct vec2 *v2, struct vec2 *diff) {
+    diff->x = v1->x - v2->x;
+    diff->y = v1->y - v2->y;
+}
 
 /**
  * @brief Linear interpolation between two vectors
@@ -166,7 +251,10 @@ void vec2_sub(const struct vec2 *v1, const struct vec2 *v2, struct vec2 *diff);
  * @param t
  * @param v_out interpolated vector
  */
-void vec2_lerp(const struct vec2 *v1, const struct vec2 *v2, pal_float_t t, struct vec2 *v_out);
+static inline void vec2_lerp(const struct vec2 *v1, const struct vec2 *v2, pal_float_t t, struct vec2 *v_out) {
+    v_out->x = lerp(v1->x, v2->x, t);
+    v_out->y = lerp(v1->y, v2->y, t);
+}
 
 /**
  * @brief Computes the dot product of two vectors
@@ -175,7 +263,9 @@ void vec2_lerp(const struct vec2 *v1, const struct vec2 *v2, pal_float_t t, stru
  * @param v2
  * @return pal_float_t dot product
  */
-pal_float_t vec2_dot(const struct vec2 *v1, const struct vec2 *v2);
+static inline pal_float_t vec2_dot(const struct vec2 *v1, const struct vec2 *v2) {
+    return pal_mul(v1->x, v2->x) + pal_mul(v1->y, v2->y);
+}
 
 /**
  * @brief Computes the 2d cross product between two vectors (z components = 1)
@@ -184,7 +274,9 @@ pal_float_t vec2_dot(const struct vec2 *v1, const struct vec2 *v2);
  * @param v2
  * @return pal_float_t
  */
-pal_float_t vec2_cross(const struct vec2 *v1, const struct vec2 *v2);
+static inline pal_float_t vec2_cross(const struct vec2 *v1, const struct vec2 *v2) {
+    return pal_mul(v1->x, v2->y) - pal_mul(v1->y, v2->x);
+}
 
 /**
  * @brief Perform 2D transformation with matrix m on vector v, returning a new vector
@@ -193,7 +285,13 @@ pal_float_t vec2_cross(const struct vec2 *v1, const struct vec2 *v2);
  * @param m
  * @param v_out transformed vector
  */
-void vec2_transform(const struct vec2 *v, const struct mat2 *m, struct vec2 *v_out);
+static inline void vec2_transform(const struct vec2 *v, const struct mat2 *m, struct vec2 *v_out) {
+    // read both components before writing so v and v_out can alias
+    pal_float_t x = pal_mul(m->a, v->x) + pal_mul(m->b, v->y);
+    pal_float_t y = pal_mul(m->c, v->x) + pal_mul(m->d, v->y);
+    v_out->x = x;
+    v_out->y = y;
+}
 
 /**
  * @brief Rotate vector v by angle, return rotated vector
@@ -211,10 +309,14 @@ void vec2_rotate(const struct vec2 *v, pal_float_t angle, struct vec2 *v_out);
  * @param scale
  * @param v_out transformed vector
  */
-void vec2_scale(const struct vec2 *v, pal_float_t scale, struct vec2 *v_out);
+static inline void vec2_scale(const struct vec2 *v, pal_float_t scale, struct vec2 *v_out) {
+    v_out->x = pal_mul(v->x, scale);
+    v_out->y = pal_mul(v->y, scale);
+}
 
 /**
- * @brief Normalizes vector
+ * @brief Normalizes vector, through fast_rsqrt in the floating point modes so the result is as
+ * close to unit length as the FAST_MATH_ACCURACY tier allows
  *
  * @param v
  * @param v_out
@@ -227,7 +329,9 @@ void vec2_normalize(const struct vec2 *v, struct vec2 *v_out);
  * @param m
  * @return pal_float_t
  */
-pal_float_t mat2_det(const struct mat2 *m);
+static inline pal_float_t mat2_det(const struct mat2 *m) {
+    return pal_mul(m->a, m->d) - pal_mul(m->b, m->c);
+}
 
 /**
  * @brief Multiplies 2 matrices together
@@ -236,7 +340,100 @@ pal_float_t mat2_det(const struct mat2 *m);
  * @param m2
  * @param product
  */
-void mat2_multiply(const struct mat2 *m1, const struct mat2 *m2, struct mat2 *product);
+static inline void mat2_multiply(const struct mat2 *m1, const struct mat2 *m2, struct mat2 *product) {
+    // computed into a temporary so product can alias either input
+    struct mat2 m = {
+        .a = pal_mul(m1->a, m2->a) + pal_mul(m1->b, m2->c),
+        .b = pal_mul(m1->a, m2->b) + pal_mul(m1->b, m2->d),
+        .c = pal_mul(m1->c, m2->a) + pal_mul(m1->d, m2->c),
+        .d = pal_mul(m1->c, m2->b) + pal_mul(m1->d, m2->d),
+    };
+    *product = m;
+}
+
+/*
+ * Value returning variants of the vector operations above. Taking and returning small structs by
+ * value lets the compiler keep both components in registers in tight loops.
+ */
+
+/**
+ * @brief Adds two vectors
+ *
+ * @param v1
+ * @param v2
+ * @return struct vec2 sum
+ */
+static inline struct vec2 vec2_add_val(struct vec2 v1, struct vec2 v2) {
+    return (struct vec2) { v1.x + v2.x, v1.y + v2.y };
+}
+
+/**
+ * @brief Subtracts two vectors
+ *
+ * @param v1
+ * @param v2
+ * @return struct vec2 difference of vectors
+ */
+static inline struct vec2 vec2_sub_val(struct vec2 v1, struct vec2 v2) {
+    return (struct vec2) { v1.x - v2.x, v1.y - v2.y };
+}
+
+/**
+ * @brief Scales vector v by scale
+ *
+ * @param v
+ * @param scale
+ * @return struct vec2 scaled vector
+ */
+static inline struct vec2 vec2_scale_val(struct vec2 v, pal_float_t scale) {
+    return (struct vec2) { pal_mul(v.x, scale), pal_mul(v.y, scale) };
+}
+
+/**
+ * @brief Computes the dot product of two vectors
+ *
+ * @param v1
+ * @param v2
+ * @return pal_float_t dot product
+ */
+static inline pal_float_t vec2_dot_val(struct vec2 v1, struct vec2 v2) {
+    return pal_mul(v1.x, v2.x) + pal_mul(v1.y, v2.y);
+}
+
+/**
+ * @brief Computes the 2d cross product between two vectors
+ *
+ * @param v1
+ * @param v2
+ * @return pal_float_t
+ */
+static inline pal_float_t vec2_cross_val(struct vec2 v1, struct vec2 v2) {
+    return pal_mul(v1.x, v2.y) - pal_mul(v1.y, v2.x);
+}
+
+/**
+ * @brief Perform 2D transformation with matrix m on vector v
+ *
+ * @param v
+ * @param m
+ * @return struct vec2 transformed vector
+ */
+static inline struct vec2 vec2_transform_val(struct vec2 v, const struct mat2 *m) {
+    return (struct vec2) { pal_mul(m->a, v.x) + pal_mul(m->b, v.y), pal_mul(m->c, v.x) + pal_mul(m->d, v.y) };
+}
+
+/**
+ * @brief Multiplies 2 matrices together
+ *
+ * @param m1
+ * @param m2
+ * @return struct mat2 product
+ */
+static inline struct mat2 mat2_multiply_val(const struct mat2 *m1, const struct mat2 *m2) {
+    struct mat2 product;
+    mat2_multiply(m1, m2, &product);
+    return product;
+}
 
 /**
  * @brief Computes the inverse of given matrix m
@@ -8,6 +8,20 @@
 #define MIDI_NUM_CHANNELS 16
 #define MIDI_DRUM_CHANNEL 9
 
+#ifndef MIDI_MAX_HELD_NOTES
+// maximum number of notes a checkpoint remembers as held, can be overridden in the CMakeLists.txt
+#define MIDI_MAX_HELD_NOTES 32
+#endif
+
+// playback rate is 16.16 fixed point
+#define MIDI_PLAYBACK_RATE_FRAC_BITS 16
+#define MIDI_PLAYBACK_RATE_ONE (1 << MIDI_PLAYBACK_RATE_FRAC_BITS)
+// highest playback rate, keeps the scaled parser time from overflowing
+#define MIDI_PLAYBACK_RATE_MAX (16 * MIDI_PLAYBACK_RATE_ONE)
+
+// song position of the end of the song
+#define MIDI_POSITION_END UINT64_MAX
+
 struct midi_chunk_header {
     char type[4];
     // length field is big endian (_be)
@@ -86,7 +100,8 @@ union status_byte {
 
 struct track {
     uint8_t *pointer;
-    int64_t timer; // nanosecond down counter until next event
+    uint64_t event_tick; // tick the next event is due at
+    int64_t time_offset; // parser time added to the track's events
     bool ended;
     union status_byte previous_status;
     uint8_t channel_prefix;
@@ -118,11 +133,74 @@ struct midi_event {
     } meta;
 };
 
+// status of a midi_stream_event that does nothing, used when the time to the next event doesn't fit in delta_samples
+#define MIDI_STREAM_STATUS_WAIT (0)
+
+/**
+ * @brief Event of a merged midi stream
+ *
+ */
+struct midi_stream_event {
+    uint16_t delta_samples; // output samples after the previous event
+    uint8_t status;         // midi status byte with channel, or MIDI_STREAM_STATUS_WAIT
+    uint8_t data[2];
+};
+
+/**
+ * @brief Every track of a midi file merged into one time sorted list of the events the player uses,
+ * with times already converted to output samples through the tempo map
+ * Generated by util/midi_to_c.py for the build's sample rate, or built at runtime with midi_stream_init
+ *
+ */
+struct midi_stream {
+    const struct midi_stream_event *events;
+    uint32_t num_events;
+    // song position of every beat (quarter note, or frame for SMPTE files) up to the last event
+    // of the file, for seeking by beat
+    const uint32_t *beat_positions;
+    uint32_t num_beats;
+    uint64_t length;    // song position where the last track ends
+    // from "loopStart" and "loopEnd" marker meta events, 0 and MIDI_POSITION_END if missing
+    uint64_t loop_start;
+    uint64_t loop_end;
+};
+
+/**
+ * @brief Notes that are on at a song position, so they can be started again after seeking there
+ * Drum channel notes are one shots and aren't kept
+ *
+ */
+struct midi_held_notes {
+    uint8_t num_notes;
+    struct {
+        uint8_t channel;
+        uint8_t note;
+        uint8_t velocity;
+    } notes[MIDI_MAX_HELD_NOTES];
+};
+
 struct midi_parser {
     bool loop; // whether or not to loop midi playback when end is reached
+    // song positions (output samples at playback rate 1) of the loop, playback jumps back to
+    // loop_start when loop_end or the end of the song is reached
+    uint64_t loop_start;
+    uint64_t loop_end;
     uint16_t num_tracks;
     uint32_t tempo_us_per_quarter_note;
-    uint32_t ns_per_tick;
+    // time is counted in units that make both a tick and an output sample a whole number of units,
+    // so playback doesn't drift from rounding
+    uint64_t time_per_tick;
+    uint64_t time_per_sample;
+    int64_t time;
+    int64_t next_event_time; // time of the earliest event of the tracks that haven't ended
+    // output samples advance time by time_per_sample scaled by the rate, the fraction of a time
+    // unit left over is carried so a changed rate doesn't drift
+    uint32_t playback_rate;
+    uint32_t time_remainder;
+    // tick and time of the last tempo change, ticks are converted to time from here so a tempo
+    // change affects the events of every track after it
+    uint64_t tempo_tick;
+    int64_t tempo_time;
     union {
         struct {
             uint16_t ticks_per_frame : 8;
@@ -143,6 +221,36 @@ struct midi_parser {
     struct track tracks[MIDI_MAX_TRACKS];
 };
 
+/**
+ * @brief Parser state at a song position, restored to seek without parsing from the start
+ *
+ */
+struct midi_checkpoint {
+    uint64_t position; // song position in output samples
+    uint32_t tempo_us_per_quarter_note;
+    uint64_t time_per_tick;
+    uint64_t tempo_tick;
+    int64_t tempo_time;
+    struct track tracks[MIDI_MAX_TRACKS];
+    struct midi_held_notes held_notes;
+};
+
+/**
+ * @brief Checkpoints of a midi file, built once at load time with midi_index_init
+ * Seeking restores the last checkpoint before the position and parses on from there
+ *
+ */
+struct midi_index {
+    const struct midi_checkpoint *checkpoints;
+    uint32_t num_checkpoints;
+    uint32_t ticks_per_beat;   // ticks per quarter note, or ticks per frame for SMPTE files
+    uint64_t time_per_sample;
+    uint64_t length;           // song position where the last track ends
+    // from "loopStart" and "loopEnd" marker meta events, 0 and MIDI_POSITION_END if missing
+    uint64_t loop_start;
+    uint64_t loop_end;
+};
+
 /**
  * @brief Initializes midi parser
  *
@@ -161,14 +269,51 @@ bool midi_parser_init(struct midi_parser *parser, void *buffer);
 void midi_parser_restart(struct midi_parser *parser);
 
 /**
- * @brief Advances parser by given time delta in nanoseconds
+ * @brief Moves playback of midi parser to song position, the events before it are parsed without
+ * being returned
  *
  * @param parser
- * @param delta_time_ns
+ * @param index checkpoints of the parser's midi file, or NULL to parse from the start
+ * @param position song position in output samples
+ * @param held_notes set to the notes that are on at position
+ */
+void midi_parser_seek(struct midi_parser *parser, const struct midi_index *index, uint64_t position, struct midi_held_notes *held_notes);
+
+/**
+ * @brief Sets playback rate of midi parser, takes effect from the next advance
+ *
+ * @param parser
+ * @param playback_rate 16.16 fixed point, clamped to MIDI_PLAYBACK_RATE_MAX
+ */
+void midi_parser_set_playback_rate(struct midi_parser *parser, uint32_t playback_rate);
+
+/**
+ * @brief Gets the number of output samples until playback needs to jump back to the loop start
+ *
+ * @param parser
+ * @return uint32_t 0 if the loop end or the end of the song is reached, UINT32_MAX if not looping
+ */
+uint32_t midi_parser_samples_until_loop_end(struct midi_parser *parser);
+
+/**
+ * @brief Advances parser by given number of output samples
+ * NOTE: don't advance past the next event, see midi_parser_samples_until_next_event
+ *
+ * @param parser
+ * @param num_samples
  * @return true event needs to be read
  * @return false no events pending
  */
-bool midi_parser_advance(struct midi_parser *parser, uint32_t delta_time_ns);
+bool midi_parser_advance(struct midi_parser *parser, uint32_t num_samples);
+
+/**
+ * @brief Gets the number of output samples until the next event is due on any track, reading
+ * the delta time of tracks whose last event was just read
+ *
+ * @param parser
+ * @return uint32_t 0 if events need to be read, UINT32_MAX if all tracks have ended
+ */
+uint32_t midi_parser_samples_until_next_event(struct midi_parser *parser);
 
 /**
  * @brief Gets pending event from parser
@@ -204,3 +349,71 @@ bool midi_parser_ended(struct midi_parser *parser);
  * @param initial_value initial time offset in seconds
  */
 void midi_parser_set_track_offset(struct midi_parser *parser, int track_num, pal_float_t initial_value);
+
+/**
+ * @brief Builds merged event stream from midi file, the runtime equivalent of util/midi_to_c.py
+ * Only note on, note off, control change and program change events are kept
+ *
+ * @param stream
+ * @param events buffer for the stream's events
+ * @param max_events size of events
+ * @param beat_positions buffer for the song position of every beat, NULL if the stream doesn't need
+ * to seek by beat
+ * @param max_beats size of beat_positions
+ * @param buffer pointer to midi file contents
+ * @return true if stream was built
+ * @return false if the midi file is invalid or its events or beats don't fit
+ */
+bool midi_stream_init(struct midi_stream *stream, struct midi_stream_event *events, uint32_t max_events, uint32_t *beat_positions, uint32_t max_beats, void *buffer);
+
+/**
+ * @brief Converts stream event to the midi event it plays
+ *
+ * @param stream_event
+ * @param event
+ */
+void midi_stream_read_event(const struct midi_stream_event *stream_event, struct midi_event *event);
+
+/**
+ * @brief Finds where playback of stream continues from song position, scanning the events from
+ * the start. The events at position are the first ones left to play
+ *
+ * @param stream
+ * @param position song position in output samples
+ * @param event_index set to the index of the first event left to play
+ * @param event_position set to the song position of that event
+ * @param held_notes set to the notes that are on at position
+ */
+void midi_stream_seek(const struct midi_stream *stream, uint64_t position, uint32_t *event_index, uint64_t *event_position, struct midi_held_notes *held_notes);
+
+/**
+ * @brief Gets song position of a beat of stream, the end of the stream for beats after its last one
+ *
+ * @param stream
+ * @param beat
+ * @return uint64_t song position in output samples
+ */
+uint64_t midi_stream_beat_position(const struct midi_stream *stream, uint32_t beat);
+
+/**
+ * @brief Builds checkpoint index of midi file for seeking and reads its loop markers
+ * Checkpoints are made every beats_per_checkpoint beats and after every tempo change
+ *
+ * @param index
+ * @param checkpoints buffer for the index's checkpoints
+ * @param max_checkpoints size of checkpoints
+ * @param beats_per_checkpoint
+ * @param buffer pointer to midi file contents, the same one the indexed parser plays
+ * @return true if index was built
+ * @return false if the midi file is invalid or its checkpoints don't fit in max_checkpoints
+ */
+bool midi_index_init(struct midi_index *index, struct midi_checkpoint *checkpoints, uint32_t max_checkpoints, uint32_t beats_per_checkpoint, void *buffer);
+
+/**
+ * @brief Gets song position of a beat through the tempo map of index
+ *
+ * @param index
+ * @param beat
+ * @return uint64_t song position in output samples
+ */
+uint64_t midi_index_beat_position(const struct midi_index *index, uint32_t beat);
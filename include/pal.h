@@ -17,11 +17,33 @@
 #include <stdbool.h>
 
 // Set this flag in the CMakeLists.txt file depending on the desired platform precision
+#if defined PAL_USE_FIXED
+// Signed fixed point, PAL_FIXED_FRAC_BITS fractional bits (Q16.16 by default)
+typedef int32_t pal_float_t;
+#ifndef PAL_FIXED_FRAC_BITS
+#define PAL_FIXED_FRAC_BITS 16
+#endif
+#define PAL_FIXED_ONE ((int32_t) 1 << PAL_FIXED_FRAC_BITS)
+#define PAL_FLOAT_MAX INT32_MAX
+// Converts real constant to pal_float_t (only use with constants, otherwise it pulls in soft float)
+#define PAL_FLOAT(x) ((pal_float_t) ((x) * PAL_FIXED_ONE))
+#define PAL_FROM_INT(i) ((pal_float_t) ((int32_t) (i) * PAL_FIXED_ONE))
+// Truncates towards zero like a cast
+#define PAL_TO_INT(x) ((int) ((x) / PAL_FIXED_ONE))
+#define PAL_TO_DOUBLE(x) ((double) (x) / PAL_FIXED_ONE)
+#else
+#include <math.h>
 #if defined PAL_USE_FLOAT32
 typedef float pal_float_t;
 #else
 typedef double pal_float_t;
 #endif
+#define PAL_FLOAT_MAX ((pal_float_t) INFINITY)
+#define PAL_FLOAT(x) ((pal_float_t) (x))
+#define PAL_FROM_INT(i) ((pal_float_t) (i))
+#define PAL_TO_INT(x) ((int) (x))
+#define PAL_TO_DOUBLE(x) ((double) (x))
+#endif
 
 #define container_of(ptr, type, member) ({                      \
         const typeof( ((type *)0)->member ) *__mptr = (ptr);    \
@@ -30,10 +52,34 @@ typedef double pal_float_t;
 #define entity_downcast(entity_ptr, subclass_struct) container_of(entity_ptr, subclass_struct, base)
 
 typedef uint16_t screen_dim_t;
+
+// Audio output format, set PAL_AUDIO_CHANNELS (1 or 2) and PAL_AUDIO_FORMAT (U16, S16 or F32)
+// in the CMakeLists.txt to what the backend's audio device takes so it can copy samples as is
+#ifndef PAL_AUDIO_CHANNELS
+#define PAL_AUDIO_CHANNELS 1
+#endif
+#if defined PAL_AUDIO_FORMAT_F32
+// -1 to 1
+typedef float audio_sample_t;
+#define AUDIO_SAMPLE_MAX (1.0f)
+#define AUDIO_SAMPLE_SILENCE (0.0f)
+#elif defined PAL_AUDIO_FORMAT_S16
+typedef int16_t audio_sample_t;
+#define AUDIO_SAMPLE_MAX INT16_MAX
+#define AUDIO_SAMPLE_SILENCE (0)
+#else
+// unsigned, silence is the middle of the range
 typedef uint16_t audio_sample_t;
 #define AUDIO_SAMPLE_MAX ((1 << (sizeof(audio_sample_t) << 3)) - 1)
+#define AUDIO_SAMPLE_SILENCE (AUDIO_SAMPLE_MAX / 2)
+#endif
 
-typedef void (*pal_audio_callback_t)(audio_sample_t *samples, int num_samples);
+/**
+ * @brief Fills samples with num_frames frames of PAL_AUDIO_CHANNELS samples, stereo frames are
+ * interleaved left first
+ *
+ */
+typedef void (*pal_audio_callback_t)(audio_sample_t *samples, int num_frames);
 
 /* Screen stuff */
 // Screen size must be set in pal.c depending on actual/window screen dimensions
@@ -167,12 +213,21 @@ void pal_screen_draw_pixel(int x, int y, struct color c);
 bool pal_poll_event(struct pal_event *event);
 
 /**
- * @brief Get time in seconds (resolution platform dependent)
+ * @brief Get time in seconds since startup (resolution platform dependent). Counting from
+ * startup keeps the time in range of fixed point, Q16.16 holds about 9.1 hours
  *
  * @return pal_float_t
  */
 pal_float_t pal_get_time();
 
+/**
+ * @brief Get monotonic time in nanoseconds (resolution platform dependent), only needed by builds
+ * with AUDIO_ENABLE_STATS or AUDIO_ENABLE_PROFILING for timing the audio rendering
+ *
+ * @return uint64_t
+ */
+uint64_t pal_get_time_ns();
+
 /**
  * @brief Sets audio callback, called when the audio subsystem is ready for samples
  *
@@ -180,6 +235,12 @@ pal_float_t pal_get_time();
  */
 void pal_set_audio_callback(pal_audio_callback_t audio_callback);
 
+/*
+ * Math functions
+ * When PAL_USE_FIXED is set these are implemented by the engine (mathutils.c) and must not be
+ * implemented by the backend.
+ */
+
 /**
  * @brief Sine function
  *
@@ -3,9 +3,24 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include "mathutils.h"
+#include "aabb_tree.h"
 
 #define MAX_POLY_SIDES 10
 
+// maximum number of bodies in the physics body store, can be overridden in the CMakeLists.txt
+#ifndef PHYS_MAX_BODIES
+#define PHYS_MAX_BODIES 256
+#endif
+
+// handle into the physics body store
+typedef uint16_t phys_body_t;
+#define PHYS_BODY_INVALID ((phys_body_t) PHYS_MAX_BODIES)
+
+// distance the scene query tree fattens body AABBs by, bodies moving less than this don't restructure the tree
+#ifndef PHYS_AABB_MARGIN
+#define PHYS_AABB_MARGIN 4.0
+#endif
+
 enum bounds_type {
     BOUNDS_TYPE_CIRCLE,
     BOUNDS_TYPE_POLY,
@@ -25,16 +40,21 @@ struct bounds {
     pal_float_t area;
 };
 
+/**
+ * @brief Physical data of an object
+ *
+ * Position, velocity, force, angle, angular velocity, torque and the inverse mass/moment of inertia
+ * live in the body store (structure of arrays) so they can be integrated in one pass, use the
+ * physics_get_* and physics_set_* accessors to read and write them.
+ *
+ */
 struct phys_data {
-    struct vec2 position;
-    struct vec2 velocity;
-    struct vec2 force;
-    pal_float_t angle;
-    pal_float_t angular_velocity;
-    pal_float_t torque;
+    phys_body_t body; // handle into body store
+    aabb_tree_proxy_t proxy; // leaf in scene query tree, AABB_TREE_NULL_NODE until bounds are set
+    void *user_data; // set by the owner of the body, e.g. the entity added to the game. NULL after physics_init
     pal_float_t elasticity;
-    pal_float_t mass, inv_mass;
-    pal_float_t moment_of_inertia, inv_moment_of_inertia;
+    pal_float_t mass;
+    pal_float_t moment_of_inertia;
     struct bounds bounds;
     struct bounds translated_bounds;
 };
@@ -52,14 +72,164 @@ struct collision_descriptor {
     struct vec2 contact;
 };
 
+/**
+ * @brief Struct describing a raycast or shape cast hit
+ *
+ */
+struct raycast_hit {
+    struct phys_data *phys;
+    pal_float_t distance; // distance along ray
+    struct vec2 point;    // point on surface of phys
+    struct vec2 normal;   // surface normal at point
+};
+
 // void physics_resolve_collision(struct collision_manifold *collision);
 /**
- * @brief Initializes physics data
+ * @brief Initializes physics data, allocating a body in the body store. The body starts asleep.
+ * Initializing physics data that still holds a body releases that body first
  *
  * @param phys
  * @param mass
+ * @return true if a body was allocated
+ * @return false if the body store is full
+ */
+bool physics_init(struct phys_data *phys, pal_float_t mass);
+
+/**
+ * @brief Checks if physics data holds a body from physics_init that hasn't been released
+ *
+ * @param phys
+ * @return true if phys holds a body
+ * @return false if it was never initialized, the body store was full or the body was released
+ */
+bool physics_has_body(const struct phys_data *phys);
+
+/**
+ * @brief Releases physics data's body back to the body store
+ *
+ * @param phys
+ */
+void physics_delete(struct phys_data *phys);
+
+/**
+ * @brief Sets whether phys_data is awake (integrated by physics_integrate_all) or asleep
+ *
+ * @param phys
+ * @param awake
+ */
+void physics_set_awake(struct phys_data *phys, bool awake);
+
+/**
+ * @brief Gets position of phys_data
+ *
+ * @param phys
+ * @param position
+ */
+void physics_get_position(const struct phys_data *phys, struct vec2 *position);
+
+/**
+ * @brief Sets position of phys_data
+ *
+ * @param phys
+ * @param position
+ */
+void physics_set_position(struct phys_data *phys, const struct vec2 *position);
+
+/**
+ * @brief Gets velocity of phys_data
+ *
+ * @param phys
+ * @param velocity
+ */
+void physics_get_velocity(const struct phys_data *phys, struct vec2 *velocity);
+
+/**
+ * @brief Sets velocity of phys_data
+ *
+ * @param phys
+ * @param velocity
+ */
+void physics_set_velocity(struct phys_data *phys, const struct vec2 *velocity);
+
+/**
+ * @brief Gets force acting on phys_data
+ *
+ * @param phys
+ * @param force
+ */
+void physics_get_force(const struct phys_data *phys, struct vec2 *force);
+
+/**
+ * @brief Sets force acting on phys_data
+ *
+ * @param phys
+ * @param force
+ */
+void physics_set_force(struct phys_data *phys, const struct vec2 *force);
+
+/**
+ * @brief Gets angle of phys_data
+ *
+ * @param phys
+ * @return pal_float_t
+ */
+pal_float_t physics_get_angle(const struct phys_data *phys);
+
+/**
+ * @brief Sets angle of phys_data
+ *
+ * @param phys
+ * @param angle
+ */
+void physics_set_angle(struct phys_data *phys, pal_float_t angle);
+
+/**
+ * @brief Gets angular velocity of phys_data
+ *
+ * @param phys
+ * @return pal_float_t
+ */
+pal_float_t physics_get_angular_velocity(const struct phys_data *phys);
+
+/**
+ * @brief Sets angular velocity of phys_data
+ *
+ * @param phys
+ * @param angular_velocity
+ */
+void physics_set_angular_velocity(struct phys_data *phys, pal_float_t angular_velocity);
+
+/**
+ * @brief Gets torque acting on phys_data
+ *
+ * @param phys
+ * @return pal_float_t
+ */
+pal_float_t physics_get_torque(const struct phys_data *phys);
+
+/**
+ * @brief Sets torque acting on phys_data
+ *
+ * @param phys
+ * @param torque
+ */
+void physics_set_torque(struct phys_data *phys, pal_float_t torque);
+
+/**
+ * @brief Gets inverse mass of phys_data (INFINITY for massless objects)
+ *
+ * @param phys
+ * @return pal_float_t
+ */
+pal_float_t physics_get_inv_mass(const struct phys_data *phys);
+
+/**
+ * @brief Gets inverse moment of inertia of phys_data (INFINITY for massless objects)
+ *
+ * @param phys
+ * @return pal_float_t
  */
-void physics_init(struct phys_data *phys, pal_float_t mass);
+pal_float_t physics_get_inv_moment_of_inertia(const struct phys_data *phys);
 
 /**
  * @brief Sets up phys_data to be polygonal
@@ -95,6 +265,13 @@ void physics_set_bounds_rect(struct phys_data *phys, pal_float_t width, pal_floa
  */
 void physics_integrate(struct phys_data *phys, pal_float_t dt);
 
+/**
+ * @brief Integrates all awake bodies in the body store given time step (dt)
+ *
+ * @param dt time step in seconds
+ */
+void physics_integrate_all(pal_float_t dt);
+
 /**
  * @brief Scales phys_data bounds by given factor
  *
@@ -136,4 +313,54 @@ bool physics_detect_collision(struct phys_data *phys1, struct phys_data *phys2,
  *
  * @param collision
  */
-void physics_resolve_collision(struct collision_descriptor *collision);
\ No newline at end of file
+void physics_resolve_collision(struct collision_descriptor *collision);
+
+/**
+ * @brief Finds all phys_datas containing point, sorted by distance from point to their position.
+ * Scene queries use the bounds from the last call to physics_compute_translated_bounds.
+ * They return every body with bounds, including ones that aren't part of an entity in the game,
+ * check user_data before treating a result as an entity
+ *
+ * @param point
+ * @param results array to place results in
+ * @param max_results size of results array, only the closest max_results phys_datas are returned
+ * @return size_t number of results
+ */
+size_t physics_query_point(const struct vec2 *point, struct phys_data **results, size_t max_results);
+
+/**
+ * @brief Finds all phys_datas overlapping region, sorted by distance from the region's center to their position.
+ * Like physics_query_point, results can be bodies that aren't part of an entity in the game
+ *
+ * @param region
+ * @param results array to place results in
+ * @param max_results size of results array, only the closest max_results phys_datas are returned
+ * @return size_t number of results
+ */
+size_t physics_query_aabb(const struct aabb *region, struct phys_data **results, size_t max_results);
+
+/**
+ * @brief Finds all phys_datas hit by ray, sorted by distance along ray
+ *
+ * @param origin
+ * @param direction does not need to be normalized
+ * @param max_distance
+ * @param hits array to place hits in
+ * @param max_hits size of hits array, only the closest max_hits hits are returned
+ * @return size_t number of hits
+ */
+size_t physics_raycast(const struct vec2 *origin, const struct vec2 *direction, pal_float_t max_distance, struct raycast_hit *hits, size_t max_hits);
+
+/**
+ * @brief Sweeps circle with given radius along ray, finding all phys_datas it hits, sorted by distance along ray.
+ * Hits report the distance the circle travels before touching the phys_data (0 if it starts overlapping)
+ *
+ * @param origin starting center of circle
+ * @param radius
+ * @param direction does not need to be normalized
+ * @param max_distance
+ * @param hits array to place hits in
+ * @param max_hits size of hits array, only the closest max_hits hits are returned
+ * @return size_t number of hits
+ */
+size_t physics_shape_cast(const struct vec2 *origin, pal_float_t radius, const struct vec2 *direction, pal_float_t max_distance, struct raycast_hit *hits, size_t max_hits);
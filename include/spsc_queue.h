@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Wait-free single producer single consumer queue of fixed size elements. One thread may push
+ * while another pops without locks, as long as only one thread ever pushes and only one pops.
+ */
+struct spsc_queue {
+    // free running indices, only the producer writes tail and only the consumer writes head
+    atomic_uint head;
+    atomic_uint tail;
+    uint32_t capacity;      // power of 2
+    uint32_t element_size;
+    uint8_t *buffer;
+};
+
+/**
+ * @brief Pushes element to queue, call only from the producer thread
+ *
+ * @param queue
+ * @param element element_size bytes to copy into the queue
+ * @return true if element was pushed
+ * @return false if queue is full
+ */
+bool spsc_queue_push(struct spsc_queue *queue, const void *element);
+
+/**
+ * @brief Pops oldest element from queue, call only from the consumer thread
+ *
+ * @param queue
+ * @param element element_size bytes to copy the element to
+ * @return true if element was popped
+ * @return false if queue is empty
+ */
+bool spsc_queue_pop(struct spsc_queue *queue, void *element);
+
+/**
+ * @brief Pushes up to count elements to queue, call only from the producer thread
+ *
+ * @param queue
+ * @param elements count * element_size bytes to copy into the queue
+ * @param count
+ * @return uint32_t number of elements pushed, less than count if the queue filled up
+ */
+uint32_t spsc_queue_push_many(struct spsc_queue *queue, const void *elements, uint32_t count);
+
+/**
+ * @brief Pops up to count oldest elements from queue, call only from the consumer thread
+ *
+ * @param queue
+ * @param elements count * element_size bytes to copy the elements to
+ * @param count
+ * @return uint32_t number of elements popped, less than count if the queue ran empty
+ */
+uint32_t spsc_queue_pop_many(struct spsc_queue *queue, void *elements, uint32_t count);
+
+/**
+ * @brief Gets number of elements in queue, exact from the producer or consumer thread, a
+ * snapshot from any other
+ *
+ * @param queue
+ * @return uint32_t
+ */
+uint32_t spsc_queue_count(struct spsc_queue *queue);
+
+/**
+ * @brief Initializes queue with backing buffer
+ *
+ * @param queue
+ * @param buffer buffer to hold capacity * element_size bytes
+ * @param element_size
+ * @param capacity number of elements, must be a power of 2
+ */
+void spsc_queue_init(struct spsc_queue *queue, void *buffer, uint32_t element_size, uint32_t capacity);
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "audio.h"
+
+// samples per table is 2^WAVETABLE_SIZE_BITS, can be overridden in the CMakeLists.txt
+#ifndef WAVETABLE_SIZE_BITS
+#define WAVETABLE_SIZE_BITS 9
+#endif
+#define WAVETABLE_SIZE (1 << WAVETABLE_SIZE_BITS)
+#define WAVETABLE_SIZE_MASK (WAVETABLE_SIZE - 1)
+// level n holds harmonics up to WAVETABLE_SIZE >> (n + 1), each level covers one octave
+#define WAVETABLE_NUM_LEVELS WAVETABLE_SIZE_BITS
+
+// number of table levels shared by all wavetables, can be overridden in the CMakeLists.txt
+// the sine table uses 1 level, other tables up to WAVETABLE_NUM_LEVELS
+#ifndef WAVETABLE_POOL_LEVELS
+#define WAVETABLE_POOL_LEVELS 32
+#endif
+
+_Static_assert(WAVETABLE_SIZE_BITS < OSC_PERIOD_BITS, "Wavetable too big! Decrease WAVETABLE_SIZE_BITS!");
+
+enum wavetable_type {
+    WAVETABLE_SINE,
+    WAVETABLE_SQUARE,
+    WAVETABLE_SAW,
+    WAVETABLE_TRIANGLE,
+    WAVETABLE_NUM_BUILTIN
+};
+
+/**
+ * @brief Band limited single cycle waveform, mip mapped by octave
+ *
+ */
+struct wavetable {
+    // levels[0] has all harmonics, levels identical to a lower one aren't stored
+    const int16_t (*levels)[WAVETABLE_SIZE];
+    uint8_t first_level;    // levels below this one are the same as levels[0]
+    uint8_t num_levels;
+};
+
+/**
+ * @brief Gets builtin wavetable, generating it on first use
+ * NOTE: call this from the game side (e.g. during setup), generation is too slow for the audio callback
+ *
+ * @param type
+ * @return const struct wavetable* NULL if the table pool is full
+ */
+const struct wavetable *wavetable_get_builtin(enum wavetable_type type);
+
+/**
+ * @brief Creates band limited wavetable from one cycle of a user waveform
+ * The waveform is normalized to full scale
+ *
+ * @param table
+ * @param samples WAVETABLE_SIZE samples of one waveform cycle
+ * @return true if table was created
+ * @return false if the table pool is full
+ */
+bool wavetable_init_from_samples(struct wavetable *table, const int16_t *samples);
+
+/**
+ * @brief Renders block of wavetable samples, picking the level from t_increment so no harmonic
+ * is above the nyquist frequency
+ *
+ * @param table
+ * @param samples
+ * @param t oscillator time, 0 to OSC_PERIOD
+ * @param t_increment
+ * @param num_samples
+ */
+void wavetable_render(const struct wavetable *table, int32_t *samples, uint32_t t, uint32_t t_increment, int num_samples);
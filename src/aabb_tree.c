@@ -0,0 +1,379 @@
+#include "aabb_tree.h"
+
+#include <stddef.h>
+
+#include "mathutils.h"
+
+// deep enough for any tree that balance() keeps in shape
+#define AABB_TREE_STACK_SIZE 64
+
+bool aabb_overlap(const struct aabb *a, const struct aabb *b) {
+    return a->min.x <= b->max.x && a->max.x >= b->min.x &&
+           a->min.y <= b->max.y && a->max.y >= b->min.y;
+}
+
+bool aabb_contains(const struct aabb *a, const struct aabb *b) {
+    return a->min.x <= b->min.x && a->min.y <= b->min.y &&
+           a->max.x >= b->max.x && a->max.y >= b->max.y;
+}
+
+static void aabb_union(const struct aabb *a, const struct aabb *b, struct aabb *out) {
+    out->min.x = pal_fmin(a->min.x, b->min.x);
+    out->min.y = pal_fmin(a->min.y, b->min.y);
+    out->max.x = pal_fmax(a->max.x, b->max.x);
+    out->max.y = pal_fmax(a->max.y, b->max.y);
+}
+
+static pal_float_t aabb_perimeter(const struct aabb *a) {
+    return 2 * ((a->max.x - a->min.x) + (a->max.y - a->min.y));
+}
+
+static aabb_tree_proxy_t allocate_node(struct aabb_tree *tree) {
+    aabb_tree_proxy_t node = tree->free_list;
+
+    if (node == AABB_TREE_NULL_NODE)
+        return AABB_TREE_NULL_NODE;
+
+    tree->free_list = tree->nodes[node].parent;
+    tree->nodes[node].parent = AABB_TREE_NULL_NODE;
+    tree->nodes[node].child1 = AABB_TREE_NULL_NODE;
+    tree->nodes[node].child2 = AABB_TREE_NULL_NODE;
+    tree->nodes[node].height = 0;
+    tree->nodes[node].data = NULL;
+
+    return node;
+}
+
+static void free_node(struct aabb_tree *tree, aabb_tree_proxy_t node) {
+    tree->nodes[node].parent = tree->free_list;
+    tree->nodes[node].height = -1;
+    tree->free_list = node;
+}
+
+static inline bool is_leaf(const struct aabb_tree_node *node) {
+    return node->child1 == AABB_TREE_NULL_NODE;
+}
+
+static void fix_node(struct aabb_tree *tree, aabb_tree_proxy_t index) {
+    struct aabb_tree_node *node = &tree->nodes[index];
+    struct aabb_tree_node *child1 = &tree->nodes[node->child1];
+    struct aabb_tree_node *child2 = &tree->nodes[node->child2];
+
+    node->height = 1 + (child1->height > child2->height ? child1->height : child2->height);
+    aabb_union(&child1->aabb, &child2->aabb, &node->aabb);
+}
+
+/**
+ * @brief Performs a left or right rotation if node a is imbalanced
+ *
+ * @param tree
+ * @param index_a
+ * @return aabb_tree_proxy_t new root of the subtree
+ */
+static aabb_tree_proxy_t balance(struct aabb_tree *tree, aabb_tree_proxy_t index_a) {
+    struct aabb_tree_node *a = &tree->nodes[index_a];
+
+    if (is_leaf(a) || a->height < 2)
+        return index_a;
+
+    aabb_tree_proxy_t index_b = a->child1;
+    aabb_tree_proxy_t index_c = a->child2;
+    struct aabb_tree_node *b = &tree->nodes[index_b];
+    struct aabb_tree_node *c = &tree->nodes[index_c];
+
+    int balance_factor = c->height - b->height;
+
+    // rotate c up (or b up) by swapping it with its parent
+    if (balance_factor > 1 || balance_factor < -1) {
+        aabb_tree_proxy_t index_up = balance_factor > 1 ? index_c : index_b;
+        aabb_tree_proxy_t index_other = balance_factor > 1 ? index_b : index_c;
+        struct aabb_tree_node *up = &tree->nodes[index_up];
+
+        aabb_tree_proxy_t index_f = up->child1;
+        aabb_tree_proxy_t index_g = up->child2;
+        struct aabb_tree_node *f = &tree->nodes[index_f];
+        struct aabb_tree_node *g = &tree->nodes[index_g];
+
+        // swap a and up
+        up->child1 = index_a;
+        up->parent = a->parent;
+        a->parent = index_up;
+
+        // a's old parent should point to up
+        if (up->parent != AABB_TREE_NULL_NODE) {
+            if (tree->nodes[up->parent].child1 == index_a)
+                tree->nodes[up->parent].child1 = index_up;
+            else
+                tree->nodes[up->parent].child2 = index_up;
+        } else {
+            tree->root = index_up;
+        }
+
+        // the taller grandchild stays under up, the shorter one moves under a
+        aabb_tree_proxy_t index_keep = f->height > g->height ? index_f : index_g;
+        aabb_tree_proxy_t index_move = f->height > g->height ? index_g : index_f;
+
+        up->child2 = index_keep;
+
+        if (balance_factor > 1) {
+            a->child1 = index_other;
+            a->child2 = index_move;
+        } else {
+            a->child1 = index_move;
+            a->child2 = index_other;
+        }
+
+        tree->nodes[index_move].parent = index_a;
+
+        fix_node(tree, index_a);
+        fix_node(tree, index_up);
+
+        return index_up;
+    }
+
+    return index_a;
+}
+
+static void insert_leaf(struct aabb_tree *tree, aabb_tree_proxy_t leaf) {
+    if (tree->root == AABB_TREE_NULL_NODE) {
+        tree->root = leaf;
+        tree->nodes[leaf].parent = AABB_TREE_NULL_NODE;
+        return;
+    }
+
+    // find the best sibling for the new leaf, descending by the surface area heuristic
+    struct aabb leaf_aabb = tree->nodes[leaf].aabb;
+    aabb_tree_proxy_t index = tree->root;
+
+    while (!is_leaf(&tree->nodes[index])) {
+        struct aabb_tree_node *node = &tree->nodes[index];
+        struct aabb combined;
+        pal_float_t area = aabb_perimeter(&node->aabb);
+
+        aabb_union(&node->aabb, &leaf_aabb, &combined);
+        pal_float_t combined_area = aabb_perimeter(&combined);
+
+        // cost of creating a new parent for this node and the new leaf
+        pal_float_t cost = 2 * combined_area;
+        // minimum cost of pushing the leaf further down the tree
+        pal_float_t inheritance_cost = 2 * (combined_area - area);
+
+        pal_float_t child_costs[2];
+        aabb_tree_proxy_t children[2] = { node->child1, node->child2 };
+
+        for (int i = 0; i < 2; i++) {
+            struct aabb_tree_node *child = &tree->nodes[children[i]];
+            aabb_union(&leaf_aabb, &child->aabb, &combined);
+
+            if (is_leaf(child))
+                child_costs[i] = aabb_perimeter(&combined) + inheritance_cost;
+            else
+                child_costs[i] = aabb_perimeter(&combined) - aabb_perimeter(&child->aabb) + inheritance_cost;
+        }
+
+        if (cost < child_costs[0] && cost < child_costs[1])
+            break;
+
+        index = child_costs[0] < child_costs[1] ? children[0] : children[1];
+    }
+
+    aabb_tree_proxy_t sibling = index;
+
+    // create a new parent for the sibling and the leaf
+    aabb_tree_proxy_t old_parent = tree->nodes[sibling].parent;
+    aabb_tree_proxy_t new_parent = allocate_node(tree);
+
+    tree->nodes[new_parent].parent = old_parent;
+    tree->nodes[new_parent].child1 = sibling;
+    tree->nodes[new_parent].child2 = leaf;
+    tree->nodes[sibling].parent = new_parent;
+    tree->nodes[leaf].parent = new_parent;
+
+    if (old_parent != AABB_TREE_NULL_NODE) {
+        if (tree->nodes[old_parent].child1 == sibling)
+            tree->nodes[old_parent].child1 = new_parent;
+        else
+            tree->nodes[old_parent].child2 = new_parent;
+    } else {
+        tree->root = new_parent;
+    }
+
+    // walk back up the tree fixing heights and AABBs
+    for (index = new_parent; index != AABB_TREE_NULL_NODE; index = tree->nodes[index].parent) {
+        index = balance(tree, index);
+        fix_node(tree, index);
+    }
+}
+
+static void remove_leaf(struct aabb_tree *tree, aabb_tree_proxy_t leaf) {
+    if (leaf == tree->root) {
+        tree->root = AABB_TREE_NULL_NODE;
+        return;
+    }
+
+    aabb_tree_proxy_t parent = tree->nodes[leaf].parent;
+    aabb_tree_proxy_t grandparent = tree->nodes[parent].parent;
+    aabb_tree_proxy_t sibling = tree->nodes[parent].child1 == leaf ? tree->nodes[parent].child2 : tree->nodes[parent].child1;
+
+    // the sibling takes the parent's place
+    if (grandparent != AABB_TREE_NULL_NODE) {
+        if (tree->nodes[grandparent].child1 == parent)
+            tree->nodes[grandparent].child1 = sibling;
+        else
+            tree->nodes[grandparent].child2 = sibling;
+
+        tree->nodes[sibling].parent = grandparent;
+        free_node(tree, parent);
+
+        for (aabb_tree_proxy_t index = grandparent; index != AABB_TREE_NULL_NODE; index = tree->nodes[index].parent) {
+            index = balance(tree, index);
+            fix_node(tree, index);
+        }
+    } else {
+        tree->root = sibling;
+        tree->nodes[sibling].parent = AABB_TREE_NULL_NODE;
+        free_node(tree, parent);
+    }
+}
+
+static void fatten_aabb(const struct aabb_tree *tree, const struct aabb *aabb, struct aabb *fat) {
+    fat->min.x = aabb->min.x - tree->margin;
+    fat->min.y = aabb->min.y - tree->margin;
+    fat->max.x = aabb->max.x + tree->margin;
+    fat->max.y = aabb->max.y + tree->margin;
+}
+
+void aabb_tree_init(struct aabb_tree *tree, pal_float_t margin) {
+    tree->root = AABB_TREE_NULL_NODE;
+    tree->margin = margin;
+
+    // link every node into the free list
+    for (int i = 0; i < AABB_TREE_MAX_NODES; i++) {
+        tree->nodes[i].parent = i < AABB_TREE_MAX_NODES - 1 ? i + 1 : AABB_TREE_NULL_NODE;
+        tree->nodes[i].height = -1;
+    }
+
+    tree->free_list = 0;
+}
+
+aabb_tree_proxy_t aabb_tree_insert(struct aabb_tree *tree, const struct aabb *aabb, void *data) {
+    // inserting a leaf also takes an internal node, make sure both are available
+    if (tree->free_list == AABB_TREE_NULL_NODE || tree->nodes[tree->free_list].parent == AABB_TREE_NULL_NODE)
+        return AABB_TREE_NULL_NODE;
+
+    aabb_tree_proxy_t leaf = allocate_node(tree);
+
+    fatten_aabb(tree, aabb, &tree->nodes[leaf].aabb);
+    tree->nodes[leaf].data = data;
+
+    insert_leaf(tree, leaf);
+
+    return leaf;
+}
+
+void aabb_tree_remove(struct aabb_tree *tree, aabb_tree_proxy_t proxy) {
+    if (proxy == AABB_TREE_NULL_NODE)
+        return;
+
+    remove_leaf(tree, proxy);
+    free_node(tree, proxy);
+}
+
+bool aabb_tree_move(struct aabb_tree *tree, aabb_tree_proxy_t proxy, const struct aabb *aabb) {
+    if (proxy == AABB_TREE_NULL_NODE || aabb_contains(&tree->nodes[proxy].aabb, aabb))
+        return false;
+
+    remove_leaf(tree, proxy);
+    fatten_aabb(tree, aabb, &tree->nodes[proxy].aabb);
+    insert_leaf(tree, proxy);
+
+    return true;
+}
+
+const struct aabb *aabb_tree_get_fat_aabb(const struct aabb_tree *tree, aabb_tree_proxy_t proxy) {
+    return &tree->nodes[proxy].aabb;
+}
+
+void aabb_tree_query(const struct aabb_tree *tree, const struct aabb *aabb, aabb_tree_query_callback_t callback, void *context) {
+    aabb_tree_proxy_t stack[AABB_TREE_STACK_SIZE];
+    int stack_size = 0;
+
+    if (tree->root == AABB_TREE_NULL_NODE)
+        return;
+
+    stack[stack_size++] = tree->root;
+
+    while (stack_size > 0) {
+        const struct aabb_tree_node *node = &tree->nodes[stack[--stack_size]];
+
+        if (!aabb_overlap(&node->aabb, aabb))
+            continue;
+
+        if (is_leaf(node)) {
+            if (!callback(node->data, context))
+                return;
+        } else if (stack_size < AABB_TREE_STACK_SIZE - 1) {
+            stack[stack_size++] = node->child1;
+            stack[stack_size++] = node->child2;
+        }
+    }
+}
+
+/**
+ * @brief Slab test of ray against AABB grown by radius
+ *
+ * @return true if the ray enters the box before max_distance
+ */
+static bool ray_hits_aabb(const struct aabb *aabb, const struct vec2 *origin, const struct vec2 *direction, pal_float_t max_distance, pal_float_t radius) {
+    pal_float_t t_min = 0;
+    pal_float_t t_max = max_distance;
+    pal_float_t o[2] = { origin->x, origin->y };
+    pal_float_t d[2] = { direction->x, direction->y };
+    pal_float_t lo[2] = { aabb->min.x - radius, aabb->min.y - radius };
+    pal_float_t hi[2] = { aabb->max.x + radius, aabb->max.y + radius };
+
+    for (int axis = 0; axis < 2; axis++) {
+        if (d[axis] == 0) {
+            // parallel to slab, must start inside it
+            if (o[axis] < lo[axis] || o[axis] > hi[axis])
+                return false;
+            continue;
+        }
+
+        pal_float_t t1 = pal_div(lo[axis] - o[axis], d[axis]);
+        pal_float_t t2 = pal_div(hi[axis] - o[axis], d[axis]);
+
+        t_min = pal_fmax(t_min, pal_fmin(t1, t2));
+        t_max = pal_fmin(t_max, pal_fmax(t1, t2));
+
+        if (t_min > t_max)
+            return false;
+    }
+
+    return true;
+}
+
+void aabb_tree_raycast(const struct aabb_tree *tree, const struct vec2 *origin, const struct vec2 *direction, pal_float_t max_distance, pal_float_t radius, aabb_tree_query_callback_t callback, void *context) {
+    aabb_tree_proxy_t stack[AABB_TREE_STACK_SIZE];
+    int stack_size = 0;
+
+    if (tree->root == AABB_TREE_NULL_NODE)
+        return;
+
+    stack[stack_size++] = tree->root;
+
+    while (stack_size > 0) {
+        const struct aabb_tree_node *node = &tree->nodes[stack[--stack_size]];
+
+        if (!ray_hits_aabb(&node->aabb, origin, direction, max_distance, radius))
+            continue;
+
+        if (is_leaf(node)) {
+            if (!callback(node->data, context))
+                return;
+        } else if (stack_size < AABB_TREE_STACK_SIZE - 1) {
+            stack[stack_size++] = node->child1;
+            stack[stack_size++] = node->child2;
+        }
+    }
+}
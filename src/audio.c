@@ -5,53 +5,470 @@
 #include <stdio.h>
 #include <math.h>
 #include <string.h>
-#include <unistd.h>
+#if AUDIO_RENDER_THREAD
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#endif
 
 #include "pal.h"
+#include "audio_drum.h"
+#include "audio_fm.h"
 #include "mathutils.h"
+#include "spsc_queue.h"
+#include "wavetable.h"
 
 #define MAX_NUM_MIDI_PLAYERS 10
 #define MAX_NUM_OSCILLATORS 100
 // #define PRINT_MIDI_LYRICS
+// prints drum notes without a sample or kit patch, from the audio thread so only for debugging
+// #define PRINT_MIDI_MISSING_DRUMS
+
+// envelope levels have this many fractional bits below OSC_AMPLITUDE full scale
+#define ENVELOPE_FRAC_BITS 8
+#define ENVELOPE_MAX (OSC_AMPLITUDE << ENVELOPE_FRAC_BITS)
+// extra fractional bits of the ramped voice gain
+#define GAIN_RAMP_FRAC_BITS 16
+// midi notes at full velocity, leaves headroom for several notes before the mix clips
+#define MIDI_NOTE_AMPLITUDE (OSC_AMPLITUDE / 8)
+#define MIDI_CONTROLLER_PAN 10
+// bus gains are applied as integers with this many fractional bits
+#define BUS_GAIN_FRAC_BITS 16
+#define BUS_GAIN_ONE (1 << BUS_GAIN_FRAC_BITS)
+#define BUS_GAIN_MAX (BUS_GAIN_ONE * 16)
+
+#define PAN_GAIN_FRAC_BITS 15
+// pan positions from left to right, 8 fractional bits between the steps of pan_sine
+#define PAN_POSITION_RIGHT (64 << 8)
+#define PAN_POSITION_CENTER (PAN_POSITION_RIGHT / 2)
+// limiter gains have this many fractional bits
+#define LIMITER_GAIN_FRAC_BITS 16
+#define LIMITER_GAIN_ONE (1 << LIMITER_GAIN_FRAC_BITS)
+#define LIMITER_THRESHOLD OSC_AMPLITUDE
+// gain increase per sample after a peak, rounded up so it's never 0
+#define LIMITER_RELEASE_STEP (LIMITER_GAIN_ONE * 1000 / (AUDIO_LIMITER_RELEASE_MS * PAL_AUDIO_SAMPLE_RATE) + 1)
+#define OSC_ALL_VOICES_FREE ((1u << OSC_MAX_VOICES) - 1)
+// the clock offset comes down by 1 / CLOCK_DRIFT_CALLBACKS of the difference every callback
+#define CLOCK_DRIFT_CALLBACKS 64
+
+enum audio_command_type {
+    AUDIO_COMMAND_OSC_PLAY,
+    AUDIO_COMMAND_OSC_STOP,
+    AUDIO_COMMAND_OSC_DELETE,
+    AUDIO_COMMAND_OSC_FM_PATCH,
+    AUDIO_COMMAND_OSC_WAVEFORM_BLOCK,
+    AUDIO_COMMAND_OSC_WAVETABLE,
+    AUDIO_COMMAND_ADD_EFFECT,
+    AUDIO_COMMAND_ADD_FILTER,
+    AUDIO_COMMAND_SAMPLE_PLAY,
+    AUDIO_COMMAND_SAMPLE_RELEASE,
+    AUDIO_COMMAND_SAMPLE_STEAL_MODE,
+    AUDIO_COMMAND_MIDI_LOAD,
+    AUDIO_COMMAND_MIDI_LOAD_STREAM,
+    AUDIO_COMMAND_MIDI_DELETE,
+    AUDIO_COMMAND_MIDI_TRANSPOSE,
+    AUDIO_COMMAND_MIDI_DRUM_KIT,
+    AUDIO_COMMAND_MIDI_FM_BANK,
+    AUDIO_COMMAND_MIDI_INDEX,
+    AUDIO_COMMAND_MIDI_SEEK,
+    AUDIO_COMMAND_MIDI_SEEK_BEAT,
+    AUDIO_COMMAND_MIDI_LOOP,
+    AUDIO_COMMAND_MIDI_LOOP_POINTS,
+    AUDIO_COMMAND_MIDI_PLAYBACK_RATE,
+    AUDIO_COMMAND_MIDI_BUS,
+    AUDIO_COMMAND_OSC_BUS,
+    AUDIO_COMMAND_SAMPLE_BUS,
+    AUDIO_COMMAND_BUS_GAIN,
+    AUDIO_COMMAND_OSC_PAN,
+    AUDIO_COMMAND_SAMPLE_PAN
+};
+
+/**
+ * @brief Game side audio call, posted to the audio thread through command_queue
+ *
+ */
+struct audio_command {
+    uint64_t sample_num;    // sample to apply the command at, AUDIO_TIME_NOW for the next block
+    enum audio_command_type type;
+    union {
+        struct {
+            struct oscillator *osc;
+            enum oscillator_voice_num voice;
+            uint16_t amplitude;
+            uint32_t t_increment;
+            union {
+                const struct fm_patch *fm_patch;
+                oscillator_waveform_block_func_t waveform_block;
+                const struct wavetable *wavetable;
+            };
+        } osc;
+        struct {
+            struct effect_node **head;
+            struct effect_node *effect;
+        } effect;
+        struct {
+            struct filter_node **head;
+            struct filter_node *filter;
+        } filter;
+        struct {
+            wave_sample_t sample;
+            uint16_t amplitude;
+            uint32_t increment;
+            uint32_t id;
+            enum wave_sample_steal_mode steal_mode;
+        } sample;
+        struct {
+            struct midi_player *player;
+            union {
+                uint8_t *midi_data;
+                const struct midi_stream *stream;
+                const struct midi_index *index;
+                const struct drum_kit *drum_kit;
+                const struct fm_bank *fm_bank;
+            };
+            uint64_t position;      // seek position or loop start
+            uint64_t loop_end;
+            uint32_t beat;
+            uint32_t playback_rate;
+            int channel;
+            int8_t transpose;
+            bool loop;
+        } midi;
+        struct {
+            audio_bus_t bus;
+            int32_t gain;
+            union {
+                struct oscillator *osc;
+                struct midi_player *player;
+                wave_sample_t sample;
+            };
+        } bus;
+        struct {
+            int32_t position;
+            union {
+                struct oscillator *osc;
+                struct {
+                    wave_sample_t sample;
+                    uint32_t id;
+                };
+            };
+        } pan;
+    };
+};
 
-#define ENVELOPE_VALUE_SCALING 10
+// 64 bit value written by one thread and read by others, split in halves because 64 bit atomics
+// aren't lock free everywhere. The sequence is incremented before and after every update, so it's
+// odd while the halves are being written and 0 until the first one
+struct published_u64 {
+    atomic_uint sequence;
+    atomic_uint low;
+    atomic_uint high;
+};
+
+// only used by the audio thread once audio is started
+static uint64_t current_sample_num = 0;
+// copy of current_sample_num for other threads
+static struct published_u64 published_sample_num;
+// sample number of game time 0, the sample the audio thread can still schedule at pal_get_time 0.
+// Only used by the audio callback, which publishes it for audio_time_to_sample_num
+static int64_t clock_offset = 0;
+static uint64_t played_sample_num = 0;
+static struct published_u64 published_clock_offset;
+
+// IMA-ADPCM decoder state of a sample voice
+struct adpcm_decoder {
+    uint32_t next;          // sample the next nibble decodes to
+    int16_t previous;       // sample next - 2
+    int16_t predictor;      // sample next - 1
+    uint8_t step_index;
+};
 
-uint64_t current_sample_num = 0;
 struct polyphonic_wave_sampler {
     const struct wave_data *wave_data;
+    enum wave_sample_steal_mode steal_mode;
+    audio_bus_t bus;
     struct channel {
-        pal_float_t pointer;
-        pal_float_t pointer_delta;
+        // sample position and increment with 16 fractional bits, integer so it doesn't depend on
+        // the range of pal_float_t
+        uint32_t position;
+        uint32_t position_frac;
+        uint32_t increment;
+        uint32_t id;
+        uint32_t order;
         uint16_t amplitude;
+        audio_bus_t bus;
         bool playing;
+        bool looping;
+        // decoder of IMA-ADPCM samples, and its state right after loop_start to jump back to.
+        // adpcm_loop.next is 0 until the decoder gets there
+        struct adpcm_decoder adpcm;
+        struct adpcm_decoder adpcm_loop;
+        struct audio_pan pan;
     } channels[MAX_CONCURRENT_SAMPLE_VOICES];
 };
 
+struct mixer_bus {
+    struct filter_node *filter_head;
+    int32_t gain;           // ramped to gain_target over the next block
+    int32_t gain_target;
+    audio_bus_t output;     // bus this one is mixed into, unused for the master bus
+};
+
 
 static struct midi_player *midi_players[MAX_NUM_MIDI_PLAYERS];
 static struct oscillator *oscillators[MAX_NUM_OSCILLATORS];
 static struct polyphonic_wave_sampler wave_samplers[MAX_POLYPHONIC_WAVE_SAMPLERS];
-struct filter_node *wave_samplers_filter_list_head;
-struct filter_node *master_filter_head;
+
+// oscillators with at least one active voice
+static struct oscillator *active_oscillators[MAX_NUM_OSCILLATORS];
+// wave sampler channels that are playing
+static struct active_sample_channel {
+    uint8_t sampler;
+    uint8_t channel;
+} active_sample_channels[MAX_POLYPHONIC_WAVE_SAMPLERS * MAX_CONCURRENT_SAMPLE_VOICES];
+
+static struct mixer_bus buses[AUDIO_MAX_BUSES] = {
+    [0 ... AUDIO_MAX_BUSES - 1] = { NULL, BUS_GAIN_ONE, BUS_GAIN_ONE, AUDIO_BUS_MASTER }
+};
+static int num_buses = AUDIO_NUM_DEFAULT_BUSES;
+// buses other than master in mixing order, every bus comes before the bus it's mixed into.
+// Compiled by audio_start so mixing is one pass over it
+static audio_bus_t bus_mix_order[AUDIO_MAX_BUSES - 1];
+// planar, a block of every channel
+static int32_t bus_samples[AUDIO_MAX_BUSES][PAL_AUDIO_CHANNELS][AUDIO_BLOCK_SIZE];
+
+// sin from 0 to pi / 2 in 64 steps, 15 fractional bits, for the constant power pan
+static const int16_t pan_sine[65] = {
+    0, 804, 1608, 2410, 3212, 4011, 4808, 5602, 6393, 7179, 7962, 8739, 9512, 10278, 11039, 11793,
+    12539, 13279, 14010, 14732, 15446, 16151, 16846, 17530, 18204, 18868, 19519, 20159, 20787,
+    21403, 22005, 22594, 23170, 23731, 24279, 24811, 25329, 25832, 26319, 26790, 27245, 27683,
+    28105, 28510, 28898, 29268, 29621, 29956, 30273, 30571, 30852, 31113, 31356, 31580, 31785,
+    31971, 32137, 32285, 32412, 32521, 32609, 32678, 32728, 32757, 32767
+};
+
+/*
+ * Look-ahead limiter on the master bus. The gain every sample needs to stay under the threshold
+ * is held for the look-ahead window, released linearly and smoothed by a moving average as long
+ * as the window. The output is delayed by the window, so the gain is all the way down by the time
+ * a peak comes out, without steps that would click.
+ */
+static struct limiter {
+    int32_t delay[PAL_AUDIO_CHANNELS][AUDIO_LIMITER_LOOKAHEAD];
+    int32_t released_gains[AUDIO_LIMITER_LOOKAHEAD];    // window of the moving average
+    int32_t gain_sum;
+    int32_t release_gain;
+    // minimum of the needed gains of the last AUDIO_LIMITER_LOOKAHEAD + 1 samples, queue of the
+    // gains that can still become the minimum, increasing from the head
+    struct limiter_minimum {
+        int32_t gain;
+        uint32_t sample;
+    } minimums[AUDIO_LIMITER_LOOKAHEAD + 1];
+    int minimums_head;
+    int num_minimums;
+    int position;       // index of the oldest sample in delay and released_gains
+    uint32_t sample;    // samples processed, wraps
+} limiter = {
+    .released_gains = { [0 ... AUDIO_LIMITER_LOOKAHEAD - 1] = LIMITER_GAIN_ONE },
+    .gain_sum = AUDIO_LIMITER_LOOKAHEAD * LIMITER_GAIN_ONE,
+    .release_gain = LIMITER_GAIN_ONE
+};
 
 static int num_midi_players = 0;
 static int num_oscillators = 0;
+static int num_active_oscillators = 0;
+static int num_active_sample_channels = 0;
+// the first num_active_drum_voices are playing
+static struct drum_voice drum_voices[AUDIO_MAX_DRUM_VOICES];
+static int num_active_drum_voices = 0;
+// id of the last sample voice played from the game side, voices the audio thread plays have id 0
+static uint32_t last_sample_voice_id = 0;
+// order of the last started sample voice, orders voices by age
+static uint32_t last_sample_voice_order = 0;
 static bool running = false;
 
-static pal_float_t master_gain = 1.0;
-static pal_float_t dynamic_mixer_gain = 1.0;
-static int32_t dynamic_mixer_timer = 0;
+static struct audio_command command_queue_buffer[AUDIO_COMMAND_QUEUE_SIZE];
+static struct spsc_queue command_queue;
+// timestamped commands waiting for their sample, in the order they were posted
+static struct audio_command scheduled_commands[AUDIO_MAX_SCHEDULED_COMMANDS];
+static int num_scheduled_commands = 0;
+#if AUDIO_RENDER_THREAD
+// posted by the audio thread and waited on by the game side
+typedef sem_t audio_fence_t;
+
+static void fence_init(audio_fence_t *fence) {
+    sem_init(fence, 0, 0);
+}
+
+static void fence_post(audio_fence_t *fence) {
+    sem_post(fence);
+}
+
+static void fence_wait(audio_fence_t *fence) {
+    while (sem_wait(fence) != 0 && errno == EINTR);
+}
+#else
+// without POSIX threads there's nothing to block on, the game side polls a count of posts while
+// the backend runs the audio callback
+typedef atomic_uint audio_fence_t;
+
+static void fence_init(audio_fence_t *fence) {
+    atomic_init(fence, 0);
+}
+
+static void fence_post(audio_fence_t *fence) {
+    atomic_fetch_add_explicit(fence, 1, memory_order_release);
+}
+
+static void fence_wait(audio_fence_t *fence) {
+    unsigned int posts = atomic_load_explicit(fence, memory_order_relaxed);
+
+    while (posts == 0 || !atomic_compare_exchange_weak_explicit(fence, &posts, posts - 1, memory_order_acquire, memory_order_relaxed))
+        posts = atomic_load_explicit(fence, memory_order_relaxed);
+}
+#endif
+
+// game side state
+static bool audio_started = false;
+static bool audio_offline = false;
+static uint64_t command_time = AUDIO_TIME_NOW;
+
+// set by audio_request_stop instead of a command so it never waits for room in the command queue
+static atomic_bool stop_requested = false;
+// set by the stop, the audio thread posts stop_fence once every voice is released
+static bool stop_fence_pending = false;
+static audio_fence_t stop_fence;
+static atomic_uint underrun_count = 0;
+
+#if AUDIO_RENDER_THREAD
+// samples rendered ahead of the audio callback, the render thread pushes and the callback pops
+static audio_sample_t render_buffer[AUDIO_RENDER_BUFFER_SIZE][PAL_AUDIO_CHANNELS];
+static struct spsc_queue render_queue;
+// posted by the audio callback after taking samples, the render thread sleeps on it
+static sem_t render_wakeup;
+static pthread_t render_thread;
+static bool render_thread_started = false;
+static atomic_uint render_ahead_samples = AUDIO_RENDER_AHEAD_BLOCKS * AUDIO_BLOCK_SIZE;
+#endif
+
+#ifdef AUDIO_ENABLE_PROFILING
+static struct audio_profile profile;
+static uint64_t profile_stage_start_ns;
+
+// adds the time since the last stage ended to stage
+#define PROFILE_STAGE_START() (profile_stage_start_ns = pal_get_time_ns())
+#define PROFILE_STAGE_END(stage) do {                               \
+        uint64_t now = pal_get_time_ns();                             \
+        profile.stage_ns[stage] += now - profile_stage_start_ns;    \
+        profile_stage_start_ns = now;                               \
+    } while (0)
+#else
+#define PROFILE_STAGE_START()
+#define PROFILE_STAGE_END(stage)
+#endif
+
+#ifdef AUDIO_ENABLE_STATS
+// published by the audio threads for audio_get_stats, each field on its own
+static struct {
+    atomic_uint load_permille;
+    atomic_uint peak_load_permille;
+    atomic_uint render_us;
+    atomic_uint budget_us;
+    atomic_uint active_voices;
+    atomic_uint peak_voices;
+    atomic_uint active_filters;
+    atomic_uint active_effects;
+    atomic_uint overruns;
+    atomic_uint late_callbacks;
+} stats;
+// set by audio_reset_stats, the thread rendering clears the peaks
+static atomic_bool stats_reset_requested = false;
+// render time and samples of the current load window, audio thread only
+static uint64_t stats_window_render_ns = 0;
+static uint32_t stats_window_samples = 0;
+// start and length of the previous audio callback, callback only
+static uint64_t last_callback_ns = 0;
+static uint32_t last_callback_samples = 0;
+#endif
 
 static void add_oscillator(struct oscillator *osc_to_add) {
     if (num_oscillators < MAX_NUM_OSCILLATORS)
         oscillators[num_oscillators++] = osc_to_add;
 }
 
+static void add_active_oscillator(struct oscillator *osc) {
+    for (int i = 0; i < num_active_oscillators; i++) {
+        if (active_oscillators[i] == osc)
+            return;
+    }
+
+    if (num_active_oscillators < MAX_NUM_OSCILLATORS)
+        active_oscillators[num_active_oscillators++] = osc;
+}
+
+static bool post_command(struct audio_command *command);
+
+static bool is_valid_bus(audio_bus_t bus) {
+    return bus >= 0 && bus < num_buses;
+}
+
+/**
+ * @brief Interpolates pan_sine
+ *
+ * @param position 0 to PAN_POSITION_RIGHT for 0 to pi / 2
+ * @return int32_t
+ */
+static int32_t pan_sine_at(int32_t position) {
+    int i = position >> 8;
+
+    if (i >= 64)
+        return pan_sine[64];
+
+    return pan_sine[i] + (((pan_sine[i + 1] - pan_sine[i]) * (position & 0xFF)) >> 8);
+}
+
+/**
+ * @brief Sets the constant power gains of pan for position
+ *
+ * @param pan
+ * @param position 0 (left) to PAN_POSITION_RIGHT, clamped
+ * @param jump true to set the gains right away instead of ramping to them over the next block
+ */
+static void set_pan_position(struct audio_pan *pan, int32_t position, bool jump) {
+    position = pal_max(0, pal_min(position, PAN_POSITION_RIGHT));
+    pan->targets[0] = pan_sine_at(PAN_POSITION_RIGHT - position);
+    pan->targets[1] = pan_sine_at(position);
+
+    if (jump) {
+        pan->gains[0] = pan->targets[0];
+        pan->gains[1] = pan->targets[1];
+    }
+}
+
+static int32_t pan_to_position(pal_float_t pan) {
+    double position = (PAL_TO_DOUBLE(pan) + 1) * PAN_POSITION_CENTER;
+
+    return position < 0 ? 0 : position > PAN_POSITION_RIGHT ? PAN_POSITION_RIGHT : (int32_t) position;
+}
+
+static void remove_active_oscillator(struct oscillator *osc) {
+    for (int i = 0; i < num_active_oscillators; i++) {
+        if (active_oscillators[i] == osc) {
+            active_oscillators[i] = active_oscillators[--num_active_oscillators];
+            return;
+        }
+    }
+}
+
 void oscillator_delete(struct oscillator *osc) {
+    struct audio_command command = { .type = AUDIO_COMMAND_OSC_DELETE, .osc = { .osc = osc } };
+
+    post_command(&command);
+
     for (int i = 0; i < num_oscillators; i++) {
         if (oscillators[i] == osc) {
             // set current oscillator to the last oscillator in the list, decrement number of oscillators
-            oscillators[i] = oscillators[num_oscillators--];
+            oscillators[i] = oscillators[--num_oscillators];
             return;
         }
     }
@@ -62,9 +479,12 @@ wave_sample_t wave_sample_register(const struct wave_data *wave_data) {
     for (int i = 0; i < MAX_POLYPHONIC_WAVE_SAMPLERS; i++) {
         if (wave_samplers[i].wave_data == NULL) {
             wave_samplers[i].wave_data = wave_data;
+            wave_samplers[i].steal_mode = WAVE_SAMPLE_STEAL_OLDEST;
+            wave_samplers[i].bus = AUDIO_BUS_SFX;
 
             for (int j = 0; j < MAX_CONCURRENT_SAMPLE_VOICES; j++) {
-                wave_samplers[i].channels[j].pointer = 0;
+                wave_samplers[i].channels[j].position = 0;
+                wave_samplers[i].channels[j].position_frac = 0;
                 wave_samplers[i].channels[j].playing = false;
             }
 
@@ -75,110 +495,231 @@ wave_sample_t wave_sample_register(const struct wave_data *wave_data) {
     return (wave_sample_t) -1;
 }
 
-void wave_sample_play(wave_sample_t sample, uint16_t amplitude, pal_float_t speed) {
-    if (sample == -1 || wave_samplers[sample].wave_data == NULL)
-        return;
+static bool wave_data_has_loop(const struct wave_data *wave_data) {
+    return wave_data->loop_end > wave_data->loop_start && wave_data->loop_end <= wave_data->length;
+}
 
-    // find free sample voice and play it
-    for (int8_t i = 0; i < MAX_CONCURRENT_SAMPLE_VOICES; i++) {
-        if (!wave_samplers[sample].channels[i].playing) {
-            wave_samplers[sample].channels[i].playing = true;
-            wave_samplers[sample].channels[i].pointer = 0;
-            wave_samplers[sample].channels[i].pointer_delta = pal_fmax(speed, 0.01);
-            wave_samplers[sample].channels[i].amplitude = amplitude;
-            return;
+static uint32_t speed_to_increment(pal_float_t speed) {
+    speed = pal_fmax(speed, PAL_FLOAT(0.01));
+
+#if defined PAL_USE_FIXED
+    return ((uint64_t) speed << 16) >> PAL_FIXED_FRAC_BITS;
+#else
+    return speed * (1 << 16);
+#endif
+}
+
+/**
+ * @brief Picks channel to play sample on, stealing a busy one if the sampler allows it
+ *
+ * @param sampler
+ * @param stolen set to true if the channel was playing
+ * @return int channel index, -1 if no channel is available
+ */
+static int find_sample_channel(struct polyphonic_wave_sampler *sampler, bool *stolen) {
+    int steal = -1;
+
+    *stolen = false;
+
+    for (int i = 0; i < MAX_CONCURRENT_SAMPLE_VOICES; i++) {
+        struct channel *channel = &sampler->channels[i];
+
+        if (!channel->playing)
+            return i;
+
+        if (steal == -1) {
+            steal = i;
+            continue;
+        }
+
+        // order increases with every play so a smaller order is an older voice
+        bool older = (int32_t) (channel->order - sampler->channels[steal].order) < 0;
+
+        if (sampler->steal_mode == WAVE_SAMPLE_STEAL_QUIETEST) {
+            if (channel->amplitude < sampler->channels[steal].amplitude || (channel->amplitude == sampler->channels[steal].amplitude && older))
+                steal = i;
+        } else if (older) {
+            steal = i;
         }
     }
+
+    if (sampler->steal_mode == WAVE_SAMPLE_STEAL_NONE)
+        return -1;
+
+    *stolen = true;
+    return steal;
 }
 
-void oscillator_change_voice_frequency(struct oscillator *osc, enum oscillator_voice_num voice, pal_float_t frequency) {
-    osc->voices[voice].t_increment = OSC_PERIOD * frequency / PAL_AUDIO_SAMPLE_RATE;
+static void start_sample_voice(wave_sample_t sample, uint16_t amplitude, uint32_t increment, uint32_t id, audio_bus_t bus, int32_t pan_position) {
+    bool stolen;
+    int i = find_sample_channel(&wave_samplers[sample], &stolen);
+
+    if (i == -1)
+        return;
+
+    struct channel *channel = &wave_samplers[sample].channels[i];
+    channel->position = 0;
+    channel->position_frac = 0;
+    channel->increment = increment;
+    channel->amplitude = amplitude;
+    channel->bus = bus;
+    channel->id = id;
+    channel->order = ++last_sample_voice_order;
+    channel->looping = wave_data_has_loop(wave_samplers[sample].wave_data);
+    channel->adpcm.next = 0;
+    channel->adpcm_loop.next = 0;
+    set_pan_position(&channel->pan, pan_position, true);
+    channel->playing = true;
+
+    // a stolen channel is already in the active list
+    if (!stolen)
+        active_sample_channels[num_active_sample_channels++] = (struct active_sample_channel) { sample, i };
 }
 
-enum oscillator_voice_num oscillator_play_voice(struct oscillator *osc, uint16_t amplitude, pal_float_t frequency) {
-    // find voice to play
-    for (enum oscillator_voice_num v = OSC_VOICE_0; v < OSC_MAX_VOICES; v++) {
-        if (osc->voices[v].adsr.state == ADSR_STATE_OFF) {
-            // start playing this voice
-            osc->voices[v].adsr.state = ADSR_STATE_ATTACK;
-            osc->voices[v].amplitude = amplitude;
-            oscillator_change_voice_frequency(osc, v, frequency);
-            return v;
-        }
+static void release_sample_voice(wave_sample_t sample, uint32_t id) {
+    for (int i = 0; i < MAX_CONCURRENT_SAMPLE_VOICES; i++) {
+        struct channel *channel = &wave_samplers[sample].channels[i];
+
+        if (channel->playing && channel->id == id)
+            channel->looping = false;
     }
+}
 
-    return OSC_VOICE_NONE;
+static void pan_sample_voice(wave_sample_t sample, uint32_t id, int32_t position) {
+    for (int i = 0; i < MAX_CONCURRENT_SAMPLE_VOICES; i++) {
+        struct channel *channel = &wave_samplers[sample].channels[i];
+
+        // a voice that hasn't been rendered yet starts at the pan
+        if (channel->playing && channel->id == id)
+            set_pan_position(&channel->pan, position, channel->position == 0 && channel->position_frac == 0);
+    }
 }
 
-void oscillator_stop_voice(struct oscillator *osc, enum oscillator_voice_num voice) {
-    if (osc->voices[voice].adsr.state != ADSR_STATE_OFF)
-        osc->voices[voice].adsr.state = ADSR_STATE_RELEASE;
+struct wave_sample_voice wave_sample_play(wave_sample_t sample, uint16_t amplitude, pal_float_t speed) {
+    struct wave_sample_voice voice = { sample, 0 };
+
+    if (sample == WAVE_SAMPLE_INVALID || wave_samplers[sample].wave_data == NULL)
+        return voice;
+
+    // skip 0 when wrapping, it's the id of voices without a handle
+    if (++last_sample_voice_id == 0)
+        last_sample_voice_id++;
+
+    struct audio_command command = {
+        .type = AUDIO_COMMAND_SAMPLE_PLAY,
+        .sample = { .sample = sample, .amplitude = amplitude, .increment = speed_to_increment(speed), .id = last_sample_voice_id }
+    };
+
+    if (post_command(&command))
+        voice.id = last_sample_voice_id;
+
+    return voice;
 }
 
-void oscillator_init(struct oscillator *osc, uint32_t attack_ms, uint32_t decay_ms, int16_t sustain_value, uint32_t release_ms, oscillator_waveform_func_t waveform) {
-    for (enum oscillator_voice_num v = OSC_VOICE_0; v < OSC_MAX_VOICES; v++) {
-        osc->voices[v].adsr.state = ADSR_STATE_OFF;
-        osc->voices[v].adsr.envelope_value = 0;
-        osc->voices[v].adsr.attack_step = ENVELOPE_VALUE_SCALING * (OSC_AMPLITUDE * 1000) / (attack_ms * PAL_AUDIO_SAMPLE_RATE);
-        osc->voices[v].adsr.decay_step = ENVELOPE_VALUE_SCALING * ((OSC_AMPLITUDE - sustain_value) * 1000) / (decay_ms * PAL_AUDIO_SAMPLE_RATE);
-        osc->voices[v].adsr.sustain = ENVELOPE_VALUE_SCALING * sustain_value;
-        osc->voices[v].adsr.release_step = ENVELOPE_VALUE_SCALING * (sustain_value * 1000) / (release_ms * PAL_AUDIO_SAMPLE_RATE);
-    }
+struct wave_sample_voice wave_sample_play_at(wave_sample_t sample, uint16_t amplitude, pal_float_t speed, pal_float_t game_time) {
+    uint64_t previous_time = command_time;
 
-    osc->waveform = waveform;
-    osc->effect_list_head = NULL;
-    osc->filter_list_head = NULL;
+    command_time = audio_time_to_sample_num(game_time);
+    struct wave_sample_voice voice = wave_sample_play(sample, amplitude, speed);
+    command_time = previous_time;
 
-    add_oscillator(osc);
+    return voice;
 }
 
-void wave_sampler_init() {
-    for (int i = 0; i < MAX_POLYPHONIC_WAVE_SAMPLERS; i++) {
-        wave_samplers[i].wave_data == NULL;
+void wave_sample_release(struct wave_sample_voice voice) {
+    struct audio_command command = { .type = AUDIO_COMMAND_SAMPLE_RELEASE, .sample = { .sample = voice.sample, .id = voice.id } };
 
-        for (int j = 0; j < MAX_CONCURRENT_SAMPLE_VOICES; j++) {
-            wave_samplers[i].channels[j].amplitude = 0;
-            wave_samplers[i].channels[j].pointer = 0;
-            wave_samplers[i].channels[j].playing = false;
-        }
-    }
+    if (voice.sample == WAVE_SAMPLE_INVALID || voice.id == 0)
+        return;
+
+    post_command(&command);
 }
 
-void oscillator_add_effect(struct oscillator *osc, struct effect_node *effect) {
-    if (osc->effect_list_head == NULL) {
-        osc->effect_list_head = effect;
-    } else {
-        // add effect on the end of list
-        struct effect_node *node = osc->effect_list_head;
-        while (node->next != NULL) node = node->next;
-        // node now points to the tail
-        node->next = effect;
-    }
+void wave_sample_set_steal_mode(wave_sample_t sample, enum wave_sample_steal_mode mode) {
+    struct audio_command command = { .type = AUDIO_COMMAND_SAMPLE_STEAL_MODE, .sample = { .sample = sample, .steal_mode = mode } };
+
+    if (sample == WAVE_SAMPLE_INVALID)
+        return;
+
+    post_command(&command);
 }
 
-void oscillator_add_filter(struct oscillator *osc, struct filter_node *filter) {
-    if (osc->filter_list_head == NULL) {
-        osc->filter_list_head = filter;
-    } else {
-        // add filter on the end of list
-        struct filter_node *node = osc->filter_list_head;
-        while (node->next != NULL) node = node->next;
-        // node now points to the tail
-        node->next = filter;
+void wave_sample_set_bus(wave_sample_t sample, audio_bus_t bus) {
+    struct audio_command command = { .type = AUDIO_COMMAND_SAMPLE_BUS, .bus = { .bus = bus, .sample = sample } };
+
+    if (sample == WAVE_SAMPLE_INVALID || !is_valid_bus(bus))
+        return;
+
+    post_command(&command);
+}
+
+void wave_sample_set_pan(struct wave_sample_voice voice, pal_float_t pan) {
+    struct audio_command command = {
+        .type = AUDIO_COMMAND_SAMPLE_PAN,
+        .pan = { .position = pan_to_position(pan), .sample = voice.sample, .id = voice.id }
+    };
+
+    // mono builds mix every voice into the one channel
+    if (PAL_AUDIO_CHANNELS == 1 || voice.sample == WAVE_SAMPLE_INVALID || voice.id == 0)
+        return;
+
+    post_command(&command);
+}
+
+static uint32_t frequency_to_increment(pal_float_t frequency) {
+#if defined PAL_USE_FIXED
+    // widen first, high notes step by more than the fixed point range
+    return ((int64_t) frequency * OSC_PERIOD / PAL_AUDIO_SAMPLE_RATE) >> PAL_FIXED_FRAC_BITS;
+#else
+    return OSC_PERIOD * frequency / PAL_AUDIO_SAMPLE_RATE;
+#endif
+}
+
+void oscillator_change_voice_frequency(struct oscillator *osc, enum oscillator_voice_num voice, pal_float_t frequency) {
+    osc->voices[voice].t_increment = frequency_to_increment(frequency);
+}
+
+/**
+ * @brief Takes free voice of oscillator, safe to call from the game and audio threads
+ *
+ * @param osc
+ * @return enum oscillator_voice_num lowest free voice, OSC_VOICE_NONE if all voices are busy
+ */
+static enum oscillator_voice_num claim_oscillator_voice(struct oscillator *osc) {
+    unsigned int free_voices = atomic_load_explicit(&osc->free_voices, memory_order_acquire);
+
+    while (free_voices != 0) {
+        enum oscillator_voice_num v = __builtin_ctz(free_voices);
+
+        // on failure free_voices is reloaded, retry with the new lowest free voice
+        if (atomic_compare_exchange_weak_explicit(&osc->free_voices, &free_voices, free_voices & ~(1u << v), memory_order_acquire, memory_order_acquire))
+            return v;
     }
+
+    return OSC_VOICE_NONE;
+}
+
+static void free_oscillator_voice(struct oscillator *osc, enum oscillator_voice_num voice) {
+    atomic_fetch_or_explicit(&osc->free_voices, 1u << voice, memory_order_release);
 }
 
-static void advance_adsr_envelope(struct adsr_envelope *adsr) {
+/**
+ * @brief Advances envelope by a control period, stages change at control points
+ *
+ * @param adsr
+ * @param num_samples
+ */
+static void advance_adsr_envelope(struct adsr_envelope *adsr, int num_samples) {
     switch (adsr->state) {
         case ADSR_STATE_ATTACK:
-            adsr->envelope_value += adsr->attack_step;
-            if (adsr->envelope_value >= OSC_AMPLITUDE) {
-                adsr->envelope_value = OSC_AMPLITUDE;
+            adsr->envelope_value += adsr->attack_step * num_samples;
+            if (adsr->envelope_value >= ENVELOPE_MAX) {
+                adsr->envelope_value = ENVELOPE_MAX;
                 adsr->state = ADSR_STATE_DECAY;
             }
             break;
         case ADSR_STATE_DECAY:
-            adsr->envelope_value -= adsr->decay_step;
+            adsr->envelope_value -= adsr->decay_step * num_samples;
             if (adsr->envelope_value <= adsr->sustain) {
                 adsr->envelope_value = adsr->sustain;
                 adsr->state = ADSR_STATE_SUSTAIN;
@@ -188,7 +729,7 @@ static void advance_adsr_envelope(struct adsr_envelope *adsr) {
             adsr->envelope_value = adsr->sustain;
             break;
         case ADSR_STATE_RELEASE:
-            adsr->envelope_value -= adsr->release_step;
+            adsr->envelope_value -= adsr->release_step * num_samples;
             if (adsr->envelope_value <= 0) {
                 adsr->envelope_value = 0;
                 adsr->state = ADSR_STATE_OFF;
@@ -200,283 +741,2144 @@ static void advance_adsr_envelope(struct adsr_envelope *adsr) {
     }
 }
 
-static int32_t run_filter_chain(struct filter_node *filter_list_head, int32_t input_sample) {
-    struct filter_node *filter = filter_list_head;
-    int32_t sample = input_sample;
+/**
+ * @brief Runs control point of voice, sets up the gain ramp to the envelope num_samples later
+ *
+ * @param voice
+ * @param num_samples samples until the next control point
+ */
+static void voice_control_tick(struct oscillator_voice *voice, int num_samples) {
+    // the last ramp ended here, drop the rounding error of its step
+    voice->gain = voice->gain_target;
+
+    if (voice->fm.patch != NULL) {
+        // the operator envelopes shape FM voices, they end once their carriers have faded out
+        if (!fm_voice_control_tick(&voice->fm, voice->adsr.state == ADSR_STATE_RELEASE, num_samples))
+            voice->adsr.state = ADSR_STATE_OFF;
+
+        voice->gain_target = voice->amplitude << GAIN_RAMP_FRAC_BITS;
+    } else {
+        advance_adsr_envelope(&voice->adsr, num_samples);
 
-    while (filter != NULL) {
-        sample = filter->process(filter, sample);
-        filter = filter->next;
+        voice->gain_target = (((voice->adsr.envelope_value >> ENVELOPE_FRAC_BITS) * voice->amplitude) >> 15) << GAIN_RAMP_FRAC_BITS;
     }
 
-    return sample;
+    voice->gain_step = (voice->gain_target - voice->gain) / num_samples;
 }
 
-static int32_t oscillator_get_sample_and_advance(struct oscillator *osc) {
-    int32_t sample = 0;
-
-    // run effects
-    struct effect_node *effect = osc->effect_list_head;
-    while (effect != NULL) {
-        effect->update(osc, effect);
-        effect = effect->next;
-    }
-
-    for (enum oscillator_voice_num v = OSC_VOICE_0; v < OSC_MAX_VOICES; v++) {
-        if (osc->voices[v].adsr.state == ADSR_STATE_OFF)
-            continue;
-
-        sample += (osc->waveform(osc->voices[v].t) * osc->voices[v].adsr.envelope_value / ENVELOPE_VALUE_SCALING) / OSC_AMPLITUDE * osc->voices[v].amplitude / OSC_AMPLITUDE;
-        osc->voices[v].t = (osc->voices[v].t + osc->voices[v].t_increment) & OSC_PERIOD_MASK;
-
-        advance_adsr_envelope(&osc->voices[v].adsr);
-    }
-
-    sample = run_filter_chain(osc->filter_list_head, sample);
+static void start_oscillator_voice(struct oscillator *osc, enum oscillator_voice_num voice, uint16_t amplitude, uint32_t t_increment) {
+    osc->voices[voice].adsr.state = ADSR_STATE_ATTACK;
+    osc->voices[voice].adsr.envelope_value = 0;
+    osc->voices[voice].amplitude = amplitude;
+    osc->voices[voice].t_increment = t_increment;
+    osc->voices[voice].gain_target = 0;
+    osc->voices[voice].fm.patch = NULL;
+
+    if (osc->fm_patch != NULL)
+        fm_voice_start(&osc->voices[voice].fm, osc->fm_patch);
+
+    // an idle oscillator starts its control periods with the note, otherwise the voice ramps up
+    // to the oscillator's next control point so it starts on its exact sample
+    if (osc->num_active_voices == 0)
+        osc->control_samples_left = 0;
+    else if (osc->control_samples_left > 0)
+        voice_control_tick(&osc->voices[voice], osc->control_samples_left);
+
+    osc->active_voices[osc->num_active_voices++] = voice;
+    add_active_oscillator(osc);
+}
 
-    return sample;
+static void release_oscillator_voice(struct oscillator *osc, enum oscillator_voice_num voice) {
+    if (osc->voices[voice].adsr.state != ADSR_STATE_OFF)
+        osc->voices[voice].adsr.state = ADSR_STATE_RELEASE;
 }
 
-static int32_t wave_sampler_get_sample_and_advance() {
-    int32_t sample = 0;
-    int32_t voice_sample;
-    pal_float_t interpolated_sample;
-    pal_float_t interpolation_t, pointer_integral;
-    size_t left_sample_index;
+enum oscillator_voice_num oscillator_play_voice(struct oscillator *osc, uint16_t amplitude, pal_float_t frequency) {
+    enum oscillator_voice_num v = claim_oscillator_voice(osc);
 
-    for (int i = 0; i < MAX_POLYPHONIC_WAVE_SAMPLERS; i++) {
-        if (wave_samplers[i].wave_data == NULL)
-            continue;
+    if (v == OSC_VOICE_NONE)
+        return OSC_VOICE_NONE;
 
-        voice_sample = 0;
+    struct audio_command command = {
+        .type = AUDIO_COMMAND_OSC_PLAY,
+        .osc = { .osc = osc, .voice = v, .amplitude = amplitude, .t_increment = frequency_to_increment(frequency) }
+    };
 
-        for (int j = 0; j < MAX_CONCURRENT_SAMPLE_VOICES; j++) {
-            if (!wave_samplers[i].channels[j].playing)
-                continue;
+    if (!post_command(&command)) {
+        free_oscillator_voice(osc, v);
+        return OSC_VOICE_NONE;
+    }
 
-            wave_samplers[i].channels[j].pointer += wave_samplers[i].channels[j].pointer_delta;
+    return v;
+}
 
-            if (wave_samplers[i].channels[j].pointer >= wave_samplers[i].wave_data->length - 1) {
-                wave_samplers[i].channels[j].playing = false;
-                continue;
-            }
+void oscillator_stop_voice(struct oscillator *osc, enum oscillator_voice_num voice) {
+    struct audio_command command = { .type = AUDIO_COMMAND_OSC_STOP, .osc = { .osc = osc, .voice = voice } };
 
-            interpolation_t = pal_modf(wave_samplers[i].channels[j].pointer, &pointer_integral);
-            left_sample_index = (size_t) pointer_integral;
-            interpolated_sample = lerp(
-                wave_samplers[i].wave_data->data[left_sample_index],
-                wave_samplers[i].wave_data->data[left_sample_index + 1],
-                interpolation_t
-            );
+    post_command(&command);
+}
 
-            voice_sample += interpolated_sample * wave_samplers[i].channels[j].amplitude / OSC_AMPLITUDE;
-        }
+enum oscillator_voice_num oscillator_play_voice_at(struct oscillator *osc, uint16_t amplitude, pal_float_t frequency, pal_float_t game_time) {
+    uint64_t previous_time = command_time;
 
-        sample += voice_sample;
-    }
+    command_time = audio_time_to_sample_num(game_time);
+    enum oscillator_voice_num v = oscillator_play_voice(osc, amplitude, frequency);
+    command_time = previous_time;
 
-    return run_filter_chain(wave_samplers_filter_list_head, sample);
+    return v;
 }
 
-static void add_midi_player(struct midi_player *player_to_add) {
-    if (num_midi_players < MAX_NUM_MIDI_PLAYERS)
-        midi_players[num_midi_players++] = player_to_add;
-}
+void oscillator_stop_voice_at(struct oscillator *osc, enum oscillator_voice_num voice, pal_float_t game_time) {
+    uint64_t previous_time = command_time;
 
-void midi_player_delete(struct midi_player *player) {
-    for (int i = 0; i < num_midi_players; i++) {
-        if (midi_players[i] == player) {
-            // set current player to the last player in the list, decrement number of players
-            midi_players[i] = midi_players[num_midi_players--];
-            return;
-        }
-    }
-    // player not found, who cares
+    command_time = audio_time_to_sample_num(game_time);
+    oscillator_stop_voice(osc, voice);
+    command_time = previous_time;
 }
 
-int32_t square_wave(uint32_t t) {
-    return (t < OSC_PERIOD / 2) ? OSC_AMPLITUDE : -OSC_AMPLITUDE;
+/**
+ * @brief Gets per sample envelope step to change level by level_change in time_ms
+ *
+ * @param level_change OSC_AMPLITUDE full scale
+ * @param time_ms
+ * @return uint32_t at least 1, so every stage ends
+ */
+static uint32_t envelope_step(int32_t level_change, uint32_t time_ms) {
+    uint64_t time_samples = (uint64_t) time_ms * PAL_AUDIO_SAMPLE_RATE / 1000;
+    uint64_t step = ((uint64_t) level_change << ENVELOPE_FRAC_BITS) / (time_samples > 0 ? time_samples : 1);
+
+    return step > 0 ? step : 1;
 }
 
-void midi_player_assign_drum_sample_to_note(struct midi_player *player, wave_sample_t sample, int note_number) {
-    player->drum_samples[note_number] = sample;
-}
+void oscillator_init(struct oscillator *osc, uint32_t attack_ms, uint32_t decay_ms, int16_t sustain_value, uint32_t release_ms, oscillator_waveform_func_t waveform) {
+    if (sustain_value < 0)
+        sustain_value = 0;
 
-void midi_player_init(struct midi_player *player) {
-    for (int i = 0; i < MIDI_NUM_CHANNELS - 1; i++) {
-        oscillator_init(&player->oscillators[i], 10, 100, OSC_AMPLITUDE * 0.9, 100, &square_wave);
-        player->channel_transpose[i] = 0;
+    for (enum oscillator_voice_num v = OSC_VOICE_0; v < OSC_MAX_VOICES; v++) {
+        osc->voices[v].adsr.state = ADSR_STATE_OFF;
+        osc->voices[v].adsr.envelope_value = 0;
+        osc->voices[v].adsr.attack_step = envelope_step(OSC_AMPLITUDE, attack_ms);
+        osc->voices[v].adsr.decay_step = envelope_step(OSC_AMPLITUDE - sustain_value, decay_ms);
+        osc->voices[v].adsr.sustain = sustain_value << ENVELOPE_FRAC_BITS;
+        osc->voices[v].adsr.release_step = envelope_step(sustain_value, release_ms);
+        osc->voices[v].gain = 0;
+        osc->voices[v].gain_step = 0;
+        osc->voices[v].gain_target = 0;
+        osc->voices[v].fm.patch = NULL;
     }
 
-    wave_sampler_init();
-
-    memset(player->drum_samples, WAVE_SAMPLE_INVALID, NUM_DRUM_NOTES * sizeof(wave_sample_t));
+    osc->waveform = waveform;
+    osc->waveform_block = NULL;
+    osc->wavetable = NULL;
+    osc->fm_patch = NULL;
+    osc->num_active_voices = 0;
+    osc->control_samples_left = 0;
+    osc->bus = AUDIO_BUS_SFX;
+    set_pan_position(&osc->pan, PAN_POSITION_CENTER, true);
+    atomic_init(&osc->free_voices, OSC_ALL_VOICES_FREE);
+    osc->effect_list_head = NULL;
+    osc->filter_list_head = NULL;
 
-    add_midi_player(player);
+    add_oscillator(osc);
 }
 
-struct oscillator *midi_player_get_channel_oscillator(struct midi_player *player, uint8_t channel) {
-    if (channel > MIDI_DRUM_CHANNEL)
-        channel--;
+void oscillator_set_waveform_block(struct oscillator *osc, oscillator_waveform_block_func_t waveform_block) {
+    struct audio_command command = { .type = AUDIO_COMMAND_OSC_WAVEFORM_BLOCK, .osc = { .osc = osc, .waveform_block = waveform_block } };
 
-    return &player->oscillators[channel];
+    post_command(&command);
 }
 
-void midi_player_load_midi(struct midi_player *player, uint8_t *midi_data_source) {
-    midi_parser_init(&player->parser, midi_data_source);
-}
+void oscillator_set_wavetable(struct oscillator *osc, const struct wavetable *wavetable) {
+    struct audio_command command = { .type = AUDIO_COMMAND_OSC_WAVETABLE, .osc = { .osc = osc, .wavetable = wavetable } };
 
-static void midi_channel_note_on(struct midi_player *player, uint8_t channel, uint8_t note_number, uint8_t velocity) {
-    uint16_t amplitude = (OSC_AMPLITUDE * velocity) / 127;
+    post_command(&command);
+}
 
-    if (channel == MIDI_DRUM_CHANNEL) {
-        if (player->drum_samples[note_number] != WAVE_SAMPLE_INVALID)
-            wave_sample_play(player->drum_samples[note_number], amplitude, 1.0);
-        else
-            printf("unassigned drum sample on note %d! maybe make it hehe\n", note_number);
-    } else {
-        if (channel > MIDI_DRUM_CHANNEL)
-            channel--;
+bool oscillator_set_fm_patch(struct oscillator *osc, const struct fm_patch *patch) {
+    struct audio_command command = { .type = AUDIO_COMMAND_OSC_FM_PATCH, .osc = { .osc = osc, .fm_patch = patch } };
 
-        enum oscillator_voice_num voice = oscillator_play_voice(&player->oscillators[channel], amplitude, midi_parser_note_frequency(note_number + player->channel_transpose[channel]));
+    if (patch != NULL && !fm_init())
+        return false;
 
-        if (voice == OSC_VOICE_NONE)
-            return; // no voices left! skip note
+    post_command(&command);
 
-        // keep track of what note the voice is playing
-        player->channel_voice_to_note_mapping[channel][voice] = note_number;
-    }
+    return true;
 }
 
-static void midi_channel_note_off(struct midi_player *player, uint8_t channel, uint8_t note_number) {
-    if (channel == MIDI_DRUM_CHANNEL) {
+void oscillator_set_bus(struct oscillator *osc, audio_bus_t bus) {
+    struct audio_command command = { .type = AUDIO_COMMAND_OSC_BUS, .bus = { .bus = bus, .osc = osc } };
+
+    if (!is_valid_bus(bus))
         return;
-    } else {
-        if (channel > MIDI_DRUM_CHANNEL)
-            channel--;
 
-        for (enum oscillator_voice_num v = OSC_VOICE_0; v < OSC_MAX_VOICES; v++) {
-            if (player->channel_voice_to_note_mapping[channel][v] == note_number) {
-                oscillator_stop_voice(&player->oscillators[channel], v);
-            }
-        }
-    }
+    post_command(&command);
 }
 
-static void midi_player_advance(struct midi_player *player, uint32_t delta_time_ns) {
-    struct midi_event event;
-    struct oscillator *osc;
+void oscillator_set_pan(struct oscillator *osc, pal_float_t pan) {
+    struct audio_command command = { .type = AUDIO_COMMAND_OSC_PAN, .pan = { .position = pan_to_position(pan), .osc = osc } };
 
-    // return if no events to parse
-    if (!midi_parser_advance(&player->parser, delta_time_ns))
+    if (PAL_AUDIO_CHANNELS == 1)
         return;
 
-    while (midi_parser_next_event(&player->parser, &event)) {
-        if (event.status.status_code == MIDI_STATUS_NOTE_ON) {
-            midi_channel_note_on(player, event.status.channel, event.note, event.velocity);
-        } else if (event.status.status_code == MIDI_STATUS_NOTE_OFF) {
-            midi_channel_note_off(player, event.status.channel, event.note);
-#if defined(PRINT_MIDI_LYRICS)
-        } else if (event.status.midi_system_code == MIDI_SYSTEM_META_ESCAPE && event.meta.code == MIDI_META_EVENT_LYRIC) {
-            printf("%*s", event.meta.length, (char *) event.meta.data);
-            if (event.meta.data[event.meta.length-1] == '\r')
-                putc('\n', stdout);
-            fflush(stdout);
-#endif
+    post_command(&command);
+}
+
+void wave_sampler_init() {
+    for (int i = 0; i < MAX_POLYPHONIC_WAVE_SAMPLERS; i++) {
+        wave_samplers[i].wave_data == NULL;
+
+        for (int j = 0; j < MAX_CONCURRENT_SAMPLE_VOICES; j++) {
+            wave_samplers[i].channels[j].amplitude = 0;
+            wave_samplers[i].channels[j].position = 0;
+            wave_samplers[i].channels[j].position_frac = 0;
+            wave_samplers[i].channels[j].playing = false;
         }
     }
+
+    num_active_sample_channels = 0;
 }
 
-void midi_player_set_channel_transpose(struct midi_player *player, int channel, int8_t transpose) {
+static void append_effect(struct effect_node **head, struct effect_node *effect) {
+    if (*head == NULL) {
+        *head = effect;
+    } else {
+        // add effect on the end of list
+        struct effect_node *node = *head;
+        while (node->next != NULL) node = node->next;
+        // node now points to the tail
+        node->next = effect;
+    }
+}
+
+static void append_filter(struct filter_node **head, struct filter_node *filter) {
+    if (*head == NULL) {
+        *head = filter;
+    } else {
+        // add filter on the end of list
+        struct filter_node *node = *head;
+        while (node->next != NULL) node = node->next;
+        // node now points to the tail
+        node->next = filter;
+    }
+}
+
+void oscillator_add_effect(struct oscillator *osc, struct effect_node *effect) {
+    struct audio_command command = { .type = AUDIO_COMMAND_ADD_EFFECT, .effect = { &osc->effect_list_head, effect } };
+
+    post_command(&command);
+}
+
+void oscillator_add_filter(struct oscillator *osc, struct filter_node *filter) {
+    struct audio_command command = { .type = AUDIO_COMMAND_ADD_FILTER, .filter = { &osc->filter_list_head, filter } };
+
+    post_command(&command);
+}
+
+static void run_filter(struct filter_node *filter, int32_t *samples, int num_samples) {
+    if (filter->process_block != NULL) {
+        filter->process_block(filter, samples, num_samples);
+        return;
+    }
+
+    for (int i = 0; i < num_samples; i++)
+        samples[i] = filter->process(filter, samples[i]);
+}
+
+static void run_filter_chain(struct filter_node *filter_list_head, int32_t *samples, int num_samples) {
+    for (struct filter_node *filter = filter_list_head; filter != NULL; filter = filter->next)
+        run_filter(filter, samples, num_samples);
+}
+
+/**
+ * @brief Runs filter chain of a bus on every channel of samples
+ *
+ * @param filter_list_head
+ * @param samples
+ * @param num_samples
+ */
+static void run_bus_filter_chain(struct filter_node *filter_list_head, int32_t (*samples)[AUDIO_BLOCK_SIZE], int num_samples) {
+#if PAL_AUDIO_CHANNELS == 1
+    run_filter_chain(filter_list_head, samples[0], num_samples);
+#else
+    for (struct filter_node *filter = filter_list_head; filter != NULL; filter = filter->next) {
+        if (filter->process_stereo_block != NULL) {
+            filter->process_stereo_block(filter, samples[0], samples[1], num_samples);
+            continue;
+        }
+
+        for (int c = 0; c < PAL_AUDIO_CHANNELS; c++)
+            run_filter(filter, samples[c], num_samples);
+    }
+#endif
+}
+
+static void run_effects(struct oscillator *osc, int num_samples) {
+    for (struct effect_node *effect = osc->effect_list_head; effect != NULL; effect = effect->next) {
+        if (effect->update_block != NULL)
+            effect->update_block(osc, effect, num_samples);
+        else
+            effect->update(osc, effect);
+    }
+}
+
+static void render_voice_waveform(struct oscillator *osc, struct oscillator_voice *voice, int32_t *samples, int num_samples) {
+    uint32_t t = voice->t;
+    uint32_t t_increment = voice->t_increment;
+
+    if (voice->fm.patch != NULL) {
+        fm_voice_render(&voice->fm, samples, t_increment, num_samples);
+    } else if (osc->wavetable != NULL) {
+        wavetable_render(osc->wavetable, samples, t, t_increment, num_samples);
+    } else if (osc->waveform_block != NULL) {
+        osc->waveform_block(samples, t, t_increment, num_samples);
+    } else {
+        for (int i = 0; i < num_samples; i++) {
+            samples[i] = osc->waveform(t);
+            t = (t + t_increment) & OSC_PERIOD_MASK;
+        }
+    }
+
+    voice->t = (voice->t + t_increment * num_samples) & OSC_PERIOD_MASK;
+}
+
+/**
+ * @brief Frees the voices whose release ramp has finished, call at a control point
+ *
+ * @param osc
+ */
+static void free_finished_voices(struct oscillator *osc) {
+    for (int active_i = 0; active_i < osc->num_active_voices;) {
+        // replace finished voice with the last active voice and let it be played again
+        if (osc->voices[osc->active_voices[active_i]].adsr.state == ADSR_STATE_OFF) {
+            free_oscillator_voice(osc, osc->active_voices[active_i]);
+            osc->active_voices[active_i] = osc->active_voices[--osc->num_active_voices];
+        } else {
+            active_i++;
+        }
+    }
+}
+
+/**
+ * @brief Runs control point of oscillator, its effects and the envelopes of its voices
+ *
+ * @param osc
+ */
+static void oscillator_control_tick(struct oscillator *osc) {
+    free_finished_voices(osc);
+    run_effects(osc, AUDIO_CONTROL_PERIOD);
+
+    for (int active_i = 0; active_i < osc->num_active_voices; active_i++)
+        voice_control_tick(&osc->voices[osc->active_voices[active_i]], AUDIO_CONTROL_PERIOD);
+
+    osc->control_samples_left = AUDIO_CONTROL_PERIOD;
+}
+
+/**
+ * @brief Renders voice and adds it to samples with its gain ramp
+ *
+ * @param osc
+ * @param voice
+ * @param samples
+ * @param num_samples no more than the samples until the next control point
+ */
+static void render_voice(struct oscillator *osc, struct oscillator_voice *voice, int32_t *samples, int num_samples) {
+    int32_t waveform[AUDIO_BLOCK_SIZE];
+    int32_t gain = voice->gain;
+    int32_t gain_step = voice->gain_step;
+
+    render_voice_waveform(osc, voice, waveform, num_samples);
+
+    if (gain_step == 0) {
+        // sustained voices keep the same gain
+        gain >>= GAIN_RAMP_FRAC_BITS;
+
+        for (int i = 0; i < num_samples; i++)
+            samples[i] += (waveform[i] * gain) >> 15;
+    } else {
+        for (int i = 0; i < num_samples; i++) {
+            gain += gain_step;
+            samples[i] += (waveform[i] * (gain >> GAIN_RAMP_FRAC_BITS)) >> 15;
+        }
+
+        voice->gain = gain;
+    }
+}
+
+/**
+ * @brief Adds mono samples to every channel of a bus with the gains of pan, ramping them to its
+ * targets over the block. Mono builds add them as they are
+ *
+ * @param pan
+ * @param samples
+ * @param output
+ * @param num_samples
+ */
+static void mix_panned(struct audio_pan *pan, const int32_t *samples, int32_t (*output)[AUDIO_BLOCK_SIZE], int num_samples) {
+#if PAL_AUDIO_CHANNELS == 1
+    (void) pan;
+
+    for (int i = 0; i < num_samples; i++)
+        output[0][i] += samples[i];
+#else
+    for (int c = 0; c < PAL_AUDIO_CHANNELS; c++) {
+        int32_t gain = pan->gains[c];
+
+        if (gain == pan->targets[c]) {
+            for (int i = 0; i < num_samples; i++)
+                output[c][i] += ((int64_t) samples[i] * gain) >> PAN_GAIN_FRAC_BITS;
+
+            continue;
+        }
+
+        int32_t gain_step = (pan->targets[c] - gain) / num_samples;
+
+        for (int i = 0; i < num_samples; i++) {
+            gain += gain_step;
+            output[c][i] += ((int64_t) samples[i] * gain) >> PAN_GAIN_FRAC_BITS;
+        }
+
+        pan->gains[c] = pan->targets[c];
+    }
+#endif
+}
+
+/**
+ * @brief Renders block of oscillator output and pans it into the channels of samples
+ *
+ * @param osc
+ * @param samples
+ * @param num_samples
+ * @return true if oscillator still has active voices
+ * @return false if all voices have finished
+ */
+static bool oscillator_render_block(struct oscillator *osc, int32_t (*samples)[AUDIO_BLOCK_SIZE], int num_samples) {
+    int32_t osc_samples[AUDIO_BLOCK_SIZE] = { 0 };
+
+    // envelopes and effects only change at control points, in between voices are a gain ramp
+    for (int offset = 0; offset < num_samples;) {
+        if (osc->control_samples_left == 0)
+            oscillator_control_tick(osc);
+
+        int chunk_size = pal_min(num_samples - offset, osc->control_samples_left);
+
+        for (int active_i = 0; active_i < osc->num_active_voices; active_i++)
+            render_voice(osc, &osc->voices[osc->active_voices[active_i]], osc_samples + offset, chunk_size);
+
+        osc->control_samples_left -= chunk_size;
+        offset += chunk_size;
+    }
+
+    // the ramps of released voices end at the control point, free them there so they can be played again
+    if (osc->control_samples_left == 0)
+        free_finished_voices(osc);
+
+    run_filter_chain(osc->filter_list_head, osc_samples, num_samples);
+    mix_panned(&osc->pan, osc_samples, samples, num_samples);
+
+    return osc->num_active_voices > 0;
+}
+
+/**
+ * @brief Renders block of one sample channel and adds it to samples
+ *
+ * @param channel
+ * @param wave_data
+ * @param samples
+ * @param num_samples
+ * @return true if channel is still playing
+ * @return false if the sample ended
+ */
+static bool render_sample_channel(struct channel *channel, const struct wave_data *wave_data, int32_t *samples, int num_samples) {
+    const int16_t *data = wave_data->data;
+    uint32_t position = channel->position;
+    uint32_t position_frac = channel->position_frac;
+    uint32_t increment_int = channel->increment >> 16;
+    uint32_t increment_frac = channel->increment & 0xffff;
+    int32_t amplitude = channel->amplitude;
+    int32_t left, right;
+    bool playing = true;
+
+    // looping is read once, a release takes effect at the next block
+    if (channel->looping) {
+        uint32_t loop_start = wave_data->loop_start;
+        uint32_t loop_end = wave_data->loop_end;
+        uint32_t loop_length = loop_end - loop_start;
+
+        for (int k = 0; k < num_samples; k++) {
+            position_frac += increment_frac;
+            position += increment_int + (position_frac >> 16);
+            position_frac &= 0xffff;
+
+            while (position >= loop_end)
+                position -= loop_length;
+
+            // interpolate across the loop seam
+            left = data[position];
+            right = data[position + 1 == loop_end ? loop_start : position + 1];
+            samples[k] += (left + (((right - left) * (int32_t) (position_frac >> 1)) >> 15)) * amplitude / OSC_AMPLITUDE;
+        }
+    } else {
+        uint32_t end = wave_data->length - 1;
+
+        for (int k = 0; k < num_samples; k++) {
+            position_frac += increment_frac;
+            position += increment_int + (position_frac >> 16);
+            position_frac &= 0xffff;
+
+            if (position >= end) {
+                playing = false;
+                break;
+            }
+
+            // linear interpolation, fraction is dropped to 15 bits so the difference can't overflow
+            left = data[position];
+            right = data[position + 1];
+            samples[k] += (left + (((right - left) * (int32_t) (position_frac >> 1)) >> 15)) * amplitude / OSC_AMPLITUDE;
+        }
+    }
+
+    channel->position = position;
+    channel->position_frac = position_frac;
+
+    return playing;
+}
+
+static const int16_t adpcm_steps[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66,
+    73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449,
+    494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272,
+    2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493,
+    10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+// step index change for the magnitude bits of a nibble
+static const int8_t adpcm_index_changes[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+/**
+ * @brief Decodes the next IMA-ADPCM sample. The first sample of a block reloads the decoder
+ * state from the block header, so decoding can start at the start of any block
+ *
+ * @param decoder
+ * @param blocks
+ */
+static inline void adpcm_decode_next(struct adpcm_decoder *decoder, const uint8_t *blocks) {
+    uint32_t in_block = decoder->next & (WAVE_ADPCM_BLOCK_SAMPLES - 1);
+    const uint8_t *block = blocks + (decoder->next / WAVE_ADPCM_BLOCK_SAMPLES) * WAVE_ADPCM_BLOCK_BYTES;
+    int32_t predictor = decoder->predictor;
+    int step_index = decoder->step_index;
+
+    if (in_block == 0) {
+        predictor = (int16_t) (block[0] | (block[1] << 8));
+        step_index = block[2];
+    }
+
+    int nibble = (block[WAVE_ADPCM_BLOCK_HEADER_BYTES + in_block / 2] >> ((in_block & 1) * 4)) & 0xF;
+    int32_t step = adpcm_steps[step_index];
+    int32_t difference = step >> 3;
+
+    if (nibble & 4)
+        difference += step;
+    if (nibble & 2)
+        difference += step >> 1;
+    if (nibble & 1)
+        difference += step >> 2;
+
+    predictor += (nibble & 8) ? -difference : difference;
+    predictor = predictor > INT16_MAX ? INT16_MAX : predictor < INT16_MIN ? INT16_MIN : predictor;
+    step_index += adpcm_index_changes[nibble & 7];
+
+    decoder->previous = decoder->predictor;
+    decoder->predictor = predictor;
+    decoder->step_index = step_index < 0 ? 0 : step_index > 88 ? 88 : step_index;
+    decoder->next++;
+}
+
+/**
+ * @brief Renders block of IMA-ADPCM sample channel and adds it to samples, decoding only as far
+ * as the voice plays. Same playback as render_sample_channel
+ *
+ * @param channel
+ * @param wave_data
+ * @param samples
+ * @param num_samples
+ * @return true if channel is still playing
+ * @return false if the sample ended
+ */
+static bool render_adpcm_channel(struct channel *channel, const struct wave_data *wave_data, int32_t *samples, int num_samples) {
+    const uint8_t *blocks = wave_data->adpcm_data;
+    struct adpcm_decoder decoder = channel->adpcm;
+    uint32_t position = channel->position;
+    uint32_t position_frac = channel->position_frac;
+    uint32_t increment_int = channel->increment >> 16;
+    uint32_t increment_frac = channel->increment & 0xffff;
+    int32_t amplitude = channel->amplitude;
+    int32_t left, right;
+    bool playing = true;
+
+    if (channel->looping) {
+        uint32_t loop_start = wave_data->loop_start;
+        uint32_t loop_end = wave_data->loop_end;
+        uint32_t loop_length = loop_end - loop_start;
+
+        for (int k = 0; k < num_samples; k++) {
+            position_frac += increment_frac;
+            position += increment_int + (position_frac >> 16);
+            position_frac &= 0xffff;
+
+            if (position >= loop_end) {
+                while (position >= loop_end)
+                    position -= loop_length;
+
+                // the state at loop_start is missing only if the voice skipped over it, decode
+                // again from the start of its block then
+                if (channel->adpcm_loop.next != 0)
+                    decoder = channel->adpcm_loop;
+                else
+                    decoder.next = loop_start & ~(WAVE_ADPCM_BLOCK_SAMPLES - 1);
+            }
+
+            // the last sample of the loop interpolates to the first one
+            uint32_t decode_end = position + 1 == loop_end ? position + 1 : position + 2;
+
+            while (decoder.next < decode_end) {
+                adpcm_decode_next(&decoder, blocks);
+
+                if (decoder.next == loop_start + 1)
+                    channel->adpcm_loop = decoder;
+            }
+
+            if (position + 1 == loop_end) {
+                left = decoder.predictor;
+                right = channel->adpcm_loop.predictor;
+            } else {
+                left = decoder.previous;
+                right = decoder.predictor;
+            }
+
+            samples[k] += (left + (((right - left) * (int32_t) (position_frac >> 1)) >> 15)) * amplitude / OSC_AMPLITUDE;
+        }
+    } else {
+        uint32_t end = wave_data->length - 1;
+
+        for (int k = 0; k < num_samples; k++) {
+            position_frac += increment_frac;
+            position += increment_int + (position_frac >> 16);
+            position_frac &= 0xffff;
+
+            if (position >= end) {
+                playing = false;
+                break;
+            }
+
+            // decoded up to the sample after position, for the interpolation
+            while (decoder.next < position + 2)
+                adpcm_decode_next(&decoder, blocks);
+
+            left = decoder.previous;
+            right = decoder.predictor;
+            samples[k] += (left + (((right - left) * (int32_t) (position_frac >> 1)) >> 15)) * amplitude / OSC_AMPLITUDE;
+        }
+    }
+
+    channel->adpcm = decoder;
+    channel->position = position;
+    channel->position_frac = position_frac;
+
+    return playing;
+}
+
+/**
+ * @brief Renders block of all wave samplers and adds every channel to the samples of its bus
+ *
+ * @param num_samples
+ */
+static void wave_sampler_render_block(int num_samples) {
+    struct channel *channel;
+
+    for (int i = 0; i < num_active_sample_channels;) {
+        struct polyphonic_wave_sampler *sampler = &wave_samplers[active_sample_channels[i].sampler];
+        channel = &sampler->channels[active_sample_channels[i].channel];
+
+        if (channel->playing) {
+#if PAL_AUDIO_CHANNELS == 1
+            int32_t *samples = bus_samples[channel->bus][0];
+#else
+            // rendered on their own to be panned into the bus
+            int32_t samples[AUDIO_BLOCK_SIZE];
+
+            memset(samples, 0, num_samples * sizeof(int32_t));
+#endif
+
+            if (sampler->wave_data->format == WAVE_DATA_IMA_ADPCM)
+                channel->playing = render_adpcm_channel(channel, sampler->wave_data, samples, num_samples);
+            else
+                channel->playing = render_sample_channel(channel, sampler->wave_data, samples, num_samples);
+
+#if PAL_AUDIO_CHANNELS == 2
+            mix_panned(&channel->pan, samples, bus_samples[channel->bus], num_samples);
+#endif
+        }
+
+        // replace finished channel with the last active channel
+        if (!channel->playing)
+            active_sample_channels[i] = active_sample_channels[--num_active_sample_channels];
+        else
+            i++;
+    }
+}
+
+static void start_drum_voice(const struct drum_patch *patch, uint16_t amplitude, audio_bus_t bus, int32_t pan_position) {
+    struct drum_voice *voice = &drum_voices[0];
+
+    if (patch->choke_group != 0) {
+        for (int i = 0; i < num_active_drum_voices; i++) {
+            if (drum_voices[i].patch->choke_group == patch->choke_group)
+                drum_voice_choke(&drum_voices[i]);
+        }
+    }
+
+    if (num_active_drum_voices < AUDIO_MAX_DRUM_VOICES) {
+        voice = &drum_voices[num_active_drum_voices++];
+    } else {
+        // every voice is busy, replace the quietest
+        for (int i = 1; i < AUDIO_MAX_DRUM_VOICES; i++) {
+            if (drum_voice_level(&drum_voices[i]) < drum_voice_level(voice))
+                voice = &drum_voices[i];
+        }
+    }
+
+    drum_voice_start(voice, patch, amplitude);
+    voice->bus = bus;
+    set_pan_position(&voice->pan, pan_position, true);
+}
+
+/**
+ * @brief Renders block of all drum voices and adds every voice to the samples of its bus
+ *
+ * @param num_samples
+ */
+static void drum_render_block(int num_samples) {
+    for (int i = 0; i < num_active_drum_voices;) {
+        struct drum_voice *voice = &drum_voices[i];
+#if PAL_AUDIO_CHANNELS == 1
+        bool playing = drum_voice_render(voice, bus_samples[voice->bus][0], num_samples);
+#else
+        int32_t samples[AUDIO_BLOCK_SIZE];
+
+        memset(samples, 0, num_samples * sizeof(int32_t));
+
+        bool playing = drum_voice_render(voice, samples, num_samples);
+
+        mix_panned(&voice->pan, samples, bus_samples[voice->bus], num_samples);
+#endif
+
+        // swap the finished voice with the last playing one, keeping its noise state in the pool
+        if (!playing) {
+            struct drum_voice finished = *voice;
+
+            *voice = drum_voices[--num_active_drum_voices];
+            drum_voices[num_active_drum_voices] = finished;
+        } else {
+            i++;
+        }
+    }
+}
+
+static void add_midi_player(struct midi_player *player_to_add) {
+    if (num_midi_players < MAX_NUM_MIDI_PLAYERS)
+        midi_players[num_midi_players++] = player_to_add;
+}
+
+static void remove_midi_player(struct midi_player *player) {
+    for (int i = 0; i < num_midi_players; i++) {
+        if (midi_players[i] == player) {
+            // set current player to the last player in the list, decrement number of players
+            midi_players[i] = midi_players[--num_midi_players];
+            return;
+        }
+    }
+    // player not found, who cares
+}
+
+void midi_player_delete(struct midi_player *player) {
+    struct audio_command command = { .type = AUDIO_COMMAND_MIDI_DELETE, .midi = { .player = player } };
+
+    post_command(&command);
+}
+
+int32_t square_wave(uint32_t t) {
+    return (t < OSC_PERIOD / 2) ? OSC_AMPLITUDE : -OSC_AMPLITUDE;
+}
+
+void square_wave_block(int32_t *samples, uint32_t t, uint32_t t_increment, int num_samples) {
+    for (int i = 0; i < num_samples; i++) {
+        samples[i] = (t < OSC_PERIOD / 2) ? OSC_AMPLITUDE : -OSC_AMPLITUDE;
+        t = (t + t_increment) & OSC_PERIOD_MASK;
+    }
+}
+
+void midi_player_assign_drum_sample_to_note(struct midi_player *player, wave_sample_t sample, int note_number) {
+    player->drum_samples[note_number] = sample;
+}
+
+static void set_midi_player_bus(struct midi_player *player, audio_bus_t bus) {
+    player->bus = bus;
+
+    for (int i = 0; i < MIDI_NUM_CHANNELS - 1; i++)
+        player->oscillators[i].bus = bus;
+}
+
+void midi_player_init(struct midi_player *player) {
+    // falls back to the naive square wave if the wavetable pool is full
+    const struct wavetable *square = wavetable_get_builtin(WAVETABLE_SQUARE);
+
+    for (int i = 0; i < MIDI_NUM_CHANNELS - 1; i++) {
+        oscillator_init(&player->oscillators[i], 10, 100, OSC_AMPLITUDE * 0.9, 100, &square_wave);
+        oscillator_set_waveform_block(&player->oscillators[i], &square_wave_block);
+        oscillator_set_wavetable(&player->oscillators[i], square);
+        player->channel_transpose[i] = 0;
+    }
+
+    set_midi_player_bus(player, AUDIO_BUS_MUSIC);
+    player->drum_pan = PAN_POSITION_CENTER;
+    player->drum_kit = &drum_kit_gm;
+    player->fm_bank = NULL;
+
+    wave_sampler_init();
+
+    memset(player->drum_samples, WAVE_SAMPLE_INVALID, NUM_DRUM_NOTES * sizeof(wave_sample_t));
+    // nothing to play until midi is loaded
+    player->parser.num_tracks = 0;
+    player->parser.loop = false;
+    player->stream = NULL;
+    player->index = NULL;
+
+    add_midi_player(player);
+}
+
+struct oscillator *midi_player_get_channel_oscillator(struct midi_player *player, uint8_t channel) {
     if (channel > MIDI_DRUM_CHANNEL)
         channel--;
 
-    player->channel_transpose[channel] = transpose;
+    return &player->oscillators[channel];
+}
+
+void midi_player_load_midi(struct midi_player *player, uint8_t *midi_data_source) {
+    struct audio_command command = { .type = AUDIO_COMMAND_MIDI_LOAD, .midi = { .player = player, .midi_data = midi_data_source } };
+
+    post_command(&command);
+}
+
+void midi_player_load_stream(struct midi_player *player, const struct midi_stream *stream) {
+    struct audio_command command = { .type = AUDIO_COMMAND_MIDI_LOAD_STREAM, .midi = { .player = player, .stream = stream } };
+
+    post_command(&command);
+}
+
+static void midi_player_start_stream(struct midi_player *player, const struct midi_stream *stream) {
+    player->stream = stream;
+    player->index = NULL;
+    player->stream_position = 0;
+    player->stream_event_position = stream->num_events > 0 ? stream->events[0].delta_samples : 0;
+    player->stream_time = 0;
+    // the parser plays nothing, its loop settings and playback rate are used for the stream
+    player->parser.num_tracks = 0;
+    player->parser.loop = false;
+    player->parser.loop_start = stream->loop_start;
+    player->parser.loop_end = stream->loop_end;
+    player->parser.playback_rate = MIDI_PLAYBACK_RATE_ONE;
+}
+
+static void midi_channel_note_on(struct midi_player *player, uint8_t channel, uint8_t note_number, uint8_t velocity) {
+    uint16_t amplitude = (MIDI_NOTE_AMPLITUDE * velocity) / 127;
+
+    if (channel == MIDI_DRUM_CHANNEL) {
+        // samples take priority over the drum kit
+        if (player->drum_samples[note_number] != WAVE_SAMPLE_INVALID)
+            start_sample_voice(player->drum_samples[note_number], (OSC_AMPLITUDE * velocity) / 127, 1 << 16, 0, player->bus, player->drum_pan);
+        else if (player->drum_kit != NULL && player->drum_kit->note_patches[note_number] != 0)
+            start_drum_voice(&player->drum_kit->patches[player->drum_kit->note_patches[note_number] - 1], (OSC_AMPLITUDE * velocity) / 127, player->bus, player->drum_pan);
+#if defined(PRINT_MIDI_MISSING_DRUMS)
+        else
+            printf("unassigned drum sample on note %d!\n", note_number);
+#endif
+    } else {
+        if (channel > MIDI_DRUM_CHANNEL)
+            channel--;
+
+        struct oscillator *osc = &player->oscillators[channel];
+        enum oscillator_voice_num voice = claim_oscillator_voice(osc);
+
+        if (voice == OSC_VOICE_NONE)
+            return; // no voices left! skip note
+
+        start_oscillator_voice(osc, voice, amplitude, frequency_to_increment(midi_parser_note_frequency(note_number + player->channel_transpose[channel])));
+
+        // keep track of what note the voice is playing
+        player->channel_voice_to_note_mapping[channel][voice] = note_number;
+    }
+}
+
+static void midi_channel_note_off(struct midi_player *player, uint8_t channel, uint8_t note_number) {
+    if (channel == MIDI_DRUM_CHANNEL) {
+        return;
+    } else {
+        if (channel > MIDI_DRUM_CHANNEL)
+            channel--;
+
+        for (enum oscillator_voice_num v = OSC_VOICE_0; v < OSC_MAX_VOICES; v++) {
+            if (player->channel_voice_to_note_mapping[channel][v] == note_number) {
+                release_oscillator_voice(&player->oscillators[channel], v);
+            }
+        }
+    }
+}
+
+static void midi_channel_pan(struct midi_player *player, uint8_t channel, uint8_t value) {
+    // 64 is the center, 0 and 127 are all the way left and right
+    int32_t position = value <= 64 ? value * PAN_POSITION_CENTER / 64 : PAN_POSITION_CENTER + (value - 64) * PAN_POSITION_CENTER / 63;
+
+    if (channel == MIDI_DRUM_CHANNEL) {
+        player->drum_pan = position;
+        return;
+    }
+
+    if (channel > MIDI_DRUM_CHANNEL)
+        channel--;
+
+    set_pan_position(&player->oscillators[channel].pan, position, false);
+}
+
+static void midi_channel_program(struct midi_player *player, uint8_t channel, uint8_t program) {
+    const struct fm_bank *bank = player->fm_bank;
+    uint8_t patch;
+
+    if (channel == MIDI_DRUM_CHANNEL || bank == NULL)
+        return;
+
+    if (channel > MIDI_DRUM_CHANNEL)
+        channel--;
+
+    // programs without a patch go back to the channel's wavetable, playing notes keep their patch
+    patch = bank->program_patches[program & 0x7F];
+    player->oscillators[channel].fm_patch = patch != 0 ? &bank->patches[patch - 1] : NULL;
+}
+
+static void midi_player_handle_event(struct midi_player *player, const struct midi_event *event) {
+    if (event->status.status_code == MIDI_STATUS_NOTE_ON) {
+        midi_channel_note_on(player, event->status.channel, event->note, event->velocity);
+    } else if (event->status.status_code == MIDI_STATUS_NOTE_OFF) {
+        midi_channel_note_off(player, event->status.channel, event->note);
+    } else if (event->status.status_code == MIDI_STATUS_CONTROL_CHANGE && event->controller.number == MIDI_CONTROLLER_PAN) {
+        midi_channel_pan(player, event->status.channel, event->controller.value);
+    } else if (event->status.status_code == MIDI_STATUS_PROGRAM_CHANGE) {
+        midi_channel_program(player, event->status.channel, event->program);
+#if defined(PRINT_MIDI_LYRICS)
+    } else if (event->status.midi_system_code == MIDI_SYSTEM_META_ESCAPE && event->meta.code == MIDI_META_EVENT_LYRIC) {
+        printf("%*s", event->meta.length, (char *) event->meta.data);
+        if (event->meta.data[event->meta.length-1] == '\r')
+            putc('\n', stdout);
+        fflush(stdout);
+#endif
+    }
+}
+
+/**
+ * @brief Gets the number of output samples until player's stream reaches song position, rounded
+ * up like the parser does
+ *
+ * @param player
+ * @param position
+ * @return uint32_t
+ */
+static uint32_t stream_samples_until_position(struct midi_player *player, uint64_t position) {
+    if (position >= (UINT64_MAX >> MIDI_PLAYBACK_RATE_FRAC_BITS))
+        return UINT32_MAX - 1;
+
+    uint64_t time = position << MIDI_PLAYBACK_RATE_FRAC_BITS;
+
+    if (time <= player->stream_time)
+        return 0;
+
+    // exact at playback rate 1, the stream time only has a fraction at other rates
+    uint64_t samples = (time - player->stream_time + player->parser.playback_rate - 1) / player->parser.playback_rate;
+
+    return samples < UINT32_MAX ? samples : UINT32_MAX - 1;
+}
+
+/**
+ * @brief Gets the number of output samples until player's stream reaches the end of the loop,
+ * the end of the song if that's first
+ *
+ * @param player
+ * @return uint32_t 0 if playback has to jump back to the loop start now
+ */
+static uint32_t stream_samples_until_loop_end(struct midi_player *player) {
+    struct midi_parser *parser = &player->parser;
+    uint64_t position = player->stream_time >> MIDI_PLAYBACK_RATE_FRAC_BITS;
+    uint64_t loop_end = parser->loop_end < player->stream->length ? parser->loop_end : player->stream->length;
+    // like the parser, the song ends once the events at its end are handled
+    bool ended = player->stream_position >= player->stream->num_events && position >= player->stream->length;
+
+    if (!parser->loop || parser->loop_end <= parser->loop_start)
+        return UINT32_MAX;
+
+    // right after jumping back the position is the loop start, so an empty loop doesn't jump forever
+    if (position > parser->loop_start && (ended || position >= parser->loop_end))
+        return 0;
+
+    return loop_end > position ? stream_samples_until_position(player, loop_end) : UINT32_MAX;
+}
+
+/**
+ * @brief Moves playback of player's midi to song position, the notes that are on there start again
+ *
+ * @param player
+ * @param position song position in output samples
+ */
+static void midi_player_seek_position(struct midi_player *player, uint64_t position) {
+    struct midi_held_notes held_notes;
+
+    for (int i = 0; i < MIDI_NUM_CHANNELS - 1; i++) {
+        struct oscillator *osc = &player->oscillators[i];
+
+        for (int v = 0; v < osc->num_active_voices; v++)
+            release_oscillator_voice(osc, osc->active_voices[v]);
+    }
+
+    if (player->stream != NULL) {
+        midi_stream_seek(player->stream, position, &player->stream_position, &player->stream_event_position, &held_notes);
+        player->stream_time = position << MIDI_PLAYBACK_RATE_FRAC_BITS;
+    } else {
+        midi_parser_seek(&player->parser, player->index, position, &held_notes);
+    }
+
+    for (int i = 0; i < held_notes.num_notes; i++)
+        midi_channel_note_on(player, held_notes.notes[i].channel, held_notes.notes[i].note, held_notes.notes[i].velocity);
+}
+
+/**
+ * @brief Handles the due events of player's stream, no parsing needed
+ *
+ * @param player
+ * @return uint32_t samples until the next event or loop end of player
+ */
+static uint32_t midi_player_run_stream_events(struct midi_player *player) {
+    const struct midi_stream *stream = player->stream;
+    struct midi_event event;
+    uint32_t samples_until_next_event;
+    uint32_t samples_until_loop_end;
+
+    while (true) {
+        // the loop end isn't part of the loop, jump back before the events there
+        if (stream_samples_until_loop_end(player) == 0)
+            midi_player_seek_position(player, player->parser.loop_start);
+
+        if (player->stream_position >= stream->num_events)
+            samples_until_next_event = UINT32_MAX;
+        else
+            samples_until_next_event = stream_samples_until_position(player, player->stream_event_position);
+
+        if (samples_until_next_event != 0)
+            break;
+
+        midi_stream_read_event(&stream->events[player->stream_position++], &event);
+        midi_player_handle_event(player, &event);
+
+        if (player->stream_position < stream->num_events)
+            player->stream_event_position += stream->events[player->stream_position].delta_samples;
+    }
+
+    samples_until_loop_end = stream_samples_until_loop_end(player);
+
+    return samples_until_next_event < samples_until_loop_end ? samples_until_next_event : samples_until_loop_end;
+}
+
+/**
+ * @brief Handles the events of player that are due at the current sample
+ *
+ * @param player
+ * @return uint32_t samples until the next event or loop end of player
+ */
+static uint32_t midi_player_run_events(struct midi_player *player) {
+    struct midi_event event;
+    uint32_t samples_until_next_event;
+    uint32_t samples_until_loop_end;
+
+    if (player->stream != NULL)
+        return midi_player_run_stream_events(player);
+
+    // handling events reads the next delta times, which can be 0 for events at the same time
+    while (true) {
+        // the loop end isn't part of the loop, jump back before the events there
+        if (midi_parser_samples_until_loop_end(&player->parser) == 0)
+            midi_player_seek_position(player, player->parser.loop_start);
+
+        if ((samples_until_next_event = midi_parser_samples_until_next_event(&player->parser)) != 0)
+            break;
+
+        while (midi_parser_next_event(&player->parser, &event))
+            midi_player_handle_event(player, &event);
+    }
+
+    samples_until_loop_end = midi_parser_samples_until_loop_end(&player->parser);
+
+    return samples_until_next_event < samples_until_loop_end ? samples_until_next_event : samples_until_loop_end;
+}
+
+void midi_player_set_index(struct midi_player *player, const struct midi_index *index) {
+    struct audio_command command = { .type = AUDIO_COMMAND_MIDI_INDEX, .midi = { .player = player, .index = index } };
+
+    post_command(&command);
+}
+
+/**
+ * @brief Converts seconds to a midi song position
+ *
+ * @param seconds
+ * @return uint64_t song position in output samples
+ */
+static uint64_t seconds_to_song_position(pal_float_t seconds) {
+    double position = PAL_TO_DOUBLE(seconds) * PAL_AUDIO_SAMPLE_RATE;
+
+    return position > 0 ? (uint64_t) position : 0;
+}
+
+void midi_player_seek(struct midi_player *player, pal_float_t seconds) {
+    struct audio_command command = { .type = AUDIO_COMMAND_MIDI_SEEK, .midi = { .player = player, .position = seconds_to_song_position(seconds) } };
+
+    post_command(&command);
+}
+
+void midi_player_seek_beat(struct midi_player *player, uint32_t beat) {
+    struct audio_command command = { .type = AUDIO_COMMAND_MIDI_SEEK_BEAT, .midi = { .player = player, .beat = beat } };
+
+    post_command(&command);
+}
+
+void midi_player_set_loop(struct midi_player *player, bool loop) {
+    struct audio_command command = { .type = AUDIO_COMMAND_MIDI_LOOP, .midi = { .player = player, .loop = loop } };
+
+    post_command(&command);
+}
+
+void midi_player_set_loop_points(struct midi_player *player, pal_float_t loop_start, pal_float_t loop_end) {
+    struct audio_command command = { .type = AUDIO_COMMAND_MIDI_LOOP_POINTS, .midi = { .player = player, .position = seconds_to_song_position(loop_start), .loop_end = seconds_to_song_position(loop_end) } };
+
+    post_command(&command);
+}
+
+void midi_player_set_playback_rate(struct midi_player *player, pal_float_t rate) {
+    double playback_rate = PAL_TO_DOUBLE(rate) * MIDI_PLAYBACK_RATE_ONE;
+    struct audio_command command = { .type = AUDIO_COMMAND_MIDI_PLAYBACK_RATE, .midi = { .player = player } };
+
+    // clamped before converting, the parser clamps it again
+    command.midi.playback_rate = playback_rate < 1 ? 1 : playback_rate > MIDI_PLAYBACK_RATE_MAX ? MIDI_PLAYBACK_RATE_MAX : (uint32_t) playback_rate;
+
+    post_command(&command);
+}
+
+void midi_player_set_channel_transpose(struct midi_player *player, int channel, int8_t transpose) {
+    struct audio_command command = { .type = AUDIO_COMMAND_MIDI_TRANSPOSE, .midi = { .player = player, .channel = channel, .transpose = transpose } };
+
+    if (channel > MIDI_DRUM_CHANNEL)
+        command.midi.channel--;
+
+    post_command(&command);
+}
+
+void midi_player_set_drum_kit(struct midi_player *player, const struct drum_kit *kit) {
+    struct audio_command command = { .type = AUDIO_COMMAND_MIDI_DRUM_KIT, .midi = { .player = player, .drum_kit = kit } };
+
+    post_command(&command);
+}
+
+bool midi_player_set_fm_bank(struct midi_player *player, const struct fm_bank *bank) {
+    struct audio_command command = { .type = AUDIO_COMMAND_MIDI_FM_BANK, .midi = { .player = player, .fm_bank = bank } };
+
+    if (bank != NULL && !fm_init())
+        return false;
+
+    post_command(&command);
+
+    return true;
+}
+
+void midi_player_set_bus(struct midi_player *player, audio_bus_t bus) {
+    struct audio_command command = { .type = AUDIO_COMMAND_MIDI_BUS, .bus = { .bus = bus, .player = player } };
+
+    if (!is_valid_bus(bus))
+        return;
+
+    post_command(&command);
+}
+
+/**
+ * @brief Handles the due events of all midi players
+ *
+ * @param block_size
+ * @return int block_size shortened so the block ends at the next event
+ */
+static int run_all_midi_events(int block_size) {
+    for (int i = 0; i < num_midi_players; i++) {
+        uint32_t samples_until_next_event = midi_player_run_events(midi_players[i]);
+
+        if (samples_until_next_event < (uint32_t) block_size)
+            block_size = samples_until_next_event;
+    }
+
+    return block_size;
+}
+
+static void advance_all_midi_players(int num_samples) {
+    for (int i = 0; i < num_midi_players; i++) {
+        struct midi_player *player = midi_players[i];
+
+        if (player->stream != NULL)
+            player->stream_time += (uint64_t) num_samples * player->parser.playback_rate;
+        else
+            midi_parser_advance(&player->parser, num_samples);
+    }
+}
+
+audio_bus_t audio_bus_add(audio_bus_t output) {
+    // the mixing order is compiled when audio starts
+    if (audio_started || num_buses >= AUDIO_MAX_BUSES || !is_valid_bus(output))
+        return AUDIO_BUS_INVALID;
+
+    buses[num_buses].output = output;
+
+    return (audio_bus_t) num_buses++;
+}
+
+void audio_bus_set_gain(audio_bus_t bus, pal_float_t gain) {
+    double bus_gain = PAL_TO_DOUBLE(gain) * BUS_GAIN_ONE;
+    struct audio_command command = { .type = AUDIO_COMMAND_BUS_GAIN, .bus = { .bus = bus } };
+
+    if (!is_valid_bus(bus))
+        return;
+
+    command.bus.gain = bus_gain < 0 ? 0 : bus_gain > BUS_GAIN_MAX ? BUS_GAIN_MAX : (int32_t) bus_gain;
+
+    post_command(&command);
+}
+
+void audio_bus_add_filter(audio_bus_t bus, struct filter_node *filter) {
+    struct audio_command command = { .type = AUDIO_COMMAND_ADD_FILTER, .filter = { &buses[bus].filter_head, filter } };
+
+    if (!is_valid_bus(bus))
+        return;
+
+    post_command(&command);
+}
+
+void audio_set_master_volume(pal_float_t gain) {
+    audio_bus_set_gain(AUDIO_BUS_MASTER, gain);
+}
+
+void audio_add_filter(struct filter_node *filter) {
+    audio_bus_add_filter(AUDIO_BUS_MASTER, filter);
+}
+
+/**
+ * @brief Compiles bus graph into bus_mix_order, deepest buses first
+ *
+ */
+static void compile_bus_graph() {
+    int depth[AUDIO_MAX_BUSES] = { 0 };
+    int max_depth = 0;
+    int num_mixed = 0;
+
+    // a bus is always added after its output
+    for (int bus = AUDIO_BUS_MASTER + 1; bus < num_buses; bus++) {
+        depth[bus] = depth[buses[bus].output] + 1;
+        max_depth = pal_max(max_depth, depth[bus]);
+    }
+
+    for (int d = max_depth; d > 0; d--) {
+        for (int bus = AUDIO_BUS_MASTER + 1; bus < num_buses; bus++) {
+            if (depth[bus] == d)
+                bus_mix_order[num_mixed++] = bus;
+        }
+    }
+}
+
+/**
+ * @brief Applies gain of bus to samples, ramping it over the block if it changed
+ *
+ * @param bus
+ * @param samples
+ * @param num_samples
+ */
+static void apply_bus_gain(struct mixer_bus *bus, int32_t (*samples)[AUDIO_BLOCK_SIZE], int num_samples) {
+    int32_t gain_step = (bus->gain_target - bus->gain) / num_samples;
+
+    if (bus->gain == bus->gain_target && bus->gain == BUS_GAIN_ONE)
+        return;
+
+    for (int c = 0; c < PAL_AUDIO_CHANNELS; c++) {
+        int32_t gain = bus->gain;
+
+        if (gain_step == 0) {
+            for (int i = 0; i < num_samples; i++)
+                samples[c][i] = ((int64_t) samples[c][i] * gain) >> BUS_GAIN_FRAC_BITS;
+
+            continue;
+        }
+
+        for (int i = 0; i < num_samples; i++) {
+            gain += gain_step;
+            samples[c][i] = ((int64_t) samples[c][i] * gain) >> BUS_GAIN_FRAC_BITS;
+        }
+    }
+
+    bus->gain = bus->gain_target;
 }
 
-static void advance_all_midi_players() {
-    for (int i = 0; i < num_midi_players; i++) {
-        midi_player_advance(midi_players[i], (uint32_t) pal_round(1000000000 / PAL_AUDIO_SAMPLE_RATE));
+/**
+ * @brief Runs filters and gains of the buses and mixes every bus into its output, leaves the
+ * final mix in the samples of the master bus
+ *
+ * @param num_samples
+ */
+static void mix_buses(int num_samples) {
+    for (int i = 0; i < num_buses - 1; i++) {
+        struct mixer_bus *bus = &buses[bus_mix_order[i]];
+        int32_t (*samples)[AUDIO_BLOCK_SIZE] = bus_samples[bus_mix_order[i]];
+        int32_t (*output)[AUDIO_BLOCK_SIZE] = bus_samples[bus->output];
+
+        run_bus_filter_chain(bus->filter_head, samples, num_samples);
+        apply_bus_gain(bus, samples, num_samples);
+
+        for (int c = 0; c < PAL_AUDIO_CHANNELS; c++) {
+            for (int k = 0; k < num_samples; k++)
+                output[c][k] += samples[c][k];
+        }
     }
+
+    run_bus_filter_chain(buses[AUDIO_BUS_MASTER].filter_head, bus_samples[AUDIO_BUS_MASTER], num_samples);
+    apply_bus_gain(&buses[AUDIO_BUS_MASTER], bus_samples[AUDIO_BUS_MASTER], num_samples);
 }
 
-void audio_set_master_volume(pal_float_t gain) {
-    master_gain = gain;
+/**
+ * @brief Adds needed gain of the newest sample to the sliding minimum of the limiter
+ *
+ * @param gain
+ */
+static void limiter_push_minimum(int32_t gain) {
+    const int capacity = AUDIO_LIMITER_LOOKAHEAD + 1;
+
+    // drop the gain that leaves the window first, so the queue has room for the new one even when
+    // every gain in the window is still in it
+    if (limiter.num_minimums > 0 && limiter.sample - limiter.minimums[limiter.minimums_head].sample >= AUDIO_LIMITER_LOOKAHEAD + 1u) {
+        limiter.minimums_head = (limiter.minimums_head + 1) % capacity;
+        limiter.num_minimums--;
+    }
+
+    int tail = (limiter.minimums_head + limiter.num_minimums) % capacity;
+
+    // gains that aren't smaller than the new one can't be the minimum anymore
+    while (limiter.num_minimums > 0) {
+        int last = (tail + capacity - 1) % capacity;
+
+        if (limiter.minimums[last].gain < gain)
+            break;
+
+        tail = last;
+        limiter.num_minimums--;
+    }
+
+    limiter.minimums[tail] = (struct limiter_minimum) { gain, limiter.sample };
+    limiter.num_minimums++;
 }
 
-void audio_add_filter(struct filter_node *filter) {
-    if (master_filter_head == NULL) {
-        master_filter_head = filter;
-    } else {
-        // add filter on the end of list
-        struct filter_node *node = master_filter_head;
-        while (node->next != NULL) node = node->next;
-        // node now points to the tail
-        node->next = filter;
+/**
+ * @brief Limits samples to LIMITER_THRESHOLD, delaying them by AUDIO_LIMITER_LOOKAHEAD samples
+ * Stereo channels share the gain so a peak on one side doesn't move the image
+ *
+ * @param samples
+ * @param num_samples
+ */
+static void limiter_process(int32_t (*samples)[AUDIO_BLOCK_SIZE], int num_samples) {
+    int32_t peak = 0;
+    int position = limiter.position;
+
+    for (int c = 0; c < PAL_AUDIO_CHANNELS; c++) {
+        for (int i = 0; i < num_samples; i++)
+            peak = pal_max(peak, pal_abs(samples[c][i]));
+    }
+
+    // no peaks in the window and none coming, the limiter is just a delay
+    if (peak <= LIMITER_THRESHOLD && limiter.gain_sum == AUDIO_LIMITER_LOOKAHEAD * LIMITER_GAIN_ONE) {
+        for (int c = 0; c < PAL_AUDIO_CHANNELS; c++) {
+            position = limiter.position;
+
+            for (int i = 0; i < num_samples; i++) {
+                int32_t input = samples[c][i];
+
+                samples[c][i] = limiter.delay[c][position];
+                limiter.delay[c][position] = input;
+                position = position + 1 == AUDIO_LIMITER_LOOKAHEAD ? 0 : position + 1;
+            }
+        }
+
+        limiter.sample += num_samples;
+        limiter.minimums[0] = (struct limiter_minimum) { LIMITER_GAIN_ONE, limiter.sample - 1 };
+        limiter.minimums_head = 0;
+        limiter.num_minimums = 1;
+        limiter.position = position;
+        return;
+    }
+
+    for (int i = 0; i < num_samples; i++) {
+        uint32_t magnitude = 0;
+
+        for (int c = 0; c < PAL_AUDIO_CHANNELS; c++)
+            magnitude = pal_max(magnitude, pal_abs(samples[c][i]));
+
+        limiter_push_minimum(magnitude > LIMITER_THRESHOLD ? ((int64_t) LIMITER_THRESHOLD << LIMITER_GAIN_FRAC_BITS) / magnitude : LIMITER_GAIN_ONE);
+        limiter.sample++;
+
+        // every gain in the moving average is at most the gain the delayed sample needs
+        limiter.release_gain = pal_min(limiter.minimums[limiter.minimums_head].gain, limiter.release_gain + LIMITER_RELEASE_STEP);
+        limiter.gain_sum += limiter.release_gain - limiter.released_gains[position];
+        limiter.released_gains[position] = limiter.release_gain;
+
+        for (int c = 0; c < PAL_AUDIO_CHANNELS; c++) {
+            int32_t input = samples[c][i];
+
+            samples[c][i] = ((int64_t) limiter.delay[c][position] * (limiter.gain_sum / AUDIO_LIMITER_LOOKAHEAD)) >> LIMITER_GAIN_FRAC_BITS;
+            limiter.delay[c][position] = input;
+        }
+
+        position = position + 1 == AUDIO_LIMITER_LOOKAHEAD ? 0 : position + 1;
+    }
+
+    limiter.position = position;
+}
+
+static void stop_all() {
+    running = false;
+
+    for (int i = 0; i < num_active_oscillators; i++) {
+        for (int v = 0; v < active_oscillators[i]->num_active_voices; v++)
+            release_oscillator_voice(active_oscillators[i], active_oscillators[i]->active_voices[v]);
+    }
+
+    for (int i = 0; i < num_active_sample_channels; i++)
+        wave_samplers[active_sample_channels[i].sampler].channels[active_sample_channels[i].channel].playing = false;
+    num_active_sample_channels = 0;
+    num_active_drum_voices = 0;
+}
+
+/**
+ * @brief Applies command to the audio state, runs on the audio thread once audio is started
+ *
+ * @param command
+ */
+static void run_command(const struct audio_command *command) {
+    switch (command->type) {
+        case AUDIO_COMMAND_OSC_PLAY:
+            start_oscillator_voice(command->osc.osc, command->osc.voice, command->osc.amplitude, command->osc.t_increment);
+            break;
+        case AUDIO_COMMAND_OSC_STOP:
+            release_oscillator_voice(command->osc.osc, command->osc.voice);
+            break;
+        case AUDIO_COMMAND_OSC_DELETE:
+            remove_active_oscillator(command->osc.osc);
+            break;
+        case AUDIO_COMMAND_OSC_FM_PATCH:
+            command->osc.osc->fm_patch = command->osc.fm_patch;
+            break;
+        case AUDIO_COMMAND_OSC_WAVEFORM_BLOCK:
+            command->osc.osc->waveform_block = command->osc.waveform_block;
+            break;
+        case AUDIO_COMMAND_OSC_WAVETABLE:
+            command->osc.osc->wavetable = command->osc.wavetable;
+            break;
+        case AUDIO_COMMAND_ADD_EFFECT:
+            append_effect(command->effect.head, command->effect.effect);
+            break;
+        case AUDIO_COMMAND_ADD_FILTER:
+            append_filter(command->filter.head, command->filter.filter);
+            break;
+        case AUDIO_COMMAND_SAMPLE_PLAY:
+            start_sample_voice(command->sample.sample, command->sample.amplitude, command->sample.increment, command->sample.id, wave_samplers[command->sample.sample].bus, PAN_POSITION_CENTER);
+            break;
+        case AUDIO_COMMAND_SAMPLE_RELEASE:
+            release_sample_voice(command->sample.sample, command->sample.id);
+            break;
+        case AUDIO_COMMAND_SAMPLE_STEAL_MODE:
+            wave_samplers[command->sample.sample].steal_mode = command->sample.steal_mode;
+            break;
+        case AUDIO_COMMAND_MIDI_LOAD:
+            // a player with a bad file plays nothing
+            command->midi.player->stream = NULL;
+            command->midi.player->index = NULL;
+            if (!midi_parser_init(&command->midi.player->parser, command->midi.midi_data))
+                command->midi.player->parser.num_tracks = 0;
+            break;
+        case AUDIO_COMMAND_MIDI_LOAD_STREAM:
+            midi_player_start_stream(command->midi.player, command->midi.stream);
+            break;
+        case AUDIO_COMMAND_MIDI_DELETE:
+            remove_midi_player(command->midi.player);
+            break;
+        case AUDIO_COMMAND_MIDI_TRANSPOSE:
+            command->midi.player->channel_transpose[command->midi.channel] = command->midi.transpose;
+            break;
+        case AUDIO_COMMAND_MIDI_DRUM_KIT:
+            command->midi.player->drum_kit = command->midi.drum_kit;
+            break;
+        case AUDIO_COMMAND_MIDI_FM_BANK:
+            command->midi.player->fm_bank = command->midi.fm_bank;
+            break;
+        case AUDIO_COMMAND_MIDI_INDEX:
+            command->midi.player->index = command->midi.index;
+            command->midi.player->parser.loop_start = command->midi.index->loop_start;
+            command->midi.player->parser.loop_end = command->midi.index->loop_end;
+            break;
+        case AUDIO_COMMAND_MIDI_SEEK:
+            midi_player_seek_position(command->midi.player, command->midi.position);
+            break;
+        case AUDIO_COMMAND_MIDI_SEEK_BEAT:
+            if (command->midi.player->stream != NULL && command->midi.player->stream->beat_positions != NULL)
+                midi_player_seek_position(command->midi.player, midi_stream_beat_position(command->midi.player->stream, command->midi.beat));
+            else if (command->midi.player->stream == NULL && command->midi.player->index != NULL)
+                midi_player_seek_position(command->midi.player, midi_index_beat_position(command->midi.player->index, command->midi.beat));
+            break;
+        case AUDIO_COMMAND_MIDI_LOOP:
+            command->midi.player->parser.loop = command->midi.loop;
+            break;
+        case AUDIO_COMMAND_MIDI_LOOP_POINTS:
+            command->midi.player->parser.loop_start = command->midi.position;
+            command->midi.player->parser.loop_end = command->midi.loop_end;
+            break;
+        case AUDIO_COMMAND_MIDI_PLAYBACK_RATE:
+            midi_parser_set_playback_rate(&command->midi.player->parser, command->midi.playback_rate);
+            break;
+        case AUDIO_COMMAND_MIDI_BUS:
+            set_midi_player_bus(command->bus.player, command->bus.bus);
+            break;
+        case AUDIO_COMMAND_OSC_BUS:
+            command->bus.osc->bus = command->bus.bus;
+            break;
+        case AUDIO_COMMAND_SAMPLE_BUS:
+            wave_samplers[command->bus.sample].bus = command->bus.bus;
+            break;
+        case AUDIO_COMMAND_BUS_GAIN:
+            buses[command->bus.bus].gain_target = command->bus.gain;
+            break;
+        case AUDIO_COMMAND_OSC_PAN:
+            set_pan_position(&command->pan.osc->pan, command->pan.position, false);
+            break;
+        case AUDIO_COMMAND_SAMPLE_PAN:
+            pan_sample_voice(command->pan.sample, command->pan.id, command->pan.position);
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Runs command now or keeps it until its sample number comes up
+ *
+ * @param command
+ * @return true if command was run or kept
+ * @return false if it isn't due and every scheduled command slot is taken
+ */
+static bool schedule_command(const struct audio_command *command) {
+    // a late command runs right away, ahead of the scheduled ones that aren't due yet
+    if (command->sample_num <= current_sample_num) {
+        run_command(command);
+        return true;
+    }
+
+    if (num_scheduled_commands >= AUDIO_MAX_SCHEDULED_COMMANDS)
+        return false;
+
+    scheduled_commands[num_scheduled_commands++] = *command;
+    return true;
+}
+
+/**
+ * @brief Stops every voice and the midi players for audio_request_stop. The commands still waiting
+ * run first, so the voices they reserved are started and given back too
+ *
+ */
+static void run_stop() {
+    struct audio_command command;
+
+    for (int i = 0; i < num_scheduled_commands; i++)
+        run_command(&scheduled_commands[i]);
+
+    num_scheduled_commands = 0;
+
+    while (spsc_queue_pop(&command_queue, &command))
+        run_command(&command);
+
+    atomic_store_explicit(&stop_requested, false, memory_order_relaxed);
+    stop_all();
+    // audio_started and audio_offline don't change once the audio thread runs
+    stop_fence_pending = audio_started && !audio_offline;
+}
+
+/**
+ * @brief Runs scheduled commands that are due, then everything the game side posted since the last block
+ *
+ */
+static void run_audio_commands() {
+    struct audio_command command;
+    int num_kept = 0;
+    // read before popping the queue, so every command posted before the stop is popped below
+    bool stop = atomic_load_explicit(&stop_requested, memory_order_acquire);
+
+    // keep the commands that aren't due in posting order
+    for (int i = 0; i < num_scheduled_commands; i++) {
+        if (scheduled_commands[i].sample_num <= current_sample_num)
+            run_command(&scheduled_commands[i]);
+        else
+            scheduled_commands[num_kept++] = scheduled_commands[i];
+    }
+
+    num_scheduled_commands = num_kept;
+
+    // with every slot taken the rest stay queued until the next scheduled command is due, running
+    // them early could put them ahead of commands posted before them
+    while (num_scheduled_commands < AUDIO_MAX_SCHEDULED_COMMANDS && spsc_queue_pop(&command_queue, &command))
+        schedule_command(&command);
+
+    if (stop)
+        run_stop();
+}
+
+/**
+ * @brief Shortens block so it ends at the next scheduled command
+ *
+ * @param block_size
+ * @return int
+ */
+static int block_size_until_next_command(int block_size) {
+    for (int i = 0; i < num_scheduled_commands; i++) {
+        if (scheduled_commands[i].sample_num - current_sample_num < (uint64_t) block_size)
+            block_size = scheduled_commands[i].sample_num - current_sample_num;
+    }
+
+    return block_size;
+}
+
+static bool submit_command(struct audio_command *command) {
+    // nothing else touches the audio state before the audio thread starts
+    if (!audio_started)
+        return schedule_command(command);
+
+    return spsc_queue_push(&command_queue, command);
+}
+
+/**
+ * @brief Posts game side command to the audio thread at the current command time
+ *
+ * @param command
+ * @return true if command was posted
+ * @return false if the command queue is full and the command was dropped
+ */
+static bool post_command(struct audio_command *command) {
+    command->sample_num = command_time;
+
+    if (submit_command(command))
+        return true;
+
+    printf("audio command queue full! dropped command %d\n", command->type);
+    return false;
+}
+
+static void publish_u64(struct published_u64 *published, uint64_t value) {
+    unsigned int sequence = atomic_load_explicit(&published->sequence, memory_order_relaxed);
+
+    atomic_store_explicit(&published->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&published->low, (uint32_t) value, memory_order_relaxed);
+    atomic_store_explicit(&published->high, (uint32_t) (value >> 32), memory_order_relaxed);
+    atomic_store_explicit(&published->sequence, sequence + 2, memory_order_release);
+}
+
+static uint64_t read_published_u64(struct published_u64 *published) {
+    unsigned int sequence;
+    uint64_t value;
+
+    // retry if the writer was updating it
+    do {
+        sequence = atomic_load_explicit(&published->sequence, memory_order_acquire);
+        value = atomic_load_explicit(&published->low, memory_order_relaxed);
+        value |= (uint64_t) atomic_load_explicit(&published->high, memory_order_relaxed) << 32;
+        atomic_thread_fence(memory_order_acquire);
+    } while ((sequence & 1) != 0 || sequence != atomic_load_explicit(&published->sequence, memory_order_relaxed));
+
+    return value;
+}
+
+/**
+ * @brief Converts game time to samples, rounded to the nearest one
+ *
+ * @param time
+ * @return int64_t
+ */
+static int64_t time_to_samples(pal_float_t time) {
+#if defined PAL_USE_FIXED
+    return ((int64_t) time * PAL_AUDIO_SAMPLE_RATE + (PAL_FIXED_ONE >> 1)) >> PAL_FIXED_FRAC_BITS;
+#else
+    return llround(time * PAL_AUDIO_SAMPLE_RATE);
+#endif
+}
+
+/**
+ * @brief Moves the clock offset to where the audio thread is at the current time, called by the
+ * audio callback
+ *
+ * @param next_sample_num first sample the audio thread can render commands posted from now at
+ */
+static void update_clock(uint64_t next_sample_num) {
+    int64_t offset = next_sample_num - time_to_samples(pal_get_time());
+
+    // callbacks come a little early or late. The offset jumps up to an early one right away so
+    // scheduled calls aren't late, and drifts back down after late ones so it doesn't jitter
+    if (atomic_load_explicit(&published_clock_offset.sequence, memory_order_relaxed) == 0 || offset > clock_offset)
+        clock_offset = offset;
+    else
+        clock_offset -= (clock_offset - offset + CLOCK_DRIFT_CALLBACKS - 1) / CLOCK_DRIFT_CALLBACKS;
+
+    publish_u64(&published_clock_offset, clock_offset);
+}
+
+#if defined AUDIO_ENABLE_PROFILING || defined AUDIO_ENABLE_STATS
+/**
+ * @brief Counts the oscillator voices and sample voices playing
+ *
+ * @return int
+ */
+static int count_active_voices() {
+    int num_voices = num_active_sample_channels + num_active_drum_voices;
+
+    for (int osc_i = 0; osc_i < num_active_oscillators; osc_i++)
+        num_voices += active_oscillators[osc_i]->num_active_voices;
+
+    return num_voices;
+}
+#endif
+
+#ifdef AUDIO_ENABLE_STATS
+static void atomic_store_max(atomic_uint *value, unsigned int candidate) {
+    if (candidate > atomic_load_explicit(value, memory_order_relaxed))
+        atomic_store_explicit(value, candidate, memory_order_relaxed);
+}
+
+/**
+ * @brief Publishes the load and voice counts of a render, called by the thread rendering
+ *
+ * @param num_samples samples rendered
+ * @param render_ns time it took
+ */
+static void update_render_stats(int num_samples, uint64_t render_ns) {
+    uint64_t budget_ns = (uint64_t) num_samples * 1000000000 / PAL_AUDIO_SAMPLE_RATE;
+    unsigned int num_filters = 0;
+    unsigned int num_effects = 0;
+    int num_voices = count_active_voices();
+
+    for (int osc_i = 0; osc_i < num_active_oscillators; osc_i++) {
+        for (struct filter_node *node = active_oscillators[osc_i]->filter_list_head; node != NULL; node = node->next)
+            num_filters++;
+        for (struct effect_node *node = active_oscillators[osc_i]->effect_list_head; node != NULL; node = node->next)
+            num_effects++;
+    }
+
+    for (int bus = 0; bus < num_buses; bus++) {
+        for (struct filter_node *node = buses[bus].filter_head; node != NULL; node = node->next)
+            num_filters++;
+    }
+
+    if (atomic_exchange_explicit(&stats_reset_requested, false, memory_order_relaxed)) {
+        atomic_store_explicit(&stats.peak_load_permille, 0, memory_order_relaxed);
+        atomic_store_explicit(&stats.peak_voices, 0, memory_order_relaxed);
+    }
+
+    atomic_store_explicit(&stats.render_us, render_ns / 1000, memory_order_relaxed);
+    atomic_store_explicit(&stats.budget_us, budget_ns / 1000, memory_order_relaxed);
+    atomic_store_max(&stats.peak_load_permille, render_ns * 1000 / budget_ns);
+    atomic_store_explicit(&stats.active_voices, num_voices, memory_order_relaxed);
+    atomic_store_max(&stats.peak_voices, num_voices);
+    atomic_store_explicit(&stats.active_filters, num_filters, memory_order_relaxed);
+    atomic_store_explicit(&stats.active_effects, num_effects, memory_order_relaxed);
+
+    if (render_ns > budget_ns)
+        atomic_fetch_add_explicit(&stats.overruns, 1, memory_order_relaxed);
+
+    stats_window_render_ns += render_ns;
+    stats_window_samples += num_samples;
+
+    if (stats_window_samples >= AUDIO_STATS_WINDOW_MS * PAL_AUDIO_SAMPLE_RATE / 1000) {
+        uint64_t window_ns = (uint64_t) stats_window_samples * 1000000000 / PAL_AUDIO_SAMPLE_RATE;
+
+        atomic_store_explicit(&stats.load_permille, stats_window_render_ns * 1000 / window_ns, memory_order_relaxed);
+        stats_window_render_ns = 0;
+        stats_window_samples = 0;
     }
 }
 
-static void audio_fill_buffer(audio_sample_t *samples, int num_samples) {
-    int32_t sample;
-    int32_t current_sample;
-    struct oscillator *osc;
+/**
+ * @brief Counts the audio callback as late if it came over two of the previous buffers after
+ * the previous callback, the device or the scheduler stalled
+ *
+ * @param num_samples samples the callback asks for
+ */
+static void update_callback_stats(int num_samples) {
+    uint64_t now = pal_get_time_ns();
+
+    if (last_callback_ns != 0 && now - last_callback_ns > (uint64_t) last_callback_samples * 2 * 1000000000 / PAL_AUDIO_SAMPLE_RATE)
+        atomic_fetch_add_explicit(&stats.late_callbacks, 1, memory_order_relaxed);
+
+    last_callback_ns = now;
+    last_callback_samples = num_samples;
+}
+#endif
+
+#ifdef AUDIO_ENABLE_PROFILING
+/**
+ * @brief Counts the limited samples over LIMITER_THRESHOLD, which the output clamp cuts
+ *
+ * @param mix
+ * @param num_samples
+ * @return int
+ */
+static int count_clipped_samples(const int32_t (*mix)[AUDIO_BLOCK_SIZE], int num_samples) {
+    int num_clipped = 0;
+
+    for (int c = 0; c < PAL_AUDIO_CHANNELS; c++) {
+        for (int i = 0; i < num_samples; i++)
+            num_clipped += mix[c][i] > LIMITER_THRESHOLD || mix[c][i] < -LIMITER_THRESHOLD;
+    }
+
+    return num_clipped;
+}
+#endif
 
-    // add samples to buffer
+/**
+ * @brief Converts the limited mix to the output format and interleaves its channels. The clamp
+ * has no branches and the scale is constant so the compiler can vectorize the loop
+ *
+ * @param samples
+ * @param mix
+ * @param num_samples
+ */
+static void convert_output(audio_sample_t *restrict samples, const int32_t (*restrict mix)[AUDIO_BLOCK_SIZE], int num_samples) {
     for (int i = 0; i < num_samples; i++) {
+        for (int c = 0; c < PAL_AUDIO_CHANNELS; c++) {
+            // the limiter leaves the mix within OSC_AMPLITUDE, clamped in case a custom filter doesn't
+            int32_t sample = mix[c][i] < -OSC_AMPLITUDE ? -OSC_AMPLITUDE : mix[c][i] > OSC_AMPLITUDE ? OSC_AMPLITUDE : mix[c][i];
+
+#if defined PAL_AUDIO_FORMAT_F32
+            samples[i * PAL_AUDIO_CHANNELS + c] = sample * (AUDIO_SAMPLE_MAX / OSC_AMPLITUDE);
+#else
+            // OSC_AMPLITUDE is INT16_MAX, the 16 bit formats only move silence
+            samples[i * PAL_AUDIO_CHANNELS + c] = sample + AUDIO_SAMPLE_SILENCE;
+#endif
+        }
+    }
+}
+
+static void audio_fill_buffer(audio_sample_t *samples, int num_frames) {
+    int32_t (*mix)[AUDIO_BLOCK_SIZE] = bus_samples[AUDIO_BUS_MASTER];
+#ifdef AUDIO_ENABLE_STATS
+    uint64_t render_start_ns = pal_get_time_ns();
+#endif
+
+    for (int offset = 0; offset < num_frames;) {
+        int block_size = pal_min(AUDIO_BLOCK_SIZE, num_frames - offset);
+
+        PROFILE_STAGE_START();
+        run_audio_commands();
+        // split the block so scheduled commands run on their exact sample
+        block_size = block_size_until_next_command(block_size);
+
+        // midi events are applied on their exact sample, split the block at the next one
         if (running)
-            advance_all_midi_players();
+            block_size = run_all_midi_events(block_size);
+
+        for (int bus = 0; bus < num_buses; bus++) {
+            for (int c = 0; c < PAL_AUDIO_CHANNELS; c++)
+                memset(bus_samples[bus][c], 0, block_size * sizeof(int32_t));
+        }
+
+        PROFILE_STAGE_END(AUDIO_PROFILE_EVENTS);
+        wave_sampler_render_block(block_size);
+        drum_render_block(block_size);
+        PROFILE_STAGE_END(AUDIO_PROFILE_SAMPLERS);
 
-        current_sample = wave_sampler_get_sample_and_advance();
+#ifdef AUDIO_ENABLE_PROFILING
+        profile.peak_voices = pal_max(profile.peak_voices, count_active_voices());
+#endif
+
+        for (int osc_i = 0; osc_i < num_active_oscillators;) {
+            struct oscillator *osc = active_oscillators[osc_i];
 
-        for (int osc_i = 0; osc_i < num_oscillators; osc_i++) {
-            current_sample += oscillator_get_sample_and_advance(oscillators[osc_i]);
+            // replace oscillator that went silent with the last active oscillator
+            if (oscillator_render_block(osc, bus_samples[osc->bus], block_size))
+                osc_i++;
+            else
+                active_oscillators[osc_i] = active_oscillators[--num_active_oscillators];
         }
 
-        // gotta figure out this mixer weirdness to balance all sounds
-        current_sample = run_filter_chain(master_filter_head, current_sample) * master_gain;
+        PROFILE_STAGE_END(AUDIO_PROFILE_OSCILLATORS);
+        mix_buses(block_size);
+        PROFILE_STAGE_END(AUDIO_PROFILE_MIX);
+        limiter_process(mix, block_size);
+#ifdef AUDIO_ENABLE_PROFILING
+        profile.clipped_samples += count_clipped_samples(mix, block_size);
+#endif
+        convert_output(samples + offset * PAL_AUDIO_CHANNELS, mix, block_size);
+
+        PROFILE_STAGE_END(AUDIO_PROFILE_OUTPUT);
 
-        if (current_sample > OSC_AMPLITUDE)
-            current_sample = OSC_AMPLITUDE;
-        if (current_sample < -OSC_AMPLITUDE)
-            current_sample = -OSC_AMPLITUDE;
+        if (running)
+            advance_all_midi_players(block_size);
+
+        PROFILE_STAGE_END(AUDIO_PROFILE_EVENTS);
+
+        offset += block_size;
+        current_sample_num += block_size;
+    }
 
-        current_sample = current_sample * (AUDIO_SAMPLE_MAX / 2) / OSC_AMPLITUDE + (AUDIO_SAMPLE_MAX / 2);
+    publish_u64(&published_sample_num, current_sample_num);
 
-        samples[i] = current_sample;
+    if (stop_fence_pending && num_active_oscillators == 0) {
+        stop_fence_pending = false;
+        fence_post(&stop_fence);
     }
+
+#ifdef AUDIO_ENABLE_STATS
+    update_render_stats(num_frames, pal_get_time_ns() - render_start_ns);
+#endif
+#ifdef AUDIO_ENABLE_PROFILING
+    profile.num_samples += num_frames;
+#endif
 }
 
 void audio_request_stop() {
-    bool oscillators_active = true;
-    running = false;
+    // nothing else touches the audio state before the audio thread starts
+    if (!audio_started) {
+        run_stop();
+        return;
+    }
 
-    for (int i = 0; i < num_oscillators; i++) {
-        for (enum oscillator_voice_num v = OSC_VOICE_0; v < OSC_MAX_VOICES; v++) {
-            oscillators[i]->voices[v].adsr.state = ADSR_STATE_RELEASE;
-        }
+    // picked up at the next block even if the command queue is full
+    atomic_store_explicit(&stop_requested, true, memory_order_release);
+
+    if (audio_offline)
+        return;
+
+    // posted once the voices are given back after their release
+    fence_wait(&stop_fence);
+}
+
+#if AUDIO_RENDER_THREAD
+/**
+ * @brief Renders blocks until render_ahead_samples are ready for the audio callback
+ *
+ */
+static void render_ahead() {
+    audio_sample_t block[AUDIO_BLOCK_SIZE * PAL_AUDIO_CHANNELS];
+
+    while (spsc_queue_count(&render_queue) + AUDIO_BLOCK_SIZE <= atomic_load_explicit(&render_ahead_samples, memory_order_relaxed)) {
+        audio_fill_buffer(block, AUDIO_BLOCK_SIZE);
+        spsc_queue_push_many(&render_queue, block, AUDIO_BLOCK_SIZE);
     }
+}
 
-    for (int i = 0; i < MAX_POLYPHONIC_WAVE_SAMPLERS; i++) {
-        if (wave_samplers[i].wave_data == NULL)
-            continue;
+static void *render_thread_main(void *arg) {
+    (void) arg;
 
-        for (int j = 0; j < MAX_CONCURRENT_SAMPLE_VOICES; j++)
-            wave_samplers[i].channels[j].playing = false;
+    for (;;) {
+        // woken up every time the audio callback takes samples
+        while (sem_wait(&render_wakeup) != 0 && errno == EINTR);
+
+        render_ahead();
     }
 
-    while (oscillators_active) {
-        oscillators_active = false;
+    return NULL;
+}
+
+/**
+ * @brief Audio callback with the render thread, copies out frames rendered ahead of time and
+ * plays silence for the ones that aren't ready yet
+ *
+ * @param samples
+ * @param num_frames
+ */
+static void copy_rendered_samples(audio_sample_t *samples, int num_frames) {
+#ifdef AUDIO_ENABLE_STATS
+    update_callback_stats(num_frames);
+#endif
 
-        for (int i = 0; i < num_oscillators; i++) {
-            for (enum oscillator_voice_num v = OSC_VOICE_0; v < OSC_MAX_VOICES; v++) {
-                if (oscillators[i]->voices[v].adsr.state != ADSR_STATE_OFF)
-                    oscillators_active = true;
-            }
-        }
+    uint32_t num_copied = spsc_queue_pop_many(&render_queue, samples, num_frames);
+
+    if (num_copied < (uint32_t) num_frames) {
+        for (int i = num_copied * PAL_AUDIO_CHANNELS; i < num_frames * PAL_AUDIO_CHANNELS; i++)
+            samples[i] = AUDIO_SAMPLE_SILENCE;
+
+        atomic_fetch_add_explicit(&underrun_count, 1, memory_order_relaxed);
     }
+
+    // samples that weren't ready play late, the clock follows the ones that were played. The render
+    // thread fills the queue back up to render_ahead_samples, a command posted from now on is
+    // picked up once the next callback wakes it
+    played_sample_num += num_copied;
+    update_clock(played_sample_num + atomic_load_explicit(&render_ahead_samples, memory_order_relaxed) + num_frames);
+
+    // doesn't block, fine in the audio callback
+    sem_post(&render_wakeup);
 }
 
-void audio_start() {
+/**
+ * @brief Starts the render thread, it renders the first blocks before the audio callback is set
+ *
+ * @return true if the thread was started
+ * @return false if it couldn't be created
+ */
+static bool start_render_thread() {
+    // a frame per element so the counts match the callback's
+    spsc_queue_init(&render_queue, render_buffer, sizeof(render_buffer[0]), AUDIO_RENDER_BUFFER_SIZE);
+    sem_init(&render_wakeup, 0, 0);
+
+    // the thread sleeps until the first callback, so the first blocks can be rendered from here
+    if (pthread_create(&render_thread, NULL, &render_thread_main, NULL) != 0)
+        return false;
+
+    struct sched_param param = { .sched_priority = sched_get_priority_max(SCHED_FIFO) - 1 };
+
+    // needs privileges on desktop systems, the thread keeps the default priority without them
+    pthread_setschedparam(render_thread, SCHED_FIFO, &param);
+
+    render_ahead();
+    render_thread_started = true;
+
+    return true;
+}
+#endif
+
+/**
+ * @brief Audio callback without the render thread, synthesizes the samples right away
+ *
+ * @param samples
+ * @param num_frames
+ */
+static void render_in_callback(audio_sample_t *samples, int num_frames) {
+#ifdef AUDIO_ENABLE_STATS
+    update_callback_stats(num_frames);
+#endif
+
+    audio_fill_buffer(samples, num_frames);
+    // a command posted from now on is picked up by the next callback
+    update_clock(current_sample_num + num_frames);
+}
+
+static void start_audio_thread_state() {
+    compile_bus_graph();
     running = true;
-    pal_set_audio_callback(&audio_fill_buffer);
-}
\ No newline at end of file
+    spsc_queue_init(&command_queue, command_queue_buffer, sizeof(struct audio_command), AUDIO_COMMAND_QUEUE_SIZE);
+    fence_init(&stop_fence);
+    audio_started = true;
+}
+
+void audio_start() {
+    start_audio_thread_state();
+
+#if AUDIO_RENDER_THREAD
+    if (start_render_thread()) {
+        pal_set_audio_callback(&copy_rendered_samples);
+        return;
+    }
+
+    printf("Can't start the audio render thread, rendering in the audio callback\n");
+#endif
+
+    pal_set_audio_callback(&render_in_callback);
+}
+
+void audio_start_offline() {
+    audio_offline = true;
+    start_audio_thread_state();
+}
+
+void audio_set_latency(int num_blocks) {
+#if AUDIO_RENDER_THREAD
+    num_blocks = pal_max(1, pal_min(num_blocks, AUDIO_RENDER_BUFFER_SIZE / AUDIO_BLOCK_SIZE));
+    atomic_store_explicit(&render_ahead_samples, num_blocks * AUDIO_BLOCK_SIZE, memory_order_relaxed);
+
+    // fill up to a raised latency right away instead of at the next callback
+    if (render_thread_started)
+        sem_post(&render_wakeup);
+#else
+    (void) num_blocks;
+#endif
+}
+
+uint32_t audio_get_underrun_count() {
+    return atomic_load_explicit(&underrun_count, memory_order_relaxed);
+}
+
+void audio_render_offline(audio_sample_t *samples, int num_frames) {
+    audio_fill_buffer(samples, num_frames);
+}
+
+#ifdef AUDIO_ENABLE_STATS
+void audio_get_stats(struct audio_stats *stats_out) {
+    *stats_out = (struct audio_stats) {
+        .load_permille = atomic_load_explicit(&stats.load_permille, memory_order_relaxed),
+        .peak_load_permille = atomic_load_explicit(&stats.peak_load_permille, memory_order_relaxed),
+        .render_us = atomic_load_explicit(&stats.render_us, memory_order_relaxed),
+        .budget_us = atomic_load_explicit(&stats.budget_us, memory_order_relaxed),
+        .active_voices = atomic_load_explicit(&stats.active_voices, memory_order_relaxed),
+        .peak_voices = atomic_load_explicit(&stats.peak_voices, memory_order_relaxed),
+        .active_filters = atomic_load_explicit(&stats.active_filters, memory_order_relaxed),
+        .active_effects = atomic_load_explicit(&stats.active_effects, memory_order_relaxed),
+        .overruns = atomic_load_explicit(&stats.overruns, memory_order_relaxed),
+        .underruns = atomic_load_explicit(&underrun_count, memory_order_relaxed),
+        .late_callbacks = atomic_load_explicit(&stats.late_callbacks, memory_order_relaxed)
+    };
+}
+
+void audio_reset_stats() {
+    atomic_store_explicit(&stats_reset_requested, true, memory_order_relaxed);
+}
+#endif
+
+#ifdef AUDIO_ENABLE_PROFILING
+void audio_get_profile(struct audio_profile *profile_out) {
+    *profile_out = profile;
+}
+
+void audio_reset_profile() {
+    profile = (struct audio_profile) { 0 };
+}
+#endif
+
+void audio_set_command_time(uint64_t sample_num) {
+    command_time = sample_num;
+}
+
+uint64_t audio_get_sample_num() {
+    return read_published_u64(&published_sample_num);
+}
+
+uint64_t audio_time_to_sample_num(pal_float_t game_time) {
+    // offline, game time is the time rendered
+    if (audio_offline)
+        return game_time > 0 ? (uint64_t) time_to_samples(game_time) : AUDIO_TIME_NOW;
+
+    // the clock starts with the audio callback
+    if (!audio_started || atomic_load_explicit(&published_clock_offset.sequence, memory_order_acquire) == 0)
+        return AUDIO_TIME_NOW;
+
+    int64_t sample_num = time_to_samples(game_time) + (int64_t) read_published_u64(&published_clock_offset) + AUDIO_SCHEDULE_SLACK_MS * PAL_AUDIO_SAMPLE_RATE / 1000;
+
+    return sample_num > 0 ? (uint64_t) sample_num : AUDIO_TIME_NOW;
+}
@@ -0,0 +1,330 @@
+#include "audio_delay.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "audio.h"
+#include "mathutils.h"
+#include "pal.h"
+
+// gains have 15 fractional bits so products with 16 bit delayed samples fit in 32 bits
+#define GAIN_FRAC_BITS 15
+#define GAIN_ONE (1 << GAIN_FRAC_BITS)
+#define DELAY_MAX_FEEDBACK 31130    // 0.95
+// reverb line lengths are tuned at 44.1 kHz
+#define REVERB_TUNING_RATE 44100
+#define REVERB_STEREO_SPREAD 23
+// the input is turned down before the combs so their resonances fit in 16 bits
+#define REVERB_INPUT_SHIFT 3
+#define REVERB_MIN_FEEDBACK 22938   // 0.7, shortest tail
+#define REVERB_FEEDBACK_RANGE 9175  // 0.28, up to 0.98 for the longest tail
+#define REVERB_MAX_DAMPING 13107    // 0.4
+
+_Static_assert(AUDIO_DELAY_POOL_SAMPLES > 0, "AUDIO_DELAY_POOL_SAMPLES must be positive!");
+
+static const uint16_t reverb_comb_lengths[AUDIO_REVERB_NUM_COMBS] = { 1116, 1277, 1422, 1557 };
+static const uint16_t reverb_allpass_lengths[AUDIO_REVERB_NUM_ALLPASSES] = { 556, 341 };
+
+// delay lines are allocated from here and never freed, like the wavetable pool
+static int16_t delay_pool[AUDIO_DELAY_POOL_SAMPLES];
+static uint32_t delay_pool_used = 0;
+
+static int32_t to_gain(pal_float_t x) {
+    x = pal_fmax(pal_fmin(x, PAL_FLOAT(1)), PAL_FLOAT(0));
+#if defined PAL_USE_FIXED
+    return ((int64_t) x * GAIN_ONE) >> PAL_FIXED_FRAC_BITS;
+#else
+    return x * GAIN_ONE;
+#endif
+}
+
+/**
+ * @brief Scales x by gain, rounding toward zero so recirculating samples die out instead of
+ * settling on -1
+ *
+ * @param x
+ * @param gain
+ * @return int32_t
+ */
+static int32_t scale_feedback(int32_t x, int32_t gain) {
+    return x * gain / GAIN_ONE;
+}
+
+static int32_t saturate_16(int32_t x) {
+    return x > INT16_MAX ? INT16_MAX : (x < INT16_MIN ? INT16_MIN : x);
+}
+
+/**
+ * @brief Sets up lines with buffers from the delay pool, either all of them or none
+ *
+ * @param lines
+ * @param lengths samples of each line, at least 1
+ * @param num_lines
+ * @return true if the lines got their buffers
+ * @return false if the pool is too small
+ */
+static bool delay_lines_alloc(struct audio_delay_line *lines, const uint32_t *lengths, int num_lines) {
+    uint32_t total = 0;
+
+    for (int i = 0; i < num_lines; i++)
+        total += lengths[i];
+
+    if (total > AUDIO_DELAY_POOL_SAMPLES - delay_pool_used)
+        return false;
+
+    for (int i = 0; i < num_lines; i++) {
+        lines[i].buffer = &delay_pool[delay_pool_used];
+        lines[i].length = lengths[i];
+        lines[i].position = 0;
+        delay_pool_used += lengths[i];
+    }
+
+    return true;
+}
+
+/**
+ * @brief Number of samples line can run before wrapping around
+ *
+ * @param line
+ * @param num_samples
+ * @return int
+ */
+static int delay_line_segment(const struct audio_delay_line *line, int num_samples) {
+    uint32_t left = line->length - line->position;
+
+    return left < (uint32_t) num_samples ? (int) left : num_samples;
+}
+
+static void delay_line_advance(struct audio_delay_line *line, int num_samples) {
+    line->position += num_samples;
+    if (line->position == line->length)
+        line->position = 0;
+}
+
+static void delay_run(struct audio_delay_line *line, int32_t feedback, int32_t mix, int32_t *samples, int num_samples) {
+    int32_t delayed[AUDIO_BLOCK_SIZE];
+
+    for (int offset = 0; offset < num_samples;) {
+        int n = delay_line_segment(line, num_samples - offset);
+        int16_t *buffer = line->buffer + line->position;
+
+        // each delayed sample is read before it's replaced and nothing is carried between samples,
+        // so the compiler can vectorize the loop
+        for (int i = 0; i < n; i++) {
+            delayed[offset + i] = buffer[i];
+            buffer[i] = saturate_16(samples[offset + i] + scale_feedback(buffer[i], feedback));
+        }
+
+        delay_line_advance(line, n);
+        offset += n;
+    }
+
+    for (int i = 0; i < num_samples; i++)
+        samples[i] = ((int64_t) samples[i] * (GAIN_ONE - mix) + (int64_t) delayed[i] * mix) >> GAIN_FRAC_BITS;
+}
+
+static void delay_process_block(struct filter_node *node, int32_t *samples, int num_samples) {
+    struct audio_delay *delay = (struct audio_delay *) node;
+    int32_t feedback = atomic_load_explicit(&delay->feedback, memory_order_relaxed);
+    int32_t mix = atomic_load_explicit(&delay->mix, memory_order_relaxed);
+
+    delay_run(&delay->lines[0], feedback, mix, samples, num_samples);
+}
+
+#if PAL_AUDIO_CHANNELS == 2
+static void delay_process_stereo_block(struct filter_node *node, int32_t *left, int32_t *right, int num_samples) {
+    struct audio_delay *delay = (struct audio_delay *) node;
+    int32_t feedback = atomic_load_explicit(&delay->feedback, memory_order_relaxed);
+    int32_t mix = atomic_load_explicit(&delay->mix, memory_order_relaxed);
+
+    delay_run(&delay->lines[0], feedback, mix, left, num_samples);
+    delay_run(&delay->lines[1], feedback, mix, right, num_samples);
+}
+#endif
+
+bool audio_delay_init(struct audio_delay *delay, uint32_t time_ms, pal_float_t feedback, pal_float_t mix) {
+    uint32_t lengths[PAL_AUDIO_CHANNELS];
+    uint64_t length = (uint64_t) time_ms * PAL_AUDIO_SAMPLE_RATE / 1000;
+
+    if (length > AUDIO_DELAY_POOL_SAMPLES)
+        return false;
+
+    for (int c = 0; c < PAL_AUDIO_CHANNELS; c++)
+        lengths[c] = length > 0 ? length : 1;
+
+    if (!delay_lines_alloc(delay->lines, lengths, PAL_AUDIO_CHANNELS))
+        return false;
+
+    delay->node.process = NULL;
+    delay->node.next = NULL;
+    delay->node.process_block = &delay_process_block;
+    delay->node.process_stereo_block = NULL;
+#if PAL_AUDIO_CHANNELS == 2
+    delay->node.process_stereo_block = &delay_process_stereo_block;
+#endif
+
+    atomic_init(&delay->feedback, 0);
+    atomic_init(&delay->mix, 0);
+    audio_delay_set(delay, feedback, mix);
+
+    return true;
+}
+
+void audio_delay_set(struct audio_delay *delay, pal_float_t feedback, pal_float_t mix) {
+    int32_t feedback_gain = to_gain(feedback);
+
+    atomic_store_explicit(&delay->feedback, feedback_gain < DELAY_MAX_FEEDBACK ? feedback_gain : DELAY_MAX_FEEDBACK, memory_order_relaxed);
+    atomic_store_explicit(&delay->mix, to_gain(mix), memory_order_relaxed);
+}
+
+/**
+ * @brief Runs input through comb and adds what comes out to wet. The damping lowpass in the
+ * feedback carries from sample to sample, so unlike the delay this loop stays scalar
+ *
+ * @param line
+ * @param lowpass damping filter state
+ * @param feedback
+ * @param damping
+ * @param input
+ * @param wet
+ * @param num_samples
+ */
+static void comb_run(struct audio_delay_line *line, int32_t *lowpass, int32_t feedback, int32_t damping, const int32_t *input, int32_t *wet, int num_samples) {
+    int32_t filtered = *lowpass;
+
+    while (num_samples > 0) {
+        int n = delay_line_segment(line, num_samples);
+        int16_t *buffer = line->buffer + line->position;
+
+        for (int i = 0; i < n; i++) {
+            int32_t delayed = buffer[i];
+
+            filtered = delayed + (((filtered - delayed) * damping) >> GAIN_FRAC_BITS);
+            buffer[i] = saturate_16(input[i] + scale_feedback(filtered, feedback));
+            wet[i] += delayed;
+        }
+
+        delay_line_advance(line, n);
+        input += n;
+        wet += n;
+        num_samples -= n;
+    }
+
+    *lowpass = filtered;
+}
+
+static void allpass_run(struct audio_delay_line *line, int32_t *samples, int num_samples) {
+    while (num_samples > 0) {
+        int n = delay_line_segment(line, num_samples);
+        int16_t *buffer = line->buffer + line->position;
+
+        // same as the delay, vectorizes
+        for (int i = 0; i < n; i++) {
+            int32_t delayed = buffer[i];
+            int32_t x = samples[i];
+
+            buffer[i] = saturate_16(x + delayed / 2);
+            samples[i] = delayed - x;
+        }
+
+        delay_line_advance(line, n);
+        samples += n;
+        num_samples -= n;
+    }
+}
+
+static void reverb_run(struct audio_reverb_channel *channel, int32_t feedback, int32_t damping, int32_t mix, int32_t *samples, int num_samples) {
+    int32_t input[AUDIO_BLOCK_SIZE];
+    int32_t wet[AUDIO_BLOCK_SIZE];
+
+    for (int i = 0; i < num_samples; i++) {
+        input[i] = samples[i] >> REVERB_INPUT_SHIFT;
+        wet[i] = 0;
+    }
+
+    for (int i = 0; i < AUDIO_REVERB_NUM_COMBS; i++)
+        comb_run(&channel->combs[i], &channel->comb_lowpass[i], feedback, damping, input, wet, num_samples);
+
+    for (int i = 0; i < AUDIO_REVERB_NUM_ALLPASSES; i++)
+        allpass_run(&channel->allpasses[i], wet, num_samples);
+
+    for (int i = 0; i < num_samples; i++)
+        samples[i] = ((int64_t) samples[i] * (GAIN_ONE - mix) + (int64_t) wet[i] * mix) >> GAIN_FRAC_BITS;
+}
+
+static void reverb_process_block(struct filter_node *node, int32_t *samples, int num_samples) {
+    struct audio_reverb *reverb = (struct audio_reverb *) node;
+    int32_t feedback = atomic_load_explicit(&reverb->feedback, memory_order_relaxed);
+    int32_t damping = atomic_load_explicit(&reverb->damping, memory_order_relaxed);
+    int32_t mix = atomic_load_explicit(&reverb->mix, memory_order_relaxed);
+
+    reverb_run(&reverb->channels[0], feedback, damping, mix, samples, num_samples);
+}
+
+#if PAL_AUDIO_CHANNELS == 2
+static void reverb_process_stereo_block(struct filter_node *node, int32_t *left, int32_t *right, int num_samples) {
+    struct audio_reverb *reverb = (struct audio_reverb *) node;
+    int32_t feedback = atomic_load_explicit(&reverb->feedback, memory_order_relaxed);
+    int32_t damping = atomic_load_explicit(&reverb->damping, memory_order_relaxed);
+    int32_t mix = atomic_load_explicit(&reverb->mix, memory_order_relaxed);
+
+    reverb_run(&reverb->channels[0], feedback, damping, mix, left, num_samples);
+    reverb_run(&reverb->channels[1], feedback, damping, mix, right, num_samples);
+}
+#endif
+
+bool audio_reverb_init(struct audio_reverb *reverb, pal_float_t size, pal_float_t decay, pal_float_t damping, pal_float_t mix) {
+    uint32_t lengths[PAL_AUDIO_CHANNELS][AUDIO_REVERB_NUM_COMBS + AUDIO_REVERB_NUM_ALLPASSES];
+    int32_t size_gain = pal_max(to_gain(size), GAIN_ONE / 10);
+    uint32_t total = 0;
+
+    for (int c = 0; c < PAL_AUDIO_CHANNELS; c++) {
+        uint32_t spread = c * REVERB_STEREO_SPREAD;
+
+        for (int i = 0; i < AUDIO_REVERB_NUM_COMBS + AUDIO_REVERB_NUM_ALLPASSES; i++) {
+            uint32_t tuning = i < AUDIO_REVERB_NUM_COMBS ? reverb_comb_lengths[i] : reverb_allpass_lengths[i - AUDIO_REVERB_NUM_COMBS];
+            uint64_t length = ((uint64_t) ((tuning * size_gain) >> GAIN_FRAC_BITS) + spread) * PAL_AUDIO_SAMPLE_RATE / REVERB_TUNING_RATE;
+
+            lengths[c][i] = length > 0 ? length : 1;
+            total += lengths[c][i];
+        }
+    }
+
+    if (total > AUDIO_DELAY_POOL_SAMPLES - delay_pool_used)
+        return false;
+
+    for (int c = 0; c < PAL_AUDIO_CHANNELS; c++) {
+        struct audio_reverb_channel *channel = &reverb->channels[c];
+
+        delay_lines_alloc(channel->combs, lengths[c], AUDIO_REVERB_NUM_COMBS);
+        delay_lines_alloc(channel->allpasses, lengths[c] + AUDIO_REVERB_NUM_COMBS, AUDIO_REVERB_NUM_ALLPASSES);
+
+        for (int i = 0; i < AUDIO_REVERB_NUM_COMBS; i++)
+            channel->comb_lowpass[i] = 0;
+    }
+
+    reverb->node.process = NULL;
+    reverb->node.next = NULL;
+    reverb->node.process_block = &reverb_process_block;
+    reverb->node.process_stereo_block = NULL;
+#if PAL_AUDIO_CHANNELS == 2
+    reverb->node.process_stereo_block = &reverb_process_stereo_block;
+#endif
+
+    atomic_init(&reverb->feedback, 0);
+    atomic_init(&reverb->damping, 0);
+    atomic_init(&reverb->mix, 0);
+    audio_reverb_set(reverb, decay, damping, mix);
+
+    return true;
+}
+
+void audio_reverb_set(struct audio_reverb *reverb, pal_float_t decay, pal_float_t damping, pal_float_t mix) {
+    int32_t feedback = REVERB_MIN_FEEDBACK + ((to_gain(decay) * REVERB_FEEDBACK_RANGE) >> GAIN_FRAC_BITS);
+
+    atomic_store_explicit(&reverb->feedback, feedback, memory_order_relaxed);
+    atomic_store_explicit(&reverb->damping, (to_gain(damping) * REVERB_MAX_DAMPING) >> GAIN_FRAC_BITS, memory_order_relaxed);
+    atomic_store_explicit(&reverb->mix, to_gain(mix), memory_order_relaxed);
+}
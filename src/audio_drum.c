@@ -0,0 +1,243 @@
+#include "audio_drum.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "audio.h"
+#include "mathutils.h"
+#include "pal.h"
+
+#define ENV_FRAC_BITS 30
+#define ENV_ONE ((int32_t) 1 << ENV_FRAC_BITS)
+// voices end once both envelopes are under -72 dB
+#define ENV_SILENT (ENV_ONE >> 12)
+// ln(1000) with ENV_FRAC_BITS, a 60 dB decay
+#define DECAY_60DB_NEPERS 7417145753LL
+#define CHOKE_MS 5
+// taps of a maximal length 32 bit Galois LFSR
+#define NOISE_TAPS 0x80200003u
+#define NOISE_SEED 0x2545F491u
+
+enum gm_drum_patch {
+    GM_KICK,
+    GM_SIDE_STICK,
+    GM_SNARE,
+    GM_CLAP,
+    GM_CLOSED_HAT,
+    GM_PEDAL_HAT,
+    GM_OPEN_HAT,
+    GM_TOM_1,
+    GM_TOM_2,
+    GM_TOM_3,
+    GM_TOM_4,
+    GM_TOM_5,
+    GM_TOM_6,
+    GM_CRASH,
+    GM_RIDE,
+    GM_RIDE_BELL,
+    GM_SPLASH,
+    GM_TAMBOURINE,
+    GM_COWBELL,
+    GM_BONGO_HIGH,
+    GM_BONGO_LOW,
+    GM_CONGA_HIGH,
+    GM_CONGA_LOW,
+    GM_TIMBALE,
+    GM_SHAKER,
+    GM_CLAVES,
+    GM_WOOD_BLOCK,
+    GM_TRIANGLE_MUTE,
+    GM_TRIANGLE_OPEN,
+    GM_NUM_PATCHES
+};
+
+static const struct drum_patch gm_patches[GM_NUM_PATCHES] = {
+    //                    start  end  sweep decay noise tone noise  lp   hp choke
+    [GM_KICK] =          { 160,   48,  35, 320,  12, 220,  35, 255,   0, 0 },
+    [GM_SIDE_STICK] =    { 900,  700,   4,  45,  25, 120, 110, 220,  90, 0 },
+    [GM_SNARE] =         { 230,  180,  15, 110, 180,  90, 165, 190,  30, 0 },
+    [GM_CLAP] =          {   0,    0,   0,   0, 140,   0, 230, 150,  60, 0 },
+    [GM_CLOSED_HAT] =    {   0,    0,   0,   0,  55,   0, 170, 255, 200, 1 },
+    [GM_PEDAL_HAT] =     {   0,    0,   0,   0,  90,   0, 150, 255, 190, 1 },
+    [GM_OPEN_HAT] =      {   0,    0,   0,   0, 450,   0, 160, 255, 200, 1 },
+    [GM_TOM_1] =         { 115,   82,  60, 380,  45, 210,  40, 160,   0, 0 },
+    [GM_TOM_2] =         { 132,   95,  60, 360,  45, 210,  40, 160,   0, 0 },
+    [GM_TOM_3] =         { 152,  110,  55, 340,  45, 210,  40, 170,   0, 0 },
+    [GM_TOM_4] =         { 175,  128,  55, 320,  40, 210,  40, 170,   0, 0 },
+    [GM_TOM_5] =         { 200,  148,  50, 300,  40, 210,  40, 180,   0, 0 },
+    [GM_TOM_6] =         { 232,  170,  50, 280,  40, 210,  40, 180,   0, 0 },
+    [GM_CRASH] =         {   0,    0,   0,   0, 1400,  0, 190, 255, 150, 0 },
+    [GM_RIDE] =          {3100, 3100,   0, 600, 900,  40, 110, 255, 210, 0 },
+    [GM_RIDE_BELL] =     {2400, 2400,   0, 700, 300, 150,  60, 255, 200, 0 },
+    [GM_SPLASH] =        {   0,    0,   0,   0, 600,   0, 180, 255, 170, 0 },
+    [GM_TAMBOURINE] =    {   0,    0,   0,   0, 160,   0, 170, 255, 220, 0 },
+    [GM_COWBELL] =       { 810,  800,   3, 220,   0, 200,   0, 255,   0, 0 },
+    [GM_BONGO_HIGH] =    { 420,  390,  10, 120,  10, 220,  25, 200,   0, 0 },
+    [GM_BONGO_LOW] =     { 310,  285,  12, 150,  10, 220,  25, 200,   0, 0 },
+    [GM_CONGA_HIGH] =    { 360,  330,  15, 200,  10, 220,  25, 200,   0, 0 },
+    [GM_CONGA_LOW] =     { 235,  215,  18, 240,  10, 220,  25, 200,   0, 0 },
+    [GM_TIMBALE] =       { 480,  440,   8, 250,  90, 150, 100, 230,  60, 0 },
+    [GM_SHAKER] =        {   0,    0,   0,   0,  70,   0, 150, 255, 230, 0 },
+    [GM_CLAVES] =        {2500, 2500,   0,  60,   0, 220,   0, 255,   0, 0 },
+    [GM_WOOD_BLOCK] =    {1100, 1000,   3,  70,  10, 200,  40, 255, 100, 0 },
+    [GM_TRIANGLE_MUTE] = {4200, 4200,   0, 140,   0, 160,   0, 255,   0, 2 },
+    [GM_TRIANGLE_OPEN] = {4200, 4200,   0, 900,   0, 160,   0, 255,   0, 2 },
+};
+
+const struct drum_kit drum_kit_gm = {
+    .patches = gm_patches,
+    .note_patches = {
+        [35] = GM_KICK + 1,             // acoustic bass drum
+        [36] = GM_KICK + 1,             // bass drum 1
+        [37] = GM_SIDE_STICK + 1,
+        [38] = GM_SNARE + 1,            // acoustic snare
+        [39] = GM_CLAP + 1,
+        [40] = GM_SNARE + 1,            // electric snare
+        [41] = GM_TOM_1 + 1,            // low floor tom
+        [42] = GM_CLOSED_HAT + 1,
+        [43] = GM_TOM_2 + 1,            // high floor tom
+        [44] = GM_PEDAL_HAT + 1,
+        [45] = GM_TOM_3 + 1,            // low tom
+        [46] = GM_OPEN_HAT + 1,
+        [47] = GM_TOM_4 + 1,            // low mid tom
+        [48] = GM_TOM_5 + 1,            // high mid tom
+        [49] = GM_CRASH + 1,            // crash cymbal 1
+        [50] = GM_TOM_6 + 1,            // high tom
+        [51] = GM_RIDE + 1,             // ride cymbal 1
+        [52] = GM_CRASH + 1,            // chinese cymbal
+        [53] = GM_RIDE_BELL + 1,
+        [54] = GM_TAMBOURINE + 1,
+        [55] = GM_SPLASH + 1,
+        [56] = GM_COWBELL + 1,
+        [57] = GM_CRASH + 1,            // crash cymbal 2
+        [59] = GM_RIDE + 1,             // ride cymbal 2
+        [60] = GM_BONGO_HIGH + 1,
+        [61] = GM_BONGO_LOW + 1,
+        [62] = GM_CONGA_HIGH + 1,       // mute high conga
+        [63] = GM_CONGA_HIGH + 1,       // open high conga
+        [64] = GM_CONGA_LOW + 1,
+        [65] = GM_TIMBALE + 1,          // high timbale
+        [66] = GM_TIMBALE + 1,          // low timbale
+        [69] = GM_SHAKER + 1,           // cabasa
+        [70] = GM_SHAKER + 1,           // maracas
+        [75] = GM_CLAVES + 1,
+        [76] = GM_WOOD_BLOCK + 1,       // high wood block
+        [77] = GM_WOOD_BLOCK + 1,       // low wood block
+        [80] = GM_TRIANGLE_MUTE + 1,
+        [81] = GM_TRIANGLE_OPEN + 1,
+    }
+};
+
+/**
+ * @brief Factor an envelope is multiplied by every sample to fall by nepers in time_ms
+ * First order approximation of e^(-nepers / samples), close once the decay is a few hundred
+ * samples long
+ *
+ * @param time_ms
+ * @param nepers with ENV_FRAC_BITS
+ * @return int32_t with ENV_FRAC_BITS
+ */
+static int32_t decay_factor(uint32_t time_ms, int64_t nepers) {
+    int64_t num_samples = (int64_t) time_ms * PAL_AUDIO_SAMPLE_RATE / 1000;
+
+    if (num_samples == 0)
+        return 0;
+
+    int64_t factor = ENV_ONE - nepers / num_samples;
+
+    return factor > 0 ? factor : 0;
+}
+
+static uint32_t hz_to_increment(uint32_t hz) {
+    return ((uint64_t) hz << 32) / PAL_AUDIO_SAMPLE_RATE;
+}
+
+/**
+ * @brief Sine of phase from a parabola and one correction step, within 0.1%
+ *
+ * @param phase a cycle is 2^32
+ * @return int32_t with 15 fractional bits
+ */
+static inline int32_t drum_sine(uint32_t phase) {
+    int32_t x = (int32_t) phase >> 16;      // -pi to pi is -32768 to 32767
+    int32_t y = (x * (32768 - pal_abs(x))) >> 13;
+
+    return y + ((7373 * (((y * pal_abs(y)) >> 15) - y)) >> 15);
+}
+
+void drum_voice_start(struct drum_voice *voice, const struct drum_patch *patch, uint16_t amplitude) {
+    voice->patch = patch;
+    voice->phase = 0;
+    voice->end_increment = hz_to_increment(patch->tone_end_hz);
+    voice->sweep_increment = (int32_t) (hz_to_increment(patch->tone_start_hz) - voice->end_increment);
+    // the noise runs on from the last hit of the voice so hits don't sound the same
+    if (voice->noise == 0)
+        voice->noise = NOISE_SEED;
+    voice->noise_lowpass = 0;
+    voice->noise_highpass = 0;
+    voice->tone_env = patch->tone_level > 0 ? ENV_ONE : 0;
+    voice->tone_decay = decay_factor(patch->tone_decay_ms, DECAY_60DB_NEPERS);
+    voice->noise_env = patch->noise_level > 0 ? ENV_ONE : 0;
+    voice->noise_decay = decay_factor(patch->noise_decay_ms, DECAY_60DB_NEPERS);
+    voice->sweep_env = ENV_ONE;
+    voice->sweep_decay = decay_factor(patch->tone_sweep_ms, ENV_ONE);
+    voice->amplitude = amplitude;
+}
+
+void drum_voice_choke(struct drum_voice *voice) {
+    int32_t decay = decay_factor(CHOKE_MS, DECAY_60DB_NEPERS);
+
+    voice->tone_decay = pal_min(voice->tone_decay, decay);
+    voice->noise_decay = pal_min(voice->noise_decay, decay);
+}
+
+int32_t drum_voice_level(const struct drum_voice *voice) {
+    return pal_max(voice->tone_env, voice->noise_env);
+}
+
+bool drum_voice_render(struct drum_voice *voice, int32_t *samples, int num_samples) {
+    const struct drum_patch *patch = voice->patch;
+    // levels with 15 fractional bits
+    int32_t tone_gain = (patch->tone_level * voice->amplitude) >> 8;
+    int32_t noise_gain = (patch->noise_level * voice->amplitude) >> 8;
+    int32_t noise_lowpass_coef = patch->noise_lowpass + 1;
+    int32_t noise_highpass_coef = patch->noise_highpass;
+    uint32_t phase = voice->phase;
+    uint32_t noise = voice->noise;
+    int32_t lowpass = voice->noise_lowpass;
+    int32_t highpass = voice->noise_highpass;
+    int32_t tone_env = voice->tone_env;
+    int32_t noise_env = voice->noise_env;
+    int32_t sweep_env = voice->sweep_env;
+
+    for (int i = 0; i < num_samples; i++) {
+        int32_t sample = 0;
+
+        if (tone_env != 0) {
+            phase += voice->end_increment + (int32_t) (((int64_t) voice->sweep_increment * sweep_env) >> ENV_FRAC_BITS);
+            sample += (((drum_sine(phase) * (tone_env >> 15)) >> 15) * tone_gain) >> 15;
+            tone_env = ((int64_t) tone_env * voice->tone_decay) >> ENV_FRAC_BITS;
+            sweep_env = ((int64_t) sweep_env * voice->sweep_decay) >> ENV_FRAC_BITS;
+        }
+
+        if (noise_env != 0) {
+            noise = (noise >> 1) ^ (-(noise & 1) & NOISE_TAPS);
+            lowpass += (((int16_t) noise - lowpass) * noise_lowpass_coef) >> 8;
+            highpass += ((lowpass - highpass) * noise_highpass_coef) >> 8;
+            sample += ((((lowpass - highpass) * (noise_env >> 15)) >> 15) * noise_gain) >> 15;
+            noise_env = ((int64_t) noise_env * voice->noise_decay) >> ENV_FRAC_BITS;
+        }
+
+        samples[i] += sample;
+    }
+
+    voice->phase = phase;
+    voice->noise = noise;
+    voice->noise_lowpass = lowpass;
+    voice->noise_highpass = highpass;
+    voice->tone_env = tone_env < ENV_SILENT ? 0 : tone_env;
+    voice->noise_env = noise_env < ENV_SILENT ? 0 : noise_env;
+    voice->sweep_env = sweep_env;
+
+    return voice->tone_env != 0 || voice->noise_env != 0;
+}
@@ -0,0 +1,526 @@
+#include "audio_filter.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "audio.h"
+#include "mathutils.h"
+#include "pal.h"
+
+// coefficients are designed with this many fractional bits, in integers so updates are cheap
+// in every numeric mode
+#define DESIGN_FRAC_BITS 28
+#define DESIGN_ONE ((int64_t) 1 << DESIGN_FRAC_BITS)
+// 2 pi with DESIGN_FRAC_BITS, also pi / 2 with 30 fractional bits
+#define TWO_PI 1686629713
+#define LN_2 186065279
+#define LOG2_E 387270501
+// shelf amplitude is 10^(gain_db / 40) = 2^(gain_db * LOG2_10_OVER_40)
+#define LOG2_10_OVER_40 22293082
+#define COEF_ONE ((int64_t) 1 << AUDIO_FILTER_COEF_FRAC_BITS)
+#define COEF_FRAC_MASK (COEF_ONE - 1)
+
+typedef void (*filter_kernel_t)(const struct audio_filter *filter, struct audio_filter_state *state, int32_t *samples, int num_samples);
+// runs both channels in one loop with the state of each, so the two recurrences overlap
+typedef void (*filter_stereo_kernel_t)(const struct audio_filter *filter, struct audio_filter_state *state, int32_t *left, int32_t *right, int num_samples);
+
+static int64_t to_design_fixed(pal_float_t x) {
+#if defined PAL_USE_FIXED
+    return ((int64_t) x * DESIGN_ONE) >> PAL_FIXED_FRAC_BITS;
+#else
+    return x * DESIGN_ONE;
+#endif
+}
+
+/**
+ * @brief Sine and cosine for filter design
+ *
+ * @param phase fraction of a cycle with 32 fractional bits
+ * @param sin_out DESIGN_FRAC_BITS fixed point
+ * @param cos_out DESIGN_FRAC_BITS fixed point
+ */
+static void sin_cos(uint32_t phase, int64_t *sin_out, int64_t *cos_out) {
+    uint32_t quadrant = phase >> 30;
+    int64_t y = phase & ((1u << 30) - 1);
+    bool upper_octant = y > (1 << 29);
+
+    // the polynomials only need to cover up to pi / 4
+    if (upper_octant)
+        y = (1 << 30) - y;
+
+    int64_t x = (y * TWO_PI) >> 32;
+    int64_t x2 = (x * x) >> DESIGN_FRAC_BITS;
+    int64_t s = DESIGN_ONE;
+    int64_t c = DESIGN_ONE;
+
+    // taylor series in horner form, both are accurate to a few lsb at pi / 4
+    for (int k = 9; k >= 3; k -= 2)
+        s = DESIGN_ONE - ((x2 * s) >> DESIGN_FRAC_BITS) / (k * (k - 1));
+    for (int k = 10; k >= 2; k -= 2)
+        c = DESIGN_ONE - ((x2 * c) >> DESIGN_FRAC_BITS) / (k * (k - 1));
+
+    s = (x * s) >> DESIGN_FRAC_BITS;
+
+    if (upper_octant) {
+        int64_t swap = s;
+        s = c;
+        c = swap;
+    }
+
+    switch (quadrant) {
+        case 0:
+            *sin_out = s;
+            *cos_out = c;
+            break;
+        case 1:
+            *sin_out = c;
+            *cos_out = -s;
+            break;
+        case 2:
+            *sin_out = -s;
+            *cos_out = -c;
+            break;
+        default:
+            *sin_out = -c;
+            *cos_out = s;
+            break;
+    }
+}
+
+/**
+ * @brief 2^x for filter design
+ *
+ * @param x DESIGN_FRAC_BITS fixed point, below 30
+ * @return int64_t DESIGN_FRAC_BITS fixed point
+ */
+static int64_t exp2_fixed(int64_t x) {
+    int64_t integer = x >> DESIGN_FRAC_BITS;
+    int64_t y = ((x & (DESIGN_ONE - 1)) * LN_2) >> DESIGN_FRAC_BITS;
+    int64_t result = DESIGN_ONE;
+
+    // e^y with y below ln 2
+    for (int k = 10; k >= 1; k--)
+        result = DESIGN_ONE + ((y * result) >> DESIGN_FRAC_BITS) / k;
+
+    return integer >= 0 ? result << integer : result >> -integer;
+}
+
+static void normalize_coefs(int32_t *coefs, int64_t b0, int64_t b1, int64_t b2, int64_t a0, int64_t a1, int64_t a2) {
+    coefs[AUDIO_FILTER_B0] = b0 * COEF_ONE / a0;
+    coefs[AUDIO_FILTER_B1] = b1 * COEF_ONE / a0;
+    coefs[AUDIO_FILTER_B2] = b2 * COEF_ONE / a0;
+    coefs[AUDIO_FILTER_A1] = a1 * COEF_ONE / a0;
+    coefs[AUDIO_FILTER_A2] = a2 * COEF_ONE / a0;
+}
+
+/**
+ * @brief Computes coefficients of filter type, biquads follow the RBJ audio EQ cookbook
+ *
+ * @param type
+ * @param frequency
+ * @param q
+ * @param gain_db
+ * @param coefs
+ */
+static void design_coefs(enum audio_filter_type type, pal_float_t frequency, pal_float_t q, pal_float_t gain_db, int32_t *coefs) {
+    // the limits keep every coefficient and intermediate value in range
+    frequency = pal_fmax(pal_fmin(frequency, PAL_FLOAT(PAL_AUDIO_SAMPLE_RATE * 0.49)), PAL_FLOAT(1));
+    q = pal_fmax(pal_fmin(q, PAL_FLOAT(64)), PAL_FLOAT(0.1));
+    gain_db = pal_fmax(pal_fmin(gain_db, PAL_FLOAT(18)), PAL_FLOAT(-18));
+
+    uint32_t phase = ((uint64_t) to_design_fixed(frequency) << (32 - DESIGN_FRAC_BITS)) / PAL_AUDIO_SAMPLE_RATE;
+    int64_t s, c;
+
+    for (int i = 0; i < AUDIO_FILTER_NUM_COEFS; i++)
+        coefs[i] = 0;
+
+    if (type == AUDIO_FILTER_ONE_POLE || type == AUDIO_FILTER_DC_BLOCKER) {
+        int64_t w0 = ((uint64_t) phase * TWO_PI) >> 32;
+        // pole at e^-w0
+        int64_t pole = exp2_fixed(-((w0 * LOG2_E) >> DESIGN_FRAC_BITS));
+
+        coefs[AUDIO_FILTER_A1] = -(pole >> (DESIGN_FRAC_BITS - AUDIO_FILTER_COEF_FRAC_BITS));
+        coefs[AUDIO_FILTER_B0] = (DESIGN_ONE - pole) >> (DESIGN_FRAC_BITS - AUDIO_FILTER_COEF_FRAC_BITS);
+
+        if (type == AUDIO_FILTER_DC_BLOCKER) {
+            coefs[AUDIO_FILTER_B0] = COEF_ONE;
+            coefs[AUDIO_FILTER_B1] = -COEF_ONE;
+        }
+
+        return;
+    }
+
+    sin_cos(phase, &s, &c);
+
+    int64_t alpha = s * DESIGN_ONE / (2 * to_design_fixed(q));
+
+    switch (type) {
+        case AUDIO_FILTER_LOWPASS:
+            normalize_coefs(coefs, (DESIGN_ONE - c) / 2, DESIGN_ONE - c, (DESIGN_ONE - c) / 2, DESIGN_ONE + alpha, -2 * c, DESIGN_ONE - alpha);
+            break;
+        case AUDIO_FILTER_HIGHPASS:
+            normalize_coefs(coefs, (DESIGN_ONE + c) / 2, -(DESIGN_ONE + c), (DESIGN_ONE + c) / 2, DESIGN_ONE + alpha, -2 * c, DESIGN_ONE - alpha);
+            break;
+        case AUDIO_FILTER_BANDPASS:
+            normalize_coefs(coefs, alpha, 0, -alpha, DESIGN_ONE + alpha, -2 * c, DESIGN_ONE - alpha);
+            break;
+        case AUDIO_FILTER_NOTCH:
+            normalize_coefs(coefs, DESIGN_ONE, -2 * c, DESIGN_ONE, DESIGN_ONE + alpha, -2 * c, DESIGN_ONE - alpha);
+            break;
+        default: {
+            int64_t gain_exponent = (to_design_fixed(gain_db) * LOG2_10_OVER_40) >> DESIGN_FRAC_BITS;
+            int64_t a = exp2_fixed(gain_exponent);
+            int64_t two_sqrt_a_alpha = (2 * exp2_fixed(gain_exponent / 2) * alpha) >> DESIGN_FRAC_BITS;
+            int64_t a_plus_1 = a + DESIGN_ONE;
+            int64_t a_minus_1 = a - DESIGN_ONE;
+            int64_t a_plus_1_cos = (a_plus_1 * c) >> DESIGN_FRAC_BITS;
+            int64_t a_minus_1_cos = (a_minus_1 * c) >> DESIGN_FRAC_BITS;
+
+            if (type == AUDIO_FILTER_LOW_SHELF) {
+                normalize_coefs(coefs,
+                    (a * (a_plus_1 - a_minus_1_cos + two_sqrt_a_alpha)) >> DESIGN_FRAC_BITS,
+                    (2 * a * (a_minus_1 - a_plus_1_cos)) >> DESIGN_FRAC_BITS,
+                    (a * (a_plus_1 - a_minus_1_cos - two_sqrt_a_alpha)) >> DESIGN_FRAC_BITS,
+                    a_plus_1 + a_minus_1_cos + two_sqrt_a_alpha,
+                    -2 * (a_minus_1 + a_plus_1_cos),
+                    a_plus_1 + a_minus_1_cos - two_sqrt_a_alpha);
+            } else {
+                normalize_coefs(coefs,
+                    (a * (a_plus_1 + a_minus_1_cos + two_sqrt_a_alpha)) >> DESIGN_FRAC_BITS,
+                    (-2 * a * (a_minus_1 + a_plus_1_cos)) >> DESIGN_FRAC_BITS,
+                    (a * (a_plus_1 + a_minus_1_cos - two_sqrt_a_alpha)) >> DESIGN_FRAC_BITS,
+                    a_plus_1 - a_minus_1_cos + two_sqrt_a_alpha,
+                    2 * (a_minus_1 - a_plus_1_cos),
+                    a_plus_1 - a_minus_1_cos - two_sqrt_a_alpha);
+            }
+            break;
+        }
+    }
+}
+
+static void biquad_run(const struct audio_filter *filter, struct audio_filter_state *state, int32_t *samples, int num_samples) {
+    const int64_t b0 = filter->coefs[AUDIO_FILTER_B0];
+    const int64_t b1 = filter->coefs[AUDIO_FILTER_B1];
+    const int64_t b2 = filter->coefs[AUDIO_FILTER_B2];
+    const int64_t a1 = filter->coefs[AUDIO_FILTER_A1];
+    const int64_t a2 = filter->coefs[AUDIO_FILTER_A2];
+    int32_t x1 = state->x1, x2 = state->x2, y1 = state->y1, y2 = state->y2;
+    int32_t error = state->error;
+
+    for (int i = 0; i < num_samples; i++) {
+        int32_t x = samples[i];
+        int64_t acc = b0 * x + b1 * x1 + b2 * x2 - a1 * y1 - a2 * y2 + error;
+        int32_t y = acc >> AUDIO_FILTER_COEF_FRAC_BITS;
+
+        error = acc & COEF_FRAC_MASK;
+        x2 = x1;
+        x1 = x;
+        y2 = y1;
+        y1 = y;
+        samples[i] = y;
+    }
+
+    state->x1 = x1;
+    state->x2 = x2;
+    state->y1 = y1;
+    state->y2 = y2;
+    state->error = error;
+}
+
+static void one_pole_run(const struct audio_filter *filter, struct audio_filter_state *state, int32_t *samples, int num_samples) {
+    const int64_t b0 = filter->coefs[AUDIO_FILTER_B0];
+    const int64_t a1 = filter->coefs[AUDIO_FILTER_A1];
+    int32_t y1 = state->y1;
+    int32_t error = state->error;
+
+    for (int i = 0; i < num_samples; i++) {
+        int64_t acc = b0 * samples[i] - a1 * y1 + error;
+
+        y1 = acc >> AUDIO_FILTER_COEF_FRAC_BITS;
+        error = acc & COEF_FRAC_MASK;
+        samples[i] = y1;
+    }
+
+    state->y1 = y1;
+    state->error = error;
+}
+
+static void dc_blocker_run(const struct audio_filter *filter, struct audio_filter_state *state, int32_t *samples, int num_samples) {
+    const int64_t a1 = filter->coefs[AUDIO_FILTER_A1];
+    int32_t x1 = state->x1, y1 = state->y1;
+    int32_t error = state->error;
+
+    for (int i = 0; i < num_samples; i++) {
+        int32_t x = samples[i];
+        int64_t acc = ((int64_t) x - x1) * COEF_ONE - a1 * y1 + error;
+
+        y1 = acc >> AUDIO_FILTER_COEF_FRAC_BITS;
+        error = acc & COEF_FRAC_MASK;
+        x1 = x;
+        samples[i] = y1;
+    }
+
+    state->x1 = x1;
+    state->y1 = y1;
+    state->error = error;
+}
+
+#if PAL_AUDIO_CHANNELS == 2
+// The stereo kernels compute the same as the mono ones on each channel, with the left and right
+// channel as the two lanes of each variable
+static void biquad_run_stereo(const struct audio_filter *filter, struct audio_filter_state *state, int32_t *left, int32_t *right, int num_samples) {
+    const int64_t b0 = filter->coefs[AUDIO_FILTER_B0];
+    const int64_t b1 = filter->coefs[AUDIO_FILTER_B1];
+    const int64_t b2 = filter->coefs[AUDIO_FILTER_B2];
+    const int64_t a1 = filter->coefs[AUDIO_FILTER_A1];
+    const int64_t a2 = filter->coefs[AUDIO_FILTER_A2];
+    int32_t x1[2] = { state[0].x1, state[1].x1 }, x2[2] = { state[0].x2, state[1].x2 };
+    int32_t y1[2] = { state[0].y1, state[1].y1 }, y2[2] = { state[0].y2, state[1].y2 };
+    int32_t error[2] = { state[0].error, state[1].error };
+
+    for (int i = 0; i < num_samples; i++) {
+        int32_t x[2] = { left[i], right[i] };
+        int32_t y[2];
+
+        for (int lane = 0; lane < 2; lane++) {
+            int64_t acc = b0 * x[lane] + b1 * x1[lane] + b2 * x2[lane] - a1 * y1[lane] - a2 * y2[lane] + error[lane];
+
+            y[lane] = acc >> AUDIO_FILTER_COEF_FRAC_BITS;
+            error[lane] = acc & COEF_FRAC_MASK;
+            x2[lane] = x1[lane];
+            x1[lane] = x[lane];
+            y2[lane] = y1[lane];
+            y1[lane] = y[lane];
+        }
+
+        left[i] = y[0];
+        right[i] = y[1];
+    }
+
+    for (int lane = 0; lane < 2; lane++) {
+        state[lane].x1 = x1[lane];
+        state[lane].x2 = x2[lane];
+        state[lane].y1 = y1[lane];
+        state[lane].y2 = y2[lane];
+        state[lane].error = error[lane];
+    }
+}
+
+static void one_pole_run_stereo(const struct audio_filter *filter, struct audio_filter_state *state, int32_t *left, int32_t *right, int num_samples) {
+    const int64_t b0 = filter->coefs[AUDIO_FILTER_B0];
+    const int64_t a1 = filter->coefs[AUDIO_FILTER_A1];
+    int32_t y1[2] = { state[0].y1, state[1].y1 };
+    int32_t error[2] = { state[0].error, state[1].error };
+
+    for (int i = 0; i < num_samples; i++) {
+        int32_t x[2] = { left[i], right[i] };
+
+        for (int lane = 0; lane < 2; lane++) {
+            int64_t acc = b0 * x[lane] - a1 * y1[lane] + error[lane];
+
+            y1[lane] = acc >> AUDIO_FILTER_COEF_FRAC_BITS;
+            error[lane] = acc & COEF_FRAC_MASK;
+        }
+
+        left[i] = y1[0];
+        right[i] = y1[1];
+    }
+
+    for (int lane = 0; lane < 2; lane++) {
+        state[lane].y1 = y1[lane];
+        state[lane].error = error[lane];
+    }
+}
+
+static void dc_blocker_run_stereo(const struct audio_filter *filter, struct audio_filter_state *state, int32_t *left, int32_t *right, int num_samples) {
+    const int64_t a1 = filter->coefs[AUDIO_FILTER_A1];
+    int32_t x1[2] = { state[0].x1, state[1].x1 }, y1[2] = { state[0].y1, state[1].y1 };
+    int32_t error[2] = { state[0].error, state[1].error };
+
+    for (int i = 0; i < num_samples; i++) {
+        int32_t x[2] = { left[i], right[i] };
+
+        for (int lane = 0; lane < 2; lane++) {
+            int64_t acc = ((int64_t) x[lane] - x1[lane]) * COEF_ONE - a1 * y1[lane] + error[lane];
+
+            y1[lane] = acc >> AUDIO_FILTER_COEF_FRAC_BITS;
+            error[lane] = acc & COEF_FRAC_MASK;
+            x1[lane] = x[lane];
+        }
+
+        left[i] = y1[0];
+        right[i] = y1[1];
+    }
+
+    for (int lane = 0; lane < 2; lane++) {
+        state[lane].x1 = x1[lane];
+        state[lane].y1 = y1[lane];
+        state[lane].error = error[lane];
+    }
+}
+#endif
+
+/**
+ * @brief Starts ramp to the coefficients from audio_filter_set, if there are new ones
+ *
+ * @param filter
+ */
+static void apply_pending_coefs(struct audio_filter *filter) {
+    unsigned int sequence = atomic_load_explicit(&filter->pending_sequence, memory_order_acquire);
+
+    if (sequence == filter->applied_sequence || (sequence & 1) != 0)
+        return;
+
+    for (int i = 0; i < AUDIO_FILTER_NUM_COEFS; i++)
+        filter->target_coefs[i] = atomic_load_explicit(&filter->pending_coefs[i], memory_order_relaxed);
+
+    atomic_thread_fence(memory_order_acquire);
+
+    // set again while reading, try again at the next block
+    if (atomic_load_explicit(&filter->pending_sequence, memory_order_relaxed) != sequence)
+        return;
+
+    filter->applied_sequence = sequence;
+
+    for (int i = 0; i < AUDIO_FILTER_NUM_COEFS; i++)
+        filter->coef_steps[i] = (filter->target_coefs[i] - filter->coefs[i]) / AUDIO_CONTROL_PERIOD;
+
+    filter->ramp_samples_left = AUDIO_CONTROL_PERIOD;
+}
+
+/**
+ * @brief Runs kernel over the samples, or stereo_kernel over both channels when right is set
+ *
+ * @param filter
+ * @param kernel
+ * @param stereo_kernel only used in stereo builds
+ * @param left
+ * @param right NULL for a mono block
+ * @param num_samples
+ */
+static void run_kernel(struct audio_filter *filter, filter_kernel_t kernel, filter_stereo_kernel_t stereo_kernel, int32_t *left, int32_t *right, int num_samples) {
+#if PAL_AUDIO_CHANNELS == 2
+    if (right != NULL) {
+        stereo_kernel(filter, filter->state, left, right, num_samples);
+        return;
+    }
+#else
+    (void) stereo_kernel;
+    (void) right;
+#endif
+
+    kernel(filter, &filter->state[0], left, num_samples);
+}
+
+/**
+ * @brief Runs a block through filter, gliding the coefficients first if they changed
+ *
+ * @param filter
+ * @param kernel
+ * @param stereo_kernel
+ * @param left
+ * @param right NULL for a mono block
+ * @param num_samples
+ */
+static void process_block(struct audio_filter *filter, filter_kernel_t kernel, filter_stereo_kernel_t stereo_kernel, int32_t *left, int32_t *right, int num_samples) {
+    int i = 0;
+
+    apply_pending_coefs(filter);
+
+    // while gliding the coefficients change every sample
+    for (; i < num_samples && filter->ramp_samples_left > 0; i++) {
+        if (--filter->ramp_samples_left == 0) {
+            for (int c = 0; c < AUDIO_FILTER_NUM_COEFS; c++)
+                filter->coefs[c] = filter->target_coefs[c];
+        } else {
+            for (int c = 0; c < AUDIO_FILTER_NUM_COEFS; c++)
+                filter->coefs[c] += filter->coef_steps[c];
+        }
+
+        run_kernel(filter, kernel, stereo_kernel, left + i, right != NULL ? right + i : NULL, 1);
+    }
+
+    if (i < num_samples)
+        run_kernel(filter, kernel, stereo_kernel, left + i, right != NULL ? right + i : NULL, num_samples - i);
+}
+
+static void biquad_process_block(struct filter_node *node, int32_t *samples, int num_samples) {
+    process_block((struct audio_filter *) node, &biquad_run, NULL, samples, NULL, num_samples);
+}
+
+static void one_pole_process_block(struct filter_node *node, int32_t *samples, int num_samples) {
+    process_block((struct audio_filter *) node, &one_pole_run, NULL, samples, NULL, num_samples);
+}
+
+static void dc_blocker_process_block(struct filter_node *node, int32_t *samples, int num_samples) {
+    process_block((struct audio_filter *) node, &dc_blocker_run, NULL, samples, NULL, num_samples);
+}
+
+#if PAL_AUDIO_CHANNELS == 2
+static void biquad_process_stereo_block(struct filter_node *node, int32_t *left, int32_t *right, int num_samples) {
+    process_block((struct audio_filter *) node, &biquad_run, &biquad_run_stereo, left, right, num_samples);
+}
+
+static void one_pole_process_stereo_block(struct filter_node *node, int32_t *left, int32_t *right, int num_samples) {
+    process_block((struct audio_filter *) node, &one_pole_run, &one_pole_run_stereo, left, right, num_samples);
+}
+
+static void dc_blocker_process_stereo_block(struct filter_node *node, int32_t *left, int32_t *right, int num_samples) {
+    process_block((struct audio_filter *) node, &dc_blocker_run, &dc_blocker_run_stereo, left, right, num_samples);
+}
+#endif
+
+void audio_filter_init(struct audio_filter *filter, enum audio_filter_type type, pal_float_t frequency, pal_float_t q, pal_float_t gain_db) {
+    filter->node.process = NULL;
+    filter->node.next = NULL;
+
+    filter->node.process_stereo_block = NULL;
+
+    if (type == AUDIO_FILTER_ONE_POLE)
+        filter->node.process_block = &one_pole_process_block;
+    else if (type == AUDIO_FILTER_DC_BLOCKER)
+        filter->node.process_block = &dc_blocker_process_block;
+    else
+        filter->node.process_block = &biquad_process_block;
+
+#if PAL_AUDIO_CHANNELS == 2
+    if (type == AUDIO_FILTER_ONE_POLE)
+        filter->node.process_stereo_block = &one_pole_process_stereo_block;
+    else if (type == AUDIO_FILTER_DC_BLOCKER)
+        filter->node.process_stereo_block = &dc_blocker_process_stereo_block;
+    else
+        filter->node.process_stereo_block = &biquad_process_stereo_block;
+#endif
+
+    filter->type = type;
+    design_coefs(type, frequency, q, gain_db, filter->coefs);
+
+    for (int i = 0; i < AUDIO_FILTER_NUM_COEFS; i++) {
+        filter->target_coefs[i] = filter->coefs[i];
+        filter->coef_steps[i] = 0;
+        atomic_init(&filter->pending_coefs[i], filter->coefs[i]);
+    }
+
+    filter->ramp_samples_left = 0;
+    for (int c = 0; c < PAL_AUDIO_CHANNELS; c++)
+        filter->state[c] = (struct audio_filter_state) { 0 };
+    atomic_init(&filter->pending_sequence, 0);
+    filter->applied_sequence = 0;
+}
+
+void audio_filter_set(struct audio_filter *filter, pal_float_t frequency, pal_float_t q, pal_float_t gain_db) {
+    int32_t coefs[AUDIO_FILTER_NUM_COEFS];
+    unsigned int sequence = atomic_load_explicit(&filter->pending_sequence, memory_order_relaxed);
+
+    design_coefs(filter->type, frequency, q, gain_db, coefs);
+
+    atomic_store_explicit(&filter->pending_sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    for (int i = 0; i < AUDIO_FILTER_NUM_COEFS; i++)
+        atomic_store_explicit(&filter->pending_coefs[i], coefs[i], memory_order_relaxed);
+
+    atomic_store_explicit(&filter->pending_sequence, sequence + 2, memory_order_release);
+}
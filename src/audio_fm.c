@@ -0,0 +1,344 @@
+#include "audio_fm.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "audio.h"
+#include "pal.h"
+#include "wavetable.h"
+
+#define ENV_FRAC_BITS 30
+#define ENV_ONE ((int32_t) 1 << ENV_FRAC_BITS)
+// operators are done once they are under -72 dB
+#define ENV_SILENT (ENV_ONE >> 12)
+// ln(1000) with ENV_FRAC_BITS, an envelope time is a fall by 60 dB
+#define DECAY_60DB_NEPERS 7417145753LL
+// operator gains are ramped with this many fractional bits below their 15
+#define GAIN_RAMP_FRAC_BITS 15
+#define RATIO_FRAC_BITS 8
+// oscillator time steps times ratios to 32 bit phase steps
+#define RATIO_SHIFT (32 - OSC_PERIOD_BITS - RATIO_FRAC_BITS)
+#define SINE_SHIFT (32 - WAVETABLE_SIZE_BITS)
+// full scale output of a modulator moves the phase it modulates by two cycles
+#define MODULATION_SHIFT 18
+// feedback 7 moves the phase by up to half a cycle
+#define FEEDBACK_SHIFT 8
+
+_Static_assert(RATIO_SHIFT >= 0, "OSC_PERIOD_BITS too big for FM operator ratios!");
+
+enum gm_fm_patch {
+    GM_FM_PIANO,
+    GM_FM_BELL,
+    GM_FM_ORGAN,
+    GM_FM_GUITAR,
+    GM_FM_BASS,
+    GM_FM_STRINGS,
+    GM_FM_BRASS,
+    GM_FM_REED,
+    GM_FM_PIPE,
+    GM_FM_LEAD,
+    GM_FM_PAD,
+    GM_FM_NUM_PATCHES
+};
+
+static const struct fm_patch gm_patches[GM_FM_NUM_PATCHES] = {
+    // operators:                                 ratio        attack decay release sus level fb
+    [GM_FM_PIANO] =   { FM_ALGORITHM_STACK, 2, { { FM_RATIO(1),     0,  900,  300,   0,  70, 0 },
+                                                 { FM_RATIO(1),     0, 3000,  400,   0, 230, 0 } } },
+    [GM_FM_BELL] =    { FM_ALGORITHM_STACK, 2, { { FM_RATIO(3.5),   0, 2000,  800,   0,  60, 0 },
+                                                 { FM_RATIO(1),     0, 4000, 1500,   0, 200, 0 } } },
+    [GM_FM_ORGAN] =   { FM_ALGORITHM_PARALLEL, 2, { { FM_RATIO(1),  5,    0,   80, 255, 140, 2 },
+                                                    { FM_RATIO(2),  5,    0,   80, 255,  90, 0 } } },
+    [GM_FM_GUITAR] =  { FM_ALGORITHM_STACK, 2, { { FM_RATIO(3),     0,  400,  150,   0,  50, 0 },
+                                                 { FM_RATIO(1),     0, 1800,  200,   0, 220, 0 } } },
+    [GM_FM_BASS] =    { FM_ALGORITHM_STACK, 2, { { FM_RATIO(1),     0,  300,  100,  40,  80, 3 },
+                                                 { FM_RATIO(1),     0, 1500,  120, 120, 240, 0 } } },
+    [GM_FM_STRINGS] = { FM_ALGORITHM_STACK, 2, { { FM_RATIO(1),   120,    0,  400, 200,  40, 6 },
+                                                 { FM_RATIO(1),   150,    0,  500, 230, 210, 0 } } },
+    [GM_FM_BRASS] =   { FM_ALGORITHM_STACK, 2, { { FM_RATIO(1),    60,  400,  200, 180,  80, 0 },
+                                                 { FM_RATIO(1),    30,  600,  150, 220, 220, 0 } } },
+    [GM_FM_REED] =    { FM_ALGORITHM_STACK, 2, { { FM_RATIO(2),    40,    0,  150, 255,  35, 0 },
+                                                 { FM_RATIO(1),    30,    0,  150, 255, 220, 0 } } },
+    [GM_FM_PIPE] =    { FM_ALGORITHM_STACK, 2, { { FM_RATIO(1),    80,    0,  150, 255,  12, 4 },
+                                                 { FM_RATIO(1),    60,    0,  200, 255, 230, 0 } } },
+    [GM_FM_LEAD] =    { FM_ALGORITHM_STACK, 2, { { FM_RATIO(1),     5,    0,  100, 255,  70, 7 },
+                                                 { FM_RATIO(1),     5,    0,  100, 255, 210, 0 } } },
+    [GM_FM_PAD] =     { FM_ALGORITHM_STACK, 2, { { FM_RATIO(2),   800,    0, 1200, 255,  30, 3 },
+                                                 { FM_RATIO(1),   600,    0, 1500, 255, 210, 0 } } },
+};
+
+const struct fm_bank fm_bank_gm = {
+    .patches = gm_patches,
+    .program_patches = {
+        [0 ... 7] = GM_FM_PIANO + 1,
+        [8 ... 15] = GM_FM_BELL + 1,        // chromatic percussion
+        [16 ... 23] = GM_FM_ORGAN + 1,
+        [24 ... 31] = GM_FM_GUITAR + 1,
+        [32 ... 39] = GM_FM_BASS + 1,
+        [40 ... 55] = GM_FM_STRINGS + 1,    // strings and ensembles
+        [56 ... 63] = GM_FM_BRASS + 1,
+        [64 ... 71] = GM_FM_REED + 1,
+        [72 ... 79] = GM_FM_PIPE + 1,
+        [80 ... 87] = GM_FM_LEAD + 1,
+        [88 ... 103] = GM_FM_PAD + 1,       // synth pads and effects
+        [104 ... 111] = GM_FM_GUITAR + 1,   // plucked ethnic instruments
+        [112 ... 119] = GM_FM_BELL + 1,     // percussive
+    }
+};
+
+// one cycle, from the builtin sine wavetable
+static const int16_t *sine = NULL;
+static const int32_t no_modulation[AUDIO_BLOCK_SIZE] = { 0 };
+
+bool fm_init() {
+    const struct wavetable *table;
+
+    if (sine != NULL)
+        return true;
+
+    if ((table = wavetable_get_builtin(WAVETABLE_SINE)) == NULL)
+        return false;
+
+    sine = table->levels[0];
+
+    return true;
+}
+
+static uint32_t ms_to_samples(uint32_t time_ms) {
+    return (uint64_t) time_ms * PAL_AUDIO_SAMPLE_RATE / 1000;
+}
+
+/**
+ * @brief Envelope change per sample to rise from silence to full level in time_ms
+ *
+ * @param time_ms
+ * @return int32_t with ENV_FRAC_BITS
+ */
+static int32_t attack_rate(uint32_t time_ms) {
+    uint32_t num_samples = ms_to_samples(time_ms);
+
+    return num_samples > 0 ? ENV_ONE / num_samples : ENV_ONE;
+}
+
+/**
+ * @brief Nepers per sample of a decay that falls by 60 dB in time_ms
+ *
+ * @param time_ms
+ * @return int32_t with ENV_FRAC_BITS
+ */
+static int32_t decay_rate(uint32_t time_ms) {
+    uint32_t num_samples = ms_to_samples(time_ms);
+    int64_t rate = num_samples > 0 ? DECAY_60DB_NEPERS / num_samples : ENV_ONE;
+
+    // a rate of ENV_ONE is silent after one sample
+    return rate < ENV_ONE ? rate : ENV_ONE;
+}
+
+/**
+ * @brief Factor a decaying envelope is multiplied by over num_samples, first order approximation
+ * of e^(-rate * num_samples). Close for decays a few control periods long, shorter ones end early
+ *
+ * @param rate nepers per sample
+ * @param num_samples
+ * @return int32_t with ENV_FRAC_BITS
+ */
+static int32_t decay_factor(int32_t rate, int num_samples) {
+    int64_t factor = ENV_ONE - (int64_t) rate * num_samples;
+
+    return factor > 0 ? factor : 0;
+}
+
+static int32_t sustain_envelope(const struct fm_operator *params) {
+    return (ENV_ONE / 255) * params->sustain;
+}
+
+/**
+ * @brief Output gain of operator at envelope, OSC_AMPLITUDE full scale with GAIN_RAMP_FRAC_BITS
+ *
+ * @param envelope
+ * @param level 0 to 255
+ * @return int32_t
+ */
+static int32_t operator_gain(int32_t envelope, uint8_t level) {
+    return (int32_t) (((int64_t) (envelope >> 15) * level * 257) >> 16) << GAIN_RAMP_FRAC_BITS;
+}
+
+static bool operator_is_carrier(const struct fm_patch *patch, int op) {
+    switch (patch->algorithm) {
+        case FM_ALGORITHM_PAIRS:
+            return (op & 1) != 0 || op == patch->num_operators - 1;
+        case FM_ALGORITHM_PARALLEL:
+            return true;
+        case FM_ALGORITHM_STACK:
+        case FM_ALGORITHM_BRANCH:
+        default:
+            return op == patch->num_operators - 1;
+    }
+}
+
+static bool operator_is_modulated(const struct fm_patch *patch, int op) {
+    switch (patch->algorithm) {
+        case FM_ALGORITHM_STACK:
+            return op > 0;
+        case FM_ALGORITHM_PAIRS:
+            return (op & 1) != 0;
+        case FM_ALGORITHM_BRANCH:
+            return op == patch->num_operators - 1;
+        case FM_ALGORITHM_PARALLEL:
+        default:
+            return false;
+    }
+}
+
+void fm_voice_start(struct fm_voice *voice, const struct fm_patch *patch) {
+    voice->patch = patch;
+
+    for (int i = 0; i < patch->num_operators; i++) {
+        struct fm_operator_state *op = &voice->operators[i];
+
+        op->phase = 0;
+        op->envelope = 0;
+        op->stage = ADSR_STATE_ATTACK;
+        op->stage_rate = attack_rate(patch->operators[i].attack_ms);
+        op->gain = 0;
+        op->gain_step = 0;
+        op->feedback[0] = 0;
+        op->feedback[1] = 0;
+    }
+}
+
+/**
+ * @brief Advances envelope of operator by num_samples, stages change at control points
+ *
+ * @param op
+ * @param params
+ * @param num_samples
+ */
+static void advance_operator_envelope(struct fm_operator_state *op, const struct fm_operator *params, int num_samples) {
+    int32_t sustain = sustain_envelope(params);
+
+    switch (op->stage) {
+        case ADSR_STATE_ATTACK:
+            if ((int64_t) op->envelope + (int64_t) op->stage_rate * num_samples < ENV_ONE) {
+                op->envelope += op->stage_rate * num_samples;
+                break;
+            }
+
+            op->envelope = ENV_ONE;
+            op->stage = ADSR_STATE_DECAY;
+            op->stage_rate = decay_rate(params->decay_ms);
+            break;
+        case ADSR_STATE_DECAY:
+            op->envelope = sustain + (((int64_t) (op->envelope - sustain) * decay_factor(op->stage_rate, num_samples)) >> ENV_FRAC_BITS);
+
+            if (op->envelope - sustain < ENV_SILENT) {
+                op->envelope = sustain;
+                op->stage = sustain > 0 ? ADSR_STATE_SUSTAIN : ADSR_STATE_OFF;
+            }
+            break;
+        case ADSR_STATE_RELEASE:
+            op->envelope = ((int64_t) op->envelope * decay_factor(op->stage_rate, num_samples)) >> ENV_FRAC_BITS;
+
+            if (op->envelope < ENV_SILENT) {
+                op->envelope = 0;
+                op->stage = ADSR_STATE_OFF;
+            }
+            break;
+        case ADSR_STATE_SUSTAIN:
+        case ADSR_STATE_OFF:
+        default:
+            break;
+    }
+}
+
+bool fm_voice_control_tick(struct fm_voice *voice, bool released, int num_samples) {
+    const struct fm_patch *patch = voice->patch;
+    bool playing = false;
+
+    for (int i = 0; i < patch->num_operators; i++) {
+        struct fm_operator_state *op = &voice->operators[i];
+        const struct fm_operator *params = &patch->operators[i];
+
+        // the last ramp ended here, drop the rounding error of its step
+        op->gain = operator_gain(op->envelope, params->level);
+
+        if (released && op->stage < ADSR_STATE_RELEASE) {
+            op->stage = ADSR_STATE_RELEASE;
+            op->stage_rate = decay_rate(params->release_ms);
+        }
+
+        advance_operator_envelope(op, params, num_samples);
+        op->gain_step = (operator_gain(op->envelope, params->level) - op->gain) / num_samples;
+
+        if (op->stage != ADSR_STATE_OFF && operator_is_carrier(patch, i))
+            playing = true;
+    }
+
+    return playing;
+}
+
+/**
+ * @brief Renders block of operator, its phase offset by modulation
+ *
+ * @param op
+ * @param params
+ * @param t_increment
+ * @param modulation outputs of the operators modulating op, can be output itself
+ * @param output
+ * @param add adds to output if set, overwrites it otherwise
+ * @param num_samples
+ */
+static void render_operator(struct fm_operator_state *op, const struct fm_operator *params, uint32_t t_increment, const int32_t *modulation, int32_t *output, bool add, int num_samples) {
+    uint32_t increment = (t_increment * params->ratio) << RATIO_SHIFT;
+    uint32_t phase = op->phase;
+    int32_t gain = op->gain;
+    int32_t gain_step = op->gain_step;
+
+    if (params->feedback == 0) {
+        for (int i = 0; i < num_samples; i++) {
+            gain += gain_step;
+            int32_t sample = (sine[(phase + ((uint32_t) modulation[i] << MODULATION_SHIFT)) >> SINE_SHIFT] * (gain >> GAIN_RAMP_FRAC_BITS)) >> 15;
+            output[i] = (add ? output[i] : 0) + sample;
+            phase += increment;
+        }
+    } else {
+        // the average of the last two outputs, which keeps strong feedback from oscillating
+        int32_t previous = op->feedback[0];
+        int32_t before_previous = op->feedback[1];
+        int shift = FEEDBACK_SHIFT + params->feedback;
+
+        for (int i = 0; i < num_samples; i++) {
+            gain += gain_step;
+            uint32_t offset = ((uint32_t) modulation[i] << MODULATION_SHIFT) + ((uint32_t) (previous + before_previous) << shift);
+            int32_t sample = (sine[(phase + offset) >> SINE_SHIFT] * (gain >> GAIN_RAMP_FRAC_BITS)) >> 15;
+            output[i] = (add ? output[i] : 0) + sample;
+            before_previous = previous;
+            previous = sample;
+            phase += increment;
+        }
+
+        op->feedback[0] = previous;
+        op->feedback[1] = before_previous;
+    }
+
+    op->phase = phase;
+    op->gain = gain;
+}
+
+void fm_voice_render(struct fm_voice *voice, int32_t *samples, uint32_t t_increment, int num_samples) {
+    const struct fm_patch *patch = voice->patch;
+    int32_t modulation[AUDIO_BLOCK_SIZE];
+    bool samples_written = false;
+
+    // operators run in order, so each one's modulators are done before it
+    for (int i = 0; i < patch->num_operators; i++) {
+        const int32_t *input = operator_is_modulated(patch, i) ? modulation : no_modulation;
+        bool carrier = operator_is_carrier(patch, i);
+        // branch modulators add up, the first one starts the sum
+        bool add = carrier ? samples_written : (patch->algorithm == FM_ALGORITHM_BRANCH && i > 0);
+
+        render_operator(&voice->operators[i], &patch->operators[i], t_increment, input, carrier ? samples : modulation, add, num_samples);
+        samples_written |= carrier;
+    }
+}
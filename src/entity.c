@@ -42,24 +42,36 @@ void entity_set_sprite_def(struct entity *entity, struct sprite_def *sprite_def)
     sprite_init(&entity->sprite, sprite_def);
 }
 
-void entity_init(struct entity *entity, pal_float_t mass) {
+bool entity_init(struct entity *entity, pal_float_t mass) {
+    // the flags of a new entity aren't set yet, one initialized before may already be in the game
+    uint32_t added_flag = physics_has_body(&entity->phys) ? entity->_state_flags & (1 << ENTITY_STATE_ADDED) : 0;
+
     // make sure event handlers are null
     for (int i = 0; i < NUM_ENTITY_EVENTS; i++) {
         entity->_event_handlers[i] = NULL;
     }
 
     // clear event flags
-    entity->_state_flags = 0;
+    entity->_state_flags = added_flag;
 
     entity->type = ENTITY_DRAW_TYPE_INVISIBLE;
 
     // initialize event queue
     queue_init(&entity->_event_queue, entity->_event_queue_buffer, sizeof(entity->_event_queue_buffer));
 
+    if (!physics_init(&entity->phys, mass)) {
+        printf("Failed to allocate physics body! Increase PHYS_MAX_BODIES.\n");
+        return false;
+    }
+
+    // scene queries find the entity again while it's in the game
+    if (added_flag != 0)
+        entity->phys.user_data = entity;
+
     // enable physics by default
     entity_state_set(entity, ENTITY_STATE_DO_PHYSICS);
 
-    physics_init(&entity->phys, mass);
+    return true;
 }
 
 void entity_set_draw_type(struct entity *entity, enum entity_draw_type type, ...) {
@@ -82,7 +94,7 @@ void entity_set_draw_type(struct entity *entity, enum entity_draw_type type, ...
         case ENTITY_DRAW_TYPE_SPRITE:
             // treat first va arg as sprite def pointer
             va_start(type_data, type);
-            entity->scale = 1.0;
+            entity->scale = PAL_FROM_INT(1);
             struct sprite_def *sprite_def = va_arg(type_data, struct sprite_def *);
             sprite_init(&entity->sprite, sprite_def);
             va_end(type_data);
@@ -91,6 +103,13 @@ void entity_set_draw_type(struct entity *entity, enum entity_draw_type type, ...
     }
 }
 
+// variadic floats are promoted to double, fixed point values are passed as plain integers
+#if defined PAL_USE_FIXED
+#define va_arg_pal_float(args) va_arg(args, pal_float_t)
+#else
+#define va_arg_pal_float(args) ((pal_float_t) va_arg(args, double))
+#endif
+
 void entity_set_bounds(struct entity *entity, enum entity_bounds_type type, ...) {
     va_list bounds_args;
 
@@ -121,13 +140,13 @@ void entity_set_bounds(struct entity *entity, enum entity_bounds_type type, ...)
             }
             break;
         case ENTITY_BOUNDS_TYPE_CIRCLE: {
-            pal_float_t radius = (pal_float_t) va_arg(bounds_args, double);
+            pal_float_t radius = va_arg_pal_float(bounds_args);
             physics_set_bounds_circle(&entity->phys, radius);
             break;
         }
         case ENTITY_BOUNDS_TYPE_RECTANGLE:
-            pal_float_t width = (pal_float_t) va_arg(bounds_args, double);
-            pal_float_t height = (pal_float_t) va_arg(bounds_args, double);
+            pal_float_t width = va_arg_pal_float(bounds_args);
+            pal_float_t height = va_arg_pal_float(bounds_args);
             physics_set_bounds_rect(&entity->phys, width, height);
             break;
     }
@@ -188,6 +207,11 @@ void entity_state_set(struct entity *entity, enum entity_state state) {
         return;
 
     entity->_state_flags |= 1 << state;
+
+    // only awake bodies are integrated, and only bodies of entities in the game are woken
+    if ((state == ENTITY_STATE_DO_PHYSICS || state == ENTITY_STATE_ADDED)
+        && entity_state_check(entity, ENTITY_STATE_DO_PHYSICS) && entity_state_check(entity, ENTITY_STATE_ADDED))
+        physics_set_awake(&entity->phys, true);
 }
 
 void entity_state_clear(struct entity *entity, enum entity_state state) {
@@ -195,6 +219,9 @@ void entity_state_clear(struct entity *entity, enum entity_state state) {
         return;
 
     entity->_state_flags &= ~(1 << state);
+
+    if (state == ENTITY_STATE_DO_PHYSICS || state == ENTITY_STATE_ADDED)
+        physics_set_awake(&entity->phys, false);
 }
 
 bool entity_state_check(struct entity *entity, enum entity_state state) {
@@ -206,7 +233,7 @@ bool entity_state_check(struct entity *entity, enum entity_state state) {
 
 void entity_scale(struct entity *entity, pal_float_t factor) {
     if (entity->type == ENTITY_DRAW_TYPE_SPRITE) {
-        entity->scale *= factor;
+        entity->scale = pal_mul(entity->scale, factor);
     }
 
     physics_scale_bounds(&entity->phys, factor);
@@ -216,16 +243,16 @@ static inline bool edge_test(int p1x, int p1y, int p2x, int p2y, int p3x, int p3
     return (p3x - p1x) * (p2y - p1y) - (p3y - p1y) * (p2x - p1x) <= 0;
 }
 
-static void render_triangle(struct vec2 *v1, struct vec2 *v2, struct vec2 *v3, struct color color) {
+static void render_triangle(int v1x, int v1y, int v2x, int v2y, int v3x, int v3y, struct color color) {
     // get start and end point for looping through screen pixels
-    int startx = pal_fmax(pal_fmin(v1->x, pal_fmin(v2->x, v3->x)), 0.0);
-    int starty = pal_fmax(pal_fmin(v1->y, pal_fmin(v2->y, v3->y)), 0.0);
-    int endx = pal_fmin(pal_fmax(v1->x, pal_fmax(v2->x, v3->x)), PAL_SCREEN_WIDTH);
-    int endy = pal_fmin(pal_fmax(v1->y, pal_fmax(v2->y, v3->y)), PAL_SCREEN_HEIGHT);
+    int startx = pal_max(pal_min(v1x, pal_min(v2x, v3x)), 0);
+    int starty = pal_max(pal_min(v1y, pal_min(v2y, v3y)), 0);
+    int endx = pal_min(pal_max(v1x, pal_max(v2x, v3x)), PAL_SCREEN_WIDTH);
+    int endy = pal_min(pal_max(v1y, pal_max(v2y, v3y)), PAL_SCREEN_HEIGHT);
 
     for (int py = starty; py < endy; py++) {
         for (int px = startx; px < endx; px++) {
-            if (edge_test(v1->x, v1->y, v2->x, v2->y, px, py) && edge_test(v2->x, v2->y, v3->x, v3->y, px, py) && edge_test(v3->x, v3->y, v1->x, v1->y, px, py))
+            if (edge_test(v1x, v1y, v2x, v2y, px, py) && edge_test(v2x, v2y, v3x, v3y, px, py) && edge_test(v3x, v3y, v1x, v1y, px, py))
                 pal_screen_draw_pixel(px, py, color);
         }
     }
@@ -240,14 +267,10 @@ static void entity_render_filled(struct entity *entity) {
     if (entity->phys.bounds.type == BOUNDS_TYPE_POLY) {
         struct vec2 *a, *b, *c;
         int a_x, a_y, b_x, b_y, c_x, c_y;
-        struct vec2 a_screen, b_screen, c_screen;
 
         a = &entity->phys.translated_bounds.vertices[0];
         game_camera_world_to_screen(a, &a_x, &a_y);
 
-        a_screen.x = a_x;
-        a_screen.y = a_y;
-
         for (int i = 1; i < entity->phys.translated_bounds.n_vertices - 1; i++) {
             b = &entity->phys.translated_bounds.vertices[i];
             c = &entity->phys.translated_bounds.vertices[i + 1];
@@ -256,17 +279,14 @@ static void entity_render_filled(struct entity *entity) {
             game_camera_world_to_screen(b, &b_x, &b_y);
             game_camera_world_to_screen(c, &c_x, &c_y);
 
-            b_screen.x = b_x;
-            b_screen.y = b_y;
-            c_screen.x = c_x;
-            c_screen.y = c_y;
-
-            render_triangle(&a_screen, &c_screen, &b_screen, entity->color);
+            render_triangle(a_x, a_y, c_x, c_y, b_x, b_y, entity->color);
         }
     } else if (entity->phys.bounds.type == BOUNDS_TYPE_CIRCLE) {
         int entity_x, entity_y;
-        game_camera_world_to_screen(&entity->phys.position, &entity_x, &entity_y);
-        graphics_draw_circle(entity_x, entity_y, entity->phys.bounds.radius * mat2_det(game_camera_get_transform()), entity->color);
+        struct vec2 position;
+        physics_get_position(&entity->phys, &position);
+        game_camera_world_to_screen(&position, &entity_x, &entity_y);
+        graphics_draw_circle(entity_x, entity_y, pal_mul(entity->phys.bounds.radius, mat2_det(game_camera_get_transform())), entity->color);
     }
 }
 
@@ -286,15 +306,20 @@ static void entity_render_stroked(struct entity *entity) {
             graphics_draw_line(p1_screen_x, p1_screen_y, p2_screen_x, p2_screen_y, entity->color);
         }
     } else if (entity->phys.bounds.type == BOUNDS_TYPE_CIRCLE) {
-        game_camera_world_to_screen(&entity->phys.position, &p1_screen_x, &p1_screen_y);
-        graphics_stroke_circle(p1_screen_x, p1_screen_y, entity->phys.bounds.radius * pal_sqrt(pal_fabs(mat2_det(game_camera_get_transform()))), entity->color, 1);
+        struct vec2 position;
+        physics_get_position(&entity->phys, &position);
+        game_camera_world_to_screen(&position, &p1_screen_x, &p1_screen_y);
+        graphics_stroke_circle(p1_screen_x, p1_screen_y, pal_mul(entity->phys.bounds.radius, pal_sqrt(pal_fabs(mat2_det(game_camera_get_transform())))), entity->color, PAL_FROM_INT(1));
     }
 }
 
 void entity_render(struct entity *entity) {
     // draw entity at physical position
-    int draw_x = pal_round(entity->phys.position.x);
-    int draw_y = pal_round(entity->phys.position.y);
+    struct vec2 position;
+    physics_get_position(&entity->phys, &position);
+
+    int draw_x = PAL_TO_INT(pal_round(position.x));
+    int draw_y = PAL_TO_INT(pal_round(position.y));
     bool previous_finished_flag;
 
     switch (entity->type) {
@@ -310,17 +335,18 @@ void entity_render(struct entity *entity) {
             if (entity->sprite.sprite_def == NULL)
                 return;
 
-            game_camera_world_to_screen(&entity->phys.position, &draw_x, &draw_y);
+            game_camera_world_to_screen(&position, &draw_x, &draw_y);
 
             struct mat2 transform, final_transform;
-            pal_float_t cos_angle = pal_cos(entity->phys.angle);
-            pal_float_t sin_angle = pal_sin(entity->phys.angle);
+            pal_float_t angle = physics_get_angle(&entity->phys);
+            pal_float_t cos_angle, sin_angle;
+            fast_sincos(angle, &sin_angle, &cos_angle);
 
             struct mat2 sprite_transform = {
-                cos_angle * entity->scale,  -sin_angle * entity->scale,
-                sin_angle * entity->scale,  cos_angle * entity->scale,
+                pal_mul(cos_angle, entity->scale),  -pal_mul(sin_angle, entity->scale),
+                pal_mul(sin_angle, entity->scale),  pal_mul(cos_angle, entity->scale),
             };
-            struct mat2 camera_reflection = { 1, 0, 0, -1 };
+            struct mat2 camera_reflection = { PAL_FROM_INT(1), 0, 0, PAL_FROM_INT(-1) };
 
             mat2_multiply(&sprite_transform, game_camera_get_transform(), &transform);
             mat2_multiply(&transform, &camera_reflection, &final_transform);
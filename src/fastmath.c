@@ -0,0 +1,171 @@
+#include "fastmath.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "mathutils.h"
+#include "pal.h"
+
+#if defined PAL_USE_FIXED || FAST_MATH_ACCURACY == FAST_MATH_ACCURACY_EXACT
+
+pal_float_t fast_sin(pal_float_t a) {
+    return pal_sin(a);
+}
+
+pal_float_t fast_cos(pal_float_t a) {
+    return pal_cos(a);
+}
+
+void fast_sincos(pal_float_t a, pal_float_t *sin_out, pal_float_t *cos_out) {
+    *sin_out = pal_sin(a);
+    *cos_out = pal_cos(a);
+}
+
+pal_float_t fast_atan2(pal_float_t y, pal_float_t x) {
+    return pal_atan2(y, x);
+}
+
+pal_float_t fast_rsqrt(pal_float_t a) {
+    return pal_div(PAL_FROM_INT(1), pal_sqrt(a));
+}
+
+#else
+
+#define TWO_OVER_PI  0.636619772367581343
+#define PI_OVER_4    0.785398163397448310
+#define PI_OVER_2    1.570796326794896619
+#define PI           3.141592653589793238
+#define TAN_PI_OVER_8 0.414213562373095049
+
+// pi/2 split in two so k * PI_OVER_2_HI is exact for the quadrant counts we see
+#if defined PAL_USE_FLOAT32
+#define PI_OVER_2_HI 1.5703125
+#define PI_OVER_2_LO 4.83826794897e-4
+#else
+#define PI_OVER_2_HI 1.57079632673412561417
+#define PI_OVER_2_LO 6.07710050650619224932e-11
+#endif
+
+/**
+ * @brief Reduces angle to r in [-pi/4, pi/4] and computes sin(r) and cos(r)
+ *
+ * @return int quadrant of angle, a = r + quadrant * pi/2
+ */
+static int reduce_and_evaluate(pal_float_t a, pal_float_t *s, pal_float_t *c) {
+    pal_float_t scaled = a * (pal_float_t) TWO_OVER_PI;
+    int k = (int) (scaled >= 0 ? scaled + (pal_float_t) 0.5 : scaled - (pal_float_t) 0.5);
+    pal_float_t r = (a - k * (pal_float_t) PI_OVER_2_HI) - k * (pal_float_t) PI_OVER_2_LO;
+    pal_float_t z = r * r;
+
+#if FAST_MATH_ACCURACY == FAST_MATH_ACCURACY_LOW
+    // truncated Taylor series, worst at |r| = pi/4
+    *s = r + r * z * ((pal_float_t) -1.6666666667e-1 + z * (pal_float_t) 8.3333333333e-3);
+    *c = 1 + z * ((pal_float_t) -0.5 + z * (pal_float_t) 4.1666666667e-2);
+#else
+    // minimax on [-pi/4, pi/4]
+    *s = r + r * z * ((pal_float_t) -1.6666654611e-1 + z * ((pal_float_t) 8.3321608736e-3 + z * (pal_float_t) -1.9515295891e-4));
+    *c = 1 - (pal_float_t) 0.5 * z + z * z * ((pal_float_t) 4.166664568298827e-2 + z * ((pal_float_t) -1.388731625493765e-3 + z * (pal_float_t) 2.443315711809948e-5));
+#endif
+
+    return k & 3;
+}
+
+pal_float_t fast_sin(pal_float_t a) {
+    pal_float_t s, c;
+
+    switch (reduce_and_evaluate(a, &s, &c)) {
+        case 0:  return s;
+        case 1:  return c;
+        case 2:  return -s;
+        default: return -c;
+    }
+}
+
+pal_float_t fast_cos(pal_float_t a) {
+    pal_float_t s, c;
+
+    switch (reduce_and_evaluate(a, &s, &c)) {
+        case 0:  return c;
+        case 1:  return -s;
+        case 2:  return -c;
+        default: return s;
+    }
+}
+
+void fast_sincos(pal_float_t a, pal_float_t *sin_out, pal_float_t *cos_out) {
+    pal_float_t s, c;
+
+    switch (reduce_and_evaluate(a, &s, &c)) {
+        case 0:  *sin_out =  s; *cos_out =  c; break;
+        case 1:  *sin_out =  c; *cos_out = -s; break;
+        case 2:  *sin_out = -s; *cos_out = -c; break;
+        default: *sin_out = -c; *cos_out =  s; break;
+    }
+}
+
+pal_float_t fast_atan2(pal_float_t y, pal_float_t x) {
+    pal_float_t abs_x = pal_fabs(x);
+    pal_float_t abs_y = pal_fabs(y);
+    pal_float_t result;
+
+    if (abs_x == 0 && abs_y == 0)
+        return 0;
+
+    // reduce to the first octant, z = min / max in [0, 1]
+    bool swapped = abs_y > abs_x;
+    pal_float_t z = swapped ? abs_x / abs_y : abs_y / abs_x;
+
+#if FAST_MATH_ACCURACY == FAST_MATH_ACCURACY_LOW
+    result = (pal_float_t) PI_OVER_4 * z - z * (z - 1) * ((pal_float_t) 0.2447 + (pal_float_t) 0.0663 * z);
+#else
+    // shift z above tan(pi/8) down by pi/4 so the polynomial only covers [-tan(pi/8), tan(pi/8)]
+    pal_float_t base = 0;
+
+    if (z > (pal_float_t) TAN_PI_OVER_8) {
+        base = (pal_float_t) PI_OVER_4;
+        z = (z - 1) / (z + 1);
+    }
+
+    pal_float_t zz = z * z;
+    result = base + z + z * zz * ((((pal_float_t) 8.05374449538e-2 * zz - (pal_float_t) 1.38776856032e-1) * zz + (pal_float_t) 1.99777106478e-1) * zz - (pal_float_t) 3.33329491539e-1);
+#endif
+
+    if (swapped)
+        result = (pal_float_t) PI_OVER_2 - result;
+    if (x < 0)
+        result = (pal_float_t) PI - result;
+    if (y < 0)
+        result = -result;
+
+    return result;
+}
+
+pal_float_t fast_rsqrt(pal_float_t a) {
+    pal_float_t half_a = (pal_float_t) 0.5 * a;
+    pal_float_t y;
+
+    // initial estimate from the exponent bits, then refine with Newton's method
+#if defined PAL_USE_FLOAT32
+    uint32_t bits;
+    memcpy(&bits, &a, sizeof(bits));
+    bits = 0x5f375a86 - (bits >> 1);
+    memcpy(&y, &bits, sizeof(y));
+#else
+    uint64_t bits;
+    memcpy(&bits, &a, sizeof(bits));
+    bits = 0x5fe6eb50c7b537a9 - (bits >> 1);
+    memcpy(&y, &bits, sizeof(y));
+#endif
+
+    y = y * ((pal_float_t) 1.5 - half_a * y * y);
+
+#if FAST_MATH_ACCURACY == FAST_MATH_ACCURACY_HIGH
+    // each step squares the relative error
+    y = y * ((pal_float_t) 1.5 - half_a * y * y);
+    y = y * ((pal_float_t) 1.5 - half_a * y * y);
+#endif
+
+    return y;
+}
+
+#endif
@@ -24,6 +24,9 @@ static pal_float_t frame_start, frame_duration;
 static bool running = false;
 static struct entity_list_node *entity_list_head = NULL;
 static struct collision_descriptor collisions[MAX_COLLISIONS];
+static struct phys_data *visible_phys[PHYS_MAX_BODIES];
+// every body under the pointer, so overlapping entities all get the click
+static struct phys_data *picked_phys[PHYS_MAX_BODIES];
 static size_t num_collisions = 0;
 
 static struct pointer {
@@ -69,7 +72,7 @@ static struct camera {
 } game_camera = {
     .dragging = false,
     .pointer_control = CAMERA_POINTER_CONTROL_NONE,
-    .zoom = 1,
+    .zoom = PAL_FROM_INT(1),
     .angle = 0,
     .position = { 0, 0 },
     .velocity = { 0, 0 },
@@ -81,6 +84,10 @@ void game_loop_stop() {
     running = false;
 }
 
+pal_float_t game_get_frame_time() {
+    return frame_start;
+}
+
 void game_entity_add(struct entity *entity) {
     struct entity_list_node *new_node = (struct entity_list_node *) malloc(sizeof(struct entity_list_node));
     new_node->entity = entity;
@@ -94,6 +101,10 @@ void game_entity_add(struct entity *entity) {
 
     new_node->prev = NULL;
     entity_list_head = new_node;
+    entity->phys.user_data = entity;
+
+    // wakes the body if the entity does physics
+    entity_state_set(entity, ENTITY_STATE_ADDED);
 }
 
 void game_entity_remove(struct entity *entity) {
@@ -141,21 +152,21 @@ static void camera_integrate(pal_float_t dt) {
     // Integrate camera velocity, slow it down exponentially
     vec2_scale(&game_camera.velocity, dt, &camera_scaled_velocity);
     vec2_add(&game_camera.position, &camera_scaled_velocity, &game_camera.position);
-    vec2_scale(&game_camera.velocity, 0.9, &game_camera.velocity);
+    vec2_scale(&game_camera.velocity, PAL_FLOAT(0.9), &game_camera.velocity);
 }
 
 static void camera_calculate_transform() {
     struct mat2 final_transform;
 
-    pal_float_t cos_angle = pal_cos(game_camera.angle);
-    pal_float_t sin_angle = pal_sin(game_camera.angle);
+    pal_float_t cos_angle, sin_angle;
+    fast_sincos(game_camera.angle, &sin_angle, &cos_angle);
 
     struct mat2 camera_scale_and_rotate = {
-        cos_angle * game_camera.zoom, -sin_angle * game_camera.zoom,
-        sin_angle * game_camera.zoom,  cos_angle * game_camera.zoom,
+        pal_mul(cos_angle, game_camera.zoom), -pal_mul(sin_angle, game_camera.zoom),
+        pal_mul(sin_angle, game_camera.zoom),  pal_mul(cos_angle, game_camera.zoom),
     };
 
-    struct mat2 camera_reflection = { 1, 0, 0, -1 };
+    struct mat2 camera_reflection = { PAL_FROM_INT(1), 0, 0, PAL_FROM_INT(-1) };
 
     mat2_multiply(&camera_scale_and_rotate, &camera_reflection, &final_transform);
 
@@ -178,13 +189,13 @@ static void camera_handle_pan() {
 
         vec2_sub(&pointer.current_position, &game_camera.drag_start_screen, &diff);
         vec2_transform(&diff, &game_camera.inv_transform, &diff_world);
-        vec2_scale(&diff_world, -1, &diff_world);
+        vec2_scale(&diff_world, PAL_FROM_INT(-1), &diff_world);
         vec2_add(&diff_world, &game_camera.drag_start_camera_pos, &game_camera.position);
     } else {
         if (game_camera.dragging) {
             struct vec2 flipped_pointer_velocity;
             vec2_transform(&pointer.velocity, &game_camera.inv_transform, &flipped_pointer_velocity);
-            vec2_scale(&flipped_pointer_velocity, -1, &flipped_pointer_velocity);
+            vec2_scale(&flipped_pointer_velocity, PAL_FROM_INT(-1), &flipped_pointer_velocity);
             game_camera.velocity = flipped_pointer_velocity;
         }
 
@@ -286,7 +297,7 @@ static void emit_events() {
         if (pointer.dragging_entity) {
             entity_event_emit(pointer.dragging_entity, ENTITY_EVENT_DRAG_STOP, NULL, 0);
             entity_state_clear(pointer.dragging_entity, ENTITY_STATE_DRAGGING);
-            pointer.dragging_entity->phys.velocity = pointer.velocity;
+            physics_set_velocity(&pointer.dragging_entity->phys, &pointer.velocity);
         }
 
         pointer.dragging_entity = NULL;
@@ -303,33 +314,43 @@ static void emit_events() {
     } else if (pointer.current_state == POINTER_STATE_DOWN) {
         if (pointer.dragging_entity != NULL) {
             // entity is already being dragged, update the entity's position
-            vec2_add(&pointer.current_position, &pointer.dragging_entity_offset, &pointer.dragging_entity->phys.position);
+            struct vec2 dragging_entity_position;
+            vec2_add(&pointer.current_position, &pointer.dragging_entity_offset, &dragging_entity_position);
+            physics_set_position(&pointer.dragging_entity->phys, &dragging_entity_position);
         } else if (pointer.can_click_entity) {
-            for (struct entity_list_node *node = entity_list_head; node != NULL; node = node->next) {
-                if (!physics_check_point_collision(&node->entity->phys, &pointer.current_position))
+            size_t num_picked = physics_query_point(&pointer.current_position, picked_phys, PHYS_MAX_BODIES);
+
+            // picks are sorted by distance, so the draggable entity closest to the pointer gets dragged
+            for (size_t i = 0; i < num_picked; i++) {
+                struct entity *entity = entity_from_phys(picked_phys[i]);
+
+                // bodies of entities outside the game, or of no entity at all
+                if (entity == NULL)
                     continue;
 
-                if (entity_state_check(node->entity, ENTITY_STATE_DRAGGABLE) && pointer.dragging_entity == NULL) {
+                if (entity_state_check(entity, ENTITY_STATE_DRAGGABLE) && pointer.dragging_entity == NULL) {
                     // Drag start!!!
-                    pointer.dragging_entity = node->entity;
+                    pointer.dragging_entity = entity;
 
-                    vec2_sub(&pointer.dragging_entity->phys.position, &pointer.current_position, &pointer.dragging_entity_offset);
+                    struct vec2 dragging_entity_position;
+                    physics_get_position(&pointer.dragging_entity->phys, &dragging_entity_position);
+                    vec2_sub(&dragging_entity_position, &pointer.current_position, &pointer.dragging_entity_offset);
                     entity_event_emit(pointer.dragging_entity, ENTITY_EVENT_DRAG_START, &pointer.dragging_entity_offset, sizeof(pointer.dragging_entity_offset));
                     entity_state_set(pointer.dragging_entity, ENTITY_STATE_DRAGGING);
 
-                    pointer.dragging_entity->phys.velocity.x = pointer.dragging_entity->phys.velocity.y = 0.0;
+                    physics_set_velocity(&pointer.dragging_entity->phys, &(struct vec2) { 0.0, 0.0 });
                 }
 
-                entity_event_emit(node->entity, ENTITY_EVENT_CLICK, NULL, 0);
-                entity_state_set(node->entity, ENTITY_STATE_CLICKED);
+                entity_event_emit(entity, ENTITY_EVENT_CLICK, NULL, 0);
+                entity_state_set(entity, ENTITY_STATE_CLICKED);
             }
 
             pointer.can_click_entity = false;
         }
 
         if (pointer.previous_position_valid) {
-            pointer.velocity.x = (pointer.current_position.x - pointer.previous_position.x) / (current_time - pointer.previous_time);
-            pointer.velocity.y = (pointer.current_position.y - pointer.previous_position.y) / (current_time - pointer.previous_time);
+            pointer.velocity.x = pal_div(pointer.current_position.x - pointer.previous_position.x, current_time - pointer.previous_time);
+            pointer.velocity.y = pal_div(pointer.current_position.y - pointer.previous_position.y, current_time - pointer.previous_time);
         } else {
             pointer.velocity.x = 0.0;
             pointer.velocity.y = 0.0;
@@ -377,10 +398,54 @@ static void entity_event_emit_immediate(struct entity *entity, enum entity_event
         entity->_event_handlers[event_id](entity, data);
 }
 
+static void get_camera_view_aabb(struct aabb *view) {
+    struct vec2 corners[4];
+
+    game_camera_screen_to_world(0, 0, &corners[0]);
+    game_camera_screen_to_world(PAL_SCREEN_WIDTH, 0, &corners[1]);
+    game_camera_screen_to_world(0, PAL_SCREEN_HEIGHT, &corners[2]);
+    game_camera_screen_to_world(PAL_SCREEN_WIDTH, PAL_SCREEN_HEIGHT, &corners[3]);
+
+    view->min = view->max = corners[0];
+
+    for (int i = 1; i < 4; i++) {
+        view->min.x = pal_fmin(view->min.x, corners[i].x);
+        view->min.y = pal_fmin(view->min.y, corners[i].y);
+        view->max.x = pal_fmax(view->max.x, corners[i].x);
+        view->max.y = pal_fmax(view->max.y, corners[i].y);
+    }
+}
+
+static void cull_entities() {
+    struct aabb view;
+
+    // only entities drawn purely from their bounds can be culled, sprites may extend past their bounds
+    // and need to keep animating off screen
+    for (struct entity_list_node *e = entity_list_head; e != NULL; e = e->next) {
+        if ((e->entity->type == ENTITY_DRAW_TYPE_SIMPLE || e->entity->type == ENTITY_DRAW_TYPE_SIMPLE_OUTLINE) && e->entity->phys.proxy != AABB_TREE_NULL_NODE)
+            entity_state_set(e->entity, ENTITY_STATE_CULLED);
+        else
+            entity_state_clear(e->entity, ENTITY_STATE_CULLED);
+    }
+
+    get_camera_view_aabb(&view);
+    size_t num_visible = physics_query_aabb(&view, visible_phys, PHYS_MAX_BODIES);
+
+    for (size_t i = 0; i < num_visible; i++) {
+        struct entity *entity = entity_from_phys(visible_phys[i]);
+
+        if (entity != NULL)
+            entity_state_clear(entity, ENTITY_STATE_CULLED);
+    }
+}
+
 static void render_all() {
+    cull_entities();
+
     // render entities
     for (struct entity_list_node *e = entity_list_head; e != NULL; e = e->next) {
-        entity_render(e->entity);
+        if (!entity_state_check(e->entity, ENTITY_STATE_CULLED))
+            entity_render(e->entity);
     }
 }
 
@@ -397,16 +462,20 @@ static void update_all(pal_float_t dt) {
             entity_handle_pending_events(e->entity);
             // call destroy handler (destructor) if one exists
             entity_event_emit_immediate(e->entity, ENTITY_EVENT_DESTROY, NULL);
+            // release entity's physics body
+            entity_state_clear(e->entity, ENTITY_STATE_ADDED);
+            e->entity->phys.user_data = NULL;
+            physics_delete(&e->entity->phys);
             // remove node from list
             remove_entity_node_from_list(e);
             e = next;
             continue;
         }
-
-        if (entity_state_check(e->entity, ENTITY_STATE_DO_PHYSICS))
-            physics_integrate(&e->entity->phys, dt);
     }
 
+    // integrate every entity with ENTITY_STATE_DO_PHYSICS set (awake bodies) in one pass
+    physics_integrate_all(dt);
+
     if (game_camera.pointer_control == CAMERA_POINTER_CONTROL_NONE)
         camera_integrate(dt);
 }
@@ -419,8 +488,8 @@ void entity_handle_all_events() {
 
 void game_camera_screen_to_world(int screen_x, int screen_y, struct vec2 *world_pos) {
     struct vec2 screen_pos;
-    screen_pos.x = screen_x - screen_center.x;
-    screen_pos.y = screen_y - screen_center.y;
+    screen_pos.x = PAL_FROM_INT(screen_x) - screen_center.x;
+    screen_pos.y = PAL_FROM_INT(screen_y) - screen_center.y;
 
     vec2_transform(&screen_pos, &game_camera.inv_transform, world_pos);
 
@@ -433,8 +502,8 @@ void game_camera_world_to_screen(const struct vec2 *world_pos, int *screen_x, in
 
     vec2_transform(&diff_from_camera, &game_camera.transform, &diff_transformed);
 
-    *screen_x = pal_round(diff_transformed.x + screen_center.x);
-    *screen_y = pal_round(diff_transformed.y + screen_center.y);
+    *screen_x = PAL_TO_INT(pal_round(diff_transformed.x + screen_center.x));
+    *screen_y = PAL_TO_INT(pal_round(diff_transformed.y + screen_center.y));
 }
 
 bool game_is_point_on_screen(const struct vec2 *world_pos) {
@@ -486,8 +555,8 @@ void game_loop_run() {
 
     audio_start();
 
-    screen_center.x = PAL_SCREEN_WIDTH / 2;
-    screen_center.y = PAL_SCREEN_HEIGHT / 2;
+    screen_center.x = PAL_FROM_INT(PAL_SCREEN_WIDTH / 2);
+    screen_center.y = PAL_FROM_INT(PAL_SCREEN_HEIGHT / 2);
 
     camera_calculate_transform();
 
@@ -504,7 +573,7 @@ void game_loop_run() {
 
         entity_handle_all_events();
 
-        update_all(DT);
+        update_all(PAL_FLOAT(DT));
 
         // be sure entity bounds are up to date
         for (struct entity_list_node *e = entity_list_head; e != NULL; e = e->next)
@@ -517,7 +586,7 @@ void game_loop_run() {
         // get frame end timestamp
         frame_duration = pal_get_time() - frame_start;
 
-        int sleep_us = FRAME_PERIOD_US - frame_duration * 1000000;
+        int sleep_us = FRAME_PERIOD_US - PAL_TO_DOUBLE(frame_duration) * 1000000;
 
         // sleep for remainder of frame
         usleep(sleep_us > 0 ? sleep_us : 0);
@@ -1,7 +1,6 @@
 #include "graphics.h"
 
 #include <stdbool.h>
-#include <math.h>
 
 #include "mathutils.h"
 #include "pal.h"
@@ -13,25 +12,25 @@ static void bound_value(int *val, int min, int max) {
 static void move_line_onto_screen(int *x0, int *y0, int *x1, int *y1) {
     long int dx = (*x1 - *x0);
     long int dy = (*y1 - *y0);
-    pal_float_t m = dx == 0 ? (dy > 0 ? INFINITY : -INFINITY) : ((pal_float_t) dy / dx);
+    pal_float_t m = dx == 0 ? (dy > 0 ? PAL_FLOAT_MAX : -PAL_FLOAT_MAX) : pal_div(PAL_FROM_INT(dy), PAL_FROM_INT(dx));
 
     // move (x0, y0) onto screen
     if (*x0 < 0 || *x0 > PAL_SCREEN_WIDTH) {
         bound_value(x0, 0, PAL_SCREEN_WIDTH);
-        *y0 = m * (*x0 - *x1) + *y1;
+        *y0 = PAL_TO_INT(pal_mul(m, PAL_FROM_INT(*x0 - *x1))) + *y1;
     }
     if (*y0 < 0 || *y0 > PAL_SCREEN_HEIGHT) {
         bound_value(y0, 0, PAL_SCREEN_HEIGHT);
-        *x0 = (*y0 - *y1) / m + *x1;
+        *x0 = PAL_TO_INT(pal_div(PAL_FROM_INT(*y0 - *y1), m)) + *x1;
     }
     // move (x1, y1) onto screen
     if (*x1 < 0 || *x1 > PAL_SCREEN_WIDTH) {
         bound_value(x1, 0, PAL_SCREEN_WIDTH);
-        *y1 = m * (*x1 - *x0) + *y0;
+        *y1 = PAL_TO_INT(pal_mul(m, PAL_FROM_INT(*x1 - *x0))) + *y0;
     }
     if (*y1 < 0 || *y1 > PAL_SCREEN_HEIGHT) {
         bound_value(y1, 0, PAL_SCREEN_HEIGHT);
-        *x1 = (*y1 - *y0) / m + *x0;
+        *x1 = PAL_TO_INT(pal_div(PAL_FROM_INT(*y1 - *y0), m)) + *x0;
     }
 }
 
@@ -47,7 +46,7 @@ void graphics_draw_line(int x1, int y1, int x2, int y2, struct color color) {
 
     int draw_x, draw_y;
 
-    if (pal_fabs(dx) >= pal_fabs(dy)) {
+    if (pal_abs(dx) >= pal_abs(dy)) {
         for (draw_x = start_x; draw_x < end_x; draw_x++) {
             draw_y = y1 + dy * (draw_x - x1) / dx;
             pal_screen_draw_pixel(draw_x, draw_y, color);
@@ -68,46 +67,71 @@ void graphics_draw_rect(int x, int y, int width, int height, struct color c) {
     }
 }
 
+/**
+ * @brief Largest integer squared pixel distance within radius, lets the per pixel circle tests compare
+ * integers instead of taking a square root per pixel
+ *
+ * @param radius
+ * @param inclusive whether a distance equal to radius counts as inside
+ * @return int32_t
+ */
+static int32_t radius_squared_limit(pal_float_t radius, bool inclusive) {
+#if defined PAL_USE_FIXED
+    // radius squared has double the fractional bits so large circles don't overflow
+    int64_t radius_squared = (int64_t) radius * radius;
+
+    if (!inclusive)
+        radius_squared -= 1;
+
+    return (int32_t) (radius_squared >> (2 * PAL_FIXED_FRAC_BITS));
+#else
+    pal_float_t radius_squared = radius * radius;
+
+    return inclusive ? pal_floor(radius_squared) : pal_ceil(radius_squared) - 1;
+#endif
+}
+
 void graphics_draw_circle(int x, int y, pal_float_t radius, struct color c) {
-    int start_x = pal_fmax(x - radius, 0);
-    int start_y = pal_fmax(y - radius, 0);
-    int end_x =   pal_fmin(x + radius, PAL_SCREEN_WIDTH);
-    int end_y =   pal_fmin(y + radius, PAL_SCREEN_HEIGHT);
+    int start_x = PAL_TO_INT(pal_fmax(PAL_FROM_INT(x) - radius, 0));
+    int start_y = PAL_TO_INT(pal_fmax(PAL_FROM_INT(y) - radius, 0));
+    int end_x =   PAL_TO_INT(pal_fmin(PAL_FROM_INT(x) + radius, PAL_FROM_INT(PAL_SCREEN_WIDTH)));
+    int end_y =   PAL_TO_INT(pal_fmin(PAL_FROM_INT(y) + radius, PAL_FROM_INT(PAL_SCREEN_HEIGHT)));
+    int32_t limit = radius_squared_limit(radius, false);
     int draw_x;
     int draw_y;
-    pal_float_t dist;
 
     for (draw_y = start_y; draw_y <= end_y; draw_y++) {
         for (draw_x = start_x; draw_x <= end_x; draw_x++) {
-            dist = pal_hypot(draw_x - x, draw_y - y);
+            int32_t dist_squared = (draw_x - x) * (draw_x - x) + (draw_y - y) * (draw_y - y);
 
-            if (dist < radius)
+            if (dist_squared <= limit)
                 pal_screen_draw_pixel(draw_x, draw_y, c);
         }
     }
 }
 
 void graphics_stroke_circle(int x, int y, pal_float_t radius, struct color c, pal_float_t stroke_width) {
-    int start_x = pal_fmax(x - radius, 0);
-    int start_y = pal_fmax(y - radius, 0);
-    int end_x =   pal_fmin(x + radius, PAL_SCREEN_WIDTH);
-    int end_y =   pal_fmin(y + radius, PAL_SCREEN_HEIGHT);
+    int start_x = PAL_TO_INT(pal_fmax(PAL_FROM_INT(x) - radius, 0));
+    int start_y = PAL_TO_INT(pal_fmax(PAL_FROM_INT(y) - radius, 0));
+    int end_x =   PAL_TO_INT(pal_fmin(PAL_FROM_INT(x) + radius, PAL_FROM_INT(PAL_SCREEN_WIDTH)));
+    int end_y =   PAL_TO_INT(pal_fmin(PAL_FROM_INT(y) + radius, PAL_FROM_INT(PAL_SCREEN_HEIGHT)));
+    int32_t outer_limit = radius_squared_limit(radius, true);
+    // pixels must be strictly further than the inner radius, any pixel is when it's negative
+    int32_t inner_limit = radius - stroke_width >= 0 ? radius_squared_limit(radius - stroke_width, true) : -1;
     int draw_x;
     int draw_y;
-    pal_float_t dist;
 
     for (draw_y = start_y; draw_y <= end_y; draw_y++) {
         for (draw_x = start_x; draw_x <= end_x; draw_x++) {
-            dist = pal_hypot(draw_x - x, draw_y - y);
+            int32_t dist_squared = (draw_x - x) * (draw_x - x) + (draw_y - y) * (draw_y - y);
 
-            if (dist <= radius && dist > radius - stroke_width)
+            if (dist_squared <= outer_limit && dist_squared > inner_limit)
                 pal_screen_draw_pixel(draw_x, draw_y, c);
         }
     }
 }
 
 void graphics_draw_transformed_rect(int x, int y, int width, int height, struct color c, struct mat2 *m) {
-    struct vec2 p_trans;
     struct mat2 m_inv;
     uint32_t row, col;
     int draw_x, draw_y;
@@ -117,32 +141,31 @@ void graphics_draw_transformed_rect(int x, int y, int width, int height, struct
 
     // compute transformed rect corners
     struct vec2 tr, tl, bl, br;
-    vec2_transform(&(struct vec2) {  width / 2, -height / 2 }, m, &tr);
-    vec2_transform(&(struct vec2) { -width / 2, -height / 2 }, m, &tl);
-    vec2_transform(&(struct vec2) { -width / 2,  height / 2 }, m, &bl);
-    vec2_transform(&(struct vec2) {  width / 2,  height / 2 }, m, &br);
+    vec2_transform(&(struct vec2) {  PAL_FROM_INT(width / 2), -PAL_FROM_INT(height / 2) }, m, &tr);
+    vec2_transform(&(struct vec2) { -PAL_FROM_INT(width / 2), -PAL_FROM_INT(height / 2) }, m, &tl);
+    vec2_transform(&(struct vec2) { -PAL_FROM_INT(width / 2),  PAL_FROM_INT(height / 2) }, m, &bl);
+    vec2_transform(&(struct vec2) {  PAL_FROM_INT(width / 2),  PAL_FROM_INT(height / 2) }, m, &br);
 
     // get start and end point for looping through screen pixels
     struct vec2 start = { pal_floor(pal_fmin(tr.x, pal_fmin(tl.x, pal_fmin(bl.x, br.x)))), pal_floor(pal_fmin(tr.y, pal_fmin(tl.y, pal_fmin(bl.y, br.y)))) } ;
     struct vec2 end =   { pal_fmax(tr.x, pal_fmax(tl.x, pal_fmax(bl.x, br.x))), pal_fmax(tr.y, pal_fmax(tl.y, pal_fmax(bl.y, br.y))) } ;
 
-    struct vec2 center_offset = { width / 2, height / 2 };
+    struct vec2 center_offset = { PAL_FROM_INT(width / 2), PAL_FROM_INT(height / 2) };
 
     struct vec2 p = start;
-    for (p.y = start.y; p.y < end.y; p.y++) {
-        for (p.x = start.x; p.x < end.x; p.x++) {
+    for (p.y = start.y; p.y < end.y; p.y += PAL_FROM_INT(1)) {
+        for (p.x = start.x; p.x < end.x; p.x += PAL_FROM_INT(1)) {
             // transform p to p_trans to find the nearest pixel in rect
-            vec2_transform(&p, &m_inv, &p_trans);
-            vec2_add(&p_trans, &center_offset, &p_trans);
+            struct vec2 p_trans = vec2_add_val(vec2_transform_val(p, &m_inv), center_offset);
 
             // NEED TO ROUND/FLOOR not truncate
-            col = pal_round(p_trans.x);
-            row = pal_round(p_trans.y);
+            col = PAL_TO_INT(pal_round(p_trans.x));
+            row = PAL_TO_INT(pal_round(p_trans.y));
 
             if (col >= 0 && row >= 0 && col < width && row < height) {
                 // draw
-                draw_x = p.x + x;
-                draw_y = p.y + y;
+                draw_x = PAL_TO_INT(p.x) + x;
+                draw_y = PAL_TO_INT(p.y) + y;
 
                 pal_screen_draw_pixel(draw_x, draw_y, c);
             }
@@ -151,7 +174,6 @@ void graphics_draw_transformed_rect(int x, int y, int width, int height, struct
 }
 
 void graphics_draw_transformed_image(struct image *image, int x, int y, struct mat2 *m) {
-    struct vec2 p_trans;
     struct mat2 m_inv;
     uint32_t row, col;
     int draw_x, draw_y;
@@ -161,32 +183,31 @@ void graphics_draw_transformed_image(struct image *image, int x, int y, struct m
 
     // compute transformed image corners
     struct vec2 tr, tl, bl, br;
-    vec2_transform(&(struct vec2) {  image->width / 2, -image->height / 2 }, m, &tr);
-    vec2_transform(&(struct vec2) { -image->width / 2, -image->height / 2 }, m, &tl);
-    vec2_transform(&(struct vec2) { -image->width / 2,  image->height / 2 }, m, &bl);
-    vec2_transform(&(struct vec2) {  image->width / 2,  image->height / 2 }, m, &br);
+    vec2_transform(&(struct vec2) {  PAL_FROM_INT(image->width / 2), -PAL_FROM_INT(image->height / 2) }, m, &tr);
+    vec2_transform(&(struct vec2) { -PAL_FROM_INT(image->width / 2), -PAL_FROM_INT(image->height / 2) }, m, &tl);
+    vec2_transform(&(struct vec2) { -PAL_FROM_INT(image->width / 2),  PAL_FROM_INT(image->height / 2) }, m, &bl);
+    vec2_transform(&(struct vec2) {  PAL_FROM_INT(image->width / 2),  PAL_FROM_INT(image->height / 2) }, m, &br);
 
     // get start and end point for looping through screen pixels
-    struct vec2 start = { pal_fmin(tr.x, pal_fmin(tl.x, pal_fmin(bl.x, br.x))), pal_fmin(tr.y, pal_fmin(tl.y, pal_fmin(bl.y, br.y))) - 1 } ;
-    struct vec2 end =   { pal_fmax(tr.x, pal_fmax(tl.x, pal_fmax(bl.x, br.x))), pal_fmax(tr.y, pal_fmax(tl.y, pal_fmax(bl.y, br.y))) + 1 } ;
+    struct vec2 start = { pal_fmin(tr.x, pal_fmin(tl.x, pal_fmin(bl.x, br.x))), pal_fmin(tr.y, pal_fmin(tl.y, pal_fmin(bl.y, br.y))) - PAL_FROM_INT(1) } ;
+    struct vec2 end =   { pal_fmax(tr.x, pal_fmax(tl.x, pal_fmax(bl.x, br.x))), pal_fmax(tr.y, pal_fmax(tl.y, pal_fmax(bl.y, br.y))) + PAL_FROM_INT(1) } ;
 
-    struct vec2 center_offset = { image->width / 2, image->height / 2 };
+    struct vec2 center_offset = { PAL_FROM_INT(image->width / 2), PAL_FROM_INT(image->height / 2) };
 
     struct vec2 p = start;
-    for (p.y = start.y; p.y < end.y; p.y++) {
-        for (p.x = start.x; p.x < end.x; p.x++) {
+    for (p.y = start.y; p.y < end.y; p.y += PAL_FROM_INT(1)) {
+        for (p.x = start.x; p.x < end.x; p.x += PAL_FROM_INT(1)) {
             // transform p to p_trans to find the nearest pixel in image
-            vec2_transform(&p, &m_inv, &p_trans);
-            vec2_add(&p_trans, &center_offset, &p_trans);
+            struct vec2 p_trans = vec2_add_val(vec2_transform_val(p, &m_inv), center_offset);
 
             // NEED TO ROUND/FLOOR not truncate
-            col = pal_round(p_trans.x);
-            row = pal_round(p_trans.y);
+            col = PAL_TO_INT(pal_round(p_trans.x));
+            row = PAL_TO_INT(pal_round(p_trans.y));
 
             if (col >= 0 && row >= 0 && col < image->width && row < image->height) {
                 // draw
-                draw_x = p.x + x;
-                draw_y = p.y + y;
+                draw_x = PAL_TO_INT(p.x) + x;
+                draw_y = PAL_TO_INT(p.y) + y;
 
                 pal_screen_draw_pixel(draw_x, draw_y, image->data[row * image->width + col]);
             }
@@ -195,12 +216,12 @@ void graphics_draw_transformed_image(struct image *image, int x, int y, struct m
 }
 
 void graphics_draw_image(struct image *image, int x, int y, pal_float_t angle, pal_float_t scale) {
-    pal_float_t cos_angle = pal_cos(angle);
-    pal_float_t sin_angle = pal_sin(angle);
+    pal_float_t cos_angle, sin_angle;
+    fast_sincos(angle, &sin_angle, &cos_angle);
 
     struct mat2 m = {
-        cos_angle * scale, -sin_angle * scale,
-        sin_angle * scale,  cos_angle * scale,
+        pal_mul(cos_angle, scale), -pal_mul(sin_angle, scale),
+        pal_mul(sin_angle, scale),  pal_mul(cos_angle, scale),
     };
 
     graphics_draw_transformed_image(image, x, y, &m);
@@ -1,15 +1,144 @@
 #include "mathutils.h"
 #include <math.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "pal.h"
 
-int pal_abs(int num) {
-    return num > 0 ? num : -num;
+#if defined PAL_USE_FIXED
+#define FIXED_FRAC_MASK (PAL_FIXED_ONE - 1)
+
+static pal_float_t saturate(int64_t num) {
+    if (num > INT32_MAX)
+        return INT32_MAX;
+    if (num < INT32_MIN)
+        return INT32_MIN;
+
+    return (pal_float_t) num;
+}
+
+pal_float_t pal_fixed_div(pal_float_t a, pal_float_t b) {
+    if (b == 0)
+        return a >= 0 ? INT32_MAX : INT32_MIN;
+
+    return saturate((int64_t) a * PAL_FIXED_ONE / b);
+}
+
+static uint32_t isqrt64(uint64_t num) {
+    uint64_t root = 0;
+    uint64_t bit = (uint64_t) 1 << 62;
+
+    while (bit > num)
+        bit >>= 2;
+
+    while (bit != 0) {
+        if (num >= root + bit) {
+            num -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+
+    return (uint32_t) root;
+}
+
+pal_float_t pal_sqrt(pal_float_t a) {
+    if (a <= 0)
+        return 0;
+
+    // sqrt(a * 2^f) * 2^(f/2) = sqrt(a * 2^2f)
+    return (pal_float_t) isqrt64((uint64_t) a << PAL_FIXED_FRAC_BITS);
+}
+
+pal_float_t pal_hypot(pal_float_t x, pal_float_t y) {
+    // squares are kept at double the fractional bits so large vectors don't overflow
+    uint64_t x_squared = (uint64_t) ((int64_t) x * x);
+    uint64_t y_squared = (uint64_t) ((int64_t) y * y);
+
+    return saturate(isqrt64(x_squared + y_squared));
+}
+
+// sine of angle in turns where 1 << 16 is a full turn, result has 16 fractional bits
+static int32_t sin_turns(uint32_t turns) {
+    // map the angle onto a quarter wave, x in [0, 1] with 16 fractional bits
+    uint32_t quadrant = (turns >> 14) & 3;
+    int64_t x = turns & 0x3fff;
+
+    if (quadrant & 1)
+        x = 0x4000 - x;
+    x <<= 2;
+
+    // 5th order polynomial, sin(pi/2 x) ~ x (a - x^2 (b - c x^2)), exact at x = 0 and x = 1
+    const int64_t a = 102944;   // pi/2
+    const int64_t b = 42047;    // 2a - 5/2
+    const int64_t c = 4640;     // a - 3/2
+    int64_t x_squared = (x * x) >> 16;
+    int64_t result = (x * (a - ((x_squared * (b - ((x_squared * c) >> 16))) >> 16))) >> 16;
+
+    return (int32_t) (quadrant & 2 ? -result : result);
+}
+
+static uint32_t radians_to_turns(pal_float_t a) {
+    // 1 / (2 pi) with 32 fractional bits
+    const int64_t inv_two_pi = 683565276;
+
+    return (uint32_t) ((((int64_t) a * inv_two_pi) >> (PAL_FIXED_FRAC_BITS + 16)));
 }
 
+static pal_float_t from_q16(int32_t num) {
+#if PAL_FIXED_FRAC_BITS >= 16
+    return num * ((int32_t) 1 << (PAL_FIXED_FRAC_BITS - 16));
+#else
+    return num >> (16 - PAL_FIXED_FRAC_BITS);
+#endif
+}
+
+pal_float_t pal_sin(pal_float_t a) {
+    return from_q16(sin_turns(radians_to_turns(a)));
+}
+
+pal_float_t pal_cos(pal_float_t a) {
+    return from_q16(sin_turns(radians_to_turns(a) + 0x4000));
+}
+
+pal_float_t pal_atan2(pal_float_t y, pal_float_t x) {
+    if (x == 0 && y == 0)
+        return 0;
+
+    // reduce to the first octant, z = min / max in [0, 1]
+    uint64_t abs_x = x < 0 ? -(int64_t) x : x;
+    uint64_t abs_y = y < 0 ? -(int64_t) y : y;
+    bool swapped = abs_y > abs_x;
+    int64_t z = swapped ? (abs_x << 16) / abs_y : (abs_y << 16) / abs_x;
+
+    // atan(z) ~ z (c1 + z^2 (c3 + z^2 (c5 + z^2 (c7 + z^2 c9)))), max error ~1e-5 rad
+    int64_t z_squared = (z * z) >> 16;
+    int64_t result = 1365;
+    result = ((result * z_squared) >> 16) - 5579;
+    result = ((result * z_squared) >> 16) + 11806;
+    result = ((result * z_squared) >> 16) - 21646;
+    result = ((result * z_squared) >> 16) + 65527;
+    result = (result * z) >> 16;
+
+    const int64_t half_pi = 102944;
+    const int64_t pi = 205887;
+    if (swapped)
+        result = half_pi - result;
+    if (x < 0)
+        result = pi - result;
+    if (y < 0)
+        result = -result;
+
+    return from_q16((int32_t) result);
+}
+#endif
+
 pal_float_t pal_fabs(pal_float_t num) {
-#if defined PAL_USE_FLOAT32
+#if defined PAL_USE_FIXED
+    return num < 0 ? -num : num;
+#elif defined PAL_USE_FLOAT32
     return fabsf(num);
 #else
     return fabs(num);
@@ -17,7 +146,9 @@ pal_float_t pal_fabs(pal_float_t num) {
 }
 
 pal_float_t pal_floor(pal_float_t num) {
-#if defined PAL_USE_FLOAT32
+#if defined PAL_USE_FIXED
+    return num & ~FIXED_FRAC_MASK;
+#elif defined PAL_USE_FLOAT32
     return floorf(num);
 #else
     return floor(num);
@@ -25,7 +156,9 @@ pal_float_t pal_floor(pal_float_t num) {
 }
 
 pal_float_t pal_ceil(pal_float_t num) {
-#if defined PAL_USE_FLOAT32
+#if defined PAL_USE_FIXED
+    return (num + FIXED_FRAC_MASK) & ~FIXED_FRAC_MASK;
+#elif defined PAL_USE_FLOAT32
     return ceilf(num);
 #else
     return ceil(num);
@@ -33,99 +166,71 @@ pal_float_t pal_ceil(pal_float_t num) {
 }
 
 pal_float_t pal_round(pal_float_t num) {
-#if defined PAL_USE_FLOAT32
+#if defined PAL_USE_FIXED
+    // rounds half away from zero like round()
+    if (num < 0)
+        return -((-num + PAL_FIXED_ONE / 2) & ~FIXED_FRAC_MASK);
+    return (num + PAL_FIXED_ONE / 2) & ~FIXED_FRAC_MASK;
+#elif defined PAL_USE_FLOAT32
     return roundf(num);
 #else
     return round(num);
 #endif
 }
 
-pal_float_t pal_fmin(pal_float_t a, pal_float_t b) {
-    return a < b ? a : b;
-}
-
-pal_float_t pal_fmax(pal_float_t a, pal_float_t b) {
-    return a > b ? a : b;
-}
-
-int pal_min(int a, int b) {
-    return a < b ? a : b;
-}
-
-int pal_max(int a, int b) {
-    return a > b ? a : b;
-}
-
 pal_float_t pal_modf(pal_float_t num, pal_float_t *integral) {
-#if defined PAL_USE_FLOAT32
+#if defined PAL_USE_FIXED
+    *integral = PAL_FROM_INT(PAL_TO_INT(num));
+    return num - *integral;
+#elif defined PAL_USE_FLOAT32
     return modff(num, integral);
 #else
     return modf(num, integral);
 #endif
 }
 
-pal_float_t lerp(pal_float_t x1, pal_float_t x2, pal_float_t t) {
-    return x1 * (1 - t) + x2 * t;
-}
-
-void vec2_lerp(const struct vec2 *v1, const struct vec2 *v2, pal_float_t t, struct vec2 *v_out) {
-    v_out->x = lerp(v1->x, v2->x, t);
-    v_out->y = lerp(v1->y, v2->y, t);
-}
-
 pal_float_t vec2_mag(const struct vec2 *v) {
     return pal_hypot(v->x, v->y);
 }
 
-pal_float_t vec2_squared_mag(const struct vec2 *v) {
-    return v->x * v->x + v->y * v->y;
-}
-
 pal_float_t vec2_dir(const struct vec2 *v) {
-    return pal_atan2(v->y, v->x);
+    return fast_atan2(v->y, v->x);
 }
 
 void vec2_set_mag(const struct vec2 *v, pal_float_t mag, struct vec2 *v_out) {
-    pal_float_t dir = vec2_dir(v);
-
-    v_out->x = mag * pal_cos(dir);
-    v_out->y = mag * pal_sin(dir);
-}
+#if defined PAL_USE_FIXED
+    pal_float_t sin_dir, cos_dir;
+    fast_sincos(vec2_dir(v), &sin_dir, &cos_dir);
 
-void vec2_set_dir(const struct vec2 *v, pal_float_t dir, struct vec2 *v_out) {
-    pal_float_t mag = vec2_mag(v);
-
-    v_out->x = mag * pal_cos(dir);
-    v_out->y = mag * pal_sin(dir);
-}
-
-void vec2_add(const struct vec2 *v1, const struct vec2 *v2, struct vec2 *sum) {
-    sum->x = v1->x + v2->x;
-    sum->y = v1->y + v2->y;
-}
+    v_out->x = pal_mul(mag, cos_dir);
+    v_out->y = pal_mul(mag, sin_dir);
+#else
+    pal_float_t squared_mag = vec2_squared_mag(v);
 
-void vec2_sub(const struct vec2 *v1, const struct vec2 *v2, struct vec2 *diff) {
-    diff->x = v1->x - v2->x;
-    diff->y = v1->y - v2->y;
-}
+    // a zero vector points along x, like its direction of 0
+    if (squared_mag == 0) {
+        v_out->x = mag;
+        v_out->y = 0;
+        return;
+    }
 
-pal_float_t vec2_dot(const struct vec2 *v1, const struct vec2 *v2) {
-    return v1->x * v2->x + v1->y * v2->y;
+    vec2_scale(v, mag * fast_rsqrt(squared_mag), v_out);
+#endif
 }
 
-pal_float_t vec2_cross(const struct vec2 *v1, const struct vec2 *v2) {
-    return v1->x * v2->y - v1->y * v2->x;
-}
+void vec2_set_dir(const struct vec2 *v, pal_float_t dir, struct vec2 *v_out) {
+    pal_float_t mag = vec2_mag(v);
+    pal_float_t sin_dir, cos_dir;
+    fast_sincos(dir, &sin_dir, &cos_dir);
 
-void vec2_transform(const struct vec2 *v, const struct mat2 *m, struct vec2 *v_out) {
-    v_out->x = m->a * v->x + m->b * v->y;
-    v_out->y = m->c * v->x + m->d * v->y;
+    v_out->x = pal_mul(mag, cos_dir);
+    v_out->y = pal_mul(mag, sin_dir);
 }
 
 void vec2_rotate(const struct vec2 *v, pal_float_t angle, struct vec2 *v_out) {
     // construct a rotation matrix and return transformed vector
-    pal_float_t cos_angle = pal_cos(angle);
-    pal_float_t sin_angle = pal_sin(angle);
+    pal_float_t cos_angle, sin_angle;
+    fast_sincos(angle, &sin_angle, &cos_angle);
 
     vec2_transform(v, &(struct mat2) {
         .a = cos_angle, .b = -sin_angle,
@@ -133,26 +238,16 @@ void vec2_rotate(const struct vec2 *v, pal_float_t angle, struct vec2 *v_out) {
     }, v_out);
 }
 
-void vec2_scale(const struct vec2 *v, pal_float_t scale, struct vec2 *v_out) {
-    v_out->x = v->x * scale;
-    v_out->y = v->y * scale;
-}
-
 void vec2_normalize(const struct vec2 *v, struct vec2 *v_out) {
+#if defined PAL_USE_FIXED
+    // the squared magnitude would lose the fraction of short vectors, hypot keeps twice the bits
     pal_float_t mag = vec2_mag(v);
-    v_out->x = v->x / mag;
-    v_out->y = v->y / mag;
-}
-
-pal_float_t mat2_det(const struct mat2 *m) {
-    return m->a * m->d - m->b * m->c;
-}
-
-void mat2_multiply(const struct mat2 *m1, const struct mat2 *m2, struct mat2 *product) {
-    product->a = m1->a * m2->a + m1->b * m2->c;
-    product->b = m1->a * m2->b + m1->b * m2->d;
-    product->c = m1->c * m2->a + m1->d * m2->c;
-    product->d = m1->c * m2->b + m1->d * m2->d;
+    v_out->x = pal_div(v->x, mag);
+    v_out->y = pal_div(v->y, mag);
+#else
+    // one reciprocal square root instead of a square root and two divisions
+    vec2_scale(v, fast_rsqrt(vec2_squared_mag(v)), v_out);
+#endif
 }
 
 bool mat2_inv(const struct mat2 *m, struct mat2 *m_inv) {
@@ -161,21 +256,29 @@ bool mat2_inv(const struct mat2 *m, struct mat2 *m_inv) {
     if (det == 0)
         return false;
 
-    pal_float_t det_inv = 1 / det;
-    m_inv->a =  det_inv * m->d;
-    m_inv->b = -det_inv * m->b;
-    m_inv->c = -det_inv * m->c;
-    m_inv->d =  det_inv * m->a;
+    pal_float_t det_inv = pal_div(PAL_FROM_INT(1), det);
+    m_inv->a =  pal_mul(det_inv, m->d);
+    m_inv->b = -pal_mul(det_inv, m->b);
+    m_inv->c = -pal_mul(det_inv, m->c);
+    m_inv->d =  pal_mul(det_inv, m->a);
 
     return true;
 }
 
 pal_float_t rand_float() {
+#if defined PAL_USE_FIXED
+    return (pal_float_t) (((uint64_t) pal_rand() << PAL_FIXED_FRAC_BITS) / ((uint64_t) PAL_RAND_MAX + 1));
+#else
     return pal_rand() / ((pal_float_t) PAL_RAND_MAX + 1);
+#endif
 }
 
 pal_float_t rand_float_range(pal_float_t min, pal_float_t max) {
+#if defined PAL_USE_FIXED
+    return pal_mul(rand_float(), max - min) + min;
+#else
     return pal_rand() / (((pal_float_t) PAL_RAND_MAX + 1) / (max - min)) + min;
+#endif
 }
 
 int rand_range(int min, int max) {
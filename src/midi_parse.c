@@ -2,6 +2,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <assert.h>
 
 #define MIDI_DEFAULT_TEMPO_BPM (120)
@@ -11,148 +12,155 @@
 // #define PRINT_EVENTS
 
 #ifdef PRINT_EVENTS
-#define TRACK_PRINT(parser, track_num, fmt, ...) printf("[Track%3d:%.6f]: " fmt, track_num, parser->tracks[track_num].timer / 1e9, ##__VA_ARGS__)
+#define TRACK_PRINT(parser, track_num, fmt, ...) printf("[Track%3d:%.6f]: " fmt, track_num, (double) track_event_time(parser, track_num) / parser->time_per_sample / PAL_AUDIO_SAMPLE_RATE, ##__VA_ARGS__)
 #else
 #define TRACK_PRINT(parser, track_num, fmt, ...)
 #endif
 
-static const pal_float_t SMPTE_frames_per_second_map[] = {
-    [MIDI_SMPTE_24] =    24.0f,
-    [MIDI_SMPTE_25] =    25.0f,
-    [MIDI_SMPTE_29_97] = 29.97f,
-    [MIDI_SMPTE_30] =    30.0f
+// frames per second as a fraction so the tick length is exact
+static const struct {
+    uint32_t numerator;
+    uint32_t denominator;
+} SMPTE_frames_per_second_map[] = {
+    [MIDI_SMPTE_24] =    { 24, 1 },
+    [MIDI_SMPTE_25] =    { 25, 1 },
+    [MIDI_SMPTE_29_97] = { 2997, 100 },
+    [MIDI_SMPTE_30] =    { 30, 1 }
 };
 
+// parser time is rebased to 0 before it gets close to overflowing
+#define MIDI_TIME_REBASE_THRESHOLD (INT64_MAX / 2)
+
 // note frequency lookup table
 static const pal_float_t note_frequencies[] = {
-    [127] = 12543.85,
-    [126] = 11839.82,
-    [125] = 11175.30,
-    [124] = 10548.08,
-    [123] = 9956.06,
-    [122] = 9397.27,
-    [121] = 8869.84,
-    [120] = 8372.02,
-    [119] = 7902.13,
-    [118] = 7458.62,
-    [117] = 7040.00,
-    [116] = 6644.88,
-    [115] = 6271.93,
-    [114] = 5919.91,
-    [113] = 5587.65,
-    [112] = 5274.04,
-    [111] = 4978.03,
-    [110] = 4698.64,
-    [109] = 4434.92,
-    [108] = 4186.01,
-    [107] = 3951.07,
-    [106] = 3729.31,
-    [105] = 3520.00,
-    [104] = 3322.44,
-    [103] = 3135.96,
-    [102] = 2959.96,
-    [101] = 2793.83,
-    [100] = 2637.02,
-    [99] = 	2489.02,
-    [98] = 	2349.32,
-    [97] = 	2217.46,
-    [96] = 	2093.00,
-    [95] = 	1975.53,
-    [94] = 	1864.66,
-    [93] = 	1760.00,
-    [92] = 	1661.22,
-    [91] = 	1567.98,
-    [90] = 	1479.98,
-    [89] = 	1396.91,
-    [88] = 	1318.51,
-    [87] = 	1244.51,
-    [86] = 	1174.66,
-    [85] = 	1108.73,
-    [84] = 	1046.50,
-    [83] = 	987.77,
-    [82] = 	932.33,
-    [81] = 	880.00,
-    [80] = 	830.61,
-    [79] = 	783.99,
-    [78] = 	739.99,
-    [77] = 	698.46,
-    [76] = 	659.26,
-    [75] = 	622.25,
-    [74] = 	587.33,
-    [73] = 	554.37,
-    [72] = 	523.25,
-    [71] = 	493.88,
-    [70] = 	466.16,
-    [69] =  440.00,
-    [68] = 	415.30,
-    [67] = 	392.00,
-    [66] = 	369.99,
-    [65] = 	349.23,
-    [64] = 	329.63,
-    [63] = 	311.13,
-    [62] = 	293.66,
-    [61] = 	277.18,
-    [60] = 	261.63,
-    [59] = 	246.94,
-    [58] = 	233.08,
-    [57] = 	220.00,
-    [56] = 	207.65,
-    [55] = 	196.00,
-    [54] = 	185.00,
-    [53] = 	174.61,
-    [52] = 	164.81,
-    [51] = 	155.56,
-    [50] = 	146.83,
-    [49] = 	138.59,
-    [48] = 	130.81,
-    [47] = 	123.47,
-    [46] = 	116.54,
-    [45] = 	110.00,
-    [44] = 	103.83,
-    [43] = 	98.00,
-    [42] = 	92.50,
-    [41] = 	87.31,
-    [40] = 	82.41,
-    [39] = 	77.78,
-    [38] = 	73.42,
-    [37] = 	69.30,
-    [36] = 	65.41,
-    [35] = 	61.74,
-    [34] = 	58.27,
-    [33] = 	55.00,
-    [32] = 	51.91,
-    [31] = 	49.00,
-    [30] = 	46.25,
-    [29] = 	43.65,
-    [28] = 	41.20,
-    [27] = 	38.89,
-    [26] = 	36.71,
-    [25] = 	34.65,
-    [24] = 	32.70,
-    [23] = 	30.87,
-    [22] = 	29.14,
-    [21] = 	27.50,
-    [20] = 	25.96,
-    [19] = 	24.50,
-    [18] = 	23.12,
-    [17] = 	21.83,
-    [16] = 	20.60,
-    [15] = 	19.45,
-    [14] = 	18.35,
-    [13] = 	17.32,
-    [12] = 	16.35,
-    [11] = 	15.43,
-    [10] = 	14.57,
-    [9] = 	13.75,
-    [8] = 	12.98,
-    [7] = 	12.25,
-    [6] = 	11.56,
-    [5] = 	10.91,
-    [4] = 	10.30,
-    [3] = 	9.72,
-    [2] = 	9.18,
-    [1] = 	8.66,
-    [0] = 	8.18,
+    [127] = PAL_FLOAT(12543.85),
+    [126] = PAL_FLOAT(11839.82),
+    [125] = PAL_FLOAT(11175.30),
+    [124] = PAL_FLOAT(10548.08),
+    [123] = PAL_FLOAT(9956.06),
+    [122] = PAL_FLOAT(9397.27),
+    [121] = PAL_FLOAT(8869.84),
+    [120] = PAL_FLOAT(8372.02),
+    [119] = PAL_FLOAT(7902.13),
+    [118] = PAL_FLOAT(7458.62),
+    [117] = PAL_FLOAT(7040.00),
+    [116] = PAL_FLOAT(6644.88),
+    [115] = PAL_FLOAT(6271.93),
+    [114] = PAL_FLOAT(5919.91),
+    [113] = PAL_FLOAT(5587.65),
+    [112] = PAL_FLOAT(5274.04),
+    [111] = PAL_FLOAT(4978.03),
+    [110] = PAL_FLOAT(4698.64),
+    [109] = PAL_FLOAT(4434.92),
+    [108] = PAL_FLOAT(4186.01),
+    [107] = PAL_FLOAT(3951.07),
+    [106] = PAL_FLOAT(3729.31),
+    [105] = PAL_FLOAT(3520.00),
+    [104] = PAL_FLOAT(3322.44),
+    [103] = PAL_FLOAT(3135.96),
+    [102] = PAL_FLOAT(2959.96),
+    [101] = PAL_FLOAT(2793.83),
+    [100] = PAL_FLOAT(2637.02),
+    [99] = 	PAL_FLOAT(2489.02),
+    [98] = 	PAL_FLOAT(2349.32),
+    [97] = 	PAL_FLOAT(2217.46),
+    [96] = 	PAL_FLOAT(2093.00),
+    [95] = 	PAL_FLOAT(1975.53),
+    [94] = 	PAL_FLOAT(1864.66),
+    [93] = 	PAL_FLOAT(1760.00),
+    [92] = 	PAL_FLOAT(1661.22),
+    [91] = 	PAL_FLOAT(1567.98),
+    [90] = 	PAL_FLOAT(1479.98),
+    [89] = 	PAL_FLOAT(1396.91),
+    [88] = 	PAL_FLOAT(1318.51),
+    [87] = 	PAL_FLOAT(1244.51),
+    [86] = 	PAL_FLOAT(1174.66),
+    [85] = 	PAL_FLOAT(1108.73),
+    [84] = 	PAL_FLOAT(1046.50),
+    [83] = 	PAL_FLOAT(987.77),
+    [82] = 	PAL_FLOAT(932.33),
+    [81] = 	PAL_FLOAT(880.00),
+    [80] = 	PAL_FLOAT(830.61),
+    [79] = 	PAL_FLOAT(783.99),
+    [78] = 	PAL_FLOAT(739.99),
+    [77] = 	PAL_FLOAT(698.46),
+    [76] = 	PAL_FLOAT(659.26),
+    [75] = 	PAL_FLOAT(622.25),
+    [74] = 	PAL_FLOAT(587.33),
+    [73] = 	PAL_FLOAT(554.37),
+    [72] = 	PAL_FLOAT(523.25),
+    [71] = 	PAL_FLOAT(493.88),
+    [70] = 	PAL_FLOAT(466.16),
+    [69] =  PAL_FLOAT(440.00),
+    [68] = 	PAL_FLOAT(415.30),
+    [67] = 	PAL_FLOAT(392.00),
+    [66] = 	PAL_FLOAT(369.99),
+    [65] = 	PAL_FLOAT(349.23),
+    [64] = 	PAL_FLOAT(329.63),
+    [63] = 	PAL_FLOAT(311.13),
+    [62] = 	PAL_FLOAT(293.66),
+    [61] = 	PAL_FLOAT(277.18),
+    [60] = 	PAL_FLOAT(261.63),
+    [59] = 	PAL_FLOAT(246.94),
+    [58] = 	PAL_FLOAT(233.08),
+    [57] = 	PAL_FLOAT(220.00),
+    [56] = 	PAL_FLOAT(207.65),
+    [55] = 	PAL_FLOAT(196.00),
+    [54] = 	PAL_FLOAT(185.00),
+    [53] = 	PAL_FLOAT(174.61),
+    [52] = 	PAL_FLOAT(164.81),
+    [51] = 	PAL_FLOAT(155.56),
+    [50] = 	PAL_FLOAT(146.83),
+    [49] = 	PAL_FLOAT(138.59),
+    [48] = 	PAL_FLOAT(130.81),
+    [47] = 	PAL_FLOAT(123.47),
+    [46] = 	PAL_FLOAT(116.54),
+    [45] = 	PAL_FLOAT(110.00),
+    [44] = 	PAL_FLOAT(103.83),
+    [43] = 	PAL_FLOAT(98.00),
+    [42] = 	PAL_FLOAT(92.50),
+    [41] = 	PAL_FLOAT(87.31),
+    [40] = 	PAL_FLOAT(82.41),
+    [39] = 	PAL_FLOAT(77.78),
+    [38] = 	PAL_FLOAT(73.42),
+    [37] = 	PAL_FLOAT(69.30),
+    [36] = 	PAL_FLOAT(65.41),
+    [35] = 	PAL_FLOAT(61.74),
+    [34] = 	PAL_FLOAT(58.27),
+    [33] = 	PAL_FLOAT(55.00),
+    [32] = 	PAL_FLOAT(51.91),
+    [31] = 	PAL_FLOAT(49.00),
+    [30] = 	PAL_FLOAT(46.25),
+    [29] = 	PAL_FLOAT(43.65),
+    [28] = 	PAL_FLOAT(41.20),
+    [27] = 	PAL_FLOAT(38.89),
+    [26] = 	PAL_FLOAT(36.71),
+    [25] = 	PAL_FLOAT(34.65),
+    [24] = 	PAL_FLOAT(32.70),
+    [23] = 	PAL_FLOAT(30.87),
+    [22] = 	PAL_FLOAT(29.14),
+    [21] = 	PAL_FLOAT(27.50),
+    [20] = 	PAL_FLOAT(25.96),
+    [19] = 	PAL_FLOAT(24.50),
+    [18] = 	PAL_FLOAT(23.12),
+    [17] = 	PAL_FLOAT(21.83),
+    [16] = 	PAL_FLOAT(20.60),
+    [15] = 	PAL_FLOAT(19.45),
+    [14] = 	PAL_FLOAT(18.35),
+    [13] = 	PAL_FLOAT(17.32),
+    [12] = 	PAL_FLOAT(16.35),
+    [11] = 	PAL_FLOAT(15.43),
+    [10] = 	PAL_FLOAT(14.57),
+    [9] = 	PAL_FLOAT(13.75),
+    [8] = 	PAL_FLOAT(12.98),
+    [7] = 	PAL_FLOAT(12.25),
+    [6] = 	PAL_FLOAT(11.56),
+    [5] = 	PAL_FLOAT(10.91),
+    [4] = 	PAL_FLOAT(10.30),
+    [3] = 	PAL_FLOAT(9.72),
+    [2] = 	PAL_FLOAT(9.18),
+    [1] = 	PAL_FLOAT(8.66),
+    [0] = 	PAL_FLOAT(8.18),
 };
 
 static const char HEADER_TYPE[4] = { 'M', 'T', 'h', 'd' };
@@ -203,13 +211,87 @@ pal_float_t midi_parser_note_frequency(uint8_t note_number) {
     return note_frequencies[note_number];
 }
 
-static void calculate_us_per_tick(struct midi_parser *parser) {
+/**
+ * @brief Gets the parser time of the next event of a track
+ *
+ * @param parser
+ * @param track_num
+ * @return int64_t
+ */
+static inline int64_t track_event_time(struct midi_parser *parser, int track_num) {
+    struct track *track = &parser->tracks[track_num];
+
+    // signed, an event at the same sample as a tempo change can be at an earlier tick
+    return parser->tempo_time + (int64_t) (track->event_tick - parser->tempo_tick) * (int64_t) parser->time_per_tick + track->time_offset;
+}
+
+/**
+ * @brief Gets the song position of the parser, in output samples at playback rate 1
+ *
+ * @param parser
+ * @return uint64_t
+ */
+static inline uint64_t song_position(struct midi_parser *parser) {
+    return parser->time / parser->time_per_sample;
+}
+
+/**
+ * @brief Gets the number of output samples until parser time reaches time, rounded up
+ *
+ * @param parser
+ * @param time
+ * @return uint32_t 0 if time is reached
+ */
+static uint32_t samples_until_time(struct midi_parser *parser, int64_t time) {
+    if (time <= parser->time)
+        return 0;
+
+    uint64_t delta = time - parser->time;
+    uint64_t samples = delta / parser->time_per_sample;
+
+    if (samples >= UINT32_MAX)
+        return UINT32_MAX - 1;
+
+    // samples at playback rate 1 rounded up to 16.16 fixed point, then divided by the playback rate.
+    // Rounding up twice gives the same result as rounding up once, so rate 1 stays exact
+    uint64_t remainder = delta % parser->time_per_sample;
+    uint64_t scaled_samples = (samples << MIDI_PLAYBACK_RATE_FRAC_BITS) + ((remainder << MIDI_PLAYBACK_RATE_FRAC_BITS) + parser->time_per_sample - 1) / parser->time_per_sample;
+
+    samples = (scaled_samples + parser->playback_rate - 1) / parser->playback_rate;
+
+    return samples < UINT32_MAX ? samples : UINT32_MAX - 1;
+}
+
+static uint64_t gcd(uint64_t a, uint64_t b) {
+    while (b != 0) {
+        uint64_t r = a % b;
+        a = b;
+        b = r;
+    }
+
+    return a;
+}
+
+static void calculate_time_per_tick(struct midi_parser *parser) {
     // depending on division format, delta time ticks means a different thing
     if (parser->division.format == MIDI_FORMAT_TICKS_PER_QUARTER_NOTE) {
-        // time deltas are always in ticks, if we're operating on ticks per quarter note then we evaluate based on tempo
-        parser->ns_per_tick = 1000 * parser->tempo_us_per_quarter_note / parser->division.ticks_per_quarter_note;
+        // a tick is tempo / ticks_per_quarter_note us and a sample is 1000000 / sample_rate us, scaled by
+        // ticks_per_quarter_note * sample_rate. The common factor of the sample rate and 1000000 is
+        // divided out to make the units bigger, the tick length changes with tempo so nothing else can be
+        uint64_t common = gcd(PAL_AUDIO_SAMPLE_RATE, 1000000);
+
+        parser->time_per_tick = (uint64_t) parser->tempo_us_per_quarter_note * (PAL_AUDIO_SAMPLE_RATE / common);
+        parser->time_per_sample = (1000000 / common) * parser->division.ticks_per_quarter_note;
     } else if (parser->division.format == MIDI_FORMAT_SMPTE) {
-        parser->ns_per_tick = 1000000000 / (SMPTE_frames_per_second_map[parser->division.midi_SMPTE_format] * parser->division.ticks_per_frame);
+        // a tick is 1 / (fps * ticks_per_frame) s and a sample is 1 / sample_rate s
+        uint64_t numerator = SMPTE_frames_per_second_map[parser->division.midi_SMPTE_format].numerator;
+        uint64_t denominator = SMPTE_frames_per_second_map[parser->division.midi_SMPTE_format].denominator;
+        uint64_t time_per_tick = denominator * PAL_AUDIO_SAMPLE_RATE;
+        uint64_t time_per_sample = numerator * parser->division.ticks_per_frame;
+        uint64_t common = gcd(time_per_tick, time_per_sample);
+
+        parser->time_per_tick = time_per_tick / common;
+        parser->time_per_sample = time_per_sample / common;
     }
 }
 
@@ -270,7 +352,10 @@ static void process_meta_event(struct midi_parser *parser, int track_num, struct
 
             TRACK_PRINT(parser, track_num, "Set tempo: %d us/qt\n", parser->tempo_us_per_quarter_note);
 
-            calculate_us_per_tick(parser);
+            // the new tempo starts at this event's tick
+            parser->tempo_time = track_event_time(parser, track_num) - parser->tracks[track_num].time_offset;
+            parser->tempo_tick = parser->tracks[track_num].event_tick;
+            calculate_time_per_tick(parser);
 
             break;
         case MIDI_META_EVENT_SMPTE_OFFSET:
@@ -340,8 +425,11 @@ static void process_event(struct midi_parser *parser, int track_num, struct midi
         // some status commands only use one byte
         if (event->status.status_code == MIDI_STATUS_PROGRAM_CHANGE || event->status.status_code == MIDI_STATUS_CHANNEL_PRESSURE)
             event->raw = next_byte(parser, track_num);
-        else
-            event->raw = next_byte(parser, track_num) | next_byte(parser, track_num) << 8;
+        else {
+            // separate statements, the evaluation order of operands isn't specified
+            event->raw = next_byte(parser, track_num);
+            event->raw |= next_byte(parser, track_num) << 8;
+        }
 
         // change note on events with zero velocity to a note off event
         if (event->status.status_code == MIDI_STATUS_NOTE_ON && event->velocity == 0)
@@ -385,40 +473,202 @@ uint64_t decode_variable_length_quantity(struct midi_parser *parser, int track_n
     return result;
 }
 
-bool midi_parser_advance(struct midi_parser *parser, uint32_t delta_time_ns) {
-    uint64_t raw_delta_ticks;
-    bool events_waiting = false;
+uint32_t midi_parser_samples_until_next_event(struct midi_parser *parser) {
+    int64_t next_event_time = INT64_MAX;
 
-    // After initialization, the track pointers are at the beginning of the track data
     for (int i = 0; i < parser->num_tracks; i++) {
         if (parser->tracks[i].ended)
             continue;
 
+        // events are kept in ticks and converted to time exactly, so rounding to samples doesn't add up
         if (parser->tracks[i].state == TRACK_STATE_READ_DELTA) {
-            raw_delta_ticks = decode_variable_length_quantity(parser, i);
-
-            parser->tracks[i].timer += raw_delta_ticks * parser->ns_per_tick;
+            parser->tracks[i].event_tick += decode_variable_length_quantity(parser, i);
             parser->tracks[i].state = TRACK_STATE_WAIT_FOR_TIMER;
         }
 
-        parser->tracks[i].timer -= delta_time_ns;
+        int64_t event_time = track_event_time(parser, i);
 
-        // if track timer has reached zero, event needs to be parsed
-        if (parser->tracks[i].timer <= 0) {
+        if (parser->tracks[i].state == TRACK_STATE_WAIT_FOR_TIMER && event_time <= parser->time)
             parser->tracks[i].state = TRACK_STATE_EVENT_PENDING;
-            events_waiting = true;
-        }
+
+        if (event_time < next_event_time)
+            next_event_time = event_time;
+    }
+
+    parser->next_event_time = next_event_time;
+
+    if (next_event_time == INT64_MAX)
+        return UINT32_MAX;
+
+    // round up, the event is applied at the first sample that starts at or after it
+    return samples_until_time(parser, next_event_time);
+}
+
+bool midi_parser_advance(struct midi_parser *parser, uint32_t num_samples) {
+    uint64_t time = (uint64_t) num_samples * parser->time_per_sample;
+    uint64_t fraction = (time & (MIDI_PLAYBACK_RATE_ONE - 1)) * parser->playback_rate + parser->time_remainder;
+
+    // scaled by the 16.16 playback rate in two parts so it can't overflow
+    parser->time += (time >> MIDI_PLAYBACK_RATE_FRAC_BITS) * parser->playback_rate + (fraction >> MIDI_PLAYBACK_RATE_FRAC_BITS);
+    parser->time_remainder = fraction & (MIDI_PLAYBACK_RATE_ONE - 1);
+
+    if (parser->time >= MIDI_TIME_REBASE_THRESHOLD) {
+        parser->tempo_time -= parser->time;
+        parser->next_event_time -= parser->time;
+        parser->time = 0;
     }
 
-    return events_waiting;
+    return parser->next_event_time <= parser->time;
 }
 
 void midi_parser_restart(struct midi_parser *parser) {
+    parser->time = 0;
+    parser->time_remainder = 0;
+    parser->next_event_time = 0;
+    parser->tempo_tick = 0;
+    parser->tempo_time = 0;
+    parser->tempo_us_per_quarter_note = BPM_TO_US_PER_QUARTER_NOTE(MIDI_DEFAULT_TEMPO_BPM);
+    calculate_time_per_tick(parser);
+
     for (int i = 0; i < parser->num_tracks; i++) {
-        parser->tracks[i].timer = 0;
+        parser->tracks[i].event_tick = 0;
         parser->tracks[i].pointer = (uint8_t *) (parser->track_headers[i] + 1);
         parser->tracks[i].ended = false;
+        parser->tracks[i].previous_status = (union status_byte) { 0 };
+        parser->tracks[i].channel_prefix = 0;
+        parser->tracks[i].state = TRACK_STATE_READ_DELTA;
+    }
+}
+
+/**
+ * @brief Keeps track of the notes that are on, for the events parsed while seeking
+ *
+ * @param held_notes
+ * @param event
+ */
+static void update_held_notes(struct midi_held_notes *held_notes, const struct midi_event *event) {
+    enum midi_status_code status_code = event->status.status_code;
+
+    if ((status_code != MIDI_STATUS_NOTE_ON && status_code != MIDI_STATUS_NOTE_OFF) || event->status.channel == MIDI_DRUM_CHANNEL)
+        return;
+
+    // a note on of a held note starts it again, so every note is in the list once
+    for (int i = 0; i < held_notes->num_notes;) {
+        if (held_notes->notes[i].channel == event->status.channel && held_notes->notes[i].note == event->note)
+            held_notes->notes[i] = held_notes->notes[--held_notes->num_notes];
+        else
+            i++;
+    }
+
+    if (status_code == MIDI_STATUS_NOTE_ON && held_notes->num_notes < MIDI_MAX_HELD_NOTES) {
+        held_notes->notes[held_notes->num_notes].channel = event->status.channel;
+        held_notes->notes[held_notes->num_notes].note = event->note;
+        held_notes->notes[held_notes->num_notes].velocity = event->velocity;
+        held_notes->num_notes++;
+    }
+}
+
+/**
+ * @brief Parses the events that play before song position without returning them
+ *
+ * @param parser
+ * @param position
+ * @param held_notes
+ */
+static void skip_to_position(struct midi_parser *parser, uint64_t position, struct midi_held_notes *held_notes) {
+    struct midi_event event;
+    uint32_t samples_until_next_event;
+    // events play on the first sample at or after them, the ones that play at position stay pending
+    int64_t last_skipped_time = ((int64_t) position - 1) * (int64_t) parser->time_per_sample;
+
+    while ((samples_until_next_event = midi_parser_samples_until_next_event(parser)) != UINT32_MAX && parser->next_event_time <= last_skipped_time) {
+        if (samples_until_next_event == 0) {
+            while (midi_parser_next_event(parser, &event))
+                update_held_notes(held_notes, &event);
+        } else {
+            // straight to the sample of the next event, not scaled by the playback rate
+            parser->time = (parser->next_event_time + parser->time_per_sample - 1) / parser->time_per_sample * parser->time_per_sample;
+        }
     }
+
+    parser->time = position * parser->time_per_sample;
+    parser->time_remainder = 0;
+}
+
+/**
+ * @brief Finds the checkpoint of index to seek from
+ *
+ * @param index
+ * @param position
+ * @return const struct midi_checkpoint* last checkpoint before position, the first one if there's none
+ */
+static const struct midi_checkpoint *find_checkpoint(const struct midi_index *index, uint64_t position) {
+    uint32_t low = 0;
+    uint32_t high = index->num_checkpoints;
+
+    // the events at the position of a checkpoint are already parsed, except for the first one at
+    // the start of the song, so only checkpoints before position can be used
+    while (high - low > 1) {
+        uint32_t middle = (low + high) / 2;
+
+        if (index->checkpoints[middle].position < position)
+            low = middle;
+        else
+            high = middle;
+    }
+
+    return &index->checkpoints[low];
+}
+
+void midi_parser_seek(struct midi_parser *parser, const struct midi_index *index, uint64_t position, struct midi_held_notes *held_notes) {
+    if (index != NULL && index->num_checkpoints > 0) {
+        const struct midi_checkpoint *checkpoint = find_checkpoint(index, position);
+
+        parser->time = checkpoint->position * parser->time_per_sample;
+        parser->next_event_time = parser->time;
+        parser->tempo_us_per_quarter_note = checkpoint->tempo_us_per_quarter_note;
+        parser->time_per_tick = checkpoint->time_per_tick;
+        parser->tempo_tick = checkpoint->tempo_tick;
+        parser->tempo_time = checkpoint->tempo_time;
+
+        for (int i = 0; i < parser->num_tracks; i++) {
+            int64_t time_offset = parser->tracks[i].time_offset;
+
+            parser->tracks[i] = checkpoint->tracks[i];
+            parser->tracks[i].time_offset = time_offset;
+        }
+
+        *held_notes = checkpoint->held_notes;
+    } else {
+        midi_parser_restart(parser);
+        held_notes->num_notes = 0;
+    }
+
+    skip_to_position(parser, position, held_notes);
+}
+
+void midi_parser_set_playback_rate(struct midi_parser *parser, uint32_t playback_rate) {
+    if (playback_rate < 1)
+        playback_rate = 1;
+    else if (playback_rate > MIDI_PLAYBACK_RATE_MAX)
+        playback_rate = MIDI_PLAYBACK_RATE_MAX;
+
+    parser->playback_rate = playback_rate;
+}
+
+uint32_t midi_parser_samples_until_loop_end(struct midi_parser *parser) {
+    if (!parser->loop || parser->loop_end <= parser->loop_start)
+        return UINT32_MAX;
+
+    // right after jumping back the position is the loop start, so an empty loop doesn't jump forever
+    if (song_position(parser) > parser->loop_start && (midi_parser_ended(parser) || song_position(parser) >= parser->loop_end))
+        return 0;
+
+    // also true for MIDI_POSITION_END, the loop ends with the song
+    if (parser->loop_end > INT64_MAX / parser->time_per_sample)
+        return UINT32_MAX;
+
+    return samples_until_time(parser, parser->loop_end * parser->time_per_sample);
 }
 
 bool midi_parser_ended(struct midi_parser *parser) {
@@ -446,8 +696,17 @@ bool midi_parser_init(struct midi_parser *parser, void *buffer) {
     parser->num_tracks = endian_swap_16(header_data[1]);
     parser->division.raw = endian_swap_16(header_data[2]);
 
-    // now that division is known, calculate microseconds per tick
-    calculate_us_per_tick(parser);
+    // now that division is known, calculate time per tick
+    calculate_time_per_tick(parser);
+    parser->time = 0;
+    parser->time_remainder = 0;
+    parser->playback_rate = MIDI_PLAYBACK_RATE_ONE;
+    parser->next_event_time = 0;
+    parser->tempo_tick = 0;
+    parser->tempo_time = 0;
+    parser->loop = false;
+    parser->loop_start = 0;
+    parser->loop_end = MIDI_POSITION_END;
 
     if (parser->num_tracks > MIDI_MAX_TRACKS)
         parser->num_tracks = MIDI_MAX_TRACKS;
@@ -463,9 +722,12 @@ bool midi_parser_init(struct midi_parser *parser, void *buffer) {
             return false;
 
         track_ptr += sizeof(struct midi_chunk_header);
-        parser->tracks[i].timer = 0;
+        parser->tracks[i].event_tick = 0;
+        parser->tracks[i].time_offset = 0;
         parser->tracks[i].pointer = track_ptr;
         parser->tracks[i].ended = false;
+        parser->tracks[i].previous_status = (union status_byte) { 0 };
+        parser->tracks[i].channel_prefix = 0;
         parser->tracks[i].state = TRACK_STATE_READ_DELTA;
         track_ptr += endian_swap_32(parser->track_headers[i]->length_be);
 
@@ -476,5 +738,236 @@ bool midi_parser_init(struct midi_parser *parser, void *buffer) {
 }
 
 void midi_parser_set_track_offset(struct midi_parser *parser, int track_num, pal_float_t offset) {
-    parser->tracks[track_num].timer = offset * 1000000000;
+    parser->tracks[track_num].time_offset = (int64_t) (PAL_TO_DOUBLE(offset) * PAL_AUDIO_SAMPLE_RATE) * parser->time_per_sample;
+}
+
+/**
+ * @brief Adds event to stream being built, with wait events in front of it if the delta is too big
+ *
+ * @return true if event was added
+ * @return false if events is full
+ */
+static bool stream_add_event(struct midi_stream_event *events, uint32_t max_events, uint32_t *num_events, uint32_t delta_samples, const struct midi_event *event) {
+    while (delta_samples > UINT16_MAX) {
+        if (*num_events >= max_events)
+            return false;
+
+        events[(*num_events)++] = (struct midi_stream_event) { UINT16_MAX, MIDI_STREAM_STATUS_WAIT, { 0, 0 } };
+        delta_samples -= UINT16_MAX;
+    }
+
+    if (*num_events >= max_events)
+        return false;
+
+    events[(*num_events)++] = (struct midi_stream_event) {
+        .delta_samples = delta_samples,
+        .status = event->status.status_code << 4 | event->status.channel,
+        .data = { event->raw & 0xFF, event->raw >> 8 }
+    };
+
+    return true;
+}
+
+static bool is_marker(const struct midi_event *event, const char *text) {
+    return event->status.status_code == MIDI_STATUS_SYSTEM && event->status.midi_system_code == MIDI_SYSTEM_META_ESCAPE && event->meta.code == MIDI_META_EVENT_MARKER
+        && event->meta.length == strlen(text) && strncasecmp((char *) event->meta.data, text, event->meta.length) == 0;
+}
+
+bool midi_stream_init(struct midi_stream *stream, struct midi_stream_event *events, uint32_t max_events, uint32_t *beat_positions, uint32_t max_beats, void *buffer) {
+    struct midi_parser parser;
+    struct midi_event event;
+    uint32_t samples_until_next_event;
+    uint32_t num_events = 0;
+    uint32_t num_beats = 0;
+    uint32_t delta_samples = 0;
+
+    if (!midi_parser_init(&parser, buffer))
+        return false;
+
+    uint64_t ticks_per_beat = parser.division.format == MIDI_FORMAT_TICKS_PER_QUARTER_NOTE ? parser.division.ticks_per_quarter_note : parser.division.ticks_per_frame;
+
+    stream->loop_start = 0;
+    stream->loop_end = MIDI_POSITION_END;
+
+    // play the file through the parser so the timing is the same as parsing it while playing
+    while ((samples_until_next_event = midi_parser_samples_until_next_event(&parser)) != UINT32_MAX) {
+        // tempo only changes at events, so the beats up to the next event have the tempo in effect now
+        uint64_t next_event_tick = parser.tempo_tick + (parser.next_event_time - parser.tempo_time) / (int64_t) parser.time_per_tick;
+
+        while (beat_positions != NULL && (uint64_t) num_beats * ticks_per_beat <= next_event_tick) {
+            int64_t time = parser.tempo_time + (int64_t) ((uint64_t) num_beats * ticks_per_beat - parser.tempo_tick) * (int64_t) parser.time_per_tick;
+
+            if (num_beats >= max_beats)
+                return false;
+
+            // same rounding as the events, beats play on the first sample at or after them
+            beat_positions[num_beats++] = (time + parser.time_per_sample - 1) / parser.time_per_sample;
+        }
+
+        if (samples_until_next_event > 0) {
+            midi_parser_advance(&parser, samples_until_next_event);
+            delta_samples += samples_until_next_event;
+            continue;
+        }
+
+        while (midi_parser_next_event(&parser, &event)) {
+            if (is_marker(&event, "loopStart"))
+                stream->loop_start = song_position(&parser);
+            else if (is_marker(&event, "loopEnd"))
+                stream->loop_end = song_position(&parser);
+
+            if (event.status.status_code != MIDI_STATUS_NOTE_ON && event.status.status_code != MIDI_STATUS_NOTE_OFF && event.status.status_code != MIDI_STATUS_CONTROL_CHANGE && event.status.status_code != MIDI_STATUS_PROGRAM_CHANGE)
+                continue;
+
+            if (!stream_add_event(events, max_events, &num_events, delta_samples, &event))
+                return false;
+
+            delta_samples = 0;
+        }
+    }
+
+    stream->events = events;
+    stream->num_events = num_events;
+    stream->beat_positions = beat_positions;
+    stream->num_beats = num_beats;
+    stream->length = song_position(&parser);
+
+    return true;
+}
+
+void midi_stream_read_event(const struct midi_stream_event *stream_event, struct midi_event *event) {
+    *event = (struct midi_event) { 0 };
+    event->status.status_code = stream_event->status >> 4;
+    event->status.channel = stream_event->status & 0x0F;
+    event->note = stream_event->data[0];
+    event->velocity = stream_event->data[1];
+}
+
+void midi_stream_seek(const struct midi_stream *stream, uint64_t position, uint32_t *event_index, uint64_t *event_position, struct midi_held_notes *held_notes) {
+    struct midi_event event;
+    uint32_t i = 0;
+    uint64_t next_event_position = stream->num_events > 0 ? stream->events[0].delta_samples : 0;
+
+    held_notes->num_notes = 0;
+
+    // events play on the first sample at or after them, the ones that play at position stay pending
+    while (i < stream->num_events && next_event_position < position) {
+        midi_stream_read_event(&stream->events[i++], &event);
+        update_held_notes(held_notes, &event);
+
+        if (i < stream->num_events)
+            next_event_position += stream->events[i].delta_samples;
+    }
+
+    *event_index = i;
+    *event_position = next_event_position;
+}
+
+uint64_t midi_stream_beat_position(const struct midi_stream *stream, uint32_t beat) {
+    return beat < stream->num_beats ? stream->beat_positions[beat] : stream->length;
+}
+
+/**
+ * @brief Adds checkpoint of parser's current state to index being built
+ *
+ * @return true if checkpoint was added
+ * @return false if checkpoints is full
+ */
+static bool index_add_checkpoint(struct midi_index *index, struct midi_checkpoint *checkpoints, uint32_t max_checkpoints, struct midi_parser *parser, const struct midi_held_notes *held_notes) {
+    if (index->num_checkpoints >= max_checkpoints)
+        return false;
+
+    struct midi_checkpoint *checkpoint = &checkpoints[index->num_checkpoints++];
+
+    checkpoint->position = song_position(parser);
+    checkpoint->tempo_us_per_quarter_note = parser->tempo_us_per_quarter_note;
+    checkpoint->time_per_tick = parser->time_per_tick;
+    checkpoint->tempo_tick = parser->tempo_tick;
+    checkpoint->tempo_time = parser->tempo_time;
+    memcpy(checkpoint->tracks, parser->tracks, sizeof(parser->tracks));
+    checkpoint->held_notes = *held_notes;
+
+    return true;
+}
+
+bool midi_index_init(struct midi_index *index, struct midi_checkpoint *checkpoints, uint32_t max_checkpoints, uint32_t beats_per_checkpoint, void *buffer) {
+    struct midi_parser parser;
+    struct midi_event event;
+    struct midi_held_notes held_notes = { 0 };
+    uint32_t samples_until_next_event;
+
+    if (!midi_parser_init(&parser, buffer))
+        return false;
+
+    index->checkpoints = checkpoints;
+    index->num_checkpoints = 0;
+    index->ticks_per_beat = parser.division.format == MIDI_FORMAT_TICKS_PER_QUARTER_NOTE ? parser.division.ticks_per_quarter_note : parser.division.ticks_per_frame;
+    index->time_per_sample = parser.time_per_sample;
+    index->loop_start = 0;
+    index->loop_end = MIDI_POSITION_END;
+
+    uint64_t ticks_per_checkpoint = (uint64_t) (beats_per_checkpoint > 0 ? beats_per_checkpoint : 1) * index->ticks_per_beat;
+    uint64_t next_checkpoint_tick = ticks_per_checkpoint;
+
+    // the start of the song, before any event is parsed
+    if (!index_add_checkpoint(index, checkpoints, max_checkpoints, &parser, &held_notes))
+        return false;
+
+    // play the file through the parser like midi_stream_init does
+    while ((samples_until_next_event = midi_parser_samples_until_next_event(&parser)) != UINT32_MAX) {
+        if (samples_until_next_event == 0) {
+            while (midi_parser_next_event(&parser, &event)) {
+                update_held_notes(&held_notes, &event);
+
+                if (is_marker(&event, "loopStart"))
+                    index->loop_start = song_position(&parser);
+                else if (is_marker(&event, "loopEnd"))
+                    index->loop_end = song_position(&parser);
+            }
+
+            continue;
+        }
+
+        // every event up to here is parsed and the next one is later, playback can start from here.
+        // Checkpoints are also made after tempo changes so every tempo is in one for beat positions
+        const struct midi_checkpoint *last_checkpoint = &checkpoints[index->num_checkpoints - 1];
+        uint64_t next_event_tick = parser.tempo_tick + (parser.next_event_time - parser.tempo_time) / (int64_t) parser.time_per_tick;
+
+        if (next_event_tick >= next_checkpoint_tick || parser.tempo_tick != last_checkpoint->tempo_tick || parser.time_per_tick != last_checkpoint->time_per_tick) {
+            if (!index_add_checkpoint(index, checkpoints, max_checkpoints, &parser, &held_notes))
+                return false;
+
+            next_checkpoint_tick = (next_event_tick / ticks_per_checkpoint + 1) * ticks_per_checkpoint;
+        }
+
+        midi_parser_advance(&parser, samples_until_next_event);
+    }
+
+    index->length = song_position(&parser);
+
+    return true;
+}
+
+uint64_t midi_index_beat_position(const struct midi_index *index, uint32_t beat) {
+    uint64_t tick = (uint64_t) beat * index->ticks_per_beat;
+    uint32_t low = 0;
+    uint32_t high = index->num_checkpoints;
+
+    if (index->num_checkpoints == 0)
+        return 0;
+
+    // last checkpoint at or before the tick's tempo change, the first one has tempo_tick 0
+    while (high - low > 1) {
+        uint32_t middle = (low + high) / 2;
+
+        if (index->checkpoints[middle].tempo_tick <= tick)
+            low = middle;
+        else
+            high = middle;
+    }
+
+    const struct midi_checkpoint *checkpoint = &index->checkpoints[low];
+    int64_t time = checkpoint->tempo_time + (int64_t) (tick - checkpoint->tempo_tick) * (int64_t) checkpoint->time_per_tick;
+
+    return (time + index->time_per_sample - 1) / index->time_per_sample;
 }
@@ -7,75 +7,319 @@ static struct vec2 collision_axes[MAX_POLY_SIDES * 2];
 static int num_phys1_collision_axes;
 static int num_phys2_collision_axes;
 
+// hot physical data of every body, stored as a structure of arrays so integration is a single pass
+// over contiguous memory. Slots [0, num_awake) hold awake bodies and slots [num_awake, num_bodies)
+// hold sleeping ones. The extra slot at PHYS_MAX_BODIES is a scratch body that PHYS_BODY_INVALID
+// maps to, so accessors never have to check handles.
+static struct phys_body_store {
+    pal_float_t position_x[PHYS_MAX_BODIES + 1];
+    pal_float_t position_y[PHYS_MAX_BODIES + 1];
+    pal_float_t velocity_x[PHYS_MAX_BODIES + 1];
+    pal_float_t velocity_y[PHYS_MAX_BODIES + 1];
+    pal_float_t force_x[PHYS_MAX_BODIES + 1];
+    pal_float_t force_y[PHYS_MAX_BODIES + 1];
+    pal_float_t inv_mass[PHYS_MAX_BODIES + 1];
+    pal_float_t angle[PHYS_MAX_BODIES + 1];
+    pal_float_t angular_velocity[PHYS_MAX_BODIES + 1];
+    pal_float_t torque[PHYS_MAX_BODIES + 1];
+    pal_float_t inv_moment_of_inertia[PHYS_MAX_BODIES + 1];
+
+    phys_body_t slot_of[PHYS_MAX_BODIES + 1];   // body handle -> slot
+    phys_body_t handle_of[PHYS_MAX_BODIES + 1]; // slot -> body handle
+    struct phys_data *owner_of[PHYS_MAX_BODIES];    // body handle -> phys_data holding it
+    phys_body_t free_handles[PHYS_MAX_BODIES];
+    uint16_t num_free_handles;
+    uint16_t next_unused_handle;
+    uint16_t num_bodies;
+    uint16_t num_awake;
+} body_store;
+
+#define BODY_SLOT(phys) (body_store.slot_of[(phys)->body])
+
+_Static_assert(PHYS_MAX_BODIES <= AABB_TREE_MAX_LEAVES, "Scene query tree can't hold every body! Increase AABB_TREE_MAX_LEAVES or decrease PHYS_MAX_BODIES!");
+
+// bounding volume tree of every body with bounds, used for scene queries
+static struct aabb_tree scene_tree;
+static bool scene_tree_initialized = false;
+
+static void body_store_swap_slots(phys_body_t slot1, phys_body_t slot2) {
+    struct phys_body_store *s = &body_store;
+    pal_float_t tmp;
+    phys_body_t handle1 = s->handle_of[slot1];
+    phys_body_t handle2 = s->handle_of[slot2];
+
+    if (slot1 == slot2)
+        return;
+
+#define SWAP_FIELD(field) tmp = s->field[slot1]; s->field[slot1] = s->field[slot2]; s->field[slot2] = tmp;
+    SWAP_FIELD(position_x);
+    SWAP_FIELD(position_y);
+    SWAP_FIELD(velocity_x);
+    SWAP_FIELD(velocity_y);
+    SWAP_FIELD(force_x);
+    SWAP_FIELD(force_y);
+    SWAP_FIELD(inv_mass);
+    SWAP_FIELD(angle);
+    SWAP_FIELD(angular_velocity);
+    SWAP_FIELD(torque);
+    SWAP_FIELD(inv_moment_of_inertia);
+#undef SWAP_FIELD
+
+    s->handle_of[slot1] = handle2;
+    s->handle_of[slot2] = handle1;
+    s->slot_of[handle1] = slot2;
+    s->slot_of[handle2] = slot1;
+}
+
 static void find_furthest_vertex_squared(struct phys_data *phys) {
     if (phys->bounds.type == BOUNDS_TYPE_POLY) {
-        pal_float_t dist_squared;
-        phys->bounds.furthest_vertex_squared = -1;
+        pal_float_t dist;
+        phys->bounds.furthest_vertex_distance = 0;
 
+        // search on the distance rather than its square so large bounds don't overflow fixed point
         for (int i = 0; i < phys->bounds.n_vertices; i++) {
-            dist_squared = phys->bounds.vertices[i].x * phys->bounds.vertices[i].x + phys->bounds.vertices[i].y * phys->bounds.vertices[i].y;
+            dist = vec2_mag(&phys->bounds.vertices[i]);
 
-            if (dist_squared > phys->bounds.furthest_vertex_squared)
-                phys->bounds.furthest_vertex_squared = dist_squared;
+            if (dist > phys->bounds.furthest_vertex_distance)
+                phys->bounds.furthest_vertex_distance = dist;
         }
     } else if (phys->bounds.type == BOUNDS_TYPE_CIRCLE) {
-        phys->bounds.furthest_vertex_squared = phys->bounds.radius * phys->bounds.radius;
+        phys->bounds.furthest_vertex_distance = phys->bounds.radius;
     }
 
-    phys->bounds.furthest_vertex_distance = pal_sqrt(phys->bounds.furthest_vertex_squared);
+    phys->bounds.furthest_vertex_squared = pal_mul(phys->bounds.furthest_vertex_distance, phys->bounds.furthest_vertex_distance);
+}
+
+static pal_float_t saturate_from_double(double num) {
+    return PAL_FLOAT(fmin(fmax(num, -PAL_TO_DOUBLE(PAL_FLOAT_MAX)), PAL_TO_DOUBLE(PAL_FLOAT_MAX)));
 }
 
 static void compute_area_and_inertia(struct phys_data *phys) {
-    // calculate area and inertia in one shot
-    pal_float_t inertia = 0.0;
+    // calculate area and inertia in one shot, this only runs when the bounds change so it's done in
+    // double precision to keep the 4th power terms from overflowing fixed point
+    double area = 0.0;
+    double inertia = 0.0;
 
     if (phys->bounds.type == BOUNDS_TYPE_POLY) {
-        pal_float_t p1_dir, p1_mag;
-        struct vec2 *p1;
-        struct vec2 *p2;
-        struct vec2 p2_rotated;
-
         for (int i = 0; i < phys->bounds.n_vertices; i++) {
-            p1 = &phys->bounds.vertices[i];
-            p2 = &phys->bounds.vertices[(i + 1) % phys->bounds.n_vertices];
-
-            p1_dir = vec2_dir(p1);
-            p1_mag = vec2_mag(p1);
+            struct vec2 *p1 = &phys->bounds.vertices[i];
+            struct vec2 *p2 = &phys->bounds.vertices[(i + 1) % phys->bounds.n_vertices];
+            double x1 = PAL_TO_DOUBLE(p1->x), y1 = PAL_TO_DOUBLE(p1->y);
+            double x2 = PAL_TO_DOUBLE(p2->x), y2 = PAL_TO_DOUBLE(p2->y);
 
-            vec2_rotate(p2, -p1_dir, &p2_rotated);
+            // triangle (origin, p1, p2), cross = base * height
+            double cross = x1 * y2 - y1 * x2;
 
-            pal_float_t b = p1_mag;
-            pal_float_t h = p2_rotated.y;
-            pal_float_t a = p2_rotated.x;
-
-            inertia += (b * (h * h * h)) / 12 + ((b * b * b) * h + (b * b) * h * a + b * h * (a * a)) / 12;
-            phys->bounds.area += vec2_mag(p2) * p1_mag * sin(vec2_dir(p2) - p1_dir) / 2;
+            inertia += cross * (x1 * x1 + y1 * y1 + x1 * x2 + y1 * y2 + x2 * x2 + y2 * y2) / 12;
+            area += cross / 2;
         }
     } else if (phys->bounds.type == BOUNDS_TYPE_CIRCLE) {
-        phys->bounds.area = M_PI * phys->bounds.radius * phys->bounds.radius;
-        inertia = M_PI_2 * phys->bounds.radius * phys->bounds.radius * phys->bounds.radius * phys->bounds.radius;
+        double radius = PAL_TO_DOUBLE(phys->bounds.radius);
+
+        area = M_PI * radius * radius;
+        inertia = M_PI_2 * radius * radius * radius * radius;
     }
 
-    phys->moment_of_inertia = inertia * phys->mass / phys->bounds.area;
+    double moment_of_inertia = inertia * PAL_TO_DOUBLE(phys->mass) / area;
 
-    // compute inverse mass and inertia as they're used heavily in collision resolution
-    phys->inv_mass = phys->mass > 0.0 ? 1.0 / phys->mass : INFINITY;
-    phys->inv_moment_of_inertia = phys->moment_of_inertia > 0.0 ? 1.0 / phys->moment_of_inertia : INFINITY;
+    phys->bounds.area = saturate_from_double(area);
+    phys->moment_of_inertia = saturate_from_double(moment_of_inertia);
+
+    // compute inverse mass and inertia as they're used heavily in collision resolution, inverting
+    // before conversion keeps precision for large bodies in fixed point
+    body_store.inv_mass[BODY_SLOT(phys)] = phys->mass > 0 ? saturate_from_double(1.0 / PAL_TO_DOUBLE(phys->mass)) : PAL_FLOAT_MAX;
+    body_store.inv_moment_of_inertia[BODY_SLOT(phys)] = moment_of_inertia > 0 ? saturate_from_double(1.0 / moment_of_inertia) : PAL_FLOAT_MAX;
 }
 
-void physics_init(struct phys_data *phys, pal_float_t mass) {
-    phys->position.x = 0.0;
-    phys->position.y = 0.0;
-    phys->velocity.x = 0.0;
-    phys->velocity.y = 0.0;
-    phys->force.x = 0.0;
-    phys->force.y = 0.0;
-    phys->angle = 0.0;
-    phys->angular_velocity = 0.0;
-    phys->torque = 0.0;
+bool physics_has_body(const struct phys_data *phys) {
+    // the handle of phys_data that was never initialized can be anything, only its own body points back at it
+    return phys->body < body_store.next_unused_handle && body_store.owner_of[phys->body] == phys;
+}
+
+bool physics_init(struct phys_data *phys, pal_float_t mass) {
+    struct phys_body_store *s = &body_store;
+    phys_body_t handle, slot;
+
+    if (!scene_tree_initialized) {
+        aabb_tree_init(&scene_tree, PAL_FLOAT(PHYS_AABB_MARGIN));
+        scene_tree_initialized = true;
+    }
+
+    // initializing again starts over with a new body instead of leaking the old one
+    if (physics_has_body(phys))
+        physics_delete(phys);
+
+    phys->proxy = AABB_TREE_NULL_NODE;
+    phys->user_data = NULL;
+
+    // reuse a released handle if possible, otherwise take a never used one
+    if (s->num_free_handles > 0) {
+        handle = s->free_handles[--s->num_free_handles];
+    } else if (s->next_unused_handle < PHYS_MAX_BODIES) {
+        handle = s->next_unused_handle++;
+    } else {
+        // store is full, point body at the scratch slot
+        handle = PHYS_BODY_INVALID;
+        s->slot_of[PHYS_BODY_INVALID] = PHYS_BODY_INVALID;
+        s->handle_of[PHYS_BODY_INVALID] = PHYS_BODY_INVALID;
+    }
+
+    phys->body = handle;
+
+    if (handle != PHYS_BODY_INVALID) {
+        // new bodies start asleep, at the end of the sleeping region
+        slot = s->num_bodies++;
+        s->slot_of[handle] = slot;
+        s->handle_of[slot] = handle;
+        s->owner_of[handle] = phys;
+    } else {
+        slot = PHYS_BODY_INVALID;
+    }
+
+    s->position_x[slot] = 0.0;
+    s->position_y[slot] = 0.0;
+    s->velocity_x[slot] = 0.0;
+    s->velocity_y[slot] = 0.0;
+    s->force_x[slot] = 0.0;
+    s->force_y[slot] = 0.0;
+    s->angle[slot] = 0.0;
+    s->angular_velocity[slot] = 0.0;
+    s->torque[slot] = 0.0;
     phys->bounds.area = 0.0;
     phys->mass = mass;
-    phys->elasticity = 1.0;
+    phys->elasticity = PAL_FROM_INT(1);
+
+    return handle != PHYS_BODY_INVALID;
+}
+
+void physics_delete(struct phys_data *phys) {
+    struct phys_body_store *s = &body_store;
+
+    if (phys->body == PHYS_BODY_INVALID)
+        return;
+
+    aabb_tree_remove(&scene_tree, phys->proxy);
+    phys->proxy = AABB_TREE_NULL_NODE;
+
+    // put body to sleep, then move it to the end of the sleeping region so the store stays packed
+    physics_set_awake(phys, false);
+    body_store_swap_slots(BODY_SLOT(phys), s->num_bodies - 1);
+    s->num_bodies--;
+
+    s->free_handles[s->num_free_handles++] = phys->body;
+    s->owner_of[phys->body] = NULL;
+    phys->body = PHYS_BODY_INVALID;
+}
+
+void physics_set_awake(struct phys_data *phys, bool awake) {
+    struct phys_body_store *s = &body_store;
+    phys_body_t slot = BODY_SLOT(phys);
+
+    if (phys->body == PHYS_BODY_INVALID)
+        return;
+
+    if (awake && slot >= s->num_awake) {
+        // swap with first sleeping body and grow the awake region
+        body_store_swap_slots(slot, s->num_awake);
+        s->num_awake++;
+    } else if (!awake && slot < s->num_awake) {
+        // swap with last awake body and shrink the awake region
+        body_store_swap_slots(slot, s->num_awake - 1);
+        s->num_awake--;
+    }
+}
+
+void physics_get_position(const struct phys_data *phys, struct vec2 *position) {
+    position->x = body_store.position_x[BODY_SLOT(phys)];
+    position->y = body_store.position_y[BODY_SLOT(phys)];
+}
+
+void physics_set_position(struct phys_data *phys, const struct vec2 *position) {
+    body_store.position_x[BODY_SLOT(phys)] = position->x;
+    body_store.position_y[BODY_SLOT(phys)] = position->y;
+}
+
+void physics_get_velocity(const struct phys_data *phys, struct vec2 *velocity) {
+    velocity->x = body_store.velocity_x[BODY_SLOT(phys)];
+    velocity->y = body_store.velocity_y[BODY_SLOT(phys)];
+}
+
+void physics_set_velocity(struct phys_data *phys, const struct vec2 *velocity) {
+    body_store.velocity_x[BODY_SLOT(phys)] = velocity->x;
+    body_store.velocity_y[BODY_SLOT(phys)] = velocity->y;
+}
+
+void physics_get_force(const struct phys_data *phys, struct vec2 *force) {
+    force->x = body_store.force_x[BODY_SLOT(phys)];
+    force->y = body_store.force_y[BODY_SLOT(phys)];
+}
+
+void physics_set_force(struct phys_data *phys, const struct vec2 *force) {
+    body_store.force_x[BODY_SLOT(phys)] = force->x;
+    body_store.force_y[BODY_SLOT(phys)] = force->y;
+}
+
+pal_float_t physics_get_angle(const struct phys_data *phys) {
+    return body_store.angle[BODY_SLOT(phys)];
+}
+
+void physics_set_angle(struct phys_data *phys, pal_float_t angle) {
+    body_store.angle[BODY_SLOT(phys)] = angle;
+}
+
+pal_float_t physics_get_angular_velocity(const struct phys_data *phys) {
+    return body_store.angular_velocity[BODY_SLOT(phys)];
+}
+
+void physics_set_angular_velocity(struct phys_data *phys, pal_float_t angular_velocity) {
+    body_store.angular_velocity[BODY_SLOT(phys)] = angular_velocity;
+}
+
+pal_float_t physics_get_torque(const struct phys_data *phys) {
+    return body_store.torque[BODY_SLOT(phys)];
+}
+
+void physics_set_torque(struct phys_data *phys, pal_float_t torque) {
+    body_store.torque[BODY_SLOT(phys)] = torque;
+}
+
+pal_float_t physics_get_inv_mass(const struct phys_data *phys) {
+    return body_store.inv_mass[BODY_SLOT(phys)];
+}
+
+pal_float_t physics_get_inv_moment_of_inertia(const struct phys_data *phys) {
+    return body_store.inv_moment_of_inertia[BODY_SLOT(phys)];
+}
+
+static void compute_aabb(struct phys_data *phys, struct aabb *aabb) {
+    struct vec2 position;
+    pal_float_t r = phys->bounds.furthest_vertex_distance;
+
+    // furthest vertex distance bounds the body at any angle, so rotating doesn't move it in the tree
+    physics_get_position(phys, &position);
+    aabb->min.x = position.x - r;
+    aabb->min.y = position.y - r;
+    aabb->max.x = position.x + r;
+    aabb->max.y = position.y + r;
+}
+
+/**
+ * @brief Inserts phys_data into scene query tree or moves it if it's already there
+ *
+ * @param phys
+ */
+static void update_proxy(struct phys_data *phys) {
+    struct aabb aabb;
+
+    if (phys->body == PHYS_BODY_INVALID)
+        return;
+
+    compute_aabb(phys, &aabb);
+
+    if (phys->proxy == AABB_TREE_NULL_NODE)
+        phys->proxy = aabb_tree_insert(&scene_tree, &aabb, phys);
+    else
+        aabb_tree_move(&scene_tree, phys->proxy, &aabb);
 }
 
 void physics_scale_bounds(struct phys_data *phys, pal_float_t factor) {
@@ -84,27 +328,40 @@ void physics_scale_bounds(struct phys_data *phys, pal_float_t factor) {
             vec2_scale(&phys->bounds.vertices[i], factor, &phys->bounds.vertices[i]);
         }
     } else if (phys->bounds.type == BOUNDS_TYPE_CIRCLE) {
-        phys->bounds.radius = phys->translated_bounds.radius = phys->bounds.radius * factor;
+        phys->bounds.radius = phys->translated_bounds.radius = pal_mul(phys->bounds.radius, factor);
     }
 
     // now that the bounds are scaled, recompute area and inertia, also finding furthest vertex squared
     compute_area_and_inertia(phys);
     find_furthest_vertex_squared(phys);
+    update_proxy(phys);
 }
 
 void physics_compute_translated_bounds(struct phys_data *phys) {
+    struct vec2 position;
+    pal_float_t angle;
+
+    // keep scene query tree in sync with the body's new position
+    update_proxy(phys);
+
     if (phys->bounds.type == BOUNDS_TYPE_CIRCLE)
         return;
 
+    physics_get_position(phys, &position);
+    angle = physics_get_angle(phys);
+
     for (int i = 0; i < phys->bounds.n_vertices; i++) {
-        vec2_rotate(&phys->bounds.vertices[i], phys->angle, &phys->translated_bounds.vertices[i]);
-        vec2_add(&phys->position, &phys->translated_bounds.vertices[i], &phys->translated_bounds.vertices[i]);
+        vec2_rotate(&phys->bounds.vertices[i], angle, &phys->translated_bounds.vertices[i]);
+        vec2_add(&position, &phys->translated_bounds.vertices[i], &phys->translated_bounds.vertices[i]);
     }
 }
 
 bool physics_check_point_collision(struct phys_data *phys, struct vec2 *point) {
+    struct vec2 position;
     struct vec2 distance_vec;
-    vec2_sub(point, &phys->position, &distance_vec);
+
+    physics_get_position(phys, &position);
+    vec2_sub(point, &position, &distance_vec);
 
     // if the point isn't within the maximum vertex, just return false
     if (vec2_squared_mag(&distance_vec) > phys->bounds.furthest_vertex_squared)
@@ -141,7 +398,7 @@ static void closest_vertex_to_point(struct phys_data *phys, struct vec2 *point,
     struct vec2 *closest_ptr = &phys->translated_bounds.vertices[0];
     struct vec2 distance_vector;
     pal_float_t distance;
-    pal_float_t min = INFINITY;
+    pal_float_t min = PAL_FLOAT_MAX;
 
     for (int i = 0; i < phys->translated_bounds.n_vertices; i++) {
         vec2_sub(&phys->translated_bounds.vertices[i], point, &distance_vector);
@@ -158,10 +415,14 @@ static void closest_vertex_to_point(struct phys_data *phys, struct vec2 *point,
 static void get_sat_axes(struct phys_data *phys1, struct phys_data *phys2) {
     num_phys1_collision_axes = num_phys2_collision_axes = 0;
     struct vec2 *axis;
+    struct vec2 position1, position2;
+
+    physics_get_position(phys1, &position1);
+    physics_get_position(phys2, &position2);
 
     // If both phys_datas are circles, we just need the normalized difference vector as an axis
     if (phys1->translated_bounds.type == BOUNDS_TYPE_CIRCLE && phys2->translated_bounds.type == BOUNDS_TYPE_CIRCLE) {
-        vec2_sub(&phys2->position, &phys1->position, &collision_axes[0]);
+        vec2_sub(&position2, &position1, &collision_axes[0]);
         vec2_normalize(&collision_axes[0], &collision_axes[0]);
         num_phys1_collision_axes = 1;
     // If phys1 is a circle, get the closest point of phys2's translated_bounds and get an axis from it
@@ -169,8 +430,8 @@ static void get_sat_axes(struct phys_data *phys1, struct phys_data *phys2) {
     } else if (phys1->translated_bounds.type == BOUNDS_TYPE_CIRCLE) {
         // axis from closest point of phys2's translated_bounds to phys1
         axis = &collision_axes[0];
-        closest_vertex_to_point(phys2, &phys1->position, axis);
-        vec2_sub(axis, &phys1->position, axis);
+        closest_vertex_to_point(phys2, &position1, axis);
+        vec2_sub(axis, &position1, axis);
         vec2_normalize(axis, axis);
         num_phys1_collision_axes = 1;
 
@@ -210,8 +471,8 @@ static void get_sat_axes(struct phys_data *phys1, struct phys_data *phys2) {
 
         // axis from closest point of phys2's translated_bounds to phys1
         axis = &collision_axes[num_phys1_collision_axes];
-        closest_vertex_to_point(phys1, &phys2->position, axis);
-        vec2_sub(axis, &phys2->position, axis);
+        closest_vertex_to_point(phys1, &position2, axis);
+        vec2_sub(axis, &position2, axis);
         vec2_normalize(axis, axis);
         num_phys2_collision_axes = 1;
     } else { // both objects are polys
@@ -260,20 +521,23 @@ static void project_phys_data(struct vec2 *axis, struct phys_data *phys, struct
     pal_float_t proj;
 
     if (phys->translated_bounds.type == BOUNDS_TYPE_CIRCLE) {
+        struct vec2 position;
         pal_float_t r = phys->translated_bounds.radius;
-        pal_float_t pos_proj = vec2_dot(axis, &phys->position);
+
+        physics_get_position(phys, &position);
+        pal_float_t pos_proj = vec2_dot(axis, &position);
 
         projection->min = pos_proj - r;
         projection->max = pos_proj + r;
         vec2_scale(axis, -r, &projection->collision_point);
-        vec2_add(&phys->position, &projection->collision_point, &projection->collision_point);
+        vec2_add(&position, &projection->collision_point, &projection->collision_point);
     } else {
         projection->min = vec2_dot(axis, &phys->translated_bounds.vertices[0]);
         projection->max = projection->min;
         projection->collision_point = phys->translated_bounds.vertices[0];
 
         for (int i = 1; i < phys->translated_bounds.n_vertices; i++) {
-            proj = vec2_dot(axis, &phys->translated_bounds.vertices[i]);
+            proj = vec2_dot_val(*axis, phys->translated_bounds.vertices[i]);
 
             if (proj < projection->min) {
                 projection->min = proj;
@@ -299,13 +563,17 @@ bool physics_detect_collision(struct phys_data *phys1, struct phys_data *phys2,
     struct vec2 *axis;
     struct phys_data *vertex_obj;
     struct projection proj1, proj2, contact_vertex;
+    struct vec2 position1, position2;
 
     collision->phys1 = phys1;
     collision->phys2 = phys2;
-    collision->penitration_depth = INFINITY;
+    collision->penitration_depth = PAL_FLOAT_MAX;
 
-    if (!aabb_collision(phys1->position.x - phys1->bounds.furthest_vertex_distance, phys1->position.y - phys1->bounds.furthest_vertex_distance, phys1->bounds.furthest_vertex_distance * 2, phys1->bounds.furthest_vertex_distance * 2,
-                        phys2->position.x - phys2->bounds.furthest_vertex_distance, phys2->position.y - phys2->bounds.furthest_vertex_distance, phys2->bounds.furthest_vertex_distance * 2, phys2->bounds.furthest_vertex_distance * 2))
+    physics_get_position(phys1, &position1);
+    physics_get_position(phys2, &position2);
+
+    if (!aabb_collision(position1.x - phys1->bounds.furthest_vertex_distance, position1.y - phys1->bounds.furthest_vertex_distance, phys1->bounds.furthest_vertex_distance * 2, phys1->bounds.furthest_vertex_distance * 2,
+                        position2.x - phys2->bounds.furthest_vertex_distance, position2.y - phys2->bounds.furthest_vertex_distance, phys2->bounds.furthest_vertex_distance * 2, phys2->bounds.furthest_vertex_distance * 2))
         return false;
 
     get_sat_axes(phys1, phys2);
@@ -324,14 +592,14 @@ bool physics_detect_collision(struct phys_data *phys1, struct phys_data *phys2,
         if ((proj1.max > proj2.max && proj1.min < proj2.min) ||
             (proj1.max < proj2.max && proj1.min > proj2.min)) {
 
-            pal_float_t mins = fabs(proj1.min - proj2.min);
-            pal_float_t maxs = fabs(proj1.max - proj2.max);
+            pal_float_t mins = pal_fabs(proj1.min - proj2.min);
+            pal_float_t maxs = pal_fabs(proj1.max - proj2.max);
 
             if (mins < maxs) {
                 overlap += mins;
             } else {
                 overlap += maxs;
-                vec2_scale(axis, -1, axis);
+                vec2_scale(axis, PAL_FROM_INT(-1), axis);
             }
         }
 
@@ -342,13 +610,13 @@ bool physics_detect_collision(struct phys_data *phys1, struct phys_data *phys2,
             if (i < num_phys1_collision_axes) {
                 vertex_obj = phys2;
                 if (proj1.max > proj2.max) {
-                    vec2_scale(axis, -1, axis);
+                    vec2_scale(axis, PAL_FROM_INT(-1), axis);
                     smallest_axis = axis;
                 }
             } else {
                 vertex_obj = phys1;
                 if (proj1.max < proj2.max) {
-                    vec2_scale(axis, -1, axis);
+                    vec2_scale(axis, PAL_FROM_INT(-1), axis);
                     smallest_axis = axis;
                 }
             }
@@ -358,7 +626,7 @@ bool physics_detect_collision(struct phys_data *phys1, struct phys_data *phys2,
     project_phys_data(smallest_axis, vertex_obj, &contact_vertex);
 
     if (vertex_obj == phys2)
-        vec2_scale(smallest_axis, -1, smallest_axis);
+        vec2_scale(smallest_axis, PAL_FROM_INT(-1), smallest_axis);
 
     collision->normal = *smallest_axis;
     collision->contact = contact_vertex.collision_point;
@@ -371,6 +639,10 @@ void physics_resolve_collision(struct collision_descriptor *collision) {
     if (!collision->should_resolve)
         return;
 
+    struct phys_data *phys1 = collision->phys1;
+    struct phys_data *phys2 = collision->phys2;
+    struct vec2 position1, position2;
+    struct vec2 velocity1, velocity2;
     struct vec2 resolution_dist1, resolution_dist2;
     struct vec2 collision_arm1, collision_arm2;
     struct vec2 closing_vel1, closing_vel2;
@@ -378,68 +650,133 @@ void physics_resolve_collision(struct collision_descriptor *collision) {
     struct vec2 impulse_vector;
     struct vec2 impulse_vec1, impulse_vec2;
 
-    pal_float_t resolution_dist_mag = collision->penitration_depth / (collision->phys1->inv_mass + collision->phys2->inv_mass);
-    pal_float_t resolution_dist1_mag = resolution_dist_mag * collision->phys1->inv_mass;
-    pal_float_t resolution_dist2_mag = -resolution_dist_mag * collision->phys2->inv_mass;
+    // pull hot data out of the body store, written back at the end
+    physics_get_position(phys1, &position1);
+    physics_get_position(phys2, &position2);
+    physics_get_velocity(phys1, &velocity1);
+    physics_get_velocity(phys2, &velocity2);
+    pal_float_t inv_mass1 = physics_get_inv_mass(phys1);
+    pal_float_t inv_mass2 = physics_get_inv_mass(phys2);
+    pal_float_t inv_moment_of_inertia1 = physics_get_inv_moment_of_inertia(phys1);
+    pal_float_t inv_moment_of_inertia2 = physics_get_inv_moment_of_inertia(phys2);
+    pal_float_t angular_velocity1 = physics_get_angular_velocity(phys1);
+    pal_float_t angular_velocity2 = physics_get_angular_velocity(phys2);
+
+    // massless bodies have an inverse mass of PAL_FLOAT_MAX and take the whole response, split
+    // evenly if both are massless. Other sums saturate instead of wrapping in fixed point
+    bool massless1 = inv_mass1 == PAL_FLOAT_MAX;
+    bool massless2 = inv_mass2 == PAL_FLOAT_MAX;
+    pal_float_t inv_mass_sum = pal_add_sat(inv_mass1, inv_mass2);
+    pal_float_t share1, share2;
+
+    if (massless1 || massless2) {
+        share1 = massless1 ? (massless2 ? PAL_FLOAT(0.5) : PAL_FROM_INT(1)) : 0;
+        share2 = PAL_FROM_INT(1) - share1;
+    } else {
+        share1 = pal_div(inv_mass1, inv_mass_sum);
+        share2 = pal_div(inv_mass2, inv_mass_sum);
+    }
+
+    pal_float_t resolution_dist1_mag = pal_mul(collision->penitration_depth, share1);
+    pal_float_t resolution_dist2_mag = -pal_mul(collision->penitration_depth, share2);
 
     vec2_scale(&collision->normal, resolution_dist1_mag, &resolution_dist1);
     vec2_scale(&collision->normal, resolution_dist2_mag, &resolution_dist2);
 
-    vec2_add(&collision->phys1->position, &resolution_dist1, &collision->phys1->position);
-    vec2_add(&collision->phys2->position, &resolution_dist2, &collision->phys2->position);
+    vec2_add(&position1, &resolution_dist1, &position1);
+    vec2_add(&position2, &resolution_dist2, &position2);
 
 
     // Closing velocity
-    vec2_sub(&collision->contact, &collision->phys1->position, &collision_arm1);
+    vec2_sub(&collision->contact, &position1, &collision_arm1);
     closing_vel1.x = -collision_arm1.y;
     closing_vel1.y = collision_arm1.x;
-    vec2_scale(&closing_vel1, collision->phys1->angular_velocity, &closing_vel1);
-    vec2_add(&collision->phys1->velocity, &closing_vel1, &closing_vel1);
+    vec2_scale(&closing_vel1, angular_velocity1, &closing_vel1);
+    vec2_add(&velocity1, &closing_vel1, &closing_vel1);
 
-    vec2_sub(&collision->contact, &collision->phys2->position, &collision_arm2);
+    vec2_sub(&collision->contact, &position2, &collision_arm2);
     closing_vel2.x = -collision_arm2.y;
     closing_vel2.y = collision_arm2.x;
-    vec2_scale(&closing_vel2, collision->phys2->angular_velocity, &closing_vel2);
-    vec2_add(&collision->phys2->velocity, &closing_vel2, &closing_vel2);
+    vec2_scale(&closing_vel2, angular_velocity2, &closing_vel2);
+    vec2_add(&velocity2, &closing_vel2, &closing_vel2);
 
     // Impulse augmentation
     pal_float_t collision_arm1_cross_normal = vec2_cross(&collision_arm1, &collision->normal);
-    pal_float_t impulse_aug1 = collision->phys1->inv_moment_of_inertia * collision_arm1_cross_normal * collision_arm1_cross_normal;
+    pal_float_t impulse_aug1 = pal_mul(pal_mul(inv_moment_of_inertia1, collision_arm1_cross_normal), collision_arm1_cross_normal);
     pal_float_t collision_arm2_cross_normal = vec2_cross(&collision_arm2, &collision->normal);
-    pal_float_t impulse_aug2 = collision->phys2->inv_moment_of_inertia * collision_arm2_cross_normal * collision_arm2_cross_normal;
+    pal_float_t impulse_aug2 = pal_mul(pal_mul(inv_moment_of_inertia2, collision_arm2_cross_normal), collision_arm2_cross_normal);
 
     vec2_sub(&closing_vel1, &closing_vel2, &relative_velocity);
 
     pal_float_t separation_velocity = vec2_dot(&relative_velocity, &collision->normal);
-    pal_float_t new_separation_velocity = -separation_velocity * pal_fmin(collision->phys1->elasticity, collision->phys2->elasticity);
+    pal_float_t new_separation_velocity = -pal_mul(separation_velocity, pal_fmin(phys1->elasticity, phys2->elasticity));
     pal_float_t separation_velocity_diff = new_separation_velocity - separation_velocity;
 
-    pal_float_t impulse = separation_velocity_diff / (collision->phys1->inv_mass + collision->phys2->inv_mass + impulse_aug1 + impulse_aug2);
+    pal_float_t impulse, velocity_change1, velocity_change2;
+
+    if (massless1 || massless2) {
+        // no impulse is left for the rest, the massless bodies take the whole velocity change
+        impulse = 0;
+        velocity_change1 = pal_mul(separation_velocity_diff, share1);
+        velocity_change2 = pal_mul(separation_velocity_diff, share2);
+    } else {
+        impulse = pal_div(separation_velocity_diff, pal_add_sat(pal_add_sat(inv_mass_sum, impulse_aug1), impulse_aug2));
+        velocity_change1 = pal_mul(impulse, inv_mass1);
+        velocity_change2 = pal_mul(impulse, inv_mass2);
+    }
 
     vec2_scale(&collision->normal, impulse, &impulse_vector);
 
     //3. Changing the velocities
-    vec2_scale(&impulse_vector, collision->phys1->inv_mass, &impulse_vec1);
-    vec2_scale(&impulse_vector, -collision->phys2->inv_mass, &impulse_vec2);
+    vec2_scale(&collision->normal, velocity_change1, &impulse_vec1);
+    vec2_scale(&collision->normal, -velocity_change2, &impulse_vec2);
 
-    vec2_add(&collision->phys1->velocity, &impulse_vec1, &collision->phys1->velocity);
-    vec2_add(&collision->phys2->velocity, &impulse_vec2, &collision->phys2->velocity);
+    vec2_add(&velocity1, &impulse_vec1, &velocity1);
+    vec2_add(&velocity2, &impulse_vec2, &velocity2);
 
-    collision->phys1->angular_velocity += collision->phys1->inv_moment_of_inertia * vec2_cross(&collision_arm1, &impulse_vector);
-    collision->phys2->angular_velocity -= collision->phys2->inv_moment_of_inertia * vec2_cross(&collision_arm2, &impulse_vector);
+    angular_velocity1 += pal_mul(inv_moment_of_inertia1, vec2_cross(&collision_arm1, &impulse_vector));
+    angular_velocity2 -= pal_mul(inv_moment_of_inertia2, vec2_cross(&collision_arm2, &impulse_vector));
+
+    physics_set_position(phys1, &position1);
+    physics_set_position(phys2, &position2);
+    physics_set_velocity(phys1, &velocity1);
+    physics_set_velocity(phys2, &velocity2);
+    physics_set_angular_velocity(phys1, angular_velocity1);
+    physics_set_angular_velocity(phys2, angular_velocity2);
 }
 
-void physics_integrate(struct phys_data *phys, pal_float_t dt) {
-    struct vec2 vel_step, acc_step;
+/**
+ * @brief Integration kernel, integrates store slots [start, end)
+ * Each field is a separate contiguous array so the compiler can vectorize the loop.
+ *
+ * @param start
+ * @param end
+ * @param dt
+ */
+static void integrate_slots(int start, int end, pal_float_t dt) {
+    struct phys_body_store *s = &body_store;
+
+    for (int i = start; i < end; i++) {
+        // position is stepped with the velocity from before this step's acceleration
+        s->position_x[i] += pal_mul(s->velocity_x[i], dt);
+        s->position_y[i] += pal_mul(s->velocity_y[i], dt);
+        s->velocity_x[i] += pal_mul(pal_mul(s->force_x[i], s->inv_mass[i]), dt);
+        s->velocity_y[i] += pal_mul(pal_mul(s->force_y[i], s->inv_mass[i]), dt);
+
+        s->angular_velocity[i] += pal_mul(pal_mul(s->torque[i], s->inv_moment_of_inertia[i]), dt);
+        s->angle[i] += pal_mul(s->angular_velocity[i], dt);
+    }
+}
 
-    vec2_scale(&phys->force, phys->inv_mass * dt, &acc_step);
-    vec2_scale(&phys->velocity, dt, &vel_step);
+void physics_integrate(struct phys_data *phys, pal_float_t dt) {
+    if (phys->body == PHYS_BODY_INVALID)
+        return;
 
-    vec2_add(&phys->velocity, &acc_step, &phys->velocity);
-    vec2_add(&phys->position, &vel_step, &phys->position);
+    integrate_slots(BODY_SLOT(phys), BODY_SLOT(phys) + 1, dt);
+}
 
-    phys->angular_velocity += phys->torque * phys->inv_moment_of_inertia * dt;
-    phys->angle += phys->angular_velocity * dt;
+void physics_integrate_all(pal_float_t dt) {
+    integrate_slots(0, body_store.num_awake, dt);
 }
 
 void physics_set_bounds_circle(struct phys_data *phys, pal_float_t radius) {
@@ -449,6 +786,7 @@ void physics_set_bounds_circle(struct phys_data *phys, pal_float_t radius) {
     // initialize things like area and inertia now that the bounds are set
     compute_area_and_inertia(phys);
     find_furthest_vertex_squared(phys);
+    update_proxy(phys);
 }
 
 void physics_set_bounds_poly(struct phys_data *phys, size_t n_vertices, struct vec2 *vertices) {
@@ -465,6 +803,7 @@ void physics_set_bounds_poly(struct phys_data *phys, size_t n_vertices, struct v
     // initialize things like area and inertia now that the bounds are set
     compute_area_and_inertia(phys);
     find_furthest_vertex_squared(phys);
+    update_proxy(phys);
 }
 
 void physics_set_bounds_rect(struct phys_data *phys, pal_float_t width, pal_float_t height) {
@@ -477,3 +816,456 @@ void physics_set_bounds_rect(struct phys_data *phys, pal_float_t width, pal_floa
 
     physics_set_bounds_poly(phys, 4, verts);
 }
+
+/**
+ * @brief Inserts phys_data into results array sorted by distance, dropping the furthest result if the array is full
+ *
+ */
+static void insert_sorted_result(struct phys_data **results, pal_float_t *distances, size_t max_results, size_t *num_results, struct phys_data *phys, pal_float_t distance) {
+    size_t i = *num_results;
+
+    if (i == max_results) {
+        if (max_results == 0 || distance >= distances[max_results - 1])
+            return;
+        i--;
+    } else {
+        (*num_results)++;
+    }
+
+    // shift further results back to make room
+    for (; i > 0 && distances[i - 1] > distance; i--) {
+        results[i] = results[i - 1];
+        distances[i] = distances[i - 1];
+    }
+
+    results[i] = phys;
+    distances[i] = distance;
+}
+
+static void insert_sorted_hit(struct raycast_hit *hits, size_t max_hits, size_t *num_hits, const struct raycast_hit *hit) {
+    size_t i = *num_hits;
+
+    if (i == max_hits) {
+        if (max_hits == 0 || hit->distance >= hits[max_hits - 1].distance)
+            return;
+        i--;
+    } else {
+        (*num_hits)++;
+    }
+
+    for (; i > 0 && hits[i - 1].distance > hit->distance; i--)
+        hits[i] = hits[i - 1];
+
+    hits[i] = *hit;
+}
+
+struct region_query {
+    const struct vec2 *point;
+    const struct aabb *region;
+    struct vec2 center;
+    struct phys_data **results;
+    pal_float_t *distances;
+    size_t max_results;
+    size_t num_results;
+};
+
+static bool phys_overlaps_aabb(struct phys_data *phys, const struct aabb *region) {
+    struct vec2 position;
+    physics_get_position(phys, &position);
+
+    if (phys->bounds.type == BOUNDS_TYPE_CIRCLE) {
+        // distance from circle center to closest point in region
+        pal_float_t dx = position.x - pal_fmax(region->min.x, pal_fmin(position.x, region->max.x));
+        pal_float_t dy = position.y - pal_fmax(region->min.y, pal_fmin(position.y, region->max.y));
+
+        return pal_mul(dx, dx) + pal_mul(dy, dy) <= pal_mul(phys->bounds.radius, phys->bounds.radius);
+    }
+
+    // SAT with region's axes
+    struct aabb poly_aabb = { phys->translated_bounds.vertices[0], phys->translated_bounds.vertices[0] };
+
+    for (int i = 1; i < phys->translated_bounds.n_vertices; i++) {
+        poly_aabb.min.x = pal_fmin(poly_aabb.min.x, phys->translated_bounds.vertices[i].x);
+        poly_aabb.min.y = pal_fmin(poly_aabb.min.y, phys->translated_bounds.vertices[i].y);
+        poly_aabb.max.x = pal_fmax(poly_aabb.max.x, phys->translated_bounds.vertices[i].x);
+        poly_aabb.max.y = pal_fmax(poly_aabb.max.y, phys->translated_bounds.vertices[i].y);
+    }
+
+    if (!aabb_overlap(&poly_aabb, region))
+        return false;
+
+    // SAT with polygon's edge normals
+    struct vec2 center = { (region->min.x + region->max.x) / 2, (region->min.y + region->max.y) / 2 };
+    struct vec2 half_extents = { (region->max.x - region->min.x) / 2, (region->max.y - region->min.y) / 2 };
+
+    for (int i = 0; i < phys->translated_bounds.n_vertices; i++) {
+        struct vec2 edge, normal;
+        vec2_sub(&phys->translated_bounds.vertices[(i + 1) % phys->translated_bounds.n_vertices], &phys->translated_bounds.vertices[i], &edge);
+        normal.x = -edge.y;
+        normal.y = edge.x;
+
+        pal_float_t poly_min = vec2_dot(&normal, &phys->translated_bounds.vertices[0]);
+        pal_float_t poly_max = poly_min;
+
+        for (int j = 1; j < phys->translated_bounds.n_vertices; j++) {
+            pal_float_t proj = vec2_dot(&normal, &phys->translated_bounds.vertices[j]);
+            poly_min = pal_fmin(poly_min, proj);
+            poly_max = pal_fmax(poly_max, proj);
+        }
+
+        pal_float_t region_center = vec2_dot(&normal, &center);
+        pal_float_t region_radius = pal_mul(half_extents.x, pal_fabs(normal.x)) + pal_mul(half_extents.y, pal_fabs(normal.y));
+
+        if (region_center + region_radius < poly_min || region_center - region_radius > poly_max)
+            return false;
+    }
+
+    return true;
+}
+
+static bool region_query_callback(void *data, void *context) {
+    struct phys_data *phys = (struct phys_data *) data;
+    struct region_query *query = (struct region_query *) context;
+    struct vec2 position, diff;
+
+    if (query->point != NULL) {
+        if (!physics_check_point_collision(phys, (struct vec2 *) query->point))
+            return true;
+    } else if (!phys_overlaps_aabb(phys, query->region)) {
+        return true;
+    }
+
+    physics_get_position(phys, &position);
+    vec2_sub(&position, &query->center, &diff);
+    insert_sorted_result(query->results, query->distances, query->max_results, &query->num_results, phys, vec2_squared_mag(&diff));
+
+    return true;
+}
+
+size_t physics_query_point(const struct vec2 *point, struct phys_data **results, size_t max_results) {
+    pal_float_t distances[max_results > 0 ? max_results : 1];
+    struct aabb region = { *point, *point };
+    struct region_query query = {
+        .point = point,
+        .region = &region,
+        .center = *point,
+        .results = results,
+        .distances = distances,
+        .max_results = max_results,
+        .num_results = 0,
+    };
+
+    aabb_tree_query(&scene_tree, &region, &region_query_callback, &query);
+
+    return query.num_results;
+}
+
+size_t physics_query_aabb(const struct aabb *region, struct phys_data **results, size_t max_results) {
+    pal_float_t distances[max_results > 0 ? max_results : 1];
+    struct region_query query = {
+        .point = NULL,
+        .region = region,
+        .center = { (region->min.x + region->max.x) / 2, (region->min.y + region->max.y) / 2 },
+        .results = results,
+        .distances = distances,
+        .max_results = max_results,
+        .num_results = 0,
+    };
+
+    aabb_tree_query(&scene_tree, region, &region_query_callback, &query);
+
+    return query.num_results;
+}
+
+struct cast_query {
+    struct vec2 origin;
+    struct vec2 direction;
+    pal_float_t max_distance;
+    pal_float_t radius;
+    struct raycast_hit *hits;
+    size_t max_hits;
+    size_t num_hits;
+};
+
+/**
+ * @brief Intersects ray with circle
+ *
+ * @return pal_float_t distance along ray, negative if missed. Zero if origin is inside circle
+ */
+static pal_float_t ray_circle_distance(const struct vec2 *origin, const struct vec2 *direction, const struct vec2 *center, pal_float_t radius) {
+    struct vec2 m;
+    vec2_sub(origin, center, &m);
+
+    pal_float_t b = vec2_dot(&m, direction);
+    pal_float_t c = vec2_squared_mag(&m) - pal_mul(radius, radius);
+
+    if (c <= 0)
+        return 0;
+
+    // origin outside circle and pointing away
+    if (b > 0)
+        return -1;
+
+    pal_float_t discriminant = pal_mul(b, b) - c;
+
+    if (discriminant < 0)
+        return -1;
+
+    return -b - pal_sqrt(discriminant);
+}
+
+/**
+ * @brief Gets outward normal of polygon edge starting at vertex i (not normalized)
+ *
+ */
+static void poly_edge_normal(const struct bounds *poly, int i, int winding, struct vec2 *normal) {
+    struct vec2 edge;
+    vec2_sub(&poly->vertices[(i + 1) % poly->n_vertices], &poly->vertices[i], &edge);
+
+    // right hand normal points out of counter clockwise polygons
+    normal->x = edge.y * winding;
+    normal->y = -edge.x * winding;
+}
+
+static int poly_winding(const struct bounds *poly) {
+    struct vec2 edge1, edge2;
+
+    // polygon is convex, so the turn between the first two edges gives the winding. Compare the
+    // cross product terms instead of subtracting them so large polygons can't overflow fixed point
+    vec2_sub(&poly->vertices[1], &poly->vertices[0], &edge1);
+    vec2_sub(&poly->vertices[2], &poly->vertices[1], &edge2);
+
+    return pal_mul(edge1.x, edge2.y) >= pal_mul(edge1.y, edge2.x) ? 1 : -1;
+}
+
+/**
+ * @brief Intersects ray with convex polygon (Cyrus-Beck clipping)
+ *
+ * @return pal_float_t distance along ray, negative if missed. Zero if origin is inside polygon
+ */
+static pal_float_t ray_poly_distance(const struct vec2 *origin, const struct vec2 *direction, pal_float_t max_distance, const struct bounds *poly, struct vec2 *normal) {
+    pal_float_t lower = 0;
+    pal_float_t upper = max_distance;
+    int winding = poly_winding(poly);
+    struct vec2 edge_normal, to_vertex;
+    int entering_edge = -1;
+
+    for (int i = 0; i < poly->n_vertices; i++) {
+        poly_edge_normal(poly, i, winding, &edge_normal);
+        vec2_sub(&poly->vertices[i], origin, &to_vertex);
+
+        pal_float_t numerator = vec2_dot(&edge_normal, &to_vertex);
+        pal_float_t denominator = vec2_dot(&edge_normal, direction);
+
+        if (denominator == 0) {
+            // parallel to edge and outside of it
+            if (numerator < 0)
+                return -1;
+            continue;
+        }
+
+        pal_float_t t = pal_div(numerator, denominator);
+
+        if (denominator < 0 && t > lower) {
+            lower = t;
+            entering_edge = i;
+        } else if (denominator > 0 && t < upper) {
+            upper = t;
+        }
+
+        if (upper < lower)
+            return -1;
+    }
+
+    if (entering_edge >= 0) {
+        poly_edge_normal(poly, entering_edge, winding, normal);
+        vec2_normalize(normal, normal);
+    } else {
+        vec2_scale(direction, PAL_FROM_INT(-1), normal);
+    }
+
+    return lower;
+}
+
+static bool raycast_callback(void *data, void *context) {
+    struct phys_data *phys = (struct phys_data *) data;
+    struct cast_query *query = (struct cast_query *) context;
+    struct raycast_hit hit = { .phys = phys };
+    struct vec2 position, step;
+
+    physics_get_position(phys, &position);
+
+    if (phys->bounds.type == BOUNDS_TYPE_CIRCLE) {
+        hit.distance = ray_circle_distance(&query->origin, &query->direction, &position, phys->bounds.radius);
+    } else {
+        hit.distance = ray_poly_distance(&query->origin, &query->direction, query->max_distance, &phys->translated_bounds, &hit.normal);
+    }
+
+    if (hit.distance < 0 || hit.distance > query->max_distance)
+        return true;
+
+    vec2_scale(&query->direction, hit.distance, &step);
+    vec2_add(&query->origin, &step, &hit.point);
+
+    if (phys->bounds.type == BOUNDS_TYPE_CIRCLE) {
+        if (hit.distance > 0) {
+            vec2_sub(&hit.point, &position, &hit.normal);
+            vec2_normalize(&hit.normal, &hit.normal);
+        } else {
+            vec2_scale(&query->direction, PAL_FROM_INT(-1), &hit.normal);
+        }
+    }
+
+    insert_sorted_hit(query->hits, query->max_hits, &query->num_hits, &hit);
+
+    return true;
+}
+
+size_t physics_raycast(const struct vec2 *origin, const struct vec2 *direction, pal_float_t max_distance, struct raycast_hit *hits, size_t max_hits) {
+    struct cast_query query = {
+        .origin = *origin,
+        .max_distance = max_distance,
+        .radius = 0,
+        .hits = hits,
+        .max_hits = max_hits,
+        .num_hits = 0,
+    };
+
+    if (vec2_squared_mag(direction) == 0)
+        return 0;
+
+    vec2_normalize(direction, &query.direction);
+    aabb_tree_raycast(&scene_tree, &query.origin, &query.direction, max_distance, 0, &raycast_callback, &query);
+
+    return query.num_hits;
+}
+
+static pal_float_t point_segment_distance_squared(const struct vec2 *point, const struct vec2 *a, const struct vec2 *b) {
+    struct vec2 ab, ap, closest;
+    vec2_sub(b, a, &ab);
+    vec2_sub(point, a, &ap);
+
+    pal_float_t t = pal_fmax(0, pal_fmin(PAL_FROM_INT(1), pal_div(vec2_dot(&ap, &ab), vec2_squared_mag(&ab))));
+
+    vec2_scale(&ab, t, &closest);
+    vec2_add(a, &closest, &closest);
+    vec2_sub(point, &closest, &ap);
+
+    return vec2_squared_mag(&ap);
+}
+
+/**
+ * @brief Sweeps circle against convex polygon by casting its center against the polygon grown by radius
+ * (edges pushed out along their normals, vertices rounded into circles)
+ *
+ * @return pal_float_t distance along ray, negative if missed
+ */
+static pal_float_t circle_cast_poly_distance(const struct cast_query *query, const struct bounds *poly, struct vec2 *normal) {
+    int winding = poly_winding(poly);
+    pal_float_t best = -1;
+    struct vec2 edge_normal, offset, a, b, edge, to_a;
+
+    // already overlapping if center is inside polygon or within radius of an edge
+    if (ray_poly_distance(&query->origin, &query->direction, 0, poly, normal) == 0)
+        return 0;
+
+    for (int i = 0; i < poly->n_vertices; i++) {
+        if (point_segment_distance_squared(&query->origin, &poly->vertices[i], &poly->vertices[(i + 1) % poly->n_vertices]) <= pal_mul(query->radius, query->radius)) {
+            vec2_scale(&query->direction, PAL_FROM_INT(-1), normal);
+            return 0;
+        }
+    }
+
+    for (int i = 0; i < poly->n_vertices; i++) {
+        poly_edge_normal(poly, i, winding, &edge_normal);
+        vec2_normalize(&edge_normal, &edge_normal);
+
+        // only edges the circle approaches can be hit first
+        if (vec2_dot(&edge_normal, &query->direction) < 0) {
+            vec2_scale(&edge_normal, query->radius, &offset);
+            vec2_add(&poly->vertices[i], &offset, &a);
+            vec2_add(&poly->vertices[(i + 1) % poly->n_vertices], &offset, &b);
+            vec2_sub(&b, &a, &edge);
+            vec2_sub(&a, &query->origin, &to_a);
+
+            pal_float_t denominator = vec2_cross(&query->direction, &edge);
+            pal_float_t t = pal_div(vec2_cross(&to_a, &edge), denominator);
+            pal_float_t s = pal_div(vec2_cross(&to_a, &query->direction), denominator);
+
+            if (s >= 0 && s <= PAL_FROM_INT(1) && t >= 0 && (best < 0 || t < best)) {
+                best = t;
+                *normal = edge_normal;
+            }
+        }
+
+        // rounded corner
+        pal_float_t t = ray_circle_distance(&query->origin, &query->direction, &poly->vertices[i], query->radius);
+
+        if (t >= 0 && (best < 0 || t < best)) {
+            struct vec2 step, center;
+            vec2_scale(&query->direction, t, &step);
+            vec2_add(&query->origin, &step, &center);
+            vec2_sub(&center, &poly->vertices[i], normal);
+            vec2_normalize(normal, normal);
+            best = t;
+        }
+    }
+
+    return best;
+}
+
+static bool shape_cast_callback(void *data, void *context) {
+    struct phys_data *phys = (struct phys_data *) data;
+    struct cast_query *query = (struct cast_query *) context;
+    struct raycast_hit hit = { .phys = phys };
+    struct vec2 position, step, center;
+
+    physics_get_position(phys, &position);
+
+    if (phys->bounds.type == BOUNDS_TYPE_CIRCLE) {
+        hit.distance = ray_circle_distance(&query->origin, &query->direction, &position, phys->bounds.radius + query->radius);
+
+        if (hit.distance > 0) {
+            vec2_scale(&query->direction, hit.distance, &step);
+            vec2_add(&query->origin, &step, &center);
+            vec2_sub(&center, &position, &hit.normal);
+            vec2_normalize(&hit.normal, &hit.normal);
+        } else {
+            vec2_scale(&query->direction, PAL_FROM_INT(-1), &hit.normal);
+        }
+    } else {
+        hit.distance = circle_cast_poly_distance(query, &phys->translated_bounds, &hit.normal);
+    }
+
+    if (hit.distance < 0 || hit.distance > query->max_distance)
+        return true;
+
+    // contact point is on the circle's surface, against the normal
+    vec2_scale(&query->direction, hit.distance, &step);
+    vec2_add(&query->origin, &step, &center);
+    vec2_scale(&hit.normal, -query->radius, &step);
+    vec2_add(&center, &step, &hit.point);
+
+    insert_sorted_hit(query->hits, query->max_hits, &query->num_hits, &hit);
+
+    return true;
+}
+
+size_t physics_shape_cast(const struct vec2 *origin, pal_float_t radius, const struct vec2 *direction, pal_float_t max_distance, struct raycast_hit *hits, size_t max_hits) {
+    struct cast_query query = {
+        .origin = *origin,
+        .max_distance = max_distance,
+        .radius = radius,
+        .hits = hits,
+        .max_hits = max_hits,
+        .num_hits = 0,
+    };
+
+    if (vec2_squared_mag(direction) == 0)
+        return 0;
+
+    vec2_normalize(direction, &query.direction);
+    aabb_tree_raycast(&scene_tree, &query.origin, &query.direction, max_distance, radius, &shape_cast_callback, &query);
+
+    return query.num_hits;
+}
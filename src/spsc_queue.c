@@ -0,0 +1,106 @@
+#include "spsc_queue.h"
+
+#include <assert.h>
+#include <string.h>
+
+bool spsc_queue_push(struct spsc_queue *queue, const void *element) {
+    uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+
+    if (tail - head >= queue->capacity)
+        return false;
+
+    memcpy(queue->buffer + (tail & (queue->capacity - 1)) * queue->element_size, element, queue->element_size);
+
+    // publish the element, the consumer can't see the new tail before the copy
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+
+    return true;
+}
+
+bool spsc_queue_pop(struct spsc_queue *queue, void *element) {
+    uint32_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+
+    if (head == tail)
+        return false;
+
+    memcpy(element, queue->buffer + (head & (queue->capacity - 1)) * queue->element_size, queue->element_size);
+
+    // hand the slot back to the producer after the copy is done
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+
+    return true;
+}
+
+/**
+ * @brief Copies count elements between queue slots starting at index and elements, in two parts
+ * if they wrap around the end of the buffer
+ *
+ * @param queue
+ * @param index free running index of the first slot
+ * @param elements
+ * @param count
+ * @param to_queue true to copy elements into the queue, false to copy out of it
+ */
+static void copy_wrapped(struct spsc_queue *queue, uint32_t index, void *elements, uint32_t count, bool to_queue) {
+    uint32_t start = index & (queue->capacity - 1);
+    uint32_t first_count = count < queue->capacity - start ? count : queue->capacity - start;
+    uint8_t *slots = queue->buffer + start * queue->element_size;
+    uint8_t *bytes = elements;
+
+    if (to_queue) {
+        memcpy(slots, bytes, first_count * queue->element_size);
+        memcpy(queue->buffer, bytes + first_count * queue->element_size, (count - first_count) * queue->element_size);
+    } else {
+        memcpy(bytes, slots, first_count * queue->element_size);
+        memcpy(bytes + first_count * queue->element_size, queue->buffer, (count - first_count) * queue->element_size);
+    }
+}
+
+uint32_t spsc_queue_push_many(struct spsc_queue *queue, const void *elements, uint32_t count) {
+    uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    uint32_t space = queue->capacity - (tail - head);
+
+    if (count > space)
+        count = space;
+
+    copy_wrapped(queue, tail, (void *) elements, count, true);
+
+    atomic_store_explicit(&queue->tail, tail + count, memory_order_release);
+
+    return count;
+}
+
+uint32_t spsc_queue_pop_many(struct spsc_queue *queue, void *elements, uint32_t count) {
+    uint32_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+
+    if (count > tail - head)
+        count = tail - head;
+
+    copy_wrapped(queue, head, elements, count, false);
+
+    atomic_store_explicit(&queue->head, head + count, memory_order_release);
+
+    return count;
+}
+
+uint32_t spsc_queue_count(struct spsc_queue *queue) {
+    uint32_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+
+    return tail - head;
+}
+
+void spsc_queue_init(struct spsc_queue *queue, void *buffer, uint32_t element_size, uint32_t capacity) {
+    assert(buffer != NULL);
+    assert(capacity > 0 && (capacity & (capacity - 1)) == 0);
+
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    queue->capacity = capacity;
+    queue->element_size = element_size;
+    queue->buffer = buffer;
+}
@@ -14,8 +14,8 @@
 
 element_t *first_element = NULL;
 static struct vec2 drag_elem_relative_pos = {
-    .x = -1,
-    .y = -1,
+    .x = PAL_FROM_INT(-1),
+    .y = PAL_FROM_INT(-1),
 };
 
 static bool inline element_is_valid(element_t *elem) {
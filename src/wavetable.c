@@ -0,0 +1,226 @@
+#include "wavetable.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "audio.h"
+#include "mathutils.h"
+#include "pal.h"
+
+// fractional bits of oscillator time below the table index, used for interpolation
+#define WAVETABLE_FRAC_BITS (OSC_PERIOD_BITS - WAVETABLE_SIZE_BITS)
+#define WAVETABLE_FRAC_MASK ((1 << WAVETABLE_FRAC_BITS) - 1)
+#define WAVETABLE_MAX_HARMONIC (WAVETABLE_SIZE / 2)
+// scale of the builtin harmonic amplitudes, the tables are normalized after synthesis
+#define HARMONIC_SCALE (1 << 16)
+
+static int16_t table_pool[WAVETABLE_POOL_LEVELS][WAVETABLE_SIZE];
+static int table_pool_used = 0;
+
+static struct wavetable builtin_tables[WAVETABLE_NUM_BUILTIN];
+
+// harmonic amplitudes of the table being generated, index is the harmonic number
+static int32_t cos_coefs[WAVETABLE_MAX_HARMONIC + 1];
+static int32_t sin_coefs[WAVETABLE_MAX_HARMONIC + 1];
+
+static inline int32_t level_max_harmonic(int level) {
+    return WAVETABLE_SIZE >> (level + 1);
+}
+
+static const int16_t *sine_table() {
+    const struct wavetable *sine = wavetable_get_builtin(WAVETABLE_SINE);
+    return sine == NULL ? NULL : sine->levels[0];
+}
+
+/**
+ * @brief Sums the cos_coefs/sin_coefs harmonics up to max_harmonic for one table sample
+ *
+ * @param sine
+ * @param i sample index
+ * @param max_harmonic
+ * @return int64_t
+ */
+static int64_t synthesize_sample(const int16_t *sine, int i, int max_harmonic) {
+    int64_t sample = 0;
+
+    for (int h = 1; h <= max_harmonic; h++) {
+        uint32_t phase = (uint32_t) h * i;
+        sample += (int64_t) sin_coefs[h] * sine[phase & WAVETABLE_SIZE_MASK];
+        sample += (int64_t) cos_coefs[h] * sine[(phase + WAVETABLE_SIZE / 4) & WAVETABLE_SIZE_MASK];
+    }
+
+    return sample;
+}
+
+/**
+ * @brief Builds mip mapped table from the harmonics in cos_coefs/sin_coefs
+ *
+ * @param table
+ * @param num_harmonics highest nonzero harmonic
+ * @return true if table was built
+ * @return false if the table pool is full
+ */
+static bool build_table(struct wavetable *table, int num_harmonics) {
+    const int16_t *sine = sine_table();
+    int first_level = 0;
+    int64_t peak = 0;
+
+    if (sine == NULL)
+        return false;
+
+    // levels that can hold every harmonic are identical, only store the highest of them
+    while (first_level < WAVETABLE_NUM_LEVELS - 1 && level_max_harmonic(first_level + 1) >= num_harmonics)
+        first_level++;
+
+    int num_levels = WAVETABLE_NUM_LEVELS - first_level;
+
+    if (table_pool_used + num_levels > WAVETABLE_POOL_LEVELS)
+        return false;
+
+    int16_t (*levels)[WAVETABLE_SIZE] = &table_pool[table_pool_used];
+    table_pool_used += num_levels;
+
+    // one scale for every level so loudness doesn't jump between octaves
+    for (int level = 0; level < num_levels; level++) {
+        for (int i = 0; i < WAVETABLE_SIZE; i++) {
+            int64_t sample = synthesize_sample(sine, i, level_max_harmonic(level + first_level));
+            if (sample > peak)
+                peak = sample;
+            if (-sample > peak)
+                peak = -sample;
+        }
+    }
+
+    for (int level = 0; level < num_levels; level++) {
+        for (int i = 0; i < WAVETABLE_SIZE; i++) {
+            int64_t sample = synthesize_sample(sine, i, level_max_harmonic(level + first_level));
+            levels[level][i] = peak == 0 ? 0 : sample * OSC_AMPLITUDE / peak;
+        }
+    }
+
+    table->levels = (const int16_t (*)[WAVETABLE_SIZE]) levels;
+    table->first_level = first_level;
+    table->num_levels = num_levels;
+
+    return true;
+}
+
+static bool build_sine_table(struct wavetable *table) {
+    if (table_pool_used >= WAVETABLE_POOL_LEVELS)
+        return false;
+
+    int16_t *sine = table_pool[table_pool_used++];
+
+    for (int i = 0; i < WAVETABLE_SIZE; i++) {
+        pal_float_t angle = pal_mul(PAL_PI, pal_div(PAL_FROM_INT(2 * i), PAL_FROM_INT(WAVETABLE_SIZE)));
+        sine[i] = PAL_TO_INT(pal_round(pal_mul(pal_sin(angle), PAL_FROM_INT(OSC_AMPLITUDE))));
+    }
+
+    table->levels = (const int16_t (*)[WAVETABLE_SIZE]) sine;
+    table->first_level = WAVETABLE_NUM_LEVELS - 1;
+    table->num_levels = 1;
+
+    return true;
+}
+
+const struct wavetable *wavetable_get_builtin(enum wavetable_type type) {
+    struct wavetable *table = &builtin_tables[type];
+    bool built;
+
+    if (table->num_levels > 0)
+        return table;
+
+    // every other table is synthesized from the sine table, build it before filling the coefficients
+    if (type != WAVETABLE_SINE && sine_table() == NULL)
+        return NULL;
+
+    for (int h = 0; h <= WAVETABLE_MAX_HARMONIC; h++) {
+        cos_coefs[h] = 0;
+        sin_coefs[h] = 0;
+    }
+
+    switch (type) {
+        case WAVETABLE_SINE:
+            built = build_sine_table(table);
+            break;
+        case WAVETABLE_SQUARE:
+            for (int h = 1; h < WAVETABLE_MAX_HARMONIC; h += 2)
+                sin_coefs[h] = HARMONIC_SCALE / h;
+            built = build_table(table, WAVETABLE_MAX_HARMONIC);
+            break;
+        case WAVETABLE_SAW:
+            // rising ramp
+            for (int h = 1; h < WAVETABLE_MAX_HARMONIC; h++)
+                sin_coefs[h] = -HARMONIC_SCALE / h;
+            built = build_table(table, WAVETABLE_MAX_HARMONIC);
+            break;
+        case WAVETABLE_TRIANGLE:
+            for (int h = 1; h < WAVETABLE_MAX_HARMONIC; h += 2)
+                sin_coefs[h] = ((h / 2) % 2 == 0 ? HARMONIC_SCALE : -HARMONIC_SCALE) / (h * h);
+            built = build_table(table, WAVETABLE_MAX_HARMONIC);
+            break;
+        default:
+            built = false;
+            break;
+    }
+
+    return built ? table : NULL;
+}
+
+bool wavetable_init_from_samples(struct wavetable *table, const int16_t *samples) {
+    const int16_t *sine = sine_table();
+    int32_t max_coef = 0;
+    int num_harmonics = 1;
+
+    if (sine == NULL)
+        return false;
+
+    // DFT, the DC offset and nyquist harmonic are dropped
+    for (int h = 1; h < WAVETABLE_MAX_HARMONIC; h++) {
+        int64_t re = 0, im = 0;
+
+        for (int i = 0; i < WAVETABLE_SIZE; i++) {
+            uint32_t phase = (uint32_t) h * i;
+            im += (int64_t) samples[i] * sine[phase & WAVETABLE_SIZE_MASK];
+            re += (int64_t) samples[i] * sine[(phase + WAVETABLE_SIZE / 4) & WAVETABLE_SIZE_MASK];
+        }
+
+        cos_coefs[h] = re >> WAVETABLE_SIZE_BITS;
+        sin_coefs[h] = im >> WAVETABLE_SIZE_BITS;
+        max_coef = pal_max(max_coef, pal_max(pal_abs(cos_coefs[h]), pal_abs(sin_coefs[h])));
+    }
+
+    cos_coefs[0] = sin_coefs[0] = 0;
+    cos_coefs[WAVETABLE_MAX_HARMONIC] = sin_coefs[WAVETABLE_MAX_HARMONIC] = 0;
+
+    // harmonics more than 72dB below the strongest one are rounding noise, ignoring them lets
+    // simple waveforms share levels
+    for (int h = 1; h < WAVETABLE_MAX_HARMONIC; h++) {
+        if (pal_abs(cos_coefs[h]) > max_coef >> 12 || pal_abs(sin_coefs[h]) > max_coef >> 12)
+            num_harmonics = h;
+    }
+
+    return build_table(table, num_harmonics);
+}
+
+void wavetable_render(const struct wavetable *table, int32_t *samples, uint32_t t, uint32_t t_increment, int num_samples) {
+    // level n is alias free up to t_increment = 2^(WAVETABLE_FRAC_BITS + n)
+    int level = t_increment > 1 ? 32 - __builtin_clz(t_increment - 1) - WAVETABLE_FRAC_BITS : 0;
+
+    level = level < table->first_level ? 0 : level - table->first_level;
+    if (level >= table->num_levels)
+        level = table->num_levels - 1;
+
+    const int16_t *data = table->levels[level];
+
+    for (int i = 0; i < num_samples; i++) {
+        uint32_t index = t >> WAVETABLE_FRAC_BITS;
+        int32_t frac = t & WAVETABLE_FRAC_MASK;
+        int32_t left = data[index];
+        int32_t right = data[(index + 1) & WAVETABLE_SIZE_MASK];
+
+        samples[i] = left + (((right - left) * frac) >> WAVETABLE_FRAC_BITS);
+        t = (t + t_increment) & OSC_PERIOD_MASK;
+    }
+}
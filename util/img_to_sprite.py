@@ -157,7 +157,7 @@ def generate_sprite_frame_def(im: Image.Image, name: str, frame: int):
 
     return f"""static struct sprite_frame {get_sprite_frame_symbol(name, frame)} = {{
     .image = &{get_image_symbol(name, frame)},
-    .duration = {im.info.get('duration', 0) / 1000}
+    .duration = PAL_FLOAT({im.info.get('duration', 0) / 1000})
 }};
 """
 
@@ -3,13 +3,36 @@
 
 Script to convert midi files to .c and .h source and header files
 
+The tracks are merged into one time sorted event stream (struct midi_stream) with the times
+converted through the tempo map to output samples, so the player doesn't parse anything at runtime.
+The song position of every beat and the loop markers are stored with it for seeking and looping.
+
 """
-import os
+import math
 import re
+import struct
+from fractions import Fraction
 from pathlib import Path
 
 import click
 
+MIDI_DEFAULT_TEMPO_US_PER_QUARTER_NOTE = 500000
+MIDI_STREAM_STATUS_WAIT = 0
+MAX_DELTA_SAMPLES = 0xFFFF
+
+STATUS_NOTE_OFF = 0x8
+STATUS_NOTE_ON = 0x9
+STATUS_CONTROL_CHANGE = 0xB
+STATUS_PROGRAM_CHANGE = 0xC
+META_MARKER = 0x06
+META_SET_TEMPO = 0x51
+META_END_OF_TRACK = 0x2F
+
+# data bytes after the status byte of each channel message type
+CHANNEL_MESSAGE_LENGTHS = { 0x8: 2, 0x9: 2, 0xA: 2, 0xB: 2, 0xC: 1, 0xD: 1, 0xE: 2 }
+
+SMPTE_FRAMES_PER_SECOND = { -24: Fraction(24), -25: Fraction(25), -29: Fraction(2997, 100), -30: Fraction(30) }
+
 
 def get_c_symbol(symbol: str):
     """Converts input symbol to a valid c symbol
@@ -23,11 +46,219 @@ def get_c_symbol(symbol: str):
     return re.sub(r'\W+', '_', symbol)
 
 
-def midi_file_to_c(midi_path: str, output_src_directory: str, output_inc_directory: str, include_path: str = ''):
-    """Creates .c and .h files containing midi file data
+def read_variable_length_quantity(data: bytes, offset: int):
+    """Decodes midi variable length quantity
+
+    Args:
+        data: Track data
+        offset: Offset of the quantity in data
+
+    Returns:
+        Tuple of the value and the offset after it
+    """
+    value = 0
+
+    while True:
+        byte = data[offset]
+        offset += 1
+        value = (value << 7) | (byte & 0x7F)
+
+        if not byte & 0x80:
+            return value, offset
+
+
+def read_track_events(data: bytes):
+    """Reads the events of one track
+
+    Args:
+        data: Track chunk data
+
+    Returns:
+        List of (tick, kind, payload) tuples, kind is 'channel' with the status and data bytes as
+        payload, 'tempo' with the tempo in us per quarter note as payload, 'marker' with the marker
+        text as payload, 'end' for the end of the track or 'other' for the remaining meta and sysex
+        events
+    """
+    events = []
+    offset = 0
+    tick = 0
+    running_status = None
+
+    while offset < len(data):
+        delta, offset = read_variable_length_quantity(data, offset)
+        tick += delta
+
+        status = data[offset]
+
+        if status == 0xFF:
+            meta_type = data[offset + 1]
+            length, offset = read_variable_length_quantity(data, offset + 2)
+            payload = data[offset:offset + length]
+            offset += length
+
+            if meta_type == META_SET_TEMPO:
+                events.append((tick, 'tempo', payload[0] << 16 | payload[1] << 8 | payload[2]))
+            elif meta_type == META_MARKER:
+                events.append((tick, 'marker', bytes(payload)))
+            elif meta_type == META_END_OF_TRACK:
+                events.append((tick, 'end', None))
+                break
+            else:
+                events.append((tick, 'other', None))
+        elif status in (0xF0, 0xF7):
+            length, offset = read_variable_length_quantity(data, offset + 1)
+            offset += length
+            events.append((tick, 'other', None))
+        else:
+            if status & 0x80:
+                running_status = status
+                offset += 1
+            elif running_status is None:
+                raise click.ClickException("Midi data byte without a status!")
+
+            length = CHANNEL_MESSAGE_LENGTHS[running_status >> 4]
+            message = bytes([ running_status ]) + data[offset:offset + length] + bytes(2 - length)
+            offset += length
+
+            events.append((tick, 'channel', message))
+
+    return events
+
+
+def midi_to_stream(midi_data: bytes, sample_rate: int):
+    """Merges the tracks of a midi file into a list of stream events
+
+    Args:
+        midi_data: Midi file contents
+        sample_rate: Output sample rate of the engine
+
+    Raises:
+        click.ClickException: If the data isn't a valid midi file
+
+    Returns:
+        Tuple of the list of (delta_samples, status, data1, data2) stream events, the list of beat
+        song positions, the song length and the loop start and end song positions, None for a
+        missing loop end
+    """
+    if midi_data[0:4] != b'MThd' or struct.unpack('>I', midi_data[4:8])[0] != 6:
+        raise click.ClickException("Invalid midi header!")
+
+    _, num_tracks, division = struct.unpack('>HHH', midi_data[8:14])
+
+    offset = 14
+    events = []
+
+    for track_num in range(num_tracks):
+        chunk_type = midi_data[offset:offset + 4]
+        length = struct.unpack('>I', midi_data[offset + 4:offset + 8])[0]
+
+        if chunk_type != b'MTrk':
+            raise click.ClickException("Invalid midi track!")
+
+        # sort key keeps events at the same tick in track order, then file order
+        for order, (tick, kind, payload) in enumerate(read_track_events(midi_data[offset + 8:offset + 8 + length])):
+            events.append((tick, track_num, order, kind, payload))
+
+        offset += 8 + length
+
+    events.sort(key=lambda event: event[:3])
+
+    # seconds per tick, changes with tempo for tick based divisions
+    if division & 0x8000:
+        frames_per_second = SMPTE_FRAMES_PER_SECOND[struct.unpack('b', bytes([ division >> 8 ]))[0]]
+        seconds_per_tick = 1 / (frames_per_second * (division & 0xFF))
+    else:
+        seconds_per_tick = Fraction(MIDI_DEFAULT_TEMPO_US_PER_QUARTER_NOTE, 1000000 * division)
+
+    tempo_tick = 0
+    tempo_seconds = Fraction(0)
+    # (tick, seconds, seconds per tick) from each tempo change on, for the beat positions
+    tempo_map = [ (tempo_tick, tempo_seconds, seconds_per_tick) ]
+    track_events = [ [] for _ in range(num_tracks) ]
+
+    for tick, track_num, _, kind, payload in events:
+        seconds = tempo_seconds + (tick - tempo_tick) * seconds_per_tick
+
+        if kind == 'tempo' and not division & 0x8000:
+            tempo_tick = tick
+            tempo_seconds = seconds
+            seconds_per_tick = Fraction(payload, 1000000 * division)
+            tempo_map.append((tempo_tick, tempo_seconds, seconds_per_tick))
+
+        # same rounding as the runtime parser, events play on the first sample at or after them
+        track_events[track_num].append((math.ceil(seconds * sample_rate), kind, payload))
+
+    # the runtime parser hands out the due events in rounds of one event per track, events landing
+    # on the same sample keep that order even if their ticks differ
+    timed_events = []
+    positions = [ 0 ] * num_tracks
+    loop_start = 0
+    loop_end = None
+
+    while True:
+        pending = [ track[position][0] for track, position in zip(track_events, positions) if position < len(track) ]
+
+        if not pending:
+            break
+
+        sample = min(pending)
+
+        for track_num, track in enumerate(track_events):
+            if positions[track_num] < len(track) and track[positions[track_num]][0] <= sample:
+                _, kind, payload = track[positions[track_num]]
+                positions[track_num] += 1
+
+                if kind == 'channel':
+                    timed_events.append((sample, payload))
+                elif kind == 'marker' and payload.lower() == b'loopstart':
+                    loop_start = sample
+                elif kind == 'marker' and payload.lower() == b'loopend':
+                    loop_end = sample
+
+    # every beat up to the last event, quarter notes or SMPTE frames
+    ticks_per_beat = division & 0xFF if division & 0x8000 else division
+    last_tick = max((event[0] for event in events), default=0)
+    beat_positions = []
+
+    for beat_tick in range(0, last_tick + 1, ticks_per_beat):
+        tick, seconds, seconds_per_tick = [ tempo for tempo in tempo_map if tempo[0] <= beat_tick ][-1]
+        beat_positions.append(math.ceil((seconds + (beat_tick - tick) * seconds_per_tick) * sample_rate))
+
+    length = max((track[-1][0] for track in track_events if track), default=0)
+
+    previous_sample = 0
+    stream = []
+
+    for sample, payload in timed_events:
+        status = payload[0]
+        status_code = status >> 4
+
+        # note on with zero velocity is a note off
+        if status_code == STATUS_NOTE_ON and payload[2] == 0:
+            status_code = STATUS_NOTE_OFF
+            status = (STATUS_NOTE_OFF << 4) | (status & 0x0F)
+
+        if status_code not in (STATUS_NOTE_ON, STATUS_NOTE_OFF, STATUS_CONTROL_CHANGE, STATUS_PROGRAM_CHANGE):
+            continue
+
+        delta = sample - previous_sample
+        previous_sample = sample
+
+        while delta > MAX_DELTA_SAMPLES:
+            stream.append((MAX_DELTA_SAMPLES, MIDI_STREAM_STATUS_WAIT, 0, 0))
+            delta -= MAX_DELTA_SAMPLES
+
+        stream.append((delta, status, payload[1], payload[2]))
+
+    return stream, beat_positions, length, loop_start, loop_end
+
+
+def midi_file_to_c(midi_path: str, sample_rate: int, output_src_directory: str, output_inc_directory: str, include_path: str = ''):
+    """Creates .c and .h files containing midi event stream and beat positions
 
     Args:
         midi_path: Path to midi file
+        sample_rate: Output sample rate of the engine
         output_src_directory: Directory to place generated midi source file
         output_inc_directory: Directory to place generated midi header file
         include_path: Include path to prepend to the included header in the source file
@@ -40,7 +271,9 @@ def midi_file_to_c(midi_path: str, output_src_directory: str, output_inc_directo
     if midi_path.suffix not in [ '.mid', '.midi' ]:
         raise click.ClickException("Input file is not a midi file!")
 
-    midi_size = os.stat(midi_path).st_size
+    with open(midi_path, 'rb') as midi_file:
+        stream, beat_positions, length, loop_start, loop_end = midi_to_stream(midi_file.read(), sample_rate)
+
     midi_symbol = get_c_symbol(midi_path.stem) + '_midi'
     source_filename = midi_path.stem + '.c'
     header_filename = midi_path.stem + '.h'
@@ -50,45 +283,48 @@ def midi_file_to_c(midi_path: str, output_src_directory: str, output_inc_directo
 
     with open(output_h_path, 'w', encoding='utf8') as out:
         out.write("#pragma once\n\n")
-        out.write("#include <stdint.h>\n\n")
-        out.write(f"extern const uint8_t {midi_symbol}_data[{midi_size}];\n\n")
+        out.write("#include \"midi_parse.h\"\n\n")
+        out.write(f"extern const struct midi_stream {midi_symbol}_stream;\n\n")
 
     with open(output_c_path, 'w', encoding='utf8') as out:
         out.write(f"#include \"{Path(include_path, header_filename)}\"\n\n")
-        out.write("#include <stdint.h>\n\n")
-        out.write(f"const uint8_t {midi_symbol}_data[{midi_size}] = {{\n")
-
-        with open(midi_path, 'rb') as midi_data:
-            count = 0
-            out.write('    ')
-
-            while True:
-                b = midi_data.read(1)
-
-                if not b:
-                    break
+        out.write("#include \"pal.h\"\n\n")
+        out.write(f"_Static_assert(PAL_AUDIO_SAMPLE_RATE == {sample_rate}, \"Midi stream was generated for another sample rate!\");\n\n")
+        out.write(f"static const struct midi_stream_event {midi_symbol}_events[{max(len(stream), 1)}] = {{\n")
 
-                out.write(f'0x{b[0]:02x},')
+        for delta, status, data1, data2 in stream:
+            out.write(f"    {{ {delta}, 0x{status:02x}, {{ {data1}, {data2} }} }},\n")
 
-                count += 1
+        out.write("};\n\n")
+        out.write(f"static const uint32_t {midi_symbol}_beat_positions[{max(len(beat_positions), 1)}] = {{\n")
 
-                if count > 30:
-                    out.write('\n    ')
-                    count = 0
+        for line_start in range(0, len(beat_positions), 8):
+            out.write("    " + " ".join(f"{position}," for position in beat_positions[line_start:line_start + 8]) + "\n")
 
-        out.write("\n};")
+        out.write("};\n\n")
+        out.write(f"const struct midi_stream {midi_symbol}_stream = {{\n")
+        out.write(f"    .events = {midi_symbol}_events,\n")
+        out.write(f"    .num_events = {len(stream)},\n")
+        out.write(f"    .beat_positions = {midi_symbol}_beat_positions,\n")
+        out.write(f"    .num_beats = {len(beat_positions)},\n")
+        out.write(f"    .length = {length},\n")
+        out.write(f"    .loop_start = {loop_start},\n")
+        out.write(f"    .loop_end = {'MIDI_POSITION_END' if loop_end is None else loop_end},\n")
+        out.write("};\n")
 
 
 @click.command()
 @click.argument("midi_file", nargs=-1, type=click.Path(exists=True, readable=True))
+@click.argument("sample_rate", type=int)
 @click.argument("output_src_directory", type=click.Path(exists=True, file_okay=False, dir_okay=True))
 @click.argument("output_inc_directory", type=click.Path(exists=True, file_okay=False, dir_okay=True))
 @click.argument("include_path", default='')
-def midi_to_c(midi_file: str, output_src_directory: str, output_inc_directory: str, include_path: str):
+def midi_to_c(midi_file: str, sample_rate: int, output_src_directory: str, output_inc_directory: str, include_path: str):
     """Click command function to convert multiple midi files to c/h
 
     Args:
         midi_file: Tuple of midi file paths
+        sample_rate: Output sample rate of the engine
         output_src_directory: Directory to place generated midi source files
         output_inc_directory: Directory to place generated midi header files
         include_path: Include path to prepend to the included header in the source file
@@ -97,7 +333,7 @@ def midi_to_c(midi_file: str, output_src_directory: str, output_inc_directory: s
         click.ClickException: If an input file isn't a midi
     """
     for midi in midi_file:
-        midi_file_to_c(midi, output_src_directory, output_inc_directory, include_path)
+        midi_file_to_c(midi, sample_rate, output_src_directory, output_inc_directory, include_path)
 
 if __name__ == '__main__':
     # (click injects the params)
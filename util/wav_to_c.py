@@ -5,19 +5,156 @@ import click
 import subprocess
 import os
 import re
+import struct
 from pathlib import Path
 from scipy.io import wavfile
 
+# must match WAVE_ADPCM_BLOCK_SAMPLES and the block layout in audio.h
+ADPCM_BLOCK_SAMPLES = 256
+
+ADPCM_STEPS = [
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66,
+    73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449,
+    494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272,
+    2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493,
+    10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+]
+
+ADPCM_INDEX_CHANGES = [ -1, -1, -1, -1, 2, 4, 6, 8 ]
+
 def get_c_symbol(symbol: str):
     return re.sub(r'[^[:alnum:]_]', '', symbol)
 
+def adpcm_decode_nibble(predictor: int, step_index: int, nibble: int):
+    """Decodes one nibble exactly like adpcm_decode_next in audio.c, returns (predictor, step_index)"""
+    step = ADPCM_STEPS[step_index]
+    difference = step >> 3
+
+    if nibble & 4:
+        difference += step
+    if nibble & 2:
+        difference += step >> 1
+    if nibble & 1:
+        difference += step >> 2
+
+    predictor += -difference if nibble & 8 else difference
+    predictor = max(-32768, min(32767, predictor))
+    step_index = max(0, min(88, step_index + ADPCM_INDEX_CHANGES[nibble & 7]))
+
+    return predictor, step_index
+
+def adpcm_encode_block(samples, predictor: int, step_index: int):
+    """Encodes ADPCM_BLOCK_SAMPLES samples from the decoder state, returns (nibbles, squared error,
+    predictor, step_index)"""
+    nibbles = []
+    error = 0
+
+    for sample in samples:
+        step = ADPCM_STEPS[step_index]
+        difference = sample - predictor
+        nibble = 0
+
+        if difference < 0:
+            nibble = 8
+            difference = -difference
+
+        if difference >= step:
+            nibble |= 4
+            difference -= step
+        if difference >= step >> 1:
+            nibble |= 2
+            difference -= step >> 1
+        if difference >= step >> 2:
+            nibble |= 1
+
+        # tracks the decoded signal so quantization errors don't add up
+        predictor, step_index = adpcm_decode_nibble(predictor, step_index, nibble)
+        nibbles.append(nibble)
+        error += (sample - predictor) ** 2
+
+    return nibbles, error, predictor, step_index
+
+def adpcm_encode(data):
+    """Encodes 16 bit samples to IMA-ADPCM blocks, the last block is padded with silence"""
+    samples = [ int(sample) for sample in data ]
+    samples += [ 0 ] * (-len(samples) % ADPCM_BLOCK_SAMPLES)
+    encoded = bytearray()
+    step_index = None
+
+    for block_start in range(0, len(samples), ADPCM_BLOCK_SAMPLES):
+        block = samples[block_start:block_start + ADPCM_BLOCK_SAMPLES]
+        # every block restarts from the real sample before it, errors don't carry over blocks
+        predictor = samples[block_start - 1] if block_start > 0 else 0
+
+        if step_index is None:
+            # the first block starts from the best step size, so the attack isn't smeared while it adapts
+            step_index = min(range(len(ADPCM_STEPS)), key=lambda index: adpcm_encode_block(block, predictor, index)[1])
+
+        encoded += struct.pack('<hBB', predictor, step_index, 0)
+        nibbles, _, _, step_index = adpcm_encode_block(block, predictor, step_index)
+
+        for i in range(0, ADPCM_BLOCK_SAMPLES, 2):
+            encoded.append(nibbles[i] | (nibbles[i + 1] << 4))
+
+    return bytes(encoded)
+
+def write_c_array(out, values):
+    count = 0
+    out.write('    ');
+
+    for value in values:
+        out.write(f'{value},')
+
+        count += 1
+
+        if count > 30:
+            out.write('\n    ')
+            count = 0
+
+    out.write("\n};\n\n")
+
+def read_sustain_loop(wav_path: Path):
+    """Returns (loop_start, loop_end, sample_rate) of the first loop in the smpl chunk, or None.
+    loop_end is exclusive."""
+    with open(wav_path, 'rb') as f:
+        riff = f.read()
+
+    if riff[0:4] != b'RIFF' or riff[8:12] != b'WAVE':
+        return None
+
+    sample_rate = None
+    loop = None
+    offset = 12
+
+    while offset + 8 <= len(riff):
+        chunk_id, chunk_size = struct.unpack_from('<4sI', riff, offset)
+        chunk = riff[offset + 8:offset + 8 + chunk_size]
+
+        if chunk_id == b'fmt ':
+            sample_rate = struct.unpack_from('<I', chunk, 4)[0]
+        elif chunk_id == b'smpl' and len(chunk) >= 36:
+            num_loops = struct.unpack_from('<I', chunk, 28)[0]
+            if num_loops > 0 and len(chunk) >= 60:
+                # cue point id, type, start, end (inclusive), fraction, play count
+                _, _, start, end, _, _ = struct.unpack_from('<6I', chunk, 36)
+                loop = (start, end + 1)
+
+        # chunks are padded to an even size
+        offset += 8 + chunk_size + (chunk_size & 1)
+
+    if loop is None or sample_rate is None:
+        return None
+
+    return loop[0], loop[1], sample_rate
+
 @click.command()
 @click.argument("wav_file", type=click.Path(exists=True, readable=True))
 @click.argument("sample_rate", type=int)
 @click.argument("output_src_directory", type=click.Path(exists=True, file_okay=False, dir_okay=True))
 @click.argument("output_inc_directory", type=click.Path(exists=True, file_okay=False, dir_okay=True))
 @click.argument("include_path", default='')
-def wav_to_c(wav_file, sample_rate, output_src_directory, output_inc_directory, include_path):
+@click.option("--adpcm", is_flag=True, help="Store the sample as 4 bit IMA-ADPCM, a quarter of the size")
+def wav_to_c(wav_file, sample_rate, output_src_directory, output_inc_directory, include_path, adpcm):
     wav_path = Path(wav_file)
 
     if wav_path.suffix != '.wav':
@@ -38,6 +175,15 @@ def wav_to_c(wav_file, sample_rate, output_src_directory, output_inc_directory,
     assert(wav_sample_rate == sample_rate)
 
     wav_size = len(data)
+
+    # loop points are in samples of the original file, scale them to the resampled data
+    loop = read_sustain_loop(wav_path)
+    if loop is not None:
+        loop_start, loop_end, loop_sample_rate = loop
+        loop_start = min(round(loop_start * sample_rate / loop_sample_rate), wav_size)
+        loop_end = min(round(loop_end * sample_rate / loop_sample_rate), wav_size)
+        if loop_end <= loop_start:
+            loop = None
     wav_symbol = get_c_symbol(wav_path.stem)
     header_filename = wav_symbol + '.h'
 
@@ -53,24 +199,25 @@ def wav_to_c(wav_file, sample_rate, output_src_directory, output_inc_directory,
     with open(output_c_path, 'w') as out:
         out.write(f"#include \"{Path(include_path, header_filename)}\"\n\n")
         out.write("#include <stdint.h>\n\n")
-        out.write(f"static const int16_t {wav_symbol}_data[{wav_size}] = {{\n")
-
-        count = 0
-        out.write('    ');
-
-        for sample in data:
-            out.write(f'{sample},')
-
-            count += 1
 
-            if count > 30:
-                out.write('\n    ')
-                count = 0
+        if adpcm:
+            encoded = adpcm_encode(data)
+            out.write(f"static const uint8_t {wav_symbol}_adpcm_data[{len(encoded)}] = {{\n")
+            write_c_array(out, encoded)
+        else:
+            out.write(f"static const int16_t {wav_symbol}_data[{wav_size}] = {{\n")
+            write_c_array(out, data)
 
-        out.write("\n};\n\n")
         out.write(f"const struct wave_data {wav_symbol} = {{\n")
-        out.write(f"    .data = {wav_symbol}_data,\n")
+        if adpcm:
+            out.write("    .format = WAVE_DATA_IMA_ADPCM,\n")
+            out.write(f"    .adpcm_data = {wav_symbol}_adpcm_data,\n")
+        else:
+            out.write(f"    .data = {wav_symbol}_data,\n")
         out.write(f"    .length = {wav_size},\n")
+        if loop is not None:
+            out.write(f"    .loop_start = {loop_start},\n")
+            out.write(f"    .loop_end = {loop_end},\n")
         out.write(f"}};\n")
 
     wav_resampled_path.unlink()